@@ -0,0 +1,112 @@
+// Measures a script loop of echo, printf, test, [ and true run as built-ins
+// against the same loop calling the external utilities by path: wall time and
+// the processes the kernel created meanwhile.
+// Usage: builtin_bench [iterations] [shell]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <spawn.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+extern char** environ;
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// Processes created since boot, by anyone: the fork count of a run is the difference
+static long processes_created() {
+    FILE* f = fopen("/proc/stat", "r");
+    char line[256];
+    long count = -1;
+    while (f && fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "processes %ld", &count) == 1) {
+            break;
+        }
+    }
+    if (f) {
+        fclose(f);
+    }
+    return count;
+}
+
+static void write_script(const char* path, const char* format, int iterations) {
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    fprintf(f, format, iterations);
+    fclose(f);
+}
+
+// Runs the script once with stdout to /dev/null; prints milliseconds and processes created
+static void run(const char* label, char* shell, char* script) {
+    char* argv[] = { shell, "--no-script-cache", script, NULL };
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+
+    long before = processes_created();
+    double start = now_ms();
+    pid_t pid;
+    int status;
+    if (posix_spawn(&pid, shell, &actions, NULL, argv, environ) != 0) {
+        perror(shell);
+        exit(EXIT_FAILURE);
+    }
+    waitpid(pid, &status, 0);
+    double elapsed = now_ms() - start;
+    long forks = processes_created() - before;
+    posix_spawn_file_actions_destroy(&actions);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "%s exited with status %d\n", script, WEXITSTATUS(status));
+        exit(EXIT_FAILURE);
+    }
+    printf("%-22s %10.1f %10ld\n", label, elapsed, forks);
+}
+
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 2000;
+    char* shell = argc > 2 ? argv[2] : "bin/myshell";
+
+    char builtins[] = "/tmp/builtin_bench_XXXXXX";
+    char externals[] = "/tmp/builtin_bench_XXXXXX";
+    int fd1 = mkstemp(builtins);
+    int fd2 = mkstemp(externals);
+    if (fd1 < 0 || fd2 < 0) {
+        perror("mkstemp");
+        return EXIT_FAILURE;
+    }
+    close(fd1);
+    close(fd2);
+    write_script(builtins,
+                 "i=0\n"
+                 "while [ $i -lt %d ]; do\n"
+                 "    echo line $i\n"
+                 "    printf '%%s=%%d\\n' i $i\n"
+                 "    test -n \"$i\" && true\n"
+                 "    i=$((i+1))\n"
+                 "done\n", iterations);
+    write_script(externals,
+                 "i=0\n"
+                 "while /usr/bin/[ $i -lt %d ]; do\n"
+                 "    /bin/echo line $i\n"
+                 "    /usr/bin/printf '%%s=%%d\\n' i $i\n"
+                 "    /usr/bin/test -n \"$i\" && /bin/true\n"
+                 "    i=$((i+1))\n"
+                 "done\n", iterations);
+
+    printf("%d iterations of 5 utility calls\n", iterations);
+    printf("%-22s %10s %10s\n", "case", "ms", "processes");
+    run("built-ins", shell, builtins);
+    run("external utilities", shell, externals);
+    unlink(builtins);
+    unlink(externals);
+    return 0;
+}
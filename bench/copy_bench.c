@@ -0,0 +1,181 @@
+// Measures the throughput of the cat built-in's copy engine against a userspace
+// read/write loop and against running /bin/cat, on a file of several GB.
+// Usage: copy_bench [size_mb] [directory]
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include "fastcopy.h"
+#include "spawner.h"
+
+#define BLOCK_SIZE (8 << 20)
+#define BUFFER_SIZE (128 * 1024) // Same buffer size as the built-in's fallback
+#define ROUNDS 3                 // Best of this many runs, to hide writeback of the previous run
+
+enum Method { METHOD_KERNEL, METHOD_USERSPACE, METHOD_EXTERNAL };
+enum Target { TARGET_TRUNCATE, TARGET_APPEND, TARGET_PIPE };
+
+static char src_path[4096];
+static char dst_path[4096];
+
+static double now_s() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void create_source(size_t size_mb) {
+    int fd = open(src_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(src_path);
+        exit(EXIT_FAILURE);
+    }
+    char* block = malloc(BLOCK_SIZE);
+    for (size_t i = 0; i < BLOCK_SIZE; i++) {
+        block[i] = 'a' + i % 26;
+    }
+    for (size_t written = 0; written < (size_mb << 20); written += BLOCK_SIZE) {
+        if (write(fd, block, BLOCK_SIZE) != BLOCK_SIZE) {
+            perror("write");
+            exit(EXIT_FAILURE);
+        }
+    }
+    free(block);
+    fsync(fd);
+    close(fd);
+}
+
+static void copy_userspace(int in_fd, int out_fd) {
+    static char buffer[BUFFER_SIZE];
+    ssize_t n;
+    while ((n = read(in_fd, buffer, sizeof(buffer))) > 0) {
+        for (ssize_t done = 0; done < n; ) {
+            ssize_t written = write(out_fd, buffer + done, n - done);
+            if (written < 0) {
+                perror("write");
+                exit(EXIT_FAILURE);
+            }
+            done += written;
+        }
+    }
+}
+
+// Reads a pipe to the end, like the consumer of `cat file | cmd`
+static pid_t start_drain(int read_fd, int write_fd) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        static char buffer[BUFFER_SIZE];
+        close(write_fd);
+        while (read(read_fd, buffer, sizeof(buffer)) > 0) {
+        }
+        _exit(EXIT_SUCCESS);
+    }
+    close(read_fd);
+    return pid;
+}
+
+static double run_once(enum Method method, enum Target target) {
+    if (target != TARGET_APPEND) {
+        unlink(dst_path);
+    }
+
+    int pipefd[2] = { -1, -1 };
+    pid_t drain = -1;
+    int out_fd;
+    if (target == TARGET_PIPE) {
+        if (pipe(pipefd) < 0) {
+            perror("pipe");
+            exit(EXIT_FAILURE);
+        }
+        drain = start_drain(pipefd[0], pipefd[1]);
+        out_fd = pipefd[1];
+    } else {
+        int flags = O_WRONLY | O_CREAT | (target == TARGET_APPEND ? O_APPEND : O_TRUNC);
+        out_fd = open(dst_path, flags, 0644);
+        if (out_fd < 0) {
+            perror(dst_path);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    double start = now_s();
+    if (method == METHOD_EXTERNAL) {
+        char* argv[] = { "/bin/cat", src_path, NULL };
+        SpawnRequest req = {
+            .argv = argv,
+            .stdin_fd = -1,
+            .stdout_fd = out_fd,
+            .tty_fd = -1,
+        };
+        pid_t pid = spawn_command(&req);
+        if (pid < 0) {
+            exit(EXIT_FAILURE);
+        }
+        waitpid(pid, NULL, 0);
+    } else {
+        int in_fd = open(src_path, O_RDONLY);
+        if (in_fd < 0) {
+            perror(src_path);
+            exit(EXIT_FAILURE);
+        }
+        if (method == METHOD_KERNEL) {
+            if (copy_fd_data(in_fd, out_fd) < 0) {
+                perror("copy_fd_data");
+                exit(EXIT_FAILURE);
+            }
+        } else {
+            copy_userspace(in_fd, out_fd);
+        }
+        close(in_fd);
+    }
+    close(out_fd);
+    if (drain > 0) {
+        waitpid(drain, NULL, 0);
+    }
+    return now_s() - start;
+}
+
+static double run(enum Method method, enum Target target) {
+    double best = 0;
+    for (int i = 0; i < ROUNDS; i++) {
+        // The append target grows by one copy per run; each run appends to a fresh file
+        if (target == TARGET_APPEND) {
+            unlink(dst_path);
+        }
+        double elapsed = run_once(method, target);
+        if (i == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    size_t size_mb = argc > 1 ? strtoul(argv[1], NULL, 10) : 2048;
+    const char* dir = argc > 2 ? argv[2] : "/tmp";
+    snprintf(src_path, sizeof(src_path), "%s/copy_bench.src", dir);
+    snprintf(dst_path, sizeof(dst_path), "%s/copy_bench.dst", dir);
+
+    printf("creating %zu MB source in %s\n", size_mb, dir);
+    fflush(stdout);
+    create_source(size_mb);
+
+    const char* target_names[] = { "> file", ">> file", "| pipe" };
+    printf("%-8s %16s %16s %16s\n", "target", "builtin_MB/s", "read_write_MB/s", "bin_cat_MB/s");
+    for (int target = TARGET_TRUNCATE; target <= TARGET_PIPE; target++) {
+        double kernel = run(METHOD_KERNEL, target);
+        double userspace = run(METHOD_USERSPACE, target);
+        double external = run(METHOD_EXTERNAL, target);
+        printf("%-8s %16.0f %16.0f %16.0f\n", target_names[target],
+               size_mb / kernel, size_mb / userspace, size_mb / external);
+        fflush(stdout);
+    }
+
+    unlink(src_path);
+    unlink(dst_path);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,90 @@
+// Compares the in-process expander behind expand_variables() with the
+// wordexp() path it replaced, on a few typical command lines.
+// Usage: expand_bench [iterations]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <wordexp.h>
+#include "expansion.h"
+
+#define MAX_WORDS 16
+
+static double now_s() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// The old expansion: join the words, run wordexp() and copy the result out
+static char** wordexp_expand(char** words) {
+    size_t len = 1;
+    for (int i = 0; words[i] != NULL; i++) {
+        len += strlen(words[i]) + 1;
+    }
+    char* line = malloc(len);
+    line[0] = '\0';
+    for (int i = 0; words[i] != NULL; i++) {
+        if (i > 0) strcat(line, " ");
+        strcat(line, words[i]);
+    }
+
+    wordexp_t p;
+    char** argv = NULL;
+    if (wordexp(line, &p, 0) == 0) {
+        size_t size = (p.we_wordc + 1) * sizeof(char*);
+        for (size_t i = 0; i < p.we_wordc; i++) {
+            size += strlen(p.we_wordv[i]) + 1;
+        }
+        argv = malloc(size);
+        char* data = (char*)(argv + p.we_wordc + 1);
+        for (size_t i = 0; i < p.we_wordc; i++) {
+            argv[i] = data;
+            data = stpcpy(data, p.we_wordv[i]) + 1;
+        }
+        argv[p.we_wordc] = NULL;
+        wordfree(&p);
+    }
+    free(line);
+    return argv;
+}
+
+typedef struct {
+    const char* name;
+    const char* words[MAX_WORDS];
+} Case;
+
+static const Case cases[] = {
+    { "plain", { "ls", "-l", "--color=auto", "/usr/lib", "/tmp", NULL } },
+    { "quoted", { "echo", "'single quoted'", "\"double $HOME\"", "a\\ b", NULL } },
+    { "variables", { "echo", "$HOME", "${USER:-nobody}", "${UNSET_VAR:-default}", "$PATH", NULL } },
+    { "tilde", { "ls", "~", "~/.config", "~root", NULL } },
+    { "glob", { "ls", "src/*.c", "include/*.h", NULL } },
+};
+
+static double run(char** (*expand)(char**), char** words, long iterations) {
+    double start = now_s();
+    for (long i = 0; i < iterations; i++) {
+        free(expand(words));
+    }
+    return now_s() - start;
+}
+
+int main(int argc, char** argv) {
+    long iterations = argc > 1 ? strtol(argv[1], NULL, 10) : 2000;
+    const int num_cases = sizeof(cases) / sizeof(cases[0]);
+
+    setenv("USER", "bench", 0);
+    printf("%-10s %14s %14s %9s   (%ld expansions each)\n",
+           "case", "native (us)", "wordexp (us)", "speedup", iterations);
+
+    for (int c = 0; c < num_cases; c++) {
+        char** words = (char**)cases[c].words;
+        double native = run(expand_variables, words, iterations);
+        double reference = run(wordexp_expand, words, iterations);
+        printf("%-10s %14.2f %14.2f %8.1fx\n", cases[c].name,
+               native * 1e6 / iterations, reference * 1e6 / iterations, reference / native);
+        fflush(stdout);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,167 @@
+// Measures path_glob() against glob(3) on a large directory, where a command
+// line expands several patterns over the same listing, and times ** over a
+// deep tree with one and several threads. Also times the words of a `[`
+// command, whose '[' closes nothing, in the large directory.
+// Usage: glob_bench [files] [directory]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <glob.h>
+#include <sys/stat.h>
+#include "pathglob.h"
+
+#define ROUNDS 5        // Best of this many runs
+#define TREE_DIRS 2000  // Directories in the ** tree, 40 per level
+#define TREE_FILES 10   // Files in each of them
+
+static const char* patterns[] = { "logs/*.gz", "logs/*.json", "logs/*.txt" };
+#define PATTERN_COUNT (sizeof(patterns) / sizeof(patterns[0]))
+
+// `[ $i -lt 10 ]` and similar: an unclosed '[' is literal and must not list the directory
+static const char* bracket_words[] = { "[", "a[", "x[1", "]" };
+#define BRACKET_WORD_COUNT (sizeof(bracket_words) / sizeof(bracket_words[0]))
+
+static double now_s() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void touch(const char* path) {
+    int fd = open(path, O_WRONLY | O_CREAT, 0644);
+    if (fd < 0) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+}
+
+static void create_tree(int files) {
+    const char* suffixes[] = { "gz", "json", "txt", "log" };
+    char path[256];
+
+    mkdir("logs", 0755);
+    for (int i = 0; i < files; i++) {
+        snprintf(path, sizeof(path), "logs/app-%06d.%s", i, suffixes[i % 4]);
+        touch(path);
+    }
+
+    mkdir("tree", 0755);
+    for (int d = 0; d < TREE_DIRS; d++) {
+        snprintf(path, sizeof(path), "tree/d%02d", d / 40);
+        mkdir(path, 0755);
+        snprintf(path, sizeof(path), "tree/d%02d/d%02d", d / 40, d % 40);
+        mkdir(path, 0755);
+        for (int f = 0; f < TREE_FILES; f++) {
+            snprintf(path, sizeof(path), "tree/d%02d/d%02d/f%d.%s", d / 40, d % 40, f, f % 2 ? "c" : "h");
+            touch(path);
+        }
+    }
+}
+
+// One command line expanding every pattern with glob(3)
+static size_t line_glob3() {
+    size_t total = 0;
+    for (size_t i = 0; i < PATTERN_COUNT; i++) {
+        glob_t g;
+        if (glob(patterns[i], 0, NULL, &g) == 0) {
+            total += g.gl_pathc;
+        }
+        globfree(&g);
+    }
+    return total;
+}
+
+// The same line with path_glob(), sharing listings until the line ends
+static size_t line_path_glob() {
+    size_t total = 0;
+    for (size_t i = 0; i < PATTERN_COUNT; i++) {
+        PathList list;
+        total += path_glob(patterns[i], &list);
+        free_path_list(&list);
+    }
+    path_glob_clear_cache();
+    return total;
+}
+
+static size_t line_globstar() {
+    PathList list;
+    size_t total = path_glob("tree/**/*.c", &list);
+    free_path_list(&list);
+    path_glob_clear_cache();
+    return total;
+}
+
+// One `[` command line, run from inside logs/
+static size_t line_bracket_words() {
+    size_t total = 0;
+    for (size_t i = 0; i < BRACKET_WORD_COUNT; i++) {
+        PathList list;
+        total += path_glob(bracket_words[i], &list);
+        free_path_list(&list);
+    }
+    path_glob_clear_cache();
+    return total;
+}
+
+static double best_of(size_t (*line)(), size_t* matches) {
+    double best = 0;
+    for (int i = 0; i < ROUNDS; i++) {
+        double start = now_s();
+        *matches = line();
+        double elapsed = now_s() - start;
+        if (i == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    int files = argc > 1 ? atoi(argv[1]) : 100000;
+    const char* dir = argc > 2 ? argv[2] : "/tmp";
+    char root[4096];
+    snprintf(root, sizeof(root), "%s/glob_bench.XXXXXX", dir);
+    if (mkdtemp(root) == NULL || chdir(root) < 0) {
+        perror(root);
+        return EXIT_FAILURE;
+    }
+
+    printf("creating %d files and a %d-directory tree in %s\n", files, TREE_DIRS, root);
+    fflush(stdout);
+    create_tree(files);
+
+    size_t matches;
+    double t = best_of(line_glob3, &matches);
+    printf("%-28s %9.2f ms  (%zu matches)\n", "3 patterns, glob(3)", t * 1e3, matches);
+    t = best_of(line_path_glob, &matches);
+    printf("%-28s %9.2f ms  (%zu matches)\n", "3 patterns, path_glob", t * 1e3, matches);
+
+    if (chdir("logs") < 0) {
+        perror("logs");
+        return EXIT_FAILURE;
+    }
+    t = best_of(line_bracket_words, &matches);
+    printf("%-28s %9.2f ms  (%zu matches)\n", "[ a[ x[1 ], in logs/", t * 1e3, matches);
+    if (chdir("..") < 0) {
+        perror("..");
+        return EXIT_FAILURE;
+    }
+
+    const char* thread_counts[] = { "1", "2", "4" };
+    for (size_t i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); i++) {
+        set_glob_threads(thread_counts[i]);
+        t = best_of(line_globstar, &matches);
+        char label[64];
+        snprintf(label, sizeof(label), "tree/**/*.c, %s thread(s)", thread_counts[i]);
+        printf("%-28s %9.2f ms  (%zu matches)\n", label, t * 1e3, matches);
+        fflush(stdout);
+    }
+
+    char cleanup[4200];
+    snprintf(cleanup, sizeof(cleanup), "rm -rf '%s'", root);
+    return system(cleanup) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
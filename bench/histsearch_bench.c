@@ -0,0 +1,116 @@
+// Measures history search over a large synthetic history: building the
+// trigram index, then each query through the index against a linear scan of
+// every entry with strcasestr(), which is what searching without it costs.
+// Usage: histsearch_bench [entries]
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "histindex.h"
+
+#define ROUNDS 5        // Best of this many runs
+#define MAX_RESULTS 20
+
+static const char* commands[] = {
+    "git commit -m", "git checkout", "git push origin", "git log --oneline", "make -j8",
+    "ssh deploy@web", "docker run --rm -it", "kubectl get pods -n", "grep -rn", "vim src/",
+    "cd ~/projects/", "python3 manage.py", "cargo build --release", "npm run", "tail -f /var/log/",
+};
+static const char* words[] = {
+    "alpha", "build", "cache", "deploy", "error", "fix", "gateway", "handler", "index", "json",
+    "kernel", "loader", "metrics", "network", "parser", "queue", "router", "server", "token", "worker",
+};
+static const char* queries[] = { "git push", "commit fix", "pods gateway", "release", "kubectl queue 4", "gcm" };
+
+#define COUNT(a) (sizeof(a) / sizeof(a[0]))
+
+static double now_s() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Deterministic, so every run searches the same history
+static unsigned long next_random(unsigned long* state) {
+    *state = *state * 6364136223846793005ul + 1442695040888963407ul;
+    return *state >> 33;
+}
+
+// Repeats as real histories do: most lines are one of a few thousand
+static char** make_history(int count) {
+    char** lines = malloc(count * sizeof(char*));
+    unsigned long state = 42;
+    for (int i = 0; i < count; i++) {
+        char line[256];
+        unsigned long r = next_random(&state);
+        int distinct = r % 4 == 0 ? 200000 : 5000;
+        unsigned long v = next_random(&state) % distinct;
+        snprintf(line, sizeof(line), "%s %s-%s %lu", commands[v % COUNT(commands)],
+                 words[v / COUNT(commands) % COUNT(words)], words[v / 7 % COUNT(words)], v % 97);
+        lines[i] = strdup(line);
+    }
+    return lines;
+}
+
+// Matches of every word in every entry, with no index and no ranking
+static int linear_search(char** lines, int count, const char* query) {
+    char* copy = strdup(query);
+    char* query_words[16];
+    int word_count = 0;
+    for (char* w = strtok(copy, " "); w && word_count < 16; w = strtok(NULL, " ")) {
+        query_words[word_count++] = w;
+    }
+    int found = 0;
+    for (int i = 0; i < count; i++) {
+        int w = 0;
+        while (w < word_count && strcasestr(lines[i], query_words[w])) w++;
+        found += w == word_count;
+    }
+    free(copy);
+    return found;
+}
+
+int main(int argc, char** argv) {
+    int count = argc > 1 ? atoi(argv[1]) : 1000000;
+    printf("generating %d history entries\n", count);
+    fflush(stdout);
+    char** lines = make_history(count);
+
+    HistIndex index = { 0 };
+    double start = now_s();
+    for (int i = 0; i < count; i++) {
+        hist_index_add(&index, lines[i], strlen(lines[i]));
+    }
+    printf("%-28s %9.2f ms  (%u distinct, %zu trigrams)\n", "build index", (now_s() - start) * 1e3,
+           index.command_count, index.trigram_count);
+
+    HistMatch matches[MAX_RESULTS];
+    for (size_t q = 0; q < COUNT(queries); q++) {
+        double best_index = 0, best_linear = 0;
+        int found = 0, linear_found = 0;
+        for (int r = 0; r < ROUNDS; r++) {
+            start = now_s();
+            found = hist_index_search(&index, queries[q], matches, MAX_RESULTS);
+            double elapsed = now_s() - start;
+            best_index = r == 0 || elapsed < best_index ? elapsed : best_index;
+
+            start = now_s();
+            linear_found = linear_search(lines, count, queries[q]);
+            elapsed = now_s() - start;
+            best_linear = r == 0 || elapsed < best_linear ? elapsed : best_linear;
+        }
+        char label[64];
+        snprintf(label, sizeof(label), "\"%s\"", queries[q]);
+        printf("%-28s %9.2f ms indexed  %9.2f ms linear  (%d shown, %d lines match)  top: %s\n", label,
+               best_index * 1e3, best_linear * 1e3, found, linear_found, found ? matches[0].text : "-");
+        fflush(stdout);
+    }
+
+    hist_index_free(&index);
+    for (int i = 0; i < count; i++) {
+        free(lines[i]);
+    }
+    free(lines);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,106 @@
+// Measures throughput through N-stage pipelines built by handle_pipe(), at
+// several pipe capacities. Every stage is /bin/cat, so the cost measured is
+// moving data through the pipes and switching between the stages.
+// Usage: pipe_bench [size_mb] [directory]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "pipe.h"
+#include "parser.h"
+#include "arena.h"
+
+#define BLOCK_SIZE (8 << 20)
+#define ROUNDS 3 // Best of this many runs
+#define MAX_LINE 1024
+
+static double now_s() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void create_source(const char* path, size_t size_mb) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    char* block = malloc(BLOCK_SIZE);
+    for (size_t i = 0; i < BLOCK_SIZE; i++) {
+        block[i] = (i % 64 == 63) ? '\n' : 'a' + i % 26;
+    }
+    for (size_t written = 0; written < (size_mb << 20); written += BLOCK_SIZE) {
+        if (write(fd, block, BLOCK_SIZE) != BLOCK_SIZE) {
+            perror("write");
+            exit(EXIT_FAILURE);
+        }
+    }
+    free(block);
+    close(fd);
+}
+
+// Runs `/bin/cat src | /bin/cat | ... > /dev/null` with the given number of stages
+static double run_pipeline(const char* src, int stages) {
+    char line[MAX_LINE];
+    int len = snprintf(line, sizeof(line), "/bin/cat %s", src);
+    for (int i = 1; i < stages; i++) {
+        len += snprintf(line + len, sizeof(line) - len, " | /bin/cat");
+    }
+    snprintf(line + len, sizeof(line) - len, " > /dev/null");
+
+    Arena arena = { 0 };
+    CommandList* list = parse_line(line, &arena, NULL);
+    if (list == NULL) {
+        exit(EXIT_FAILURE);
+    }
+
+    double best = 0;
+    for (int i = 0; i < ROUNDS; i++) {
+        double start = now_s();
+        handle_pipe(list->first->pipelines, 0);
+        double elapsed = now_s() - start;
+        if (i == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    arena_free(&arena);
+    return best;
+}
+
+int main(int argc, char** argv) {
+    size_t size_mb = argc > 1 ? strtoul(argv[1], NULL, 10) : 1024;
+    const char* dir = argc > 2 ? argv[2] : "/tmp";
+    char src[4096];
+    snprintf(src, sizeof(src), "%s/pipe_bench.src", dir);
+
+    const int stage_counts[] = { 2, 4, 8 };
+    const char* buffer_sizes[] = { "default", "256K", "1M" };
+    const int num_stages = sizeof(stage_counts) / sizeof(stage_counts[0]);
+    const int num_sizes = sizeof(buffer_sizes) / sizeof(buffer_sizes[0]);
+
+    printf("creating %zu MB source in %s\n", size_mb, dir);
+    fflush(stdout);
+    create_source(src, size_mb);
+
+    printf("%8s", "stages");
+    for (int s = 0; s < num_sizes; s++) {
+        printf(" %12s", buffer_sizes[s]);
+    }
+    printf("   (MB/s by pipebuf)\n");
+
+    for (int n = 0; n < num_stages; n++) {
+        printf("%8d", stage_counts[n]);
+        for (int s = 0; s < num_sizes; s++) {
+            set_pipe_buffer_size(buffer_sizes[s]);
+            printf(" %12.0f", size_mb / run_pipeline(src, stage_counts[n]));
+            fflush(stdout);
+        }
+        printf("\n");
+    }
+
+    unlink(src);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,109 @@
+// Compares running a script parsed once into a syntax tree, loops included,
+// with running the same work one line at a time, each line parsed on its own,
+// as the shell used to run scripts. The bodies are arithmetic and function
+// calls, which never fork, so the cost measured is the shell's own.
+// Usage: script_bench [iterations]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "parser.h"
+#include "executor.h"
+#include "arena.h"
+
+#define ROUNDS 5 // Best of this many runs
+
+static double now_s() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef struct {
+    const char* name;
+    const char* setup;  // Run once, before timing
+    const char* body;   // The loop body, using $i
+} Case;
+
+static const Case cases[] = {
+    { "arith", "x=0", "x=$((x + i))" },
+    { "call", "count() { calls=$((calls + $1)); }", "count $i" },
+    { "case", "y=0", "case $i in *0) y=$((y + 1)) ;; *) ;; esac" },
+    { "if", "z=0", "if z=$((z + i)); then z=$((z - 1)); fi" },
+};
+
+static void run_text(const char* text, Arena* arena) {
+    CommandList* list = parse_line(text, arena, NULL);
+    if (list == NULL) {
+        exit(EXIT_FAILURE);
+    }
+    execute_list(list);
+    arena_reset(arena);
+}
+
+// The loop as one script, `for i in 0 1 2 ...; do body; done`: parsed once,
+// the tree walked on every iteration
+static double run_parsed_once(const Case* c, long iterations) {
+    size_t size = iterations * 21 + strlen(c->body) + 64;
+    char* script = malloc(size);
+    if (!script) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    size_t len = snprintf(script, size, "for i in");
+    for (long i = 0; i < iterations; i++) {
+        len += snprintf(script + len, size - len, " %ld", i);
+    }
+    snprintf(script + len, size - len, "; do %s; done", c->body);
+
+    Arena arena = { 0 };
+    double start = now_s();
+    run_text(script, &arena);
+    double elapsed = now_s() - start;
+    arena_free(&arena);
+    free(script);
+    return elapsed;
+}
+
+// The same work unrolled into lines, `i=N; body`, each parsed, run and freed in turn
+static double run_line_at_a_time(const Case* c, long iterations) {
+    char line[512];
+    Arena arena = { 0 };
+    double start = now_s();
+    for (long i = 0; i < iterations; i++) {
+        snprintf(line, sizeof(line), "i=%ld; %s", i, c->body);
+        run_text(line, &arena);
+    }
+    double elapsed = now_s() - start;
+    arena_free(&arena);
+    return elapsed;
+}
+
+static double best_of(double (*run)(const Case*, long), const Case* c, long iterations) {
+    double best = 0;
+    for (int i = 0; i < ROUNDS; i++) {
+        double elapsed = run(c, iterations);
+        if (i == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    long iterations = argc > 1 ? strtol(argv[1], NULL, 10) : 20000;
+    const int num_cases = sizeof(cases) / sizeof(cases[0]);
+    Arena arena = { 0 };
+
+    printf("%-8s %16s %16s %9s   (%ld iterations)\n",
+           "case", "parsed once (ms)", "per line (ms)", "speedup", iterations);
+    for (int c = 0; c < num_cases; c++) {
+        run_text(cases[c].setup, &arena);
+        double once = best_of(run_parsed_once, &cases[c], iterations);
+        double per_line = best_of(run_line_at_a_time, &cases[c], iterations);
+        printf("%-8s %16.2f %16.2f %8.1fx\n", cases[c].name, once * 1e3, per_line * 1e3, per_line / once);
+        fflush(stdout);
+    }
+    arena_free(&arena);
+    return EXIT_SUCCESS;
+}
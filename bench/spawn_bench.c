@@ -0,0 +1,64 @@
+// Measures command launch latency for each spawn engine as the shell's RSS grows.
+// Usage: spawn_bench [launches] [command]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/wait.h>
+#include "spawner.h"
+
+static double now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static double time_launches(enum SpawnEngine engine, char** argv, int launches) {
+    SpawnRequest req = {
+        .argv = argv,
+        .stdin_fd = -1,
+        .stdout_fd = -1,
+        .tty_fd = -1,
+    };
+
+    set_spawn_engine(engine);
+    double start = now_us();
+    for (int i = 0; i < launches; i++) {
+        pid_t pid = spawn_command(&req);
+        if (pid < 0) {
+            exit(EXIT_FAILURE);
+        }
+        waitpid(pid, NULL, 0);
+    }
+    return (now_us() - start) / launches;
+}
+
+int main(int argc, char** argv) {
+    int launches = argc > 1 ? atoi(argv[1]) : 500;
+    char* command[] = { argc > 2 ? argv[2] : "/bin/true", NULL };
+    const size_t rss_steps_mb[] = { 0, 64, 256, 1024 };
+    size_t held_mb = 0;
+    char* ballast = NULL;
+
+    printf("%8s %14s %14s %8s\n", "rss_mb", "fork_us", "posix_spawn_us", "speedup");
+    for (size_t i = 0; i < sizeof(rss_steps_mb) / sizeof(rss_steps_mb[0]); i++) {
+        // Grow and touch the ballast so every page is resident, like a long-lived session
+        if (rss_steps_mb[i] > held_mb) {
+            free(ballast);
+            ballast = malloc(rss_steps_mb[i] << 20);
+            if (!ballast) {
+                perror("malloc");
+                return EXIT_FAILURE;
+            }
+            memset(ballast, 1, rss_steps_mb[i] << 20);
+            held_mb = rss_steps_mb[i];
+        }
+
+        double fork_us = time_launches(SPAWN_ENGINE_FORK, command, launches);
+        double spawn_us = time_launches(SPAWN_ENGINE_POSIX, command, launches);
+        printf("%8zu %14.1f %14.1f %7.1fx\n", held_mb, fork_us, spawn_us, fork_us / spawn_us);
+    }
+
+    free(ballast);
+    return EXIT_SUCCESS;
+}
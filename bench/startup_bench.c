@@ -0,0 +1,75 @@
+// Measures how long the shell takes to start, run one command and exit, against
+// running the command directly and through /bin/sh.
+// Usage: startup_bench [runs] [shell]
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <spawn.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+extern char** environ;
+
+static double now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// Average microseconds from launch to exit, with stdin from /dev/null
+static double time_runs(char** argv, int runs) {
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+
+    double start = now_us();
+    for (int i = 0; i < runs; i++) {
+        pid_t pid;
+        int status;
+        if (posix_spawn(&pid, argv[0], &actions, NULL, argv, environ) != 0) {
+            perror(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "%s exited with status %d\n", argv[0], WEXITSTATUS(status));
+            exit(EXIT_FAILURE);
+        }
+    }
+    double elapsed = (now_us() - start) / runs;
+    posix_spawn_file_actions_destroy(&actions);
+    return elapsed;
+}
+
+int main(int argc, char** argv) {
+    int runs = argc > 1 ? atoi(argv[1]) : 500;
+    char* shell = argc > 2 ? argv[2] : "bin/myshell";
+
+    char script[] = "/tmp/startup_bench_XXXXXX";
+    int fd = mkstemp(script);
+    if (fd < 0 || write(fd, "/bin/true\n", 10) != 10) {
+        perror("mkstemp");
+        return EXIT_FAILURE;
+    }
+    close(fd);
+
+    struct {
+        const char* label;
+        char* argv[5];
+    } cases[] = {
+        { "/bin/true, no shell",           { "/bin/true", NULL } },
+        { "sh -c /bin/true",               { "/bin/sh", "-c", "/bin/true", NULL } },
+        { "-c, last command exec'd",       { shell, "-c", "/bin/true", NULL } },
+        { "-c, last command forked",       { shell, "-c", "/bin/true; x=1", NULL } },
+        { "script file",                   { shell, "--no-script-cache", script, NULL } },
+        { "-s, commands from stdin",       { shell, "-s", NULL } },
+    };
+
+    printf("%-28s %10s\n", "case", "us/run");
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        printf("%-28s %10.1f\n", cases[i].label, time_runs(cases[i].argv, runs));
+    }
+    unlink(script);
+    return 0;
+}
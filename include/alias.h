@@ -1,11 +1,33 @@
 #ifndef ALIAS_H
 #define ALIAS_H
 
+#define ALIAS_FILE ".myshell_aliases"
+
 // Built-in commands for managing aliases
-void builtin_alias(char** args);
-void builtin_unalias(char** args);
+int builtin_alias(char** args);
+int builtin_unalias(char** args);
+
+/**
+ * Expands the aliases of every word of line in command position: the first
+ * word, words after `;`, `&`, `|`, `(`, newlines and keywords such as `then`,
+ * and, as in bash, the word after an alias whose value ends in a blank. An
+ * alias's value is expanded in turn, except for aliases already being
+ * expanded, so `alias ls='ls -F'` and cycles such as a=b, b=a stop there.
+ * Top-level expansions are memoized until the next alias or unalias.
+ * @return The expanded line, to be freed, or NULL if nothing was expanded.
+ */
+char* expand_aliases(const char* line);
+
+/**
+ * Loads ~/.myshell_aliases, in one read, as `alias` lines. From then on
+ * every alias and unalias in this shell rewrites the file.
+ */
+void load_aliases();
+
+// The value of the alias called name, or NULL if there is none
+const char* lookup_alias(const char* name);
 
-// Function to expand an alias if it exists
-char* expand_alias(const char* command_name);
+// Calls fn for every defined alias
+void for_each_alias(void (*fn)(const char* name, const char* value, void* ctx), void* ctx);
 
 #endif //ALIAS_H
@@ -0,0 +1,29 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+typedef struct ArenaBlock ArenaBlock;
+
+/**
+ * A bump allocator for data that lives exactly as long as one command line,
+ * such as the parsed syntax tree. Allocations are never freed one by one;
+ * arena_reset() releases them all at once. A zeroed Arena is ready to use.
+ */
+typedef struct {
+    ArenaBlock* head; // Block currently being filled; older blocks follow it
+} Arena;
+
+// Returns size bytes, suitably aligned for any type. Exits if memory runs out.
+void* arena_alloc(Arena* arena, size_t size);
+
+// Copies len bytes of s into the arena and null-terminates them
+char* arena_strndup(Arena* arena, const char* s, size_t len);
+
+// Releases every allocation, keeping one block for the next line
+void arena_reset(Arena* arena);
+
+// Releases every allocation and the blocks themselves
+void arena_free(Arena* arena);
+
+#endif //ARENA_H
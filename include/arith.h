@@ -0,0 +1,14 @@
+#ifndef ARITH_H
+#define ARITH_H
+
+/**
+ * Evaluates an arithmetic expression, as in $((expr)), with C's long integers:
+ * numbers (decimal, 0x hex, 0 octal), variable names, ( ), the unary, binary
+ * and ?: operators of C, ** for powers, and assignments (=, +=, ..., ++, --), which set the variable.
+ * An unset or empty variable counts as 0.
+ * @param expr The expression, with $ expansions already done.
+ * @return 0 with the value in *result, or -1 on an error (already reported).
+ */
+int arith_evaluate(const char* expr, long* result);
+
+#endif //ARITH_H
@@ -0,0 +1,37 @@
+#ifndef ASTIMAGE_H
+#define ASTIMAGE_H
+
+#include <stddef.h>
+#include "parser.h"
+
+/**
+ * A syntax tree flattened into one position-independent block. Every node
+ * and string is copied in, and every pointer is stored as an offset from the
+ * start of data; relocs lists where those pointers are, so that
+ * relocate_ast_image() can turn them back into addresses wherever the block
+ * ends up: in a malloc()ed buffer, or in a file mapped from the script cache.
+ * The root node is always at offset 0.
+ */
+typedef struct {
+    char* data;
+    size_t size;
+    size_t capacity;
+    size_t* relocs;       // Offsets of the pointers in data
+    size_t reloc_count;
+    size_t reloc_capacity;
+} AstImage;
+
+// Flattens a whole command list, or one command and what it contains (not cmd->next)
+void flatten_list(const CommandList* list, AstImage* out);
+void flatten_command(const Command* cmd, AstImage* out);
+
+/**
+ * Turns the offsets at relocs into addresses, with base as the start of the image.
+ * @return 0 on success, -1 if a pointer or its target lies outside size bytes
+ *         (a damaged image; it may be partly relocated).
+ */
+int relocate_ast_image(char* base, size_t size, const size_t* relocs, size_t reloc_count);
+
+void free_ast_image(AstImage* image);
+
+#endif //ASTIMAGE_H
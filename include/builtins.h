@@ -1,11 +1,44 @@
 #ifndef BUILTINS_H
 #define BUILTINS_H
 
+#include "redirect.h"
+#include "spawner.h"
+
+// A built-in returns its exit status
+typedef int (*BuiltinFunc)(char** args);
+
+/**
+ * Looks up the built-in that would run args, without running it.
+ * A built-in may leave some invocations to the external program of the same
+ * name: cat does when given options, or when it would read from a terminal,
+ * since the shell does not take Ctrl+C while it runs a built-in.
+ * @param args Command and arguments, redirections already removed.
+ * @param stdin_is_tty Whether the command's stdin would be a terminal.
+ * @return The built-in's function, or NULL to run args as an external command.
+ */
+BuiltinFunc find_builtin(char** args, int stdin_is_tty);
+
+/**
+ * Whether a foreground built-in may run in the shell process itself. cat at an
+ * interactive prompt may not: its copy lasts as long as its input, and the
+ * shell takes Ctrl+C through its signalfd, so only a child in its own process
+ * group can be interrupted or stopped from the terminal.
+ */
+int builtin_runs_in_shell(BuiltinFunc builtin);
+
+/**
+ * Runs a built-in in the shell process itself, with stdin_fd (if not -1) as its
+ * stdin and its redirections applied to the shell's descriptors while it runs.
+ * @return The built-in's exit status, or 1 if a redirection failed.
+ */
+int run_builtin_in_shell(BuiltinFunc builtin, char** argv, int stdin_fd,
+                         const Redirection* redirs, int redir_count);
+
 /**
- * Attempts to execute a built-in command.
- * @param args Parsed command and arguments.
- * @return 1 if the command was a built-in and was handled, 0 otherwise.
+ * Runs a built-in in a forked copy of the shell (see spawn_subshell()), for
+ * pipeline stages and background commands that cannot run in the shell itself.
+ * @return The child's pid, or -1 if fork failed (already reported).
  */
-int handle_builtin_command(char** args);
+pid_t spawn_builtin(const SpawnRequest* req, BuiltinFunc builtin);
 
 #endif //BUILTINS_H
@@ -0,0 +1,47 @@
+#ifndef CMDHASH_H
+#define CMDHASH_H
+
+/**
+ * Resolves a command name to the path of the executable that execvp would run,
+ * remembering the answer so later launches skip the $PATH walk.
+ * The table is flushed when $PATH changes. Changes inside a $PATH directory
+ * arrive through inotify, or, for unwatched directories, through its mtime
+ * (rechecked at most once per second).
+ * @param name Command name without any '/'.
+ * @return The resolved path, valid until the next table operation, or NULL.
+ */
+const char* cmdhash_lookup(const char* name);
+
+// Remembers an explicit path for name, as `hash -p` does
+void cmdhash_remember(const char* name, const char* path);
+
+// Forgets one remembered name, or every name
+void cmdhash_forget(const char* name);
+void cmdhash_clear();
+
+/**
+ * Starts listing every $PATH directory on a background thread, and watches
+ * them with inotify so later changes are applied incrementally.
+ * Does nothing if a scan is running or the table is already complete.
+ */
+void cmdhash_start_scan();
+
+/**
+ * Makes sure every executable on $PATH is in the table, waiting for the
+ * background scan if needed. Tab completion relies on this, so both share
+ * one copy of each name.
+ */
+void cmdhash_scan_path();
+
+// Applies pending inotify events for the $PATH directories without blocking
+void cmdhash_poll();
+
+// Calls fn for every name currently in the table
+void cmdhash_foreach(void (*fn)(const char* name, void* ctx), void* ctx);
+
+// Changes whenever names are added or dropped, so users of cmdhash_foreach know to rebuild
+unsigned long cmdhash_generation();
+
+int builtin_hash(char** args);
+
+#endif //CMDHASH_H
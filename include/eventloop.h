@@ -0,0 +1,18 @@
+#ifndef EVENTLOOP_H
+#define EVENTLOOP_H
+
+/**
+ * Sets up the epoll set for the interactive shell: the terminal plus the
+ * signalfd from setup_signal_handlers().
+ */
+void init_event_loop();
+
+/**
+ * Reads one line through readline's callback interface while waiting on
+ * epoll. Children are reaped as soon as SIGCHLD arrives, and finished
+ * background jobs are reported above the prompt.
+ * @return The line (to be freed by the caller), or NULL on end of input.
+ */
+char* event_loop_readline(const char* prompt);
+
+#endif //EVENTLOOP_H
@@ -1,6 +1,79 @@
 #ifndef EXECUTOR_H
 #define EXECUTOR_H
 
-void execute_command(char** args, int is_background);
+#include "parser.h"
+#include "spawner.h"
+
+// Exit status of the last pipeline run in the foreground
+extern int last_exit_status;
+
+// $1, $2 ... for the script or the function being run; they are not copied
+extern char** positional_params;
+extern int positional_count;
+extern const char* shell_name; // $0
+
+// What a break, continue or return has asked the enclosing commands to do
+enum ControlFlow {
+    FLOW_NORMAL,
+    FLOW_BREAK,
+    FLOW_CONTINUE,
+    FLOW_RETURN,
+    FLOW_INTERRUPT  // A foreground job was killed by Ctrl+C: the whole command line stops
+};
+
+extern enum ControlFlow pending_flow;
+extern int pending_levels;  // How many enclosing loops a break or continue still has to leave
+extern int loop_depth;      // Loops running in the current function, or at top level
+extern int function_depth;
+
+// Set for -c: if the last command of the next execute_list() is a plain
+// external command, it replaces the shell instead of running in a child
+extern int exec_last_command;
+
+// A simple command after expansion, ready to run
+typedef struct {
+    char** argv;          // From expand_variables(); argv[0] is NULL for a bare redirection
+    char** assigns;       // Leading NAME=value words, expanded; NULL-terminated
+    Redirection* redirs;  // Paths are expanded copies
+    int redir_count;
+} ExpandedCommand;
+
+/**
+ * Expands the words and redirection targets of a parsed command.
+ * Only simple commands have words; a compound command gets an empty argv.
+ * @return 0 on success, -1 on an expansion error (already reported).
+ */
+int expand_command(const Command* cmd, ExpandedCommand* out);
+void free_expanded_command(ExpandedCommand* cmd);
+
+/**
+ * Sets the assignments in front of a command in the environment for as long as
+ * it runs, as in `LANG=C sort`. Undo them with pop_assignments().
+ * @return The previous values, to hand to pop_assignments().
+ */
+char** push_assignments(const ExpandedCommand* cmd);
+void pop_assignments(const ExpandedCommand* cmd, char** saved);
+
+/**
+ * Runs a parsed command line or script: each and-or list in order, honouring
+ * &&, || and '&'. Stops early once a break, continue or return is pending.
+ * @return The exit status of the last pipeline run in the foreground.
+ */
+int execute_list(const CommandList* list);
+
+/**
+ * Runs a single command that is not part of a pipeline: a built-in, a function
+ * or a compound command in the shell itself, anything else as a job of its own.
+ * @return The command's exit status; 0 once a background command has started.
+ */
+int execute_command(const Command* cmd, int is_background);
+
+/**
+ * Runs a compound command, or a call to a function (argv[0]), in a forked copy
+ * of the shell, for pipeline stages. The command's redirections must already
+ * be in req.
+ * @return The child's pid, or -1 if fork failed (already reported).
+ */
+pid_t spawn_shell_command(const SpawnRequest* req, const Command* cmd, char** argv);
 
 #endif //EXECUTOR_H
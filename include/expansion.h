@@ -2,10 +2,35 @@
 #define EXPANSION_H
 
 /**
- * Expands environment variables in the argument list.
- * It processes arguments in-place, replacing tokens like $VAR or ${VAR}.
- * @param args The null-terminated array of arguments.
+ * Expands the words of a parsed command into the argument vector to run, in
+ * the shell itself: {a,b} braces, $name, ${name}, ${name:-word} and the other
+ * ${} forms, $?, $$, $#, $0 to $9, ${10}, $@ and $*, $((arithmetic)), ~ and
+ * ~user, field splitting, globs (see path_glob()), then quote removal.
+ * Command substitution is not supported. words is not modified.
+ * @param words Null-terminated words as written, from a Command.
+ * @return A null-terminated argv in a single allocation (release it with free()),
+ *         or NULL on an error (already reported).
  */
-char** expand_variables(char** args);
+char** expand_variables(char** words);
+
+/**
+ * Expands a redirection target, which must yield exactly one word.
+ * @return A newly allocated path, or NULL if it was ambiguous (already reported).
+ */
+char* expand_redirection_target(const char* word);
+
+/**
+ * Expands the value of a NAME=value assignment, or the word of a case:
+ * like a double-quoted word, but with quotes removed and ~ expanded.
+ * @return A newly allocated string, or NULL on an error (already reported).
+ */
+char* expand_assignment(const char* value);
+
+/**
+ * Expands a case pattern. Glob characters keep their meaning unless quoted;
+ * quoted ones are escaped with a backslash, ready for pattern_match().
+ * @return A newly allocated pattern, or NULL on an error (already reported).
+ */
+char* expand_pattern(const char* word);
 
 #endif //EXPANSION_H
@@ -0,0 +1,15 @@
+#ifndef FASTCOPY_H
+#define FASTCOPY_H
+
+#include <sys/types.h>
+
+/**
+ * Copies everything from in_fd to out_fd, keeping the data in the kernel when
+ * the descriptor types allow it: copy_file_range between regular files,
+ * sendfile from a regular file, splice to or from a pipe. Anything else falls
+ * back to a read/write loop.
+ * @return The number of bytes copied, or -1 on error (errno is set).
+ */
+off_t copy_fd_data(int in_fd, int out_fd);
+
+#endif //FASTCOPY_H
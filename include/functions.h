@@ -0,0 +1,39 @@
+#ifndef FUNCTIONS_H
+#define FUNCTIONS_H
+
+#include "parser.h"
+
+/*
+ * Shell functions, in a hash table keyed by name. Each body is copied into a
+ * block of its own (see astimage.h), so it outlives the command line or
+ * script that defined it.
+ */
+typedef struct Function {
+    char* name;
+    const Command* body;    // A compound command, at the start of image
+    char* image;
+    int running;            // Calls in progress
+    int retired;            // Redefined or unset while running: freed by the last call to return
+    struct Function* next;  // Next in the same bucket
+} Function;
+
+/**
+ * Defines (or redefines) the function described by def, as running
+ * `name() { ...; }` does.
+ */
+void define_function(const FunctionDef* def);
+
+// The function called name, or NULL if there is none
+Function* find_function(const char* name);
+
+/**
+ * Removes a function, as `unset -f name` does.
+ * @return 0 if it existed, -1 otherwise.
+ */
+int unset_function(const char* name);
+
+// Bracket every call, so that a function redefining itself keeps its body until it returns
+void function_enter(Function* fn);
+void function_leave(Function* fn);
+
+#endif //FUNCTIONS_H
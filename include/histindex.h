@@ -0,0 +1,66 @@
+#ifndef HISTINDEX_H
+#define HISTINDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// One distinct command of the history
+typedef struct {
+    size_t text;        // Offset of its NUL-terminated text in HistIndex.texts
+    uint32_t len;
+    uint32_t count;     // Times it was entered
+    uint32_t last_seq;  // When it was last entered; higher is more recent
+} IndexedCommand;
+
+// The ids of the commands a trigram occurs in, ascending
+typedef struct {
+    uint32_t* ids;
+    uint32_t len;
+    uint32_t cap;
+} PostingList;
+
+/**
+ * A search index over history entries: each distinct command once, with how
+ * often and how recently it was entered, and a posting list per trigram of
+ * lowercased text. Entries are added incrementally; a search reads only the
+ * posting lists of the query's trigrams and checks the commands in all of
+ * them, instead of scanning the history. A zeroed HistIndex is empty and ready.
+ */
+typedef struct {
+    char* texts;
+    size_t texts_len;
+    size_t texts_cap;
+    IndexedCommand* commands;
+    uint32_t command_count;
+    uint32_t command_cap;
+    uint32_t* by_text;      // Open addressing: command id + 1, 0 for empty
+    size_t by_text_size;
+    uint32_t* trigram_keys; // Open addressing: three lowercased bytes, 0 for empty
+    PostingList* postings;
+    size_t trigram_size;
+    size_t trigram_count;
+    uint32_t seq;           // Entries added so far
+} HistIndex;
+
+typedef struct {
+    const char* text;   // Valid until the next hist_index_add()
+    uint32_t count;
+    double score;
+} HistMatch;
+
+// Records one entered line; a command seen before only becomes more frequent and recent
+void hist_index_add(HistIndex* index, const char* text, size_t len);
+
+/**
+ * Finds the commands containing every blank-separated word of query, in any
+ * order and ignoring case, best first: a word at the start of the command or
+ * of one of its words counts most, then how often and how recently it was
+ * entered. If no command contains them all, the query's characters are matched
+ * as a subsequence instead ("gcm" finds "git commit -m"), tightest first.
+ * @return The number of matches written to out, at most max.
+ */
+int hist_index_search(HistIndex* index, const char* query, HistMatch* out, int max);
+
+void hist_index_free(HistIndex* index);
+
+#endif //HISTINDEX_H
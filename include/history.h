@@ -1,10 +1,70 @@
 #ifndef HISTORY_H
 #define HISTORY_H
 
+#include "histindex.h"
+
 #define HISTORY_FILE ".myshell_history"
 
-void builtin_history(char** args);
+/*
+ * The file is a sequence of records, each an ASCII record separator (0x1e),
+ * the length of the entry in decimal, ':', the entry itself, which may span
+ * lines, and '\n'. A record is appended whole with one write, so sessions
+ * sharing the file never see each other's entries torn or interleaved.
+ * Plain lines, from older versions, are read as one entry each.
+ */
+
+int builtin_history(char** args);
+
+/**
+ * Loads the last $HISTSIZE (default 10000) entries of ~/.myshell_history,
+ * reading only the tail of a mapped file, so startup does not grow with it.
+ * Starts a background compaction of the file once it holds a quarter more
+ * than $HISTFILESIZE (default 100000) entries, or still holds plain lines.
+ */
 void load_history();
-void save_history();
+
+/**
+ * Adds an accepted line to the history and appends it to the file at once,
+ * in a single O_APPEND write, so a crash or `exit` loses nothing.
+ */
+void record_history(const char* line);
+
+/**
+ * Waits for a compaction in progress and closes the file. Runs at exit.
+ */
+void close_history();
+
+/**
+ * With sharing on, adds what other sessions appended since the last look,
+ * reading the file only from the offset reached then. After a compaction the
+ * history is reloaded from the new file instead. Called before each prompt,
+ * before `!` expansion and by `history`.
+ */
+void sync_history();
+
+/**
+ * `set histshare=on|off`: whether sessions see each other's entries as they
+ * are entered, not only at startup. The initial value comes from $HISTSHARE.
+ * @return 0 on success, -1 if value is not "on" or "off".
+ */
+int set_history_sharing(const char* value);
+int get_history_sharing();
+
+/**
+ * `set histdedup=on|off`: whether compaction keeps only the newest copy of
+ * each entry. On by default if $HISTCONTROL contains "erasedups", as in bash.
+ * @return 0 on success, -1 if value is not "on" or "off".
+ */
+int set_history_erase_dups(const char* value);
+int get_history_erase_dups();
+
+/**
+ * Searches every entry of the history file, not only those in memory, for
+ * commands holding query's words (see hist_index_search()). The index is built
+ * by a thread started at load_history(); the first search waits for it.
+ * `history -s [-n N] words...` prints the results.
+ * @return The number of matches written to out, at most max.
+ */
+int search_history(const char* query, HistMatch* out, int max);
 
 #endif //HISTORY_H
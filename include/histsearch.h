@@ -0,0 +1,20 @@
+#ifndef HISTSEARCH_H
+#define HISTSEARCH_H
+
+/**
+ * Binds Ctrl-R to a fuzzy reverse search over the whole history file, in
+ * place of readline's own: the typed words may come in any order, matches are
+ * ranked by search_history(), and each keystroke redraws the best one. Ctrl-R
+ * again moves to the next match, Enter runs it, Ctrl-G restores the line, and
+ * any other key keeps the match and then acts as usual. Also available as the
+ * readline function fuzzy-history-search, for ~/.inputrc.
+ */
+void init_history_search();
+
+/**
+ * Leaves a search in progress without touching the line, as when Ctrl+C
+ * abandons it. Does nothing otherwise.
+ */
+void cancel_history_search();
+
+#endif //HISTSEARCH_H
@@ -0,0 +1,42 @@
+#ifndef JOBQUEUE_H
+#define JOBQUEUE_H
+
+#include "jobs.h"
+
+/*
+ * A queue of background jobs that start only while the machine has room:
+ * fewer running background jobs than `max`, and a 1-minute load average under
+ * `load` when that is set. Queued jobs live in the job table with the status
+ * QUEUED, so `jobs` lists them and `fg`/`bg` can start one early.
+ */
+
+/**
+ * The `queue` built-in:
+ *   queue add [-p PRIO] command...   Queue a command line; higher PRIO starts first, then FIFO
+ *   queue ls                         Show the limits and the queued jobs, in start order
+ *   queue set [max=N] [load=L]       Limit running background jobs, and the load (0 = ignore)
+ *   queue rm JOB                     Drop a job that has not started
+ *   queue drain                      Wait until every queued job has started and finished
+ */
+int builtin_queue(char** args);
+
+/**
+ * Starts queued jobs while the limits allow. Called whenever a job may have
+ * finished: from the event loop, before each prompt, and between script commands.
+ */
+void dispatch_queued_jobs();
+
+/**
+ * How long the event loop may sleep before the queue needs another look, in
+ * milliseconds: finite only while a job waits on the load average, which can
+ * drop without any child changing state. -1 otherwise.
+ */
+int queue_poll_timeout();
+
+/**
+ * Starts a queued job now, regardless of the limits, as `fg` and `bg` do.
+ * @return 0, or -1 if it could not be started (already reported; the job is dropped).
+ */
+int start_queued_job(Job* job, int foreground);
+
+#endif //JOBQUEUE_H
@@ -2,50 +2,159 @@
 #define JOBS_H
 
 #include <sys/types.h>
+#include <sys/resource.h> // For struct rusage
 #include <termios.h> // For struct termios
 
-#define MAX_JOBS 20
-
 enum JobStatus {
     RUNNING,
     STOPPED,
     BACKGROUND,
     FOREGROUND,
     COMPLETED,
-    TERMINATED
+    TERMINATED,
+    QUEUED      // Waiting in the queue (see jobqueue.h); no process yet
 };
 
+// One process of a job's pipeline
 typedef struct {
+    pid_t pid;
+    int status;         // Last status word from waitpid
+    int exited;         // 1 once the process has exited or been killed
+    int stopped;        // 1 while the process is stopped
+} JobProcess;
+
+typedef struct Job {
     pid_t pid;          // Process ID of the job's process group leader
     pid_t pgid;         // Process group ID
-    char command[1024]; // Command string
+    const char* command; // Command string, interned and shared between jobs
     enum JobStatus status;
     int job_id;         // Sequential job number
     int is_background;  // 1 if background, 0 if foreground
+
+    JobProcess* procs;  // Every process of the pipeline, in order
+    int proc_count;
+    int proc_capacity;
+    int live_count;     // Processes that have not exited yet
+    int stopped_count;  // Live processes that are currently stopped
+    int priority;       // Queued jobs: higher starts first
+    int from_queue;     // Started by the queue, which waits for it on drain
+    double start_ms;    // When its first process started (CLOCK_MONOTONIC)
+    double end_ms;      // When its last process exited; 0 until then
+    struct rusage usage; // Summed over exited processes, from wait4; ru_maxrss is the largest
+
+    // Bookkeeping for the job table
+    struct Job* prev;   // Active jobs, in job-id order
+    struct Job* next;
+    struct Job* next_finished; // Queue of jobs that completed since the last cleanup
+    int finished_queued;
+    int in_use;
 } Job;
 
-extern Job jobs[MAX_JOBS];
 extern int next_job_id;
 extern pid_t shell_pgid;
 extern int shell_is_interactive;
 extern int shell_terminal; // The file descriptor for the shell's terminal
 extern struct termios shell_tmodes; // Terminal modes for the shell
 extern int current_foreground_job;
+extern pid_t inherited_pgid; // Process group new jobs join; 0 gives each job its own
+extern pid_t last_background_pid; // $!
 
 void init_job_control();
 void cleanup_jobs();
-void add_job(pid_t pid, pid_t pgid, const char* command, enum JobStatus status, int is_background);
+
+/**
+ * Collects every child that changed state, without blocking, and records it
+ * in the job table. This is the only place background children are reaped.
+ */
+void reap_children();
+int has_finished_jobs();
+int has_active_jobs();
+
+/**
+ * Creates an empty job for a pipeline; add its processes with add_job_process().
+ * The table grows as needed, so there is no limit on the number of jobs.
+ */
+Job* add_job(pid_t pgid, const char* command, enum JobStatus status, int is_background);
+void add_job_process(Job* job, pid_t pid);
 void remove_job(int job_id);
+
+/**
+ * Makes pid, of a job just started in the background, the value of $!, and
+ * tells an interactive user "[job_id] pid".
+ */
+void announce_background_job(const Job* job, pid_t pid);
+
+// O(1) lookups; any pid of a pipeline finds its job
 Job* get_job_by_pid(pid_t pid);
 Job* get_job_by_job_id(int job_id);
-void update_job_status(pid_t pid, enum JobStatus status);
-void print_jobs();
-void put_job_in_foreground(Job* job, int cont);
+
+/**
+ * Records a status word reported by wait4 for one process and updates the
+ * state of the job it belongs to. Once the process has exited, usage (if not
+ * NULL) is added to the job's.
+ */
+void update_job_status(pid_t pid, int status, const struct rusage* usage);
+int job_is_running(const Job* job);
+
+/**
+ * A job's exit status, taken from its last process as in any shell: the exit
+ * code, or 128 plus the number of the signal that killed or stopped it.
+ */
+int job_exit_status(const Job* job);
+
+/**
+ * Blocks until a child changes state, and records it in the job table, or
+ * until timeout_ms passes (-1 for no limit). The caller must have a child to
+ * wait for when there is no limit. An interactive shell waits on its
+ * signalfd, so Ctrl+C ends the wait.
+ * @return 1 if Ctrl+C was pressed, -1 without a limit if the shell has no
+ *         children left, 0 otherwise.
+ */
+int wait_for_child_event(int timeout_ms);
+
+/**
+ * Milliseconds on CLOCK_MONOTONIC, the clock job start and end times use.
+ */
+double now_ms();
+
+/**
+ * Lists the jobs as `jobs` does; with long_format as `jobs -l`, adding the
+ * pid and the resources used so far.
+ */
+void print_jobs(int long_format);
+/**
+ * Gives job the terminal and waits until it exits or stops.
+ * @return The job's exit status (128 + signal if it was killed or stopped).
+ */
+int put_job_in_foreground(Job* job, int cont);
 void put_job_in_background(Job* job, int cont);
+void for_each_job(void (*fn)(Job* job, void* ctx), void* ctx);
 
 // Built-in job commands
-void builtin_jobs(char** args);
-void builtin_fg(char** args);
-void builtin_bg(char** args);
+int builtin_jobs(char** args);
+int builtin_fg(char** args);
+int builtin_bg(char** args);
+
+/**
+ * The `wait` built-in:
+ *   wait                   Wait for every background job
+ *   wait [%job|pid]...     Wait for each in turn; the status is the last one's
+ *   wait -n [%job|pid]...  Wait for whichever job finishes first, of those
+ *                          given or of all, and return its status
+ * Sleeps on child events, never polls. A background job that finished before
+ * `wait` was called, even one already reported and dropped from the table,
+ * still gives its status; those of the last 1024 processes are kept.
+ * @return 127 for an unknown job, 130 if Ctrl+C ended the wait.
+ */
+int builtin_wait(char** args);
+
+/**
+ * kill [-s sigspec | -n signum | -sigspec] pid | %job ...
+ * kill -l [status]
+ * Signals a whole job's process group for %job. A queued job is removed from
+ * the queue instead; a stopped one is continued after SIGTERM or SIGHUP, so
+ * it sees them.
+ */
+int builtin_kill(char** args);
 
 #endif //JOBS_H
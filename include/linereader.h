@@ -0,0 +1,41 @@
+#ifndef LINEREADER_H
+#define LINEREADER_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * Reads commands from a file descriptor that is not a terminal, such as
+ * `myshell < cmds.txt` or `generator | myshell`, without readline. A regular
+ * file is mapped and scanned in place; anything else is read in large chunks
+ * into a buffer that grows to fit the longest line. A zeroed LineReader is
+ * not ready: use line_reader_init().
+ */
+typedef struct {
+    int fd;
+    char* data;         // The mapped file, or the read buffer
+    size_t len;         // Bytes of data available
+    size_t pos;         // Start of the next line
+    size_t cap;         // Size of the read buffer; 0 while data is mapped
+    off_t map_offset;   // File offset of data[0] while mapped
+    int mapped;
+    int eof;            // read() returned 0
+} LineReader;
+
+void line_reader_init(LineReader* reader, int fd);
+
+/**
+ * Returns the next line, without its newline, in a malloc()ed string the caller
+ * frees, as readline() does. Lines of any length are returned whole; a line
+ * ending in a backslash or inside a quote is continued by the caller asking
+ * for more, as it does at the terminal. When reading a regular file, the
+ * descriptor's offset is moved to just past the line, so a command run from
+ * it reads what follows.
+ * @return The line, or NULL at end of input.
+ */
+char* line_reader_next(LineReader* reader);
+
+// Unmaps or frees the buffer; the descriptor is left open
+void line_reader_close(LineReader* reader);
+
+#endif //LINEREADER_H
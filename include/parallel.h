@@ -0,0 +1,24 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+/**
+ * The `parallel` built-in:
+ *
+ *     parallel [-j N] [-k] [-q] command [args...] [::: items...]
+ *
+ * Runs command once per item, with every `{}` in its words replaced by the
+ * item (or the item appended, if there is no `{}`), keeping N children
+ * running until the items run out. Items come after `:::`, or one per line
+ * from stdin. Children are tracked in the job table and reaped through it.
+ * Each child's stdout and stderr go to a file of its own, written out in one
+ * piece when it finishes, followed on stderr by its exit status and wall time.
+ *   -j N  Children at once; the number of online CPUs by default.
+ *   -k    Write outputs in the order of the items, not as children finish.
+ *   -q    Report only the items that failed.
+ * @return 0 if every item succeeded, else the number that failed, at most
+ *         101 as in GNU parallel; 130 once a child is killed by Ctrl+C, after
+ *         which no more are started.
+ */
+int builtin_parallel(char** args);
+
+#endif //PARALLEL_H
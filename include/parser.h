@@ -1,8 +1,148 @@
 #ifndef PARSER_H
 #define PARSER_H
 
-#define MAX_ARGS 64
+#include <stddef.h>
+#include "arena.h"
+#include "redirect.h"
 
-char** parse_input(char* input);
+/*
+ * The syntax tree of a command line or a whole script. Every node and string
+ * lives in the arena passed to parse_line(), so the whole tree is freed with
+ * arena_reset().
+ *
+ *   list       : and_or ((';' | '&' | newline) and_or)*
+ *   and_or     : pipeline (('&&' | '||') pipeline)*
+ *   pipeline   : ['!'] command ('|' command)*
+ *   command    : simple | compound redirection* | function
+ *   simple     : (word | redirection)+
+ *   compound   : '{' list '}' | '(' list ')'
+ *              | 'if' list 'then' list ('elif' list 'then' list)* ['else' list] 'fi'
+ *              | ('while' | 'until') list 'do' list 'done'
+ *              | 'for' name ['in' word*] (';' | newline) 'do' list 'done'
+ *              | 'case' word 'in' (['('] word ('|' word)* ')' list ';;')* 'esac'
+ *   function   : name '(' ')' compound | 'function' name ['(' ')'] compound
+ *   redirection: [n] ('<' | '>' | '>>') word
+ */
+
+struct CommandList;
+struct Command;
+
+enum CommandType {
+    COMMAND_SIMPLE,
+    COMMAND_GROUP,      // { list; }
+    COMMAND_SUBSHELL,   // ( list )
+    COMMAND_IF,
+    COMMAND_WHILE,
+    COMMAND_UNTIL,
+    COMMAND_FOR,
+    COMMAND_CASE,
+    COMMAND_FUNCTION    // A definition; running it defines the function
+};
+
+typedef struct IfClause {
+    struct CommandList* condition;
+    struct CommandList* then_part;
+    struct IfClause* elif;          // Tried when condition fails, or NULL
+    struct CommandList* else_part;  // Run when every condition fails, or NULL
+} IfClause;
+
+// while and until
+typedef struct {
+    struct CommandList* condition;
+    struct CommandList* body;
+} LoopClause;
+
+typedef struct {
+    const char* name;
+    char** words;                   // NULL without `in`, which loops over "$@"
+    int word_count;
+    struct CommandList* body;
+} ForClause;
+
+typedef struct CaseItem {
+    char** patterns;                // Words as written
+    int pattern_count;
+    struct CommandList* body;       // May be empty
+    struct CaseItem* next;
+} CaseItem;
+
+typedef struct {
+    const char* subject;            // Word as written
+    CaseItem* items;
+} CaseClause;
+
+typedef struct {
+    const char* name;
+    struct Command* body;           // A compound command
+    const char* text;               // The whole definition, as written
+} FunctionDef;
+
+// One stage of a pipeline
+typedef struct Command {
+    enum CommandType type;
+    char** words;               // Null-terminated, as written: quotes are still in place. Empty unless simple.
+    int word_count;
+    Redirection* redirs;        // Targets are words as written, expanded before use
+    int redir_count;
+    const char* text;           // Source text of a compound command, for the job table
+    union {
+        struct CommandList* list;   // COMMAND_GROUP and COMMAND_SUBSHELL
+        IfClause* if_clause;
+        LoopClause* loop;           // COMMAND_WHILE and COMMAND_UNTIL
+        ForClause* for_clause;
+        CaseClause* case_clause;
+        FunctionDef* function;
+    };
+    struct Command* next;       // Next stage of the pipeline
+} Command;
+
+// How a pipeline is joined to the one after it
+enum Connector {
+    CONNECT_NONE,
+    CONNECT_AND, // &&
+    CONNECT_OR   // ||
+};
+
+typedef struct Pipeline {
+    Command* commands;
+    int command_count;
+    int negated;                // Started with '!'
+    const char* text;           // Source text, for the job table
+    enum Connector connector;   // Joins this pipeline to next
+    struct Pipeline* next;
+} Pipeline;
+
+// Pipelines joined by && and ||, ended by ';', '&' or a newline
+typedef struct AndOrList {
+    Pipeline* pipelines;
+    int is_background;          // Ended by '&'
+    const char* text;           // Source text, for the job table
+    struct AndOrList* next;
+} AndOrList;
+
+typedef struct CommandList {
+    AndOrList* first;           // NULL for a blank line
+} CommandList;
+
+/**
+ * Tokenizes and parses a command line or a whole script in a single pass.
+ * Quotes and backslashes are understood, so operators inside them are plain
+ * text, and '#' starts a comment. Reserved words are only recognized where a
+ * command can start.
+ * @param line The text to parse; it is not modified and may be freed afterwards.
+ * @param arena Where the tree is allocated.
+ * @param incomplete If not NULL, and the text ends in the middle of a command
+ *        (an open quote, an `if` without `fi`, a trailing `|`...), *incomplete
+ *        is set to 1 and nothing is reported, so the caller can read more.
+ * @return The parsed list, or NULL on a syntax error (already reported).
+ */
+CommandList* parse_line(const char* line, Arena* arena, int* incomplete);
+
+/**
+ * Removes quotes and backslash escapes from a word as written.
+ * @param out Receives the result; strlen(raw) + 1 bytes are always enough.
+ * @return The length of the result.
+ */
+size_t unquote_word(const char* raw, char* out);
 
 #endif //PARSER_H
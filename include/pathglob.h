@@ -0,0 +1,55 @@
+#ifndef PATHGLOB_H
+#define PATHGLOB_H
+
+#include <stddef.h>
+
+// File names matched by a pattern, sorted
+typedef struct {
+    char** paths;
+    size_t count;
+    size_t capacity;
+} PathList;
+
+/**
+ * Matches a pattern against the file system. Supports *, ?, [...] (with ! or ^
+ * to negate) and ** as a whole component, which matches any number of
+ * directories. A backslash makes the next character literal. Names starting
+ * with '.' only match a pattern that starts with a literal '.'.
+ * Directory listings are cached until path_glob_clear_cache(), so patterns
+ * over the same directories read each one once.
+ * @param out Receives the matches; release it with free_path_list().
+ * @return The number of matches; 0 when nothing matched.
+ */
+size_t path_glob(const char* pattern, PathList* out);
+
+void free_path_list(PathList* list);
+
+/**
+ * Whether path_glob() would treat pattern as a pattern: it holds *, ?, or a [
+ * closed by a ] in the same component. Anything else, such as `[` or `x[1`,
+ * names a single file and needs no directory listing.
+ */
+int pattern_has_meta(const char* pattern);
+
+/**
+ * Matches a whole string against a pattern with the syntax of path_glob(),
+ * as case does. '/' and a leading '.' are ordinary characters here.
+ * @return 1 if it matches, 0 otherwise.
+ */
+int pattern_match(const char* pattern, const char* string);
+
+/**
+ * Drops the cached directory listings. The shell calls it after every command line.
+ */
+void path_glob_clear_cache();
+
+/**
+ * Sets how many threads read directory trees for **, as `set globthreads=N`
+ * does. 1 reads them in the calling thread. The initial value comes from $GLOB_THREADS.
+ * @return 0 on success, -1 if value is not a number from 1 to 64.
+ */
+int set_glob_threads(const char* value);
+
+int get_glob_threads();
+
+#endif //PATHGLOB_H
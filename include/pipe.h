@@ -1,6 +1,25 @@
 #ifndef PIPE_H
 #define PIPE_H
 
-void handle_pipe(char* input);
+#include "parser.h"
+
+/**
+ * Runs a pipeline of two or more commands as one job, each stage's stdout
+ * connected to the next one's stdin.
+ * @return The exit status of the last stage; 0 once a background pipeline has started.
+ */
+int handle_pipe(const Pipeline* pipeline, int is_background);
+
+/**
+ * Sets the capacity of every pipe handle_pipe() creates from now on, as
+ * `set pipebuf=SIZE` does. SIZE is a byte count with an optional K or M
+ * suffix; 0 or "default" leaves the kernel default (64 KiB).
+ * The initial value comes from $PIPE_BUFSIZE.
+ * @return 0 on success, -1 if value is not a valid size.
+ */
+int set_pipe_buffer_size(const char* value);
+
+// The configured pipe capacity in bytes, or 0 for the kernel default
+long get_pipe_buffer_size();
 
 #endif //PIPE_H
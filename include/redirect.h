@@ -2,13 +2,57 @@
 #define REDIRECT_H
 
 /**
- * Scans for and handles I/O redirection operators ('<', '>', '>>').
- * This function should be called in the child process before execvp.
- * It modifies the args array by setting redirection operators and filenames to NULL,
- * effectively removing them from the command's arguments.
- *
- * @param args The parsed command and arguments.
- */
-void handle_redirection(char** args);
+ * A single redirection of a command. The parser fills these in with the target
+ * word as written; the executor replaces path with the expanded file name.
+ * Nothing is opened until the command runs.
+ */
+typedef struct {
+    int fd;           // Descriptor being redirected: stdin, stdout, or the N of N>file
+    int flags;        // Flags to pass to open() for the target file
+    const char* path; // Target file name
+} Redirection;
+
+/**
+ * Opens every target in redirs and installs it on the corresponding descriptor.
+ * @return 0 on success, -1 if a file could not be opened (errno is reported).
+ */
+int apply_redirections(const Redirection* redirs, int count);
+
+// Returns 1 if any of the redirections replaces fd
+int redirects_fd(const Redirection* redirs, int count, int fd);
+
+#define SHELL_FD_BASE 10  // The shell's own descriptors live here and above, out of the range users redirect
+#define MAX_SAVED_FDS 16  // Distinct descriptors one command run in the shell can redirect
+
+/**
+ * The shell's descriptors that redirect_shell_fds() replaced, in the order it
+ * saved them. A descriptor that was closed before is closed again on restore.
+ */
+typedef struct {
+    int count;
+    int fds[MAX_SAVED_FDS];
+    int copies[MAX_SAVED_FDS]; // Where each was moved, or -1 if it was not open
+} SavedFds;
+
+/**
+ * Applies redirections to the shell's own descriptors, so a built-in can run
+ * with them in place. Every descriptor that gets replaced is saved first, so
+ * `pwd 4>file` leaves the shell's descriptor 4 as it was.
+ * @param stdin_fd Descriptor to install as stdin before the redirections, or -1.
+ * @param saved Receives what restore_shell_fds() needs to put them back.
+ * @return 0 on success, -1 on failure (already reported, nothing left changed).
+ */
+int redirect_shell_fds(int stdin_fd, const Redirection* redirs, int count, SavedFds* saved);
+
+// Puts back the descriptors saved by redirect_shell_fds()
+void restore_shell_fds(SavedFds* saved);
+
+/**
+ * Moves a descriptor the shell keeps open for good (the signalfd, epoll,
+ * inotify, the history file) to SHELL_FD_BASE or above, close-on-exec, so
+ * that a command's `3>file` never lands on it.
+ * @return The new descriptor; fd itself if it is negative, already high enough, or cannot be moved.
+ */
+int move_shell_fd(int fd);
 
 #endif //REDIRECT_H
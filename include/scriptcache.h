@@ -0,0 +1,36 @@
+#ifndef SCRIPTCACHE_H
+#define SCRIPTCACHE_H
+
+#include <stddef.h>
+#include "parser.h"
+
+enum ScriptCacheResult {
+    SCRIPT_CACHE_OFF,   // --no-script-cache, or not a regular file
+    SCRIPT_CACHE_HIT,
+    SCRIPT_CACHE_MISS
+};
+
+typedef struct {
+    enum ScriptCacheResult result;
+    int stored;             // A new entry was written after a miss
+    size_t image_size;      // Bytes of flattened tree loaded or stored
+    size_t pointer_count;   // Pointers relocated or recorded
+    double elapsed_ms;      // Loading the entry, or reading, parsing and storing
+} ScriptCacheStats;
+
+/**
+ * Returns the syntax tree of the script at path. Parsed scripts are stored
+ * flattened (see astimage.h) in $XDG_CACHE_HOME/myshell, or ~/.cache/myshell,
+ * under the script's device and inode. An entry is used only while the
+ * script's mtime and size are unchanged; it is mapped and relocated in place,
+ * so nothing is lexed or parsed. A script modified in the last two seconds is
+ * not stored, since a second change within the same mtime would go unnoticed.
+ * The tree lives until the process exits.
+ * @param use_cache 0 to always parse, and store nothing.
+ * @param list Receives the tree, or NULL on a syntax error (already reported).
+ * @param stats Receives what happened; may be NULL.
+ * @return 0, or -1 if the script cannot be read (already reported).
+ */
+int load_script(const char* path, int use_cache, CommandList** list, ScriptCacheStats* stats);
+
+#endif //SCRIPTCACHE_H
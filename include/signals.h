@@ -1,6 +1,29 @@
 #ifndef SIGNALS_H
 #define SIGNALS_H
 
+#define SIGNAL_BIT(signo) (1u << (signo))
+
+/**
+ * Blocks SIGCHLD, SIGINT and SIGWINCH and routes them to a signalfd.
+ * Call after init_job_control().
+ */
 void setup_signal_handlers();
 
+// The signalfd, for the event loop to poll; -1 if it could not be created
+int get_signal_fd();
+
+/**
+ * Drains the signalfd without blocking.
+ * @return A mask of SIGNAL_BIT(signo) for every signal that arrived.
+ */
+unsigned int read_pending_signals();
+
+/**
+ * Consumes a SIGINT that arrived while the shell itself was busy, such as
+ * between the commands of a loop, and leaves every other signal queued for
+ * the event loop.
+ * @return 1 if there was one, 0 otherwise.
+ */
+int take_pending_interrupt();
+
 #endif //SIGNALS_H
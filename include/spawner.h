@@ -0,0 +1,58 @@
+#ifndef SPAWNER_H
+#define SPAWNER_H
+
+#include <sys/types.h>
+#include "redirect.h"
+
+enum SpawnEngine {
+    SPAWN_ENGINE_POSIX, // posix_spawn (clone(CLONE_VM|CLONE_VFORK) in glibc)
+    SPAWN_ENGINE_FORK   // Classic fork() + execvp()
+};
+
+/**
+ * Everything needed to launch one external command.
+ * The child gets default job-control signal dispositions and an empty signal mask.
+ */
+typedef struct {
+    char** argv;              // Command and arguments, redirections already removed
+    pid_t pgid;               // Process group to join; 0 starts a new group led by the child
+    int stdin_fd;             // Descriptor to install as stdin, or -1 to inherit
+    int stdout_fd;            // Descriptor to install as stdout, or -1 to inherit
+    const int* close_fds;     // Extra descriptors the child must not keep open
+    int close_count;
+    const Redirection* redirs; // Redirections applied after the pipe descriptors
+    int redir_count;
+    int tty_fd;               // Terminal to hand to the new group, or -1 for background
+} SpawnRequest;
+
+/**
+ * Launches a command described by req.
+ * argv[0] is resolved through the command hash (see cmdhash.h) unless it contains a '/'.
+ * Uses posix_spawn by default and falls back to fork() when posix_spawn cannot
+ * express the request. The engine can be forced with MYSHELL_SPAWN=fork|spawn.
+ * @return The child's pid, or -1 if the command could not be started (already reported).
+ */
+pid_t spawn_command(const SpawnRequest* req);
+
+/**
+ * Runs fn(ctx) in a forked copy of the shell, set up exactly as an external
+ * command would be, but without exec. The child exits with fn's return value.
+ * Used for built-ins inside a pipeline that cannot run in the shell itself,
+ * and for command lists run in the background. req->argv is not used.
+ * @return The child's pid, or -1 if fork failed (already reported).
+ */
+pid_t spawn_subshell(const SpawnRequest* req, int (*fn)(void* ctx), void* ctx);
+
+/**
+ * Replaces the shell with the command described by req, as its last act:
+ * the signal dispositions and mask are reset, req's descriptors and
+ * redirections applied, and the command exec'd in the shell's own process.
+ * req->pgid and req->tty_fd are not used.
+ * @return Only on failure (already reported): 127 if the command was not
+ *         found, 126 if it could not be run, 1 if a redirection failed.
+ */
+int exec_command(const SpawnRequest* req);
+
+void set_spawn_engine(enum SpawnEngine engine);
+
+#endif //SPAWNER_H
@@ -0,0 +1,36 @@
+#ifndef TEXT_H
+#define TEXT_H
+
+#include <stddef.h>
+
+/**
+ * A growable string. A zeroed Buffer is empty and ready; once anything is
+ * added, data is NUL-terminated. The caller frees data. Running out of
+ * memory exits, as everywhere in the shell.
+ */
+typedef struct {
+    char* data;
+    size_t len;
+    size_t cap;
+} Buffer;
+
+// Makes room for extra more bytes and the NUL
+void buffer_reserve(Buffer* b, size_t extra);
+
+void buffer_append(Buffer* b, const char* s, size_t len);
+
+void buffer_putc(Buffer* b, char c);
+
+// Empties b, allocating it if needed, so that data is always a string
+void buffer_reset(Buffer* b);
+
+// The words joined with single spaces, in a malloc()ed string, as the job table and `queue` store a command line
+char* join_args(char** argv);
+
+// FNV-1a over len bytes: the hash every table of the shell uses
+size_t hash_bytes(const char* data, size_t len);
+
+// hash_bytes() of a NUL-terminated string
+size_t hash_string(const char* s);
+
+#endif //TEXT_H
@@ -0,0 +1,46 @@
+#ifndef UTILITIES_H
+#define UTILITIES_H
+
+/*
+ * POSIX utilities that scripts run constantly, built in so that each use
+ * costs a function call instead of a fork and an exec. They print through
+ * stdio, like the other built-ins; spawning a command flushes stdout first,
+ * so their output keeps its place among that of external commands.
+ */
+
+// echo [-neE] [arg...]: -n drops the newline, -e decodes backslash escapes (\n, \t, \0nnn, \xHH, \c)
+int builtin_echo(char** args);
+
+/**
+ * printf format [arguments]: %d %i %o %u %x %X, %e %f %g %a, %s %c, and %b
+ * (the argument with escapes decoded), with flags, width and precision, `*`
+ * included. The format is reused until every argument is consumed.
+ * @return 1 if an argument was not a valid number, 0 otherwise.
+ */
+int builtin_printf(char** args);
+
+/**
+ * test expr and [ expr ]: the file tests (-e -f -d -r -w -x -s -L ...),
+ * string tests (-z -n = != < >), integer comparisons (-eq -ne -lt -le -gt
+ * -ge), -nt -ot -ef, and ! ( ) -a -o. Up to four arguments are read as POSIX
+ * specifies, by their number.
+ * @return 0 if true, 1 if false, 2 on a syntax error.
+ */
+int builtin_test(char** args);
+
+int builtin_true(char** args);
+int builtin_false(char** args);
+
+/**
+ * read [-r] [-p prompt] [name...]: reads one line of stdin, splits it on $IFS
+ * and assigns the fields, the last name taking the rest; without names the
+ * whole line goes to REPLY. Never reads past the newline, so the next command
+ * gets the rest of the input. Ctrl+C at the terminal interrupts it.
+ * @return 0, 1 at the end of input, 130 if interrupted.
+ */
+int builtin_read(char** args);
+
+// type [-t] name...: whether each name is an alias, keyword, function, built-in or file, and which
+int builtin_type(char** args);
+
+#endif //UTILITIES_H
@@ -0,0 +1,20 @@
+#ifndef VARIABLES_H
+#define VARIABLES_H
+
+/*
+ * Shell variables live in the environment, so every command started sees
+ * them. They are set here rather than with setenv(), which keeps every value
+ * it ever allocated: a loop assigning a counter would grow without bound.
+ * Each string installed here is freed as soon as it is replaced or unset.
+ */
+
+/**
+ * Sets name to value, as `name=value` does.
+ * @return 0 on success, -1 if name is empty or contains '=' (already reported).
+ */
+int set_variable(const char* name, const char* value);
+
+// Removes name from the environment, as `unset name` does
+void unset_variable(const char* name);
+
+#endif //VARIABLES_H
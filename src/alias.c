@@ -2,98 +2,475 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "text.h"
 
-#define MAX_ALIASES 50
+#define INITIAL_BUCKETS 64
 
-typedef struct {
+typedef struct Alias {
     char* name;
     char* value;
+    char* expanded;                 // value with its own aliases expanded, from a top-level expansion
+    unsigned long expanded_generation;
+    int expanding;                  // Inside its own expansion: a cycle if its name comes up again
+    struct Alias* next;             // Next in the same bucket
 } Alias;
 
-static Alias alias_list[MAX_ALIASES];
-static int alias_count = 0;
+static Alias** buckets = NULL;
+static size_t bucket_count = 0;
+static size_t alias_count = 0;
+static unsigned long generation = 1;  // Changes with every definition, so memos know they are stale
+static char alias_path[1024];
+static pid_t alias_owner = 0;         // Only the shell that loaded the file writes it back
 
-void print_aliases() {
-    for (int i = 0; i < alias_count; i++) {
-        printf("alias %s='%s'\n", alias_list[i].name, alias_list[i].value);
+// Words after which the next word is a command again
+static const char* command_keywords[] = { "if", "then", "elif", "else", "while", "until", "do", "{", "!", NULL };
+
+// --- The table ---
+
+static Alias* find_alias(const char* name, size_t len) {
+    if (bucket_count == 0) {
+        return NULL;
+    }
+    for (Alias* a = buckets[hash_bytes(name, len) & (bucket_count - 1)]; a != NULL; a = a->next) {
+        if (strncmp(a->name, name, len) == 0 && a->name[len] == '\0') {
+            return a;
+        }
     }
+    return NULL;
 }
 
-void builtin_alias(char** args) {
-    if (args[1] == NULL) {
-        print_aliases();
+static void grow_buckets() {
+    size_t count = bucket_count ? bucket_count * 2 : INITIAL_BUCKETS;
+    Alias** grown = calloc(count, sizeof(Alias*));
+    if (!grown) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t b = 0; b < bucket_count; b++) {
+        while (buckets[b] != NULL) {
+            Alias* a = buckets[b];
+            buckets[b] = a->next;
+            size_t slot = hash_string(a->name) & (count - 1);
+            a->next = grown[slot];
+            grown[slot] = a;
+        }
+    }
+    free(buckets);
+    buckets = grown;
+    bucket_count = count;
+}
+
+static void define_alias(const char* name, const char* value) {
+    generation++;
+    Alias* a = find_alias(name, strlen(name));
+    if (a != NULL) {
+        free(a->value);
+        a->value = strdup(value);
         return;
     }
+    if (alias_count + 1 > bucket_count) {
+        grow_buckets();
+    }
+    a = calloc(1, sizeof(Alias));
+    if (!a) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    a->name = strdup(name);
+    a->value = strdup(value);
+    size_t slot = hash_string(name) & (bucket_count - 1);
+    a->next = buckets[slot];
+    buckets[slot] = a;
+    alias_count++;
+}
 
-    char* eq_pos = strchr(args[1], '=');
-    if (eq_pos == NULL) {
-        // Just print the specific alias
-        for (int i = 0; i < alias_count; i++) {
-            if (strcmp(alias_list[i].name, args[1]) == 0) {
-                printf("alias %s='%s'\n", alias_list[i].name, alias_list[i].value);
-                return;
-            }
+static int remove_alias(const char* name) {
+    if (bucket_count == 0) {
+        return -1;
+    }
+    Alias** link = &buckets[hash_string(name) & (bucket_count - 1)];
+    for (; *link != NULL; link = &(*link)->next) {
+        if (strcmp((*link)->name, name) == 0) {
+            Alias* a = *link;
+            *link = a->next;
+            free(a->name);
+            free(a->value);
+            free(a->expanded);
+            free(a);
+            alias_count--;
+            generation++;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int compare_names(const void* x, const void* y) {
+    return strcmp((*(Alias* const*)x)->name, (*(Alias* const*)y)->name);
+}
+
+// Every alias, sorted by name as bash lists them; the caller frees the array
+static Alias** sorted_aliases() {
+    Alias** list = malloc((alias_count + 1) * sizeof(Alias*));
+    if (!list) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    size_t n = 0;
+    for (size_t b = 0; b < bucket_count; b++) {
+        for (Alias* a = buckets[b]; a != NULL; a = a->next) {
+            list[n++] = a;
+        }
+    }
+    qsort(list, n, sizeof(Alias*), compare_names);
+    return list;
+}
+
+// `alias name='value'`, with quotes in value escaped so the line can be read back
+static void write_alias(FILE* f, const Alias* a) {
+    fprintf(f, "alias %s='", a->name);
+    for (const char* p = a->value; *p; p++) {
+        if (*p == '\'') {
+            fputs("'\\''", f);
+        } else {
+            fputc(*p, f);
         }
+    }
+    fputs("'\n", f);
+}
+
+// --- The startup file ---
+
+// Rewrites the file through a temporary one, so a crash never leaves it half written
+static void save_aliases() {
+    if (alias_owner != getpid()) {
         return;
     }
-    
-    // Define a new alias
-    if (alias_count >= MAX_ALIASES) {
-        fprintf(stderr, "alias: Too many aliases defined.\n");
+    char temp_path[sizeof(alias_path) + 8];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", alias_path);
+    FILE* f = fopen(temp_path, "w");
+    if (f == NULL) {
+        perror(temp_path);
         return;
     }
+    Alias** list = sorted_aliases();
+    for (size_t i = 0; i < alias_count; i++) {
+        write_alias(f, list[i]);
+    }
+    free(list);
+    if (fclose(f) != 0 || rename(temp_path, alias_path) < 0) {
+        perror(alias_path);
+        unlink(temp_path);
+    }
+}
+
+// Removes the quotes of the word at p in place, which may span lines inside
+// quotes. Returns the end of what is left; *rest is set to where the word ended.
+static char* unquote_word(char* p, char** rest) {
+    char* out = p;
+    while (*p && *p != '\n' && *p != ' ' && *p != '\t') {
+        if (*p == '\'') {
+            for (p++; *p && *p != '\''; ) *out++ = *p++;
+            if (*p) p++;
+        } else if (*p == '"') {
+            for (p++; *p && *p != '"'; ) {
+                if (*p == '\\' && (p[1] == '"' || p[1] == '\\' || p[1] == '$')) p++;
+                *out++ = *p++;
+            }
+            if (*p) p++;
+        } else if (*p == '\\' && p[1] != '\0') {
+            *out++ = p[1];
+            p += 2;
+        } else {
+            *out++ = *p++;
+        }
+    }
+    *rest = p;
+    return out;
+}
 
-    *eq_pos = '\0'; // Split the string at '='
-    char* name = args[1];
-    char* value = eq_pos + 1;
+void load_aliases() {
+    char* home_dir = getenv("HOME");
+    if (home_dir == NULL) {
+        return;
+    }
+    snprintf(alias_path, sizeof(alias_path), "%s/%s", home_dir, ALIAS_FILE);
+    alias_owner = getpid();
 
-    // Remove quotes if present
-    if (*value == '\'' || *value == '"') {
-        value++;
-        char* end_quote = strrchr(value, *value == '\'' ? '\'' : '"');
-        if (end_quote) *end_quote = '\0';
+    int fd = open(alias_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    // The whole file in one read, however many aliases it holds
+    struct stat st;
+    char* data = fstat(fd, &st) == 0 ? malloc(st.st_size + 1) : NULL;
+    ssize_t n = data ? read(fd, data, st.st_size) : -1;
+    close(fd);
+    if (n < 0) {
+        perror(alias_path);
+        free(data);
+        return;
     }
+    data[n] = '\0';
 
-    // Check if alias already exists to overwrite it
-    for (int i = 0; i < alias_count; i++) {
-        if (strcmp(alias_list[i].name, name) == 0) {
-            free(alias_list[i].value);
-            alias_list[i].value = strdup(value);
-            return;
+    // Lines as `alias` prints them: alias name='value'
+    char* line = data;
+    while (*line) {
+        line += strspn(line, " \t");
+        if (strncmp(line, "alias ", 6) == 0) {
+            line += 6 + strspn(line + 6, " \t");
         }
+        size_t name_len = strcspn(line, "=\n");
+        char* rest = line + name_len;
+        if (*line != '#' && name_len > 0 && line[name_len] == '=') {
+            line[name_len] = '\0';
+            char* end = unquote_word(line + name_len + 1, &rest);
+            char saved = *rest;
+            *end = '\0';
+            define_alias(line, line + name_len + 1);
+            *rest = saved; // Unquoted, the value ends where the word does
+        }
+        rest += strcspn(rest, "\n");
+        line = *rest ? rest + 1 : rest;
     }
+    free(data);
+}
 
-    // Add new alias
-    alias_list[alias_count].name = strdup(name);
-    alias_list[alias_count].value = strdup(value);
-    alias_count++;
+// --- Expansion ---
+
+static void expand_text(const char* text, Buffer* out, int depth);
+
+static int is_keyword(const char* word, size_t len) {
+    for (int i = 0; command_keywords[i]; i++) {
+        if (strlen(command_keywords[i]) == len && strncmp(command_keywords[i], word, len) == 0) {
+            return 1;
+        }
+    }
+    return 0;
 }
 
-void builtin_unalias(char** args) {
-    if (args[1] == NULL) {
-        fprintf(stderr, "unalias: usage: unalias <alias_name>\n");
+// NAME=value before a command leaves the next word in command position
+static int is_assignment(const char* word, size_t len) {
+    size_t i = 0;
+    while (i < len && (word[i] == '_' || (word[i] >= 'a' && word[i] <= 'z') || (word[i] >= 'A' && word[i] <= 'Z') ||
+                       (i > 0 && word[i] >= '0' && word[i] <= '9'))) {
+        i++;
+    }
+    return i > 0 && i < len && word[i] == '=';
+}
+
+// Whether what follows text is in command position: after a blank (the
+// trailing-space rule) or after an operator that ends a command
+static int ends_at_command_start(const Buffer* out, size_t from) {
+    if (out->len == from) {
+        return 1;
+    }
+    return strchr(" \t\n;&|(", out->data[out->len - 1]) != NULL;
+}
+
+static void expand_alias(Alias* a, Buffer* out, int depth) {
+    // A top-level expansion never depends on what is being expanded around it
+    if (depth == 0 && a->expanded != NULL && a->expanded_generation == generation) {
+        buffer_append(out, a->expanded, strlen(a->expanded));
         return;
     }
+    size_t start = out->len;
+    a->expanding = 1;
+    expand_text(a->value, out, depth + 1);
+    a->expanding = 0;
+    if (depth == 0) {
+        free(a->expanded);
+        a->expanded = strndup(out->data + start, out->len - start);
+        a->expanded_generation = generation;
+    }
+}
 
-    for (int i = 0; i < alias_count; i++) {
-        if (strcmp(alias_list[i].name, args[1]) == 0) {
-            free(alias_list[i].name);
-            free(alias_list[i].value);
-            // Shift remaining aliases down
-            for (int j = i; j < alias_count - 1; j++) {
-                alias_list[j] = alias_list[j+1];
+// Where the word at p ends: quotes, escapes and $(...) / ${...} are skipped
+// whole. *quoted is set if any part of it was quoted, so it is no alias name.
+static const char* word_end(const char* p, int* quoted) {
+    *quoted = 0;
+    while (*p && !strchr(" \t\n;&|()<>", *p)) {
+        if (*p == '\\' && p[1] != '\0') {
+            *quoted = 1;
+            p += 2;
+        } else if (*p == '\'' || *p == '"') {
+            char quote = *p++;
+            *quoted = 1;
+            while (*p && *p != quote) {
+                if (quote == '"' && *p == '\\' && p[1] != '\0') p++;
+                p++;
             }
-            alias_count--;
-            return;
+            if (*p) p++;
+        } else if (*p == '$' && (p[1] == '(' || p[1] == '{')) {
+            char open = p[1], close = open == '(' ? ')' : '}';
+            int nesting = 1;
+            *quoted = 1;
+            for (p += 2; *p && nesting > 0; p++) {
+                if (*p == open) nesting++;
+                else if (*p == close) nesting--;
+            }
+        } else {
+            p++;
         }
     }
+    return p;
 }
 
-char* expand_alias(const char* command_name) {
-    for (int i = 0; i < alias_count; i++) {
-        if (strcmp(alias_list[i].name, command_name) == 0) {
-            return strdup(alias_list[i].value);
+// Copies text to out with the aliases of every word in command position
+// expanded: the first word, words after ; & | ( and newlines, after keywords
+// such as `then`, and after an alias whose value ends in a blank
+static void expand_text(const char* text, Buffer* out, int depth) {
+    size_t start = out->len;
+    int command_position = 1;
+    const char* p = text;
+    while (*p) {
+        if (*p == ' ' || *p == '\t') {
+            buffer_append(out, p++, 1);
+            continue;
+        }
+        if (*p == '#' && (p == text || p[-1] == ' ' || p[-1] == '\t' || p[-1] == '\n')) {
+            // A comment, to the end of its line
+            size_t len = strcspn(p, "\n");
+            buffer_append(out, p, len);
+            p += len;
+            continue;
+        }
+        if (strchr("\n;&|()", *p)) {
+            buffer_append(out, p++, 1);
+            command_position = 1;
+            continue;
+        }
+        if (*p == '<' || *p == '>') {
+            // A redirection: its target is no command
+            size_t len = 1 + strspn(p + 1, "<>&|-");
+            buffer_append(out, p, len);
+            p += len;
+            command_position = 0;
+            continue;
+        }
+
+        int quoted;
+        const char* end = word_end(p, &quoted);
+        size_t len = end - p;
+        if (command_position && !quoted) {
+            if (is_keyword(p, len) || is_assignment(p, len)) {
+                buffer_append(out, p, len);
+                p = end;
+                continue;
+            }
+            Alias* a = find_alias(p, len);
+            if (a != NULL && !a->expanding) {
+                expand_alias(a, out, depth);
+                command_position = ends_at_command_start(out, start);
+                p = end;
+                continue;
+            }
+        }
+        buffer_append(out, p, len);
+        p = end;
+        command_position = 0;
+    }
+}
+
+char* expand_aliases(const char* line) {
+    if (alias_count == 0) {
+        return NULL;
+    }
+    Buffer out = { 0 };
+    expand_text(line, &out, 0);
+    if (out.data == NULL || strcmp(out.data, line) == 0) {
+        free(out.data);
+        return NULL;
+    }
+    return out.data;
+}
+
+// --- Built-ins ---
+
+int builtin_alias(char** args) {
+    if (args[1] == NULL || (strcmp(args[1], "-p") == 0 && args[2] == NULL)) {
+        Alias** list = sorted_aliases();
+        for (size_t i = 0; i < alias_count; i++) {
+            write_alias(stdout, list[i]);
+        }
+        free(list);
+        return 0;
+    }
+
+    int status = 0, changed = 0;
+    for (int i = 1; args[i]; i++) {
+        char* eq_pos = strchr(args[i], '=');
+        if (eq_pos == NULL) {
+            // Just print the specific alias
+            Alias* a = find_alias(args[i], strlen(args[i]));
+            if (a == NULL) {
+                fprintf(stderr, "alias: %s: not found\n", args[i]);
+                status = 1;
+            } else {
+                write_alias(stdout, a);
+            }
+            continue;
+        }
+        if (eq_pos == args[i] || strcspn(args[i], " \t\n;&|()<>'\"\\$`/") < (size_t)(eq_pos - args[i])) {
+            fprintf(stderr, "alias: %.*s: invalid alias name\n", (int)(eq_pos - args[i]), args[i]);
+            status = 1;
+            continue;
+        }
+
+        *eq_pos = '\0'; // Split the string at '='
+        define_alias(args[i], eq_pos + 1);
+        *eq_pos = '=';
+        changed = 1;
+    }
+    if (changed) {
+        save_aliases();
+    }
+    return status;
+}
+
+int builtin_unalias(char** args) {
+    if (args[1] == NULL) {
+        fprintf(stderr, "unalias: usage: unalias [-a] name [name ...]\n");
+        return 1;
+    }
+    if (strcmp(args[1], "-a") == 0) {
+        Alias** list = sorted_aliases();
+        size_t count = alias_count;
+        for (size_t i = 0; i < count; i++) {
+            remove_alias(list[i]->name);
+        }
+        free(list);
+        save_aliases();
+        return 0;
+    }
+
+    int status = 0, changed = 0;
+    for (int i = 1; args[i]; i++) {
+        if (remove_alias(args[i]) < 0) {
+            fprintf(stderr, "unalias: %s: not found\n", args[i]);
+            status = 1;
+        } else {
+            changed = 1;
+        }
+    }
+    if (changed) {
+        save_aliases();
+    }
+    return status;
+}
+
+const char* lookup_alias(const char* name) {
+    Alias* a = find_alias(name, strlen(name));
+    return a ? a->value : NULL;
+}
+
+void for_each_alias(void (*fn)(const char* name, const char* value, void* ctx), void* ctx) {
+    for (size_t b = 0; b < bucket_count; b++) {
+        for (Alias* a = buckets[b]; a != NULL; a = a->next) {
+            fn(a->name, a->value, ctx);
         }
     }
-    return NULL;
 }
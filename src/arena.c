@@ -0,0 +1,72 @@
+#include "arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdalign.h>
+
+#define ARENA_BLOCK_SIZE 4096 // A typical command line fits in the first block
+
+struct ArenaBlock {
+    ArenaBlock* next;
+    size_t size; // Usable bytes in data
+    size_t used;
+    alignas(max_align_t) unsigned char data[];
+};
+
+static ArenaBlock* new_block(size_t size, ArenaBlock* next) {
+    ArenaBlock* block = malloc(sizeof(ArenaBlock) + size);
+    if (!block) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    block->next = next;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+void* arena_alloc(Arena* arena, size_t size) {
+    const size_t align = alignof(max_align_t);
+    size = (size + align - 1) & ~(align - 1);
+
+    ArenaBlock* block = arena->head;
+    if (block == NULL || block->size - block->used < size) {
+        // Oversized requests get a block of their own
+        block = new_block(size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE, arena->head);
+        arena->head = block;
+    }
+
+    void* ptr = block->data + block->used;
+    block->used += size;
+    return ptr;
+}
+
+char* arena_strndup(Arena* arena, const char* s, size_t len) {
+    char* copy = arena_alloc(arena, len + 1);
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+void arena_reset(Arena* arena) {
+    ArenaBlock* block = arena->head;
+    if (block == NULL) {
+        return;
+    }
+    // Keep the oldest block, which is the standard size
+    while (block->next != NULL) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    block->used = 0;
+    arena->head = block;
+}
+
+void arena_free(Arena* arena) {
+    while (arena->head != NULL) {
+        ArenaBlock* next = arena->head->next;
+        free(arena->head);
+        arena->head = next;
+    }
+}
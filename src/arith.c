@@ -0,0 +1,265 @@
+#include "arith.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "variables.h"
+
+#define MAX_NAME 256
+
+typedef struct {
+    const char* expr;   // The whole expression, for error messages
+    const char* pos;
+    int skip;           // Inside the branch && || or ?: does not take: no side effects
+    int failed;
+} ArithParser;
+
+// Binary operators, longest first so that << is not read as <
+static const struct {
+    const char* op;
+    int prec;
+} binary_ops[] = {
+    { "||", 1 }, { "&&", 2 }, { "==", 6 }, { "!=", 6 }, { "<=", 7 }, { ">=", 7 },
+    { "<<", 8 }, { ">>", 8 }, { "|", 3 }, { "^", 4 }, { "&", 5 }, { "<", 7 }, { ">", 7 },
+    { "+", 9 }, { "-", 9 }, { "**", 11 }, { "*", 10 }, { "/", 10 }, { "%", 10 },
+};
+
+static void skip_blanks(ArithParser* a) {
+    while (isspace((unsigned char)*a->pos)) a->pos++;
+}
+
+static void arith_error(ArithParser* a, const char* message) {
+    if (!a->failed) {
+        fprintf(stderr, "%s: %s (error token is \"%s\")\n", a->expr, message, a->pos);
+        a->failed = 1;
+    }
+}
+
+// Reads a variable name at a->pos into name; returns its length, 0 if there is none
+static size_t read_name(ArithParser* a, char name[MAX_NAME]) {
+    const char* s = a->pos;
+    if (!isalpha((unsigned char)*s) && *s != '_') {
+        return 0;
+    }
+    size_t len = 0;
+    while ((isalnum((unsigned char)s[len]) || s[len] == '_') && len < MAX_NAME - 1) {
+        name[len] = s[len];
+        len++;
+    }
+    name[len] = '\0';
+    return len;
+}
+
+static long get_variable(const char* name) {
+    const char* value = getenv(name);
+    return value ? strtol(value, NULL, 0) : 0;
+}
+
+static void assign_variable(ArithParser* a, const char* name, long value) {
+    if (a->skip) {
+        return;
+    }
+    char text[32];
+    snprintf(text, sizeof(text), "%ld", value);
+    set_variable(name, text);
+}
+
+static long apply(ArithParser* a, const char* op, long lhs, long rhs) {
+    switch (op[0]) {
+        case '+': return lhs + rhs;
+        case '-': return lhs - rhs;
+        case '*':
+            if (op[1] == '*') {
+                if (rhs < 0) {
+                    if (!a->skip) arith_error(a, "exponent less than 0");
+                    return 0;
+                }
+                long power = 1;
+                for (; rhs > 0; rhs >>= 1, lhs *= lhs) {
+                    if (rhs & 1) power *= lhs;
+                }
+                return power;
+            }
+            return lhs * rhs;
+        case '/':
+        case '%':
+            if (rhs == 0) {
+                if (!a->skip) arith_error(a, "division by 0");
+                return 0;
+            }
+            return op[0] == '/' ? lhs / rhs : lhs % rhs;
+        case '^': return lhs ^ rhs;
+        case '=': return lhs == rhs;
+        case '!': return lhs != rhs;
+        case '|': return op[1] == '|' ? (lhs || rhs) : (lhs | rhs);
+        case '&': return op[1] == '&' ? (lhs && rhs) : (lhs & rhs);
+        case '<':
+            if (op[1] == '<') return lhs << rhs;
+            return op[1] == '=' ? lhs <= rhs : lhs < rhs;
+        case '>':
+            if (op[1] == '>') return lhs >> rhs;
+            return op[1] == '=' ? lhs >= rhs : lhs > rhs;
+    }
+    return 0;
+}
+
+static long parse_assignment(ArithParser* a);
+
+static long parse_unary(ArithParser* a) {
+    skip_blanks(a);
+    char c = *a->pos;
+    char name[MAX_NAME];
+
+    // Prefix ++ and -- change the variable first
+    if ((c == '+' || c == '-') && a->pos[1] == c) {
+        a->pos += 2;
+        skip_blanks(a);
+        size_t len = read_name(a, name);
+        if (len == 0) {
+            arith_error(a, "operand expected");
+            return 0;
+        }
+        a->pos += len;
+        long value = get_variable(name) + (c == '+' ? 1 : -1);
+        assign_variable(a, name, value);
+        return value;
+    }
+    if (c == '+' || c == '-' || c == '!' || c == '~') {
+        a->pos++;
+        long value = parse_unary(a);
+        return c == '-' ? -value : c == '!' ? !value : c == '~' ? ~value : value;
+    }
+    if (c == '(') {
+        a->pos++;
+        long value = parse_assignment(a);
+        skip_blanks(a);
+        if (*a->pos != ')') {
+            arith_error(a, "missing `)'");
+            return 0;
+        }
+        a->pos++;
+        return value;
+    }
+    if (isdigit((unsigned char)c)) {
+        char* end;
+        long value = strtol(a->pos, &end, 0);
+        if (isalnum((unsigned char)*end) || *end == '_') {
+            a->pos = end;
+            arith_error(a, "value too great for base");
+            return 0;
+        }
+        a->pos = end;
+        return value;
+    }
+
+    size_t len = read_name(a, name);
+    if (len == 0) {
+        arith_error(a, "operand expected");
+        return 0;
+    }
+    a->pos += len;
+    long value = get_variable(name);
+
+    // Postfix ++ and -- return the old value
+    skip_blanks(a);
+    if ((a->pos[0] == '+' || a->pos[0] == '-') && a->pos[1] == a->pos[0]) {
+        assign_variable(a, name, value + (a->pos[0] == '+' ? 1 : -1));
+        a->pos += 2;
+    }
+    return value;
+}
+
+// Precedence climbing over the binary operators
+static long parse_binary(ArithParser* a, int min_prec) {
+    long lhs = parse_unary(a);
+
+    while (!a->failed) {
+        skip_blanks(a);
+        size_t i, count = sizeof(binary_ops) / sizeof(binary_ops[0]);
+        size_t len = 0;
+        for (i = 0; i < count; i++) {
+            len = strlen(binary_ops[i].op);
+            if (strncmp(a->pos, binary_ops[i].op, len) == 0) {
+                break;
+            }
+        }
+        // Stop at the end, at a lower-precedence operator, and before an assignment such as +=
+        if (i == count || binary_ops[i].prec < min_prec ||
+            (a->pos[len] == '=' && binary_ops[i].op[len - 1] != '=')) {
+            break;
+        }
+        const char* op = binary_ops[i].op;
+        a->pos += len;
+
+        // The right side of && and || is only evaluated when it matters
+        int short_circuit = (strcmp(op, "&&") == 0 && !lhs) || (strcmp(op, "||") == 0 && lhs);
+        a->skip += short_circuit;
+        // ** groups to the right, everything else to the left
+        long rhs = parse_binary(a, binary_ops[i].prec + (strcmp(op, "**") != 0));
+        a->skip -= short_circuit;
+        lhs = apply(a, op, lhs, rhs);
+    }
+    return lhs;
+}
+
+static long parse_ternary(ArithParser* a) {
+    long condition = parse_binary(a, 1);
+    skip_blanks(a);
+    if (*a->pos != '?') {
+        return condition;
+    }
+    a->pos++;
+
+    a->skip += !condition;
+    long if_true = parse_assignment(a);
+    a->skip -= !condition;
+    skip_blanks(a);
+    if (*a->pos != ':') {
+        arith_error(a, "`:' expected for conditional expression");
+        return 0;
+    }
+    a->pos++;
+    a->skip += !!condition;
+    long if_false = parse_ternary(a);
+    a->skip -= !!condition;
+    return condition ? if_true : if_false;
+}
+
+static long parse_assignment(ArithParser* a) {
+    skip_blanks(a);
+    char name[MAX_NAME];
+    size_t len = read_name(a, name);
+    if (len > 0) {
+        // name followed by =, +=, <<= and the like
+        const char* s = a->pos + len;
+        while (isspace((unsigned char)*s)) s++;
+        size_t op_len = strspn(s, "+-*/%<>&^|");
+        if (op_len <= 2 && s[op_len] == '=' && s[op_len + 1] != '=' &&
+            (op_len != 2 || s[0] == s[1]) && (op_len == 0 || strchr("<>", s[0]) == NULL || op_len == 2)) {
+            char op[3] = { 0 };
+            memcpy(op, s, op_len);
+            a->pos = s + op_len + 1;
+            long rhs = parse_assignment(a);
+            long value = op_len == 0 ? rhs : apply(a, op, get_variable(name), rhs);
+            assign_variable(a, name, value);
+            return value;
+        }
+    }
+    return parse_ternary(a);
+}
+
+int arith_evaluate(const char* expr, long* result) {
+    ArithParser a = { .expr = expr, .pos = expr };
+    skip_blanks(&a);
+    if (*a.pos == '\0') {
+        *result = 0; // $(( )) is 0
+        return 0;
+    }
+
+    *result = parse_assignment(&a);
+    skip_blanks(&a);
+    if (!a.failed && *a.pos != '\0') {
+        arith_error(&a, "syntax error in expression");
+    }
+    return a.failed ? -1 : 0;
+}
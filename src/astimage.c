@@ -0,0 +1,228 @@
+#include "astimage.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdalign.h>
+
+#define NO_NODE SIZE_MAX // Offset standing for a NULL pointer
+
+static void* grow(void* data, size_t* capacity, size_t needed, size_t item_size) {
+    if (needed <= *capacity) {
+        return data;
+    }
+    size_t cap = *capacity ? *capacity : 256;
+    while (cap < needed) {
+        cap *= 2;
+    }
+    data = realloc(data, cap * item_size);
+    if (!data) {
+        perror("realloc");
+        exit(EXIT_FAILURE);
+    }
+    *capacity = cap;
+    return data;
+}
+
+// Copies size bytes into the image, aligned to align, and returns their offset
+static size_t put(AstImage* img, const void* src, size_t size, size_t align) {
+    size_t at = (img->size + align - 1) & ~(align - 1);
+    img->data = grow(img->data, &img->capacity, at + size, 1);
+    memset(img->data + img->size, 0, at - img->size); // Padding, so equal trees give equal images
+    memcpy(img->data + at, src, size);
+    img->size = at + size;
+    return at;
+}
+
+// Stores target in the pointer at offset field: as an offset to relocate, or NULL
+static void set_pointer(AstImage* img, size_t field, size_t target) {
+    uintptr_t value = 0;
+    if (target != NO_NODE) {
+        value = target;
+        img->relocs = grow(img->relocs, &img->reloc_capacity, img->reloc_count + 1, sizeof(size_t));
+        img->relocs[img->reloc_count++] = field;
+    }
+    memcpy(img->data + field, &value, sizeof(value));
+}
+
+static size_t put_string(AstImage* img, const char* s) {
+    return s ? put(img, s, strlen(s) + 1, 1) : NO_NODE;
+}
+
+// A null-terminated array of count words
+static size_t put_words(AstImage* img, char** words, int count) {
+    if (words == NULL) {
+        return NO_NODE;
+    }
+    size_t at = put(img, words, (count + 1) * sizeof(char*), alignof(char*));
+    for (int i = 0; i < count; i++) {
+        set_pointer(img, at + i * sizeof(char*), put_string(img, words[i]));
+    }
+    set_pointer(img, at + count * sizeof(char*), NO_NODE);
+    return at;
+}
+
+static size_t put_redirs(AstImage* img, const Redirection* redirs, int count) {
+    if (redirs == NULL || count == 0) {
+        return NO_NODE;
+    }
+    size_t at = put(img, redirs, count * sizeof(Redirection), alignof(Redirection));
+    for (int i = 0; i < count; i++) {
+        set_pointer(img, at + i * sizeof(Redirection) + offsetof(Redirection, path), put_string(img, redirs[i].path));
+    }
+    return at;
+}
+
+static size_t put_list(AstImage* img, const CommandList* list);
+static size_t put_command(AstImage* img, const Command* cmd);
+
+static size_t put_if(AstImage* img, const IfClause* clause) {
+    if (clause == NULL) {
+        return NO_NODE;
+    }
+    size_t at = put(img, clause, sizeof(IfClause), alignof(IfClause));
+    set_pointer(img, at + offsetof(IfClause, condition), put_list(img, clause->condition));
+    set_pointer(img, at + offsetof(IfClause, then_part), put_list(img, clause->then_part));
+    set_pointer(img, at + offsetof(IfClause, elif), put_if(img, clause->elif));
+    set_pointer(img, at + offsetof(IfClause, else_part), put_list(img, clause->else_part));
+    return at;
+}
+
+static size_t put_loop(AstImage* img, const LoopClause* loop) {
+    size_t at = put(img, loop, sizeof(LoopClause), alignof(LoopClause));
+    set_pointer(img, at + offsetof(LoopClause, condition), put_list(img, loop->condition));
+    set_pointer(img, at + offsetof(LoopClause, body), put_list(img, loop->body));
+    return at;
+}
+
+static size_t put_for(AstImage* img, const ForClause* clause) {
+    size_t at = put(img, clause, sizeof(ForClause), alignof(ForClause));
+    set_pointer(img, at + offsetof(ForClause, name), put_string(img, clause->name));
+    set_pointer(img, at + offsetof(ForClause, words), put_words(img, clause->words, clause->word_count));
+    set_pointer(img, at + offsetof(ForClause, body), put_list(img, clause->body));
+    return at;
+}
+
+static size_t put_case(AstImage* img, const CaseClause* clause) {
+    size_t at = put(img, clause, sizeof(CaseClause), alignof(CaseClause));
+    set_pointer(img, at + offsetof(CaseClause, subject), put_string(img, clause->subject));
+
+    size_t field = at + offsetof(CaseClause, items);
+    for (const CaseItem* item = clause->items; item != NULL; item = item->next) {
+        size_t item_at = put(img, item, sizeof(CaseItem), alignof(CaseItem));
+        set_pointer(img, field, item_at);
+        set_pointer(img, item_at + offsetof(CaseItem, patterns), put_words(img, item->patterns, item->pattern_count));
+        set_pointer(img, item_at + offsetof(CaseItem, body), put_list(img, item->body));
+        field = item_at + offsetof(CaseItem, next);
+    }
+    set_pointer(img, field, NO_NODE);
+    return at;
+}
+
+static size_t put_function(AstImage* img, const FunctionDef* def) {
+    size_t at = put(img, def, sizeof(FunctionDef), alignof(FunctionDef));
+    set_pointer(img, at + offsetof(FunctionDef, name), put_string(img, def->name));
+    set_pointer(img, at + offsetof(FunctionDef, body), put_command(img, def->body));
+    set_pointer(img, at + offsetof(FunctionDef, text), put_string(img, def->text));
+    return at;
+}
+
+// One command, without the rest of its pipeline
+static size_t put_command(AstImage* img, const Command* cmd) {
+    if (cmd == NULL) {
+        return NO_NODE;
+    }
+    size_t at = put(img, cmd, sizeof(Command), alignof(Command));
+    set_pointer(img, at + offsetof(Command, words), put_words(img, cmd->words, cmd->word_count));
+    set_pointer(img, at + offsetof(Command, redirs), put_redirs(img, cmd->redirs, cmd->redir_count));
+    set_pointer(img, at + offsetof(Command, text), put_string(img, cmd->text));
+
+    // Every member of the union shares one offset
+    size_t node = NO_NODE;
+    switch (cmd->type) {
+        case COMMAND_GROUP:
+        case COMMAND_SUBSHELL: node = put_list(img, cmd->list); break;
+        case COMMAND_IF:       node = put_if(img, cmd->if_clause); break;
+        case COMMAND_WHILE:
+        case COMMAND_UNTIL:    node = put_loop(img, cmd->loop); break;
+        case COMMAND_FOR:      node = put_for(img, cmd->for_clause); break;
+        case COMMAND_CASE:     node = put_case(img, cmd->case_clause); break;
+        case COMMAND_FUNCTION: node = put_function(img, cmd->function); break;
+        case COMMAND_SIMPLE:   break;
+    }
+    set_pointer(img, at + offsetof(Command, list), node);
+    set_pointer(img, at + offsetof(Command, next), NO_NODE);
+    return at;
+}
+
+static size_t put_pipeline(AstImage* img, const Pipeline* pipeline) {
+    size_t at = put(img, pipeline, sizeof(Pipeline), alignof(Pipeline));
+    set_pointer(img, at + offsetof(Pipeline, text), put_string(img, pipeline->text));
+
+    size_t field = at + offsetof(Pipeline, commands);
+    for (const Command* cmd = pipeline->commands; cmd != NULL; cmd = cmd->next) {
+        size_t cmd_at = put_command(img, cmd);
+        set_pointer(img, field, cmd_at);
+        field = cmd_at + offsetof(Command, next);
+    }
+    set_pointer(img, field, NO_NODE);
+    return at;
+}
+
+// Chains are copied in a loop, so a script of many commands does not recurse deeply
+static size_t put_list(AstImage* img, const CommandList* list) {
+    if (list == NULL) {
+        return NO_NODE;
+    }
+    size_t at = put(img, list, sizeof(CommandList), alignof(CommandList));
+
+    size_t field = at + offsetof(CommandList, first);
+    for (const AndOrList* item = list->first; item != NULL; item = item->next) {
+        size_t item_at = put(img, item, sizeof(AndOrList), alignof(AndOrList));
+        set_pointer(img, field, item_at);
+        set_pointer(img, item_at + offsetof(AndOrList, text), put_string(img, item->text));
+
+        size_t pipe_field = item_at + offsetof(AndOrList, pipelines);
+        for (const Pipeline* pipeline = item->pipelines; pipeline != NULL; pipeline = pipeline->next) {
+            size_t pipe_at = put_pipeline(img, pipeline);
+            set_pointer(img, pipe_field, pipe_at);
+            pipe_field = pipe_at + offsetof(Pipeline, next);
+        }
+        set_pointer(img, pipe_field, NO_NODE);
+        field = item_at + offsetof(AndOrList, next);
+    }
+    set_pointer(img, field, NO_NODE);
+    return at;
+}
+
+void flatten_list(const CommandList* list, AstImage* out) {
+    memset(out, 0, sizeof(AstImage));
+    put_list(out, list);
+}
+
+void flatten_command(const Command* cmd, AstImage* out) {
+    memset(out, 0, sizeof(AstImage));
+    put_command(out, cmd);
+}
+
+int relocate_ast_image(char* base, size_t size, const size_t* relocs, size_t reloc_count) {
+    for (size_t i = 0; i < reloc_count; i++) {
+        uintptr_t offset;
+        if (relocs[i] > size - sizeof(offset) || size < sizeof(offset)) {
+            return -1;
+        }
+        memcpy(&offset, base + relocs[i], sizeof(offset));
+        if (offset >= size) {
+            return -1;
+        }
+        offset += (uintptr_t)base;
+        memcpy(base + relocs[i], &offset, sizeof(offset));
+    }
+    return 0;
+}
+
+void free_ast_image(AstImage* image) {
+    free(image->data);
+    free(image->relocs);
+    memset(image, 0, sizeof(AstImage));
+}
@@ -3,22 +3,47 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "redirect.h"
+#include "fastcopy.h" // For the cat built-in
+#include "pipe.h"     // For shell options
+#include "pathglob.h" // For shell options
 #include "jobs.h"     // For job control built-ins
-#include "history.h"  // For history built-in
+#include "history.h"  // For history built-in and options
 #include "alias.h"    // For alias built-ins
+#include "cmdhash.h"  // For the hash built-in
+#include "executor.h" // For the last exit status, parameters and loops
+#include "functions.h" // For unset -f
+#include "variables.h" // For export and unset
+#include "parallel.h"  // For the parallel built-in
+#include "jobqueue.h"  // For the queue built-in
+#include "utilities.h" // For echo, printf, test, read and type
+
+extern char** environ;
 
 // Forward declarations for built-in functions
-void builtin_cd(char** args);
-void builtin_pwd(char** args);
-void builtin_help(char** args);
-void builtin_exit(char** args);
-void builtin_jobs(char** args);
-void builtin_fg(char** args);
-void builtin_bg(char** args);
-void builtin_history(char** args);
+int builtin_cd(char** args);
+int builtin_pwd(char** args);
+int builtin_help(char** args);
+int builtin_exit(char** args);
+int builtin_jobs(char** args);
+int builtin_fg(char** args);
+int builtin_bg(char** args);
+int builtin_history(char** args);
 // New built-in declarations
-void builtin_alias(char** args);
-void builtin_unalias(char** args);
+int builtin_alias(char** args);
+int builtin_unalias(char** args);
+int builtin_hash(char** args);
+int builtin_cat(char** args);
+int builtin_set(char** args);
+int builtin_break(char** args);
+int builtin_continue(char** args);
+int builtin_return(char** args);
+int builtin_shift(char** args);
+int builtin_export(char** args);
+int builtin_unset(char** args);
 
 // Array of built-in command names
 const char* builtin_names[] = {
@@ -31,11 +56,32 @@ const char* builtin_names[] = {
     "bg",
     "history", // New built-in
     "alias",   // New built-in
-    "unalias"  // New built-in
+    "unalias", // New built-in
+    "hash",
+    "cat",
+    "set",
+    "break",
+    "continue",
+    "return",
+    "shift",
+    "export",
+    "unset",
+    "parallel",
+    "queue",
+    "wait",
+    "echo",
+    "printf",
+    "test",
+    "[",
+    "true",
+    "false",
+    "kill",
+    "read",
+    "type"
 };
 
 // Array of corresponding built-in functions
-void (*builtin_funcs[]) (char**) = {
+int (*builtin_funcs[]) (char**) = {
     &builtin_cd,
     &builtin_pwd,
     &builtin_help,
@@ -45,64 +91,352 @@ void (*builtin_funcs[]) (char**) = {
     &builtin_bg,
     &builtin_history, // New built-in
     &builtin_alias,
-    &builtin_unalias
+    &builtin_unalias,
+    &builtin_hash,
+    &builtin_cat,
+    &builtin_set,
+    &builtin_break,
+    &builtin_continue,
+    &builtin_return,
+    &builtin_shift,
+    &builtin_export,
+    &builtin_unset,
+    &builtin_parallel,
+    &builtin_queue,
+    &builtin_wait,
+    &builtin_echo,
+    &builtin_printf,
+    &builtin_test,
+    &builtin_test,
+    &builtin_true,
+    &builtin_false,
+    &builtin_kill,
+    &builtin_read,
+    &builtin_type
 };
 
 int num_builtins() {
     return sizeof(builtin_names) / sizeof(char*);
 }
 
-void builtin_cd(char** args) {
+int builtin_cd(char** args) {
     if (args[1] == NULL) {
         // No argument, change to HOME directory
         char* home = getenv("HOME");
         if (home == NULL) {
             fprintf(stderr, "cd: HOME not set\n");
-            return;
+            return 1;
         }
         if (chdir(home) != 0) {
             perror("cd");
+            return 1;
         }
     } else {
         if (chdir(args[1]) != 0) {
             perror("cd");
+            return 1;
         }
     }
+    return 0;
 }
 
-void builtin_pwd(char** args) {
+int builtin_pwd(char** args) {
     char cwd[1024];
     if (getcwd(cwd, sizeof(cwd)) != NULL) {
         printf("%s\n", cwd);
-    } else {
-        perror("pwd");
+        return 0;
     }
+    perror("pwd");
+    return 1;
 }
 
-void builtin_help(char** args) {
+int builtin_help(char** args) {
     printf("My Custom Shell\n");
     printf("The following built-in commands are available:\n");
     for (int i = 0; i < num_builtins(); i++) {
         printf("  %s\n", builtin_names[i]);
     }
+    return 0;
+}
+
+int builtin_exit(char** args) {
+    // Without an argument, exit with the status of the last command
+    exit(args[1] ? atoi(args[1]) : last_exit_status);
+}
+
+// Copies one file to stdout; "-" is stdin. Returns 0 on success.
+static int cat_file(const char* name, const struct stat* out_st) {
+    int fd = STDIN_FILENO;
+    if (strcmp(name, "-") != 0) {
+        fd = open(name, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            fprintf(stderr, "cat: %s: %s\n", name, strerror(errno));
+            return 1;
+        }
+    }
+
+    int status = 0;
+    // Appending a file to itself would never reach its end
+    struct stat in_st;
+    if (out_st && fstat(fd, &in_st) == 0 && S_ISREG(in_st.st_mode)
+            && in_st.st_dev == out_st->st_dev && in_st.st_ino == out_st->st_ino) {
+        fprintf(stderr, "cat: %s: input file is output file\n", name);
+        status = 1;
+    } else if (copy_fd_data(fd, STDOUT_FILENO) < 0) {
+        if (errno != EPIPE) {
+            fprintf(stderr, "cat: %s: %s\n", name, strerror(errno));
+        }
+        status = 1;
+    }
+
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+    return status;
+}
+
+int builtin_cat(char** args) {
+    // Anything printf'd before must reach stdout ahead of the copied data
+    fflush(stdout);
+
+    struct stat out_st;
+    int out_is_file = fstat(STDOUT_FILENO, &out_st) == 0 && S_ISREG(out_st.st_mode);
+
+    if (args[1] == NULL) {
+        return cat_file("-", out_is_file ? &out_st : NULL);
+    }
+    int status = 0;
+    for (int i = 1; args[i] != NULL; i++) {
+        status |= cat_file(args[i], out_is_file ? &out_st : NULL);
+    }
+    return status;
+}
+
+int builtin_set(char** args) {
+    if (args[1] == NULL) {
+        // List the current options
+        long size = get_pipe_buffer_size();
+        if (size > 0) {
+            printf("pipebuf=%ld\n", size);
+        } else {
+            printf("pipebuf=default\n");
+        }
+        printf("globthreads=%d\n", get_glob_threads());
+        printf("histshare=%s\n", get_history_sharing() ? "on" : "off");
+        printf("histdedup=%s\n", get_history_erase_dups() ? "on" : "off");
+        return 0;
+    }
+
+    int status = 0;
+    for (int i = 1; args[i] != NULL; i++) {
+        if (strncmp(args[i], "pipebuf=", 8) == 0) {
+            if (set_pipe_buffer_size(args[i] + 8) < 0) {
+                fprintf(stderr, "set: %s: invalid size\n", args[i] + 8);
+                status = 1;
+            }
+        } else if (strncmp(args[i], "globthreads=", 12) == 0) {
+            if (set_glob_threads(args[i] + 12) < 0) {
+                fprintf(stderr, "set: %s: invalid thread count\n", args[i] + 12);
+                status = 1;
+            }
+        } else if (strncmp(args[i], "histshare=", 10) == 0) {
+            if (set_history_sharing(args[i] + 10) < 0) {
+                fprintf(stderr, "set: %s: expected on or off\n", args[i] + 10);
+                status = 1;
+            }
+        } else if (strncmp(args[i], "histdedup=", 10) == 0) {
+            if (set_history_erase_dups(args[i] + 10) < 0) {
+                fprintf(stderr, "set: %s: expected on or off\n", args[i] + 10);
+                status = 1;
+            }
+        } else {
+            fprintf(stderr, "set: %s: unknown option\n", args[i]);
+            status = 1;
+        }
+    }
+    return status;
+}
+
+// Reads the optional count of break, continue and shift; returns -1 if it is not a number >= min
+static long count_argument(char** args, long min) {
+    if (args[1] == NULL) {
+        return 1;
+    }
+    char* end;
+    long n = strtol(args[1], &end, 10);
+    if (end == args[1] || *end != '\0' || n < min) {
+        fprintf(stderr, "%s: %s: numeric argument required\n", args[0], args[1]);
+        return -1;
+    }
+    return n;
+}
+
+// break [n] and continue [n] leave or restart the n-th enclosing loop
+static int leave_loops(char** args, enum ControlFlow flow) {
+    long n = count_argument(args, 1);
+    if (n < 0) {
+        return 1;
+    }
+    if (loop_depth == 0) {
+        fprintf(stderr, "%s: only meaningful in a `for', `while', or `until' loop\n", args[0]);
+        return 0;
+    }
+    pending_flow = flow;
+    pending_levels = n < loop_depth ? (int)n : loop_depth;
+    return 0;
+}
+
+int builtin_break(char** args) {
+    return leave_loops(args, FLOW_BREAK);
+}
+
+int builtin_continue(char** args) {
+    return leave_loops(args, FLOW_CONTINUE);
+}
+
+int builtin_return(char** args) {
+    if (function_depth == 0) {
+        fprintf(stderr, "return: can only `return' from a function\n");
+        return 1;
+    }
+    pending_flow = FLOW_RETURN;
+    return args[1] ? atoi(args[1]) & 0xff : last_exit_status;
 }
 
-void builtin_exit(char** args) {
-    exit(0);
+int builtin_shift(char** args) {
+    long n = count_argument(args, 0);
+    if (n < 0) {
+        return 1;
+    }
+    if (n > positional_count) {
+        fprintf(stderr, "shift: %ld: shift count out of range\n", n);
+        return 1;
+    }
+    positional_params += n;
+    positional_count -= n;
+    return 0;
 }
 
-int handle_builtin_command(char** args) {
-    if (args[0] == NULL) {
-        // An empty command is not a built-in
+int builtin_export(char** args) {
+    // Variables live in the environment, so every one is already exported
+    if (args[1] == NULL) {
+        for (char** env = environ; *env != NULL; env++) {
+            const char* eq = strchr(*env, '=');
+            if (eq != NULL) {
+                printf("export %.*s=\"%s\"\n", (int)(eq - *env), *env, eq + 1);
+            }
+        }
         return 0;
     }
 
+    int status = 0;
+    for (int i = 1; args[i] != NULL; i++) {
+        char* eq = strchr(args[i], '=');
+        if (eq == NULL) {
+            continue;
+        }
+        *eq = '\0';
+        if (set_variable(args[i], eq + 1) < 0) {
+            status = 1;
+        }
+        *eq = '=';
+    }
+    return status;
+}
+
+int builtin_unset(char** args) {
+    int i = 1;
+    int functions_only = 0, variables_only = 0;
+    for (; args[i] != NULL && args[i][0] == '-'; i++) {
+        if (strcmp(args[i], "-f") == 0) {
+            functions_only = 1;
+        } else if (strcmp(args[i], "-v") == 0) {
+            variables_only = 1;
+        } else {
+            fprintf(stderr, "unset: %s: invalid option\n", args[i]);
+            return 2;
+        }
+    }
+
+    // Without an option, a variable goes first and a function only if there is no such variable
+    for (; args[i] != NULL; i++) {
+        if (functions_only || (!variables_only && getenv(args[i]) == NULL)) {
+            unset_function(args[i]);
+        } else {
+            unset_variable(args[i]);
+        }
+    }
+    return 0;
+}
+
+// Whether cat's options or input need the external program
+static int cat_needs_external(char** args, int stdin_is_tty) {
+    int reads_stdin = args[1] == NULL;
+    for (int i = 1; args[i] != NULL; i++) {
+        if (strcmp(args[i], "-") == 0) {
+            reads_stdin = 1;
+        } else if (args[i][0] == '-') {
+            return 1;
+        }
+    }
+    return reads_stdin && stdin_is_tty;
+}
+
+BuiltinFunc find_builtin(char** args, int stdin_is_tty) {
     for (int i = 0; i < num_builtins(); i++) {
         if (strcmp(args[0], builtin_names[i]) == 0) {
-            (*builtin_funcs[i])(args);
-            return 1; // It was a built-in, and we handled it
+            if (builtin_funcs[i] == &builtin_cat && cat_needs_external(args, stdin_is_tty)) {
+                return NULL;
+            }
+            return builtin_funcs[i];
+        }
+    }
+    return NULL;
+}
+
+int builtin_runs_in_shell(BuiltinFunc builtin) {
+    return !(builtin == &builtin_cat && shell_is_interactive);
+}
+
+// Built-ins print through stdio; what they wrote goes out as soon as they
+// return, in order with what commands and stderr write. A failed write fails the built-in.
+static int flush_builtin_output(const char* name, int status) {
+    if (fflush(stdout) == EOF) {
+        if (errno != EPIPE) {
+            fprintf(stderr, "%s: write error: %s\n", name, strerror(errno));
         }
+        clearerr(stdout);
+        return status == 0 ? 1 : status;
+    }
+    return status;
+}
+
+int run_builtin_in_shell(BuiltinFunc builtin, char** argv, int stdin_fd,
+                         const Redirection* redirs, int redir_count) {
+    if (stdin_fd < 0 && redir_count == 0) {
+        return flush_builtin_output(argv[0], builtin(argv));
+    }
+
+    SavedFds saved;
+    if (redirect_shell_fds(stdin_fd, redirs, redir_count, &saved) < 0) {
+        return 1;
     }
+    int status = flush_builtin_output(argv[0], builtin(argv));
+    restore_shell_fds(&saved);
+    return status;
+}
+
+typedef struct {
+    BuiltinFunc builtin;
+    char** argv;
+} BuiltinCall;
+
+static int call_builtin(void* ctx) {
+    BuiltinCall* call = ctx;
+    return call->builtin(call->argv);
+}
 
-    return 0; // Not a built-in command
+pid_t spawn_builtin(const SpawnRequest* req, BuiltinFunc builtin) {
+    BuiltinCall call = { builtin, req->argv }; // The child gets its own copy
+    return spawn_subshell(req, call_builtin, &call);
 }
@@ -0,0 +1,628 @@
+#define _GNU_SOURCE
+#include "cmdhash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include "redirect.h" // For move_shell_fd
+#include "text.h"
+
+#define INITIAL_BUCKETS 256
+#define RECHECK_SECONDS 1 // How stale a directory's mtime may get before we stat it again
+#define WATCH_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | \
+                      IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+typedef struct CmdEntry {
+    char* path;            // Full path; the name lives in the same allocation
+    const char* name;      // Usually points into path, just after the last '/'
+    int dir_index;         // Index into path_dirs, or -1 for `hash -p` entries
+    unsigned int hits;     // Times this entry was used to launch a command
+    int remembered;        // Looked up by name rather than only found by the completion scan
+    struct CmdEntry* next; // Next entry in the same bucket
+} CmdEntry;
+
+typedef struct {
+    char* dir;
+    struct timespec mtime;
+    time_t checked_at;
+    int wd;                // inotify watch descriptor, or -1 if the mtime is polled instead
+} PathDir;
+
+// Names found by a background $PATH scan, merged into the table by the main thread
+typedef struct {
+    char** dirs;           // Private copy of the directories being scanned
+    int dir_count;
+    int* name_dirs;        // Directory index of each name found
+    size_t* name_offsets;  // Offset of each name in text
+    size_t count, capacity;
+    char* text;
+    size_t text_len, text_capacity;
+} ScanResult;
+
+static CmdEntry** buckets = NULL;
+static size_t bucket_count = 0;
+static size_t entry_count = 0;
+static unsigned long generation = 0;
+
+static char* path_snapshot = NULL; // The $PATH the table was built for
+static PathDir* path_dirs = NULL;
+static int path_dir_count = 0;
+
+static ScanResult* scan_result = NULL; // Non-NULL while a scan is in flight
+static pthread_t scan_thread;
+static int scan_threaded = 0;          // scan_thread must be joined before merging
+static int scan_complete = 0;          // Every executable on $PATH is in the table
+static int inotify_fd = -1;
+
+static void finish_scan(int merge);
+
+static void free_entries(int min_dir_index) {
+    for (size_t b = 0; b < bucket_count; b++) {
+        CmdEntry** link = &buckets[b];
+        while (*link) {
+            CmdEntry* e = *link;
+            if (e->dir_index >= min_dir_index) {
+                *link = e->next;
+                free(e->path);
+                free(e);
+                entry_count--;
+            } else {
+                link = &e->next;
+            }
+        }
+    }
+    generation++;
+    if (min_dir_index < path_dir_count) {
+        scan_complete = 0; // The next completion request scans again
+    }
+}
+
+static void load_path_dirs(const char* path_env) {
+    // A scan of the old directories is of no use any more
+    finish_scan(0);
+    if (inotify_fd >= 0) {
+        close(inotify_fd);
+        inotify_fd = -1;
+    }
+
+    for (int i = 0; i < path_dir_count; i++) {
+        free(path_dirs[i].dir);
+    }
+    free(path_dirs);
+    free(path_snapshot);
+    path_dirs = NULL;
+    path_dir_count = 0;
+    path_snapshot = strdup(path_env);
+
+    int capacity = 1;
+    for (const char* p = path_env; *p; p++) {
+        if (*p == ':') capacity++;
+    }
+    path_dirs = calloc(capacity, sizeof(PathDir));
+
+    const char* start = path_env;
+    while (1) {
+        const char* end = strchrnul(start, ':');
+        PathDir* d = &path_dirs[path_dir_count++];
+        // An empty entry means the current directory
+        d->dir = (end == start) ? strdup(".") : strndup(start, end - start);
+        d->checked_at = 0;
+        d->wd = -1;
+        if (*end == '\0') break;
+        start = end + 1;
+    }
+}
+
+// Flushes the whole table if $PATH is not the one it was built for
+static void check_path_env() {
+    const char* path_env = getenv("PATH");
+    if (path_env == NULL) path_env = "";
+
+    if (path_snapshot == NULL || strcmp(path_snapshot, path_env) != 0) {
+        free_entries(-1);
+        load_path_dirs(path_env);
+    }
+}
+
+// Re-stats directories 0..upto whose last check is stale.
+// When one changed, entries from it and every later directory are dropped,
+// since a new file there may shadow or replace them.
+// Returns 1 if anything was dropped.
+static int revalidate_dirs(int upto) {
+    time_t now = time(NULL);
+    for (int i = 0; i <= upto && i < path_dir_count; i++) {
+        PathDir* d = &path_dirs[i];
+        // Watched directories report their changes through inotify instead
+        if (d->wd >= 0 || now - d->checked_at < RECHECK_SECONDS) {
+            continue;
+        }
+
+        struct stat st;
+        struct timespec mtime = {0, 0};
+        if (stat(d->dir, &st) == 0) {
+            mtime = st.st_mtim;
+        }
+        int changed = d->checked_at != 0 &&
+                      (mtime.tv_sec != d->mtime.tv_sec || mtime.tv_nsec != d->mtime.tv_nsec);
+        d->mtime = mtime;
+        d->checked_at = now;
+
+        if (changed) {
+            free_entries(i);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void grow_buckets() {
+    size_t new_count = bucket_count ? bucket_count * 2 : INITIAL_BUCKETS;
+    CmdEntry** new_buckets = calloc(new_count, sizeof(CmdEntry*));
+    if (!new_buckets) {
+        perror("calloc");
+        return;
+    }
+
+    for (size_t b = 0; b < bucket_count; b++) {
+        CmdEntry* e = buckets[b];
+        while (e) {
+            CmdEntry* next = e->next;
+            size_t nb = hash_string(e->name) & (new_count - 1);
+            e->next = new_buckets[nb];
+            new_buckets[nb] = e;
+            e = next;
+        }
+    }
+    free(buckets);
+    buckets = new_buckets;
+    bucket_count = new_count;
+}
+
+static CmdEntry* find_entry(const char* name) {
+    if (bucket_count == 0) return NULL;
+    for (CmdEntry* e = buckets[hash_string(name) & (bucket_count - 1)]; e; e = e->next) {
+        if (strcmp(e->name, name) == 0) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static CmdEntry* insert_entry(const char* path, const char* name, int dir_index) {
+    if (entry_count >= bucket_count * 3 / 4) {
+        grow_buckets();
+    }
+
+    // The name normally is the tail of the path; only `hash -p` needs its own copy
+    size_t path_len = strlen(path);
+    size_t name_len = strlen(name);
+    int name_is_tail = path_len > name_len && path[path_len - name_len - 1] == '/' &&
+                       strcmp(path + path_len - name_len, name) == 0;
+
+    CmdEntry* e = malloc(sizeof(CmdEntry));
+    char* block = malloc(path_len + 1 + (name_is_tail ? 0 : name_len + 1));
+    if (!e || !block) {
+        perror("malloc");
+        free(e);
+        free(block);
+        return NULL;
+    }
+    memcpy(block, path, path_len + 1);
+
+    e->path = block;
+    e->name = name_is_tail ? block + path_len - name_len
+                           : memcpy(block + path_len + 1, name, name_len + 1);
+    e->dir_index = dir_index;
+    e->hits = 0;
+    e->remembered = dir_index < 0;
+
+    size_t b = hash_string(name) & (bucket_count - 1);
+    e->next = buckets[b];
+    buckets[b] = e;
+    entry_count++;
+    generation++;
+    return e;
+}
+
+static int is_executable_file(const char* path) {
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode) && access(path, X_OK) == 0;
+}
+
+// Walks $PATH from directory first the way execvp does and caches the first match
+static CmdEntry* search_path(const char* name, int first) {
+    char full_path[4096];
+    time_t now = time(NULL);
+
+    for (int i = first; i < path_dir_count; i++) {
+        snprintf(full_path, sizeof(full_path), "%s/%s", path_dirs[i].dir, name);
+        if (!is_executable_file(full_path)) {
+            continue;
+        }
+
+        // A relative directory means something else after the next cd, so it is never cached
+        if (path_dirs[i].dir[0] != '/') {
+            static CmdEntry uncached;
+            static char uncached_path[4096];
+            strcpy(uncached_path, full_path);
+            uncached.path = uncached_path;
+            uncached.name = name;
+            uncached.dir_index = i;
+            return &uncached;
+        }
+
+        // Record the mtime we resolved against, so later changes invalidate the entry
+        for (int j = 0; j <= i; j++) {
+            struct stat st;
+            if (path_dirs[j].checked_at == 0 && stat(path_dirs[j].dir, &st) == 0) {
+                path_dirs[j].mtime = st.st_mtim;
+                path_dirs[j].checked_at = now;
+            }
+        }
+        return insert_entry(full_path, name, i);
+    }
+    return NULL;
+}
+
+static CmdEntry* resolve(const char* name) {
+    check_path_env();
+    cmdhash_poll();
+
+    CmdEntry* e = find_entry(name);
+    if (e && e->dir_index >= 0 && revalidate_dirs(e->dir_index)) {
+        e = find_entry(name);
+    }
+    if (!e) {
+        e = search_path(name, 0);
+    }
+    if (e) {
+        e->remembered = 1;
+    }
+    return e;
+}
+
+const char* cmdhash_lookup(const char* name) {
+    CmdEntry* e = resolve(name);
+    if (!e) {
+        return NULL;
+    }
+    e->hits++;
+    return e->path;
+}
+
+void cmdhash_remember(const char* name, const char* path) {
+    check_path_env();
+    cmdhash_forget(name);
+    insert_entry(path, name, -1);
+}
+
+void cmdhash_forget(const char* name) {
+    if (bucket_count == 0) return;
+
+    CmdEntry** link = &buckets[hash_string(name) & (bucket_count - 1)];
+    while (*link) {
+        CmdEntry* e = *link;
+        if (strcmp(e->name, name) == 0) {
+            *link = e->next;
+            free(e->path);
+            free(e);
+            entry_count--;
+            generation++;
+            return;
+        }
+        link = &e->next;
+    }
+}
+
+// Called for each inotify event on a watched $PATH directory
+static void handle_dir_event(const struct inotify_event* ev) {
+    if (ev->mask & IN_Q_OVERFLOW) {
+        // Events were lost, so only a full rescan can be trusted
+        free_entries(0);
+        return;
+    }
+
+    int i = 0;
+    while (i < path_dir_count && path_dirs[i].wd != ev->wd) {
+        i++;
+    }
+    if (i == path_dir_count) {
+        return;
+    }
+
+    if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+        // The directory itself went away; fall back to polling its mtime
+        path_dirs[i].wd = -1;
+        path_dirs[i].checked_at = 0;
+        free_entries(i);
+        return;
+    }
+    if (ev->len == 0) {
+        return;
+    }
+
+    char full_path[4096];
+    snprintf(full_path, sizeof(full_path), "%s/%s", path_dirs[i].dir, ev->name);
+    CmdEntry* e = find_entry(ev->name);
+
+    if (is_executable_file(full_path)) {
+        // An earlier directory (or an explicit `hash -p`) still wins
+        if (e && e->dir_index <= i) {
+            return;
+        }
+        if (e) {
+            cmdhash_forget(ev->name);
+        }
+        insert_entry(full_path, ev->name, i);
+    } else if (e && e->dir_index == i) {
+        // Removed or no longer executable; a later directory may have one too
+        cmdhash_forget(ev->name);
+        search_path(ev->name, i + 1);
+    }
+}
+
+void cmdhash_poll() {
+    // Events stay queued in the kernel until an in-flight scan has been merged
+    if (inotify_fd < 0 || scan_result != NULL) {
+        return;
+    }
+
+    char buf[8192] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+    while ((len = read(inotify_fd, buf, sizeof(buf))) > 0) {
+        for (char* p = buf; p < buf + len; ) {
+            const struct inotify_event* ev = (const struct inotify_event*)p;
+            handle_dir_event(ev);
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+}
+
+void cmdhash_clear() {
+    free_entries(-1);
+}
+
+static void scan_add(ScanResult* r, int dir_index, const char* name) {
+    size_t name_len = strlen(name) + 1;
+
+    if (r->count == r->capacity) {
+        r->capacity = r->capacity ? r->capacity * 2 : 1024;
+        r->name_dirs = realloc(r->name_dirs, r->capacity * sizeof(int));
+        r->name_offsets = realloc(r->name_offsets, r->capacity * sizeof(size_t));
+    }
+    if (r->text_len + name_len > r->text_capacity) {
+        r->text_capacity = r->text_capacity ? r->text_capacity * 2 : 16384;
+        while (r->text_len + name_len > r->text_capacity) {
+            r->text_capacity *= 2;
+        }
+        r->text = realloc(r->text, r->text_capacity);
+    }
+
+    memcpy(r->text + r->text_len, name, name_len);
+    r->name_dirs[r->count] = dir_index;
+    r->name_offsets[r->count] = r->text_len;
+    r->text_len += name_len;
+    r->count++;
+}
+
+// Thread body: lists every directory without touching the shared table
+static void* scan_path_dirs(void* arg) {
+    ScanResult* r = arg;
+
+    for (int i = 0; i < r->dir_count; i++) {
+        // Relative directories are searched on demand but never cached
+        if (r->dirs[i][0] != '/') {
+            continue;
+        }
+        int dir_fd = open(r->dirs[i], O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dir_fd < 0) {
+            continue;
+        }
+        DIR* dir = fdopendir(dir_fd);
+        if (!dir) {
+            close(dir_fd);
+            continue;
+        }
+
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+            // d_type rules out directories and devices without a syscall
+            if (entry->d_type != DT_REG && entry->d_type != DT_LNK && entry->d_type != DT_UNKNOWN) {
+                continue;
+            }
+            // fstatat avoids building a full path for every file
+            struct stat st;
+            if (fstatat(dir_fd, entry->d_name, &st, 0) == 0 && S_ISREG(st.st_mode) && (st.st_mode & S_IXUSR)) {
+                scan_add(r, i, entry->d_name);
+            }
+        }
+        closedir(dir);
+    }
+    return NULL;
+}
+
+static void watch_path_dirs() {
+    if (inotify_fd < 0) {
+        inotify_fd = move_shell_fd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC));
+        if (inotify_fd < 0) {
+            return; // Changes are then noticed through directory mtimes
+        }
+    }
+    for (int i = 0; i < path_dir_count; i++) {
+        if (path_dirs[i].wd < 0 && path_dirs[i].dir[0] == '/') {
+            path_dirs[i].wd = inotify_add_watch(inotify_fd, path_dirs[i].dir, WATCH_EVENTS);
+        }
+    }
+}
+
+// Waits for the in-flight scan and, if merge is set, adds its names to the table
+static void finish_scan(int merge) {
+    ScanResult* r = scan_result;
+    if (!r) {
+        return;
+    }
+    if (scan_threaded) {
+        pthread_join(scan_thread, NULL);
+        scan_threaded = 0;
+    }
+    scan_result = NULL;
+
+    if (merge) {
+        char full_path[4096];
+        for (size_t k = 0; k < r->count; k++) {
+            const char* name = r->text + r->name_offsets[k];
+            int dir_index = r->name_dirs[k];
+
+            // An earlier directory wins, exactly as in execvp
+            CmdEntry* e = find_entry(name);
+            if (e && e->dir_index <= dir_index) {
+                continue;
+            }
+            if (e) {
+                cmdhash_forget(name);
+            }
+            snprintf(full_path, sizeof(full_path), "%s/%s", r->dirs[dir_index], name);
+            insert_entry(full_path, name, dir_index);
+        }
+        scan_complete = 1;
+        generation++;
+    }
+
+    for (int i = 0; i < r->dir_count; i++) {
+        free(r->dirs[i]);
+    }
+    free(r->dirs);
+    free(r->name_dirs);
+    free(r->name_offsets);
+    free(r->text);
+    free(r);
+}
+
+void cmdhash_start_scan() {
+    check_path_env();
+    if (scan_complete || scan_result) {
+        return;
+    }
+
+    // Watch first, so nothing that changes while we scan is missed
+    watch_path_dirs();
+
+    ScanResult* r = calloc(1, sizeof(ScanResult));
+    r->dirs = malloc(path_dir_count * sizeof(char*));
+    r->dir_count = path_dir_count;
+    for (int i = 0; i < path_dir_count; i++) {
+        r->dirs[i] = strdup(path_dirs[i].dir);
+    }
+    scan_result = r;
+
+    if (pthread_create(&scan_thread, NULL, scan_path_dirs, r) == 0) {
+        scan_threaded = 1;
+    } else {
+        scan_path_dirs(r); // No thread available, so scan right here
+    }
+}
+
+void cmdhash_scan_path() {
+    cmdhash_start_scan();
+    finish_scan(1);
+    cmdhash_poll();
+}
+
+void cmdhash_foreach(void (*fn)(const char* name, void* ctx), void* ctx) {
+    for (size_t b = 0; b < bucket_count; b++) {
+        for (CmdEntry* e = buckets[b]; e; e = e->next) {
+            fn(e->name, ctx);
+        }
+    }
+}
+
+unsigned long cmdhash_generation() {
+    return generation;
+}
+
+// Built-in: hash [-r] [-l] [-d name...] [-p path name] [name...]
+int builtin_hash(char** args) {
+    int list_reusable = 0;
+    int cleared = 0;
+    int i = 1;
+
+    for (; args[i] != NULL && args[i][0] == '-'; i++) {
+        if (strcmp(args[i], "-r") == 0) {
+            cmdhash_clear();
+            cleared = 1;
+        } else if (strcmp(args[i], "-l") == 0) {
+            list_reusable = 1;
+        } else if (strcmp(args[i], "-d") == 0) {
+            if (args[i+1] == NULL) {
+                fprintf(stderr, "hash: -d: option requires an argument\n");
+                return 1;
+            }
+            int status = 0;
+            for (i++; args[i] != NULL; i++) {
+                if (!find_entry(args[i])) {
+                    fprintf(stderr, "hash: %s: not found\n", args[i]);
+                    status = 1;
+                }
+                cmdhash_forget(args[i]);
+            }
+            return status;
+        } else if (strcmp(args[i], "-p") == 0) {
+            if (args[i+1] == NULL || args[i+2] == NULL) {
+                fprintf(stderr, "hash: usage: hash -p <path> <name>\n");
+                return 1;
+            }
+            cmdhash_remember(args[i+2], args[i+1]);
+            return 0;
+        } else {
+            fprintf(stderr, "hash: %s: invalid option\n", args[i]);
+            fprintf(stderr, "hash: usage: hash [-lr] [-p path] [-d] [name ...]\n");
+            return 2;
+        }
+    }
+
+    // Remember the named commands
+    if (args[i] != NULL) {
+        int status = 0;
+        for (; args[i] != NULL; i++) {
+            if (strchr(args[i], '/')) {
+                continue;
+            }
+            if (!resolve(args[i])) {
+                fprintf(stderr, "hash: %s: not found\n", args[i]);
+                status = 1;
+            }
+        }
+        return status;
+    }
+
+    if (cleared && !list_reusable) {
+        return 0;
+    }
+
+    // List the commands that were looked up, not everything the completion scan found
+    int shown = 0;
+    for (size_t b = 0; b < bucket_count; b++) {
+        for (CmdEntry* e = buckets[b]; e; e = e->next) {
+            if (!e->remembered) {
+                continue;
+            }
+            if (list_reusable) {
+                printf("hash -p %s %s\n", e->path, e->name);
+            } else {
+                if (shown == 0) printf("hits\tcommand\n");
+                printf("%4u\t%s\n", e->hits, e->path);
+            }
+            shown++;
+        }
+    }
+    if (shown == 0 && !list_reusable) {
+        printf("hash: hash table empty\n");
+    }
+    return 0;
+}
@@ -2,122 +2,208 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <dirent.h>
-#include <sys/stat.h>
 #include <readline/readline.h>
 #include "builtins.h"
+#include "cmdhash.h"
+#include "jobs.h"
+#include "alias.h"
+
+// A sorted array of names. Every name sharing a prefix sits in one
+// contiguous range, so matches are found in O(log n + k).
+typedef struct {
+    const char** names;
+    int count;
+    int capacity;
+} NameIndex;
 
 static char** shell_completion(const char* text, int start, int end);
 static char* command_generator(const char* text, int state);
+static char* argument_generator(const char* text, int state);
 
-// A list to hold all possible commands (built-ins + executables from PATH)
-static char** command_list = NULL;
-static int command_count = 0;
+// All possible commands (built-ins + executables from PATH).
+// The names are borrowed from builtin_names[] and the command hash table.
+static NameIndex command_index;
+static unsigned long command_generation = 0; // cmdhash generation the index was built from
+
+// Candidates for the argument being completed (job ids, alias names); owns its names
+static NameIndex argument_index;
 
 void build_command_list();
 void free_command_list();
 
 void initialize_completion() {
     rl_attempted_completion_function = shell_completion;
-    // Build the command list once at the start
-    build_command_list();
+    // Scan $PATH in the background while the first prompt is up;
+    // the command list itself is built on the first Tab
+    cmdhash_start_scan();
     // Register a function to free the list on exit
     atexit(free_command_list);
 }
 
+// Comparison function for qsort
+int compare_strings(const void* a, const void* b) {
+    return strcmp(*(const char**)a, *(const char**)b);
+}
+
+static void index_add(NameIndex* index, const char* name) {
+    if (index->count >= index->capacity) {
+        index->capacity = index->capacity ? index->capacity * 2 : 64;
+        index->names = realloc(index->names, index->capacity * sizeof(char*));
+    }
+    index->names[index->count++] = name;
+}
+
+static void index_sort(NameIndex* index) {
+    qsort(index->names, index->count, sizeof(char*), compare_strings);
+}
+
+// Finds the range [*first, *last) of names starting with prefix
+static void index_prefix_range(const NameIndex* index, const char* prefix, int* first, int* last) {
+    size_t len = strlen(prefix);
+
+    // First name >= prefix
+    int lo = 0, hi = index->count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (strcmp(index->names[mid], prefix) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *first = lo;
+
+    // First name after it that no longer starts with prefix
+    hi = index->count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (strncmp(index->names[mid], prefix, len) == 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *last = lo;
+}
+
+// Shared body of the readline generators: walks the matching range once
+static char* index_generator(const NameIndex* index, const char* text, int state) {
+    static int list_index, list_end;
+
+    if (!state) { // First call for this completion
+        index_prefix_range(index, text, &list_index, &list_end);
+    }
+
+    // Return the next name in the range, skipping duplicates (a built-in may also be on PATH)
+    while (list_index < list_end) {
+        const char* name = index->names[list_index];
+        list_index++;
+        if (list_index < list_end && strcmp(name, index->names[list_index]) == 0) {
+            continue;
+        }
+        return strdup(name);
+    }
+
+    return NULL; // No more matches
+}
+
+static void add_job_argument(Job* job, void* ctx) {
+    (void)ctx;
+    char id[16];
+    snprintf(id, sizeof(id), "%d", job->job_id);
+    index_add(&argument_index, strdup(id));
+}
+
+static void add_alias_argument(const char* name, const char* value, void* ctx) {
+    (void)value;
+    (void)ctx;
+    index_add(&argument_index, strdup(name));
+}
+
+// Fills argument_index for the command at the start of the line.
+// Returns 0 if that command takes no completable arguments.
+static int build_argument_index(const char* command) {
+    for (int i = 0; i < argument_index.count; i++) {
+        free((char*)argument_index.names[i]);
+    }
+    argument_index.count = 0;
+
+    if (strcmp(command, "fg") == 0 || strcmp(command, "bg") == 0) {
+        for_each_job(add_job_argument, NULL);
+    } else if (strcmp(command, "unalias") == 0) {
+        for_each_alias(add_alias_argument, NULL);
+    } else {
+        return 0;
+    }
+
+    index_sort(&argument_index);
+    return 1;
+}
+
 static char** shell_completion(const char* text, int start, int end) {
+    (void)end;
+
     // If we are at the beginning of a command, use our command generator
     if (start == 0) {
         return rl_completion_matches(text, command_generator);
     }
+
+    // Built-ins with their own kind of argument complete from that set only
+    size_t skip = strspn(rl_line_buffer, " \t");
+    size_t word_len = strcspn(rl_line_buffer + skip, " \t");
+    char* command = strndup(rl_line_buffer + skip, word_len);
+    int has_arguments = build_argument_index(command);
+    free(command);
+    if (has_arguments) {
+        rl_attempted_completion_over = 1;
+        return rl_completion_matches(text, argument_generator);
+    }
+
     // Otherwise, let readline do its default filename completion
     return NULL;
 }
 
 static char* command_generator(const char* text, int state) {
-    static int list_index, len;
-
     if (!state) { // First call for this completion
-        list_index = 0;
-        len = strlen(text);
-    }
-
-    // Return the next command from our list that matches the text
-    while (list_index < command_count) {
-        const char* name = command_list[list_index];
-        list_index++;
-        if (strncmp(name, text, len) == 0) {
-            return strdup(name);
+        // Waits for the startup scan if it is still running, and applies new binaries
+        cmdhash_scan_path();
+        if (command_index.names == NULL || command_generation != cmdhash_generation()) {
+            free_command_list();
+            build_command_list();
         }
     }
+    return index_generator(&command_index, text, state);
+}
 
-    return NULL; // No more matches
+static char* argument_generator(const char* text, int state) {
+    return index_generator(&argument_index, text, state);
 }
 
-// Comparison function for qsort
-int compare_strings(const void* a, const void* b) {
-    return strcmp(*(const char**)a, *(const char**)b);
+static void append_command(const char* name, void* ctx) {
+    (void)ctx;
+    index_add(&command_index, name);
 }
 
 void build_command_list() {
     // Add built-in commands
     extern const char* builtin_names[];
     extern int num_builtins();
-    command_count = num_builtins();
-
-    // Start with a reasonable allocation size
-    int capacity = command_count + 256;
-    command_list = malloc(capacity * sizeof(char*));
 
-    for (int i = 0; i < command_count; i++) {
-        command_list[i] = strdup(builtin_names[i]);
+    for (int i = 0; i < num_builtins(); i++) {
+        index_add(&command_index, builtin_names[i]);
     }
 
-    // Add executables from PATH
-    char* path_env = getenv("PATH");
-    if (path_env == NULL) return;
-
-    char* path = strdup(path_env); // Make a copy for strtok
-    char* token = strtok(path, ":");
-
-    while (token != NULL) {
-        DIR* dir = opendir(token);
-        if (dir) {
-            struct dirent* entry;
-            while ((entry = readdir(dir)) != NULL) {
-                // Ignore '.' and '..'
-                if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-                    continue;
-                }
-                
-                // Construct full path to check if it's executable
-                char full_path[1024];
-                snprintf(full_path, sizeof(full_path), "%s/%s", token, entry->d_name);
-                
-                struct stat st;
-                if (stat(full_path, &st) == 0 && S_ISREG(st.st_mode) && (st.st_mode & S_IXUSR)) {
-                    if (command_count >= capacity) {
-                        capacity *= 2;
-                        command_list = realloc(command_list, capacity * sizeof(char*));
-                    }
-                    command_list[command_count++] = strdup(entry->d_name);
-                }
-            }
-            closedir(dir);
-        }
-        token = strtok(NULL, ":");
-    }
-    free(path);
+    // Add executables from PATH, sharing the names stored in the command hash
+    cmdhash_foreach(append_command, NULL);
+    command_generation = cmdhash_generation();
 
-    // Sort the list for nice, alphabetical completion
-    qsort(command_list, command_count, sizeof(char*), compare_strings);
+    // Sort once; every completion is then a binary search
+    index_sort(&command_index);
 }
 
 void free_command_list() {
-    if (command_list) {
-        for (int i = 0; i < command_count; i++) {
-            free(command_list[i]);
-        }
-        free(command_list);
-    }
-}
\ No newline at end of file
+    free(command_index.names);
+    command_index.names = NULL;
+    command_index.count = 0;
+    command_index.capacity = 0;
+}
@@ -0,0 +1,119 @@
+#include "eventloop.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <readline/readline.h>
+#include "signals.h"
+#include "histsearch.h"
+#include "jobs.h"
+#include "jobqueue.h"
+#include "redirect.h" // For move_shell_fd
+
+#define MAX_EVENTS 4
+
+static int epoll_fd = -1;
+static char* accepted_line = NULL;
+static int line_done = 0;
+
+void init_event_loop() {
+    // The loop owns SIGINT and SIGWINCH; readline must not install handlers of its own
+    rl_catch_signals = 0;
+    rl_catch_sigwinch = 0;
+
+    epoll_fd = move_shell_fd(epoll_create1(EPOLL_CLOEXEC));
+    if (epoll_fd < 0) {
+        perror("epoll_create1");
+        return;
+    }
+
+    struct epoll_event ev = { .events = EPOLLIN };
+    ev.data.fd = STDIN_FILENO;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, STDIN_FILENO, &ev) < 0) {
+        perror("epoll_ctl");
+    }
+
+    int signal_fd = get_signal_fd();
+    if (signal_fd >= 0) {
+        ev.data.fd = signal_fd;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, signal_fd, &ev) < 0) {
+            perror("epoll_ctl");
+        }
+    }
+}
+
+static void line_handler(char* line) {
+    accepted_line = line;
+    line_done = 1;
+    // Remove the handler now, or readline would print the prompt again
+    rl_callback_handler_remove();
+}
+
+static void handle_signals() {
+    unsigned int pending = read_pending_signals();
+
+    if (pending & SIGNAL_BIT(SIGCHLD)) {
+        reap_children();
+        dispatch_queued_jobs(); // A finished job may have made room
+        if (has_finished_jobs()) {
+            // Report above the prompt, then redraw it with whatever was typed so far
+            rl_clear_visible_line();
+            cleanup_jobs();
+            fflush(stdout);
+            rl_forced_update_display();
+        }
+    }
+
+    if (pending & SIGNAL_BIT(SIGINT)) {
+        // Ctrl+C at the prompt abandons the line instead of killing the shell
+        rl_callback_sigcleanup();
+        cancel_history_search();
+        rl_free_line_state();
+        rl_replace_line("", 0);
+        rl_crlf();
+        rl_on_new_line();
+        rl_redisplay();
+    }
+
+    if (pending & SIGNAL_BIT(SIGWINCH)) {
+        rl_resize_terminal();
+    }
+}
+
+char* event_loop_readline(const char* prompt) {
+    if (epoll_fd < 0) {
+        return readline(prompt);
+    }
+
+    accepted_line = NULL;
+    line_done = 0;
+    rl_callback_handler_install(prompt, line_handler);
+
+    while (!line_done) {
+        struct epoll_event events[MAX_EVENTS];
+        // Queued jobs waiting on the load average need a look now and then
+        int n = epoll_wait(epoll_fd, events, MAX_EVENTS, queue_poll_timeout());
+        if (n == 0) {
+            dispatch_queued_jobs();
+            continue;
+        }
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            rl_callback_handler_remove();
+            return NULL;
+        }
+
+        for (int i = 0; i < n && !line_done; i++) {
+            if (events[i].data.fd == STDIN_FILENO) {
+                rl_callback_read_char();
+            } else {
+                handle_signals();
+            }
+        }
+    }
+
+    return accepted_line;
+}
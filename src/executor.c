@@ -1,82 +1,667 @@
 #include "executor.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <signal.h>
 #include <unistd.h>
-#include <sys/wait.h>
 #include "redirect.h"
+#include "spawner.h"
+#include "builtins.h"
+#include "expansion.h"
+#include "functions.h"
+#include "pathglob.h"
+#include "pipe.h"
 #include "jobs.h"
-#include <signal.h>
-#include <errno.h> // For errno
+#include "jobqueue.h"
+#include "variables.h"
+#include "signals.h"
+#include "text.h"
 
-void execute_command(char** args, int is_background) {
-    if (args[0] == NULL) {
-        return;
+#define STATUS_NOT_FOUND 127    // Exit status of a command that could not be started
+#define MAX_FUNCTION_DEPTH 1000 // Deeper recursion is taken to be a runaway
+
+int last_exit_status = 0;
+
+char** positional_params = NULL;
+int positional_count = 0;
+const char* shell_name = "myshell";
+
+enum ControlFlow pending_flow = FLOW_NORMAL;
+int pending_levels = 0;
+int loop_depth = 0;
+int function_depth = 0;
+int exec_last_command = 0;
+
+static int exec_in_place = 0; // The simple command about to run ends a -c string
+
+static int execute_and_or(const AndOrList* list, int is_background);
+
+// Whether a word as written has the form NAME=value
+static int is_assignment(const char* word) {
+    if (!isalpha((unsigned char)*word) && *word != '_') {
+        return 0;
     }
+    while (isalnum((unsigned char)*word) || *word == '_') word++;
+    return *word == '=';
+}
 
-    pid_t pid = fork();
+// Expands the leading NAME=value words of cmd; returns how many there were, or -1 on an error
+static int expand_assignments(const Command* cmd, ExpandedCommand* out) {
+    int count = 0;
+    while (count < cmd->word_count && is_assignment(cmd->words[count])) count++;
+    if (count == 0) {
+        return 0;
+    }
 
-    if (pid < 0) {
-        perror("fork");
-    } else if (pid == 0) {
-        // Child process
-        pid_t pgid = getpid();
-        if (setpgid(pgid, pgid) < 0) {
-            perror("setpgid");
+    out->assigns = calloc(count + 1, sizeof(char*));
+    if (!out->assigns) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < count; i++) {
+        const char* eq = strchr(cmd->words[i], '=');
+        char* value = expand_assignment(eq + 1);
+        if (value == NULL) {
+            return -1;
+        }
+        size_t name_len = eq - cmd->words[i] + 1;
+        out->assigns[i] = malloc(name_len + strlen(value) + 1);
+        if (!out->assigns[i]) {
+            perror("malloc");
             exit(EXIT_FAILURE);
         }
+        memcpy(out->assigns[i], cmd->words[i], name_len);
+        strcpy(out->assigns[i] + name_len, value);
+        free(value);
+    }
+    return count;
+}
+
+int expand_command(const Command* cmd, ExpandedCommand* out) {
+    out->redirs = NULL;
+    out->redir_count = 0;
+    out->argv = NULL;
+    out->assigns = NULL;
+
+    int assign_count = expand_assignments(cmd, out);
+    if (assign_count < 0) {
+        free_expanded_command(out);
+        return -1;
+    }
+    out->argv = expand_variables(cmd->words + assign_count);
+    if (out->argv == NULL) {
+        free_expanded_command(out);
+        return -1;
+    }
 
-        if (!is_background && shell_is_interactive) {
-            tcsetpgrp(shell_terminal, pgid);
-        }
-
-        signal(SIGINT, SIG_DFL);
-        signal(SIGQUIT, SIG_DFL);
-        signal(SIGTSTP, SIG_DFL);
-        signal(SIGTTIN, SIG_DFL);
-        signal(SIGTTOU, SIG_DFL);
-        signal(SIGCHLD, SIG_DFL);
-
-        handle_redirection(args);
-        
-        execvp(args[0], args);
-        
-        // If execvp fails, check if it's an executable script without a shebang
-        if (errno == ENOEXEC) {
-            // Prepend our shell to the args and re-execute
-            // First, count existing args
-            int arg_count = 0;
-            while(args[arg_count] != NULL) {
-                arg_count++;
+    if (cmd->redir_count > 0) {
+        out->redirs = malloc(cmd->redir_count * sizeof(Redirection));
+        if (!out->redirs) {
+            perror("malloc");
+            free_expanded_command(out);
+            return -1;
+        }
+        for (int i = 0; i < cmd->redir_count; i++) {
+            char* path = expand_redirection_target(cmd->redirs[i].path);
+            if (path == NULL) {
+                free_expanded_command(out);
+                return -1;
             }
-            // Create new args array
-            char** new_args = malloc((arg_count + 2) * sizeof(char*));
-            if (!new_args) {
-                perror("malloc");
-                exit(EXIT_FAILURE);
+            out->redirs[i] = cmd->redirs[i];
+            out->redirs[i].path = path;
+            out->redir_count++;
+        }
+    }
+    return 0;
+}
+
+void free_expanded_command(ExpandedCommand* cmd) {
+    for (int i = 0; i < cmd->redir_count; i++) {
+        free((char*)cmd->redirs[i].path);
+    }
+    if (cmd->assigns) {
+        for (int i = 0; cmd->assigns[i] != NULL; i++) {
+            free(cmd->assigns[i]);
+        }
+    }
+    free(cmd->assigns);
+    free(cmd->redirs);
+    free(cmd->argv);
+    cmd->redirs = NULL;
+    cmd->redir_count = 0;
+    cmd->argv = NULL;
+    cmd->assigns = NULL;
+}
+
+// Sets NAME=value in the environment; returns the previous value, copied, or NULL if it was unset
+static char* assign(const char* assignment) {
+    const char* eq = strchr(assignment, '=');
+    char* name = strndup(assignment, eq - assignment);
+    const char* old = getenv(name);
+    char* saved = old ? strdup(old) : NULL;
+    set_variable(name, eq + 1);
+    free(name);
+    return saved;
+}
+
+char** push_assignments(const ExpandedCommand* cmd) {
+    if (cmd->assigns == NULL) {
+        return NULL;
+    }
+    int count = 0;
+    while (cmd->assigns[count] != NULL) count++;
+    char** saved = calloc(count, sizeof(char*));
+    if (!saved) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < count; i++) {
+        saved[i] = assign(cmd->assigns[i]);
+    }
+    return saved;
+}
+
+void pop_assignments(const ExpandedCommand* cmd, char** saved) {
+    if (saved == NULL) {
+        return;
+    }
+    int count = 0;
+    while (cmd->assigns[count] != NULL) count++;
+    // Backwards, so that `a=1 a=2 cmd` puts back the value from before both
+    for (int i = count - 1; i >= 0; i--) {
+        const char* eq = strchr(cmd->assigns[i], '=');
+        char* name = strndup(cmd->assigns[i], eq - cmd->assigns[i]);
+        if (saved[i]) {
+            set_variable(name, saved[i]);
+        } else {
+            unset_variable(name);
+        }
+        free(name);
+        free(saved[i]);
+    }
+    free(saved);
+}
+
+// Runs a function with argv as its positional parameters
+static int call_function(Function* fn, char** argv);
+static int execute_compound(const Command* cmd);
+
+// Ctrl+C while the shell itself runs, in a built-in or between commands, reaches
+// no child; it stops the command line here. Returns 1 if the line must stop.
+static int interrupted() {
+    if (shell_is_interactive && pending_flow == FLOW_NORMAL && take_pending_interrupt()) {
+        fputc('\n', stderr); // The prompt starts on a line of its own, after the ^C
+        pending_flow = FLOW_INTERRUPT;
+    }
+    return pending_flow == FLOW_INTERRUPT;
+}
+
+// Consumes a break or continue aimed at the innermost loop. Returns 1 if the loop must stop.
+static int loop_must_stop() {
+    if (pending_flow != FLOW_BREAK && pending_flow != FLOW_CONTINUE) {
+        return pending_flow != FLOW_NORMAL;
+    }
+    if (--pending_levels > 0) {
+        return 1; // Aimed at an outer loop
+    }
+    int stop = pending_flow == FLOW_BREAK;
+    pending_flow = FLOW_NORMAL;
+    return stop;
+}
+
+static int execute_if(const IfClause* clause) {
+    for (; clause != NULL; clause = clause->elif) {
+        int condition = execute_list(clause->condition);
+        if (pending_flow != FLOW_NORMAL) {
+            return condition;
+        }
+        if (condition == 0) {
+            return execute_list(clause->then_part);
+        }
+        if (clause->else_part != NULL) {
+            return execute_list(clause->else_part);
+        }
+    }
+    return 0;
+}
+
+// while, or until when until is set
+static int execute_loop(const LoopClause* loop, int until) {
+    int status = 0;
+    loop_depth++;
+    while (!interrupted()) {
+        int condition = execute_list(loop->condition);
+        if (loop_must_stop() || (condition == 0) == until) {
+            break;
+        }
+        status = execute_list(loop->body);
+        if (loop_must_stop()) {
+            break;
+        }
+    }
+    loop_depth--;
+    return status;
+}
+
+static int execute_for(const ForClause* clause) {
+    static char* all_params[] = { "\"$@\"", NULL }; // for name; do ... loops over the parameters
+    char** values = expand_variables(clause->words ? clause->words : all_params);
+    if (values == NULL) {
+        return 1;
+    }
+
+    int status = 0;
+    loop_depth++;
+    for (int i = 0; values[i] != NULL && !interrupted(); i++) {
+        set_variable(clause->name, values[i]);
+        status = execute_list(clause->body);
+        if (loop_must_stop()) {
+            break;
+        }
+    }
+    loop_depth--;
+    free(values);
+    return status;
+}
+
+static int execute_case(const CaseClause* clause) {
+    char* subject = expand_assignment(clause->subject);
+    if (subject == NULL) {
+        return 1;
+    }
+
+    int status = 0;
+    for (const CaseItem* item = clause->items; item != NULL; item = item->next) {
+        int matched = 0;
+        for (int i = 0; i < item->pattern_count && !matched; i++) {
+            char* pattern = expand_pattern(item->patterns[i]);
+            if (pattern == NULL) {
+                free(subject);
+                return 1;
             }
-            new_args[0] = "./bin/myshell";
-            for (int i = 0; i < arg_count; i++) {
-                new_args[i+1] = args[i];
+            matched = pattern_match(pattern, subject);
+            free(pattern);
+        }
+        if (matched) {
+            status = item->body->first ? execute_list(item->body) : 0;
+            break;
+        }
+    }
+    free(subject);
+    return status;
+}
+
+// Runs a compound command whose redirections are already in place
+static int execute_compound_body(const Command* cmd) {
+    switch (cmd->type) {
+        case COMMAND_GROUP:
+        case COMMAND_SUBSHELL:
+            return execute_list(cmd->list);
+        case COMMAND_IF:
+            return execute_if(cmd->if_clause);
+        case COMMAND_WHILE:
+        case COMMAND_UNTIL:
+            return execute_loop(cmd->loop, cmd->type == COMMAND_UNTIL);
+        case COMMAND_FOR:
+            return execute_for(cmd->for_clause);
+        case COMMAND_CASE:
+            return execute_case(cmd->case_clause);
+        case COMMAND_FUNCTION:
+            define_function(cmd->function);
+            return 0;
+        default:
+            return 0;
+    }
+}
+
+// Runs a compound command in the shell itself, its redirections applied while it runs
+static int execute_compound(const Command* cmd) {
+    if (cmd->redir_count == 0) {
+        return execute_compound_body(cmd);
+    }
+
+    ExpandedCommand ec;
+    if (expand_command(cmd, &ec) < 0) {
+        return 1;
+    }
+    SavedFds saved;
+    int status = 1;
+    if (redirect_shell_fds(-1, ec.redirs, ec.redir_count, &saved) == 0) {
+        status = execute_compound_body(cmd);
+        restore_shell_fds(&saved);
+    }
+    free_expanded_command(&ec);
+    return status;
+}
+
+static int call_function(Function* fn, char** argv) {
+    if (function_depth >= MAX_FUNCTION_DEPTH) {
+        fprintf(stderr, "%s: maximum function nesting level exceeded (%d)\n", argv[0], MAX_FUNCTION_DEPTH);
+        return 1;
+    }
+
+    char** saved_params = positional_params;
+    int saved_count = positional_count;
+    int saved_loops = loop_depth;
+    positional_params = argv + 1;
+    positional_count = 0;
+    while (argv[positional_count + 1] != NULL) positional_count++;
+    loop_depth = 0; // break and continue do not reach the caller's loops
+
+    function_enter(fn);
+    function_depth++;
+    int status = execute_compound(fn->body);
+    function_depth--;
+    function_leave(fn);
+
+    positional_params = saved_params;
+    positional_count = saved_count;
+    loop_depth = saved_loops;
+    if (pending_flow == FLOW_RETURN) {
+        pending_flow = FLOW_NORMAL;
+    }
+    return status;
+}
+
+typedef struct {
+    const Command* cmd;
+    char** argv;
+} ShellCommand;
+
+// Body of a forked copy of the shell; its commands stay in its process group
+static int run_shell_command(void* ctx) {
+    ShellCommand* sc = ctx;
+    shell_is_interactive = 0;
+    inherited_pgid = getpgrp();
+    if (sc->cmd->type == COMMAND_SIMPLE) {
+        return call_function(find_function(sc->argv[0]), sc->argv);
+    }
+    return execute_compound_body(sc->cmd);
+}
+
+pid_t spawn_shell_command(const SpawnRequest* req, const Command* cmd, char** argv) {
+    ShellCommand sc = { cmd, argv }; // The child gets its own copy
+    return spawn_subshell(req, run_shell_command, &sc);
+}
+
+// Runs a subshell, or a function in the background, as a job of its own
+static int start_shell_job(const Command* cmd, const ExpandedCommand* ec, const char* text, int is_background) {
+    SpawnRequest req = {
+        .argv = ec->argv,
+        .pgid = inherited_pgid,
+        .stdin_fd = -1,
+        .stdout_fd = -1,
+        .redirs = ec->redirs,
+        .redir_count = ec->redir_count,
+        .tty_fd = (!is_background && shell_is_interactive) ? shell_terminal : -1,
+    };
+    pid_t pid = spawn_shell_command(&req, cmd, ec->argv);
+    if (pid < 0) {
+        return 1;
+    }
+
+    Job* job = add_job(inherited_pgid ? inherited_pgid : pid, text, is_background ? BACKGROUND : FOREGROUND, is_background);
+    if (job) {
+        add_job_process(job, pid);
+    }
+    if (job && is_background) {
+        announce_background_job(job, pid);
+    } else if (job) {
+        return put_job_in_foreground(job, 0);
+    }
+    return 0;
+}
+
+static int execute_subshell(const Command* cmd, int is_background) {
+    ExpandedCommand ec;
+    if (expand_command(cmd, &ec) < 0) {
+        return 1;
+    }
+    int status = start_shell_job(cmd, &ec, cmd->text, is_background);
+    free_expanded_command(&ec);
+    return status;
+}
+
+static int execute_simple(const Command* cmd, int is_background) {
+    int replace_shell = exec_in_place;
+    exec_in_place = 0; // Not for commands run by the functions it calls
+    ExpandedCommand ec;
+    if (expand_command(cmd, &ec) < 0) {
+        return 1;
+    }
+    char** argv = ec.argv;
+
+    // Without a command, assignments are permanent and redirections only create or truncate their files
+    if (argv[0] == NULL) {
+        for (int i = 0; ec.assigns && ec.assigns[i] != NULL; i++) {
+            free(assign(ec.assigns[i]));
+        }
+        SavedFds saved;
+        int status = 0;
+        if (ec.redir_count > 0) {
+            status = redirect_shell_fds(-1, ec.redirs, ec.redir_count, &saved) < 0 ? 1 : 0;
+            if (status == 0) {
+                restore_shell_fds(&saved);
             }
-            new_args[arg_count + 1] = NULL;
-            
-            execvp(new_args[0], new_args);
-            // If this also fails, print the error for the original command
         }
-        
-        perror(args[0]);
-        exit(EXIT_FAILURE);
+        free_expanded_command(&ec);
+        return status;
+    }
+
+    char** saved_env = push_assignments(&ec);
+    int status = 0;
+
+    // Functions come first, so that they can wrap built-ins and commands of the same name
+    Function* fn = find_function(argv[0]);
+    if (fn != NULL) {
+        if (is_background) {
+            char* text = join_args(argv);
+            status = start_shell_job(cmd, &ec, text, 1);
+            free(text);
+        } else if (ec.redir_count == 0) {
+            status = call_function(fn, argv);
+        } else {
+            SavedFds saved;
+            status = 1;
+            if (redirect_shell_fds(-1, ec.redirs, ec.redir_count, &saved) == 0) {
+                status = call_function(fn, argv);
+                restore_shell_fds(&saved);
+            }
+        }
+        pop_assignments(&ec, saved_env);
+        free_expanded_command(&ec);
+        return status;
+    }
+
+    int stdin_is_tty = !redirects_fd(ec.redirs, ec.redir_count, STDIN_FILENO) && isatty(STDIN_FILENO);
+    BuiltinFunc builtin = find_builtin(argv, stdin_is_tty);
+
+    // Built-ins run in the shell itself, which is essential for cd and exit
+    if (builtin && !is_background && builtin_runs_in_shell(builtin)) {
+        status = run_builtin_in_shell(builtin, argv, -1, ec.redirs, ec.redir_count);
+        pop_assignments(&ec, saved_env);
+        free_expanded_command(&ec);
+        return status;
+    }
+
+    // The last command of a -c string needs no child: the shell has nothing left to do
+    if (replace_shell && !builtin) {
+        SpawnRequest req = {
+            .argv = argv,
+            .stdin_fd = -1,
+            .stdout_fd = -1,
+            .redirs = ec.redirs,
+            .redir_count = ec.redir_count,
+            .tty_fd = -1,
+        };
+        status = exec_command(&req); // Returns only if the command could not run
+        pop_assignments(&ec, saved_env);
+        free_expanded_command(&ec);
+        return status;
+    }
 
+    // Redirections become spawn file actions, so nothing is opened in the shell itself
+    SpawnRequest req = {
+        .argv = argv,
+        .pgid = inherited_pgid, // Normally a new process group, for robust job control
+        .stdin_fd = -1,
+        .stdout_fd = -1,
+        .redirs = ec.redirs,
+        .redir_count = ec.redir_count,
+        .tty_fd = (!is_background && shell_is_interactive) ? shell_terminal : -1,
+    };
+
+    pid_t pid = builtin ? spawn_builtin(&req, builtin) : spawn_command(&req);
+    pop_assignments(&ec, saved_env); // The child has its own copy of the environment
+    if (pid < 0) {
+        free_expanded_command(&ec);
+        return STATUS_NOT_FOUND;
+    }
+
+    // Parent process
+    pid_t pgid = inherited_pgid ? inherited_pgid : pid;
+    char* command = join_args(argv);
+    Job* job = add_job(pgid, command, is_background ? BACKGROUND : FOREGROUND, is_background);
+    free(command);
+    free_expanded_command(&ec);
+    if (job) {
+        add_job_process(job, pid);
+    }
+
+    if (job && is_background) {
+        announce_background_job(job, pid);
+    } else if (job) {
+        return put_job_in_foreground(job, 0);
+    }
+    return 0;
+}
+
+int execute_command(const Command* cmd, int is_background) {
+    switch (cmd->type) {
+        case COMMAND_SIMPLE:
+            return execute_simple(cmd, is_background);
+        case COMMAND_SUBSHELL:
+            return execute_subshell(cmd, is_background);
+        default:
+            return execute_compound(cmd);
+    }
+}
+
+static int execute_pipeline(const Pipeline* pipeline, int is_background) {
+    int status;
+    if (pipeline->command_count == 1) {
+        status = execute_command(pipeline->commands, is_background);
     } else {
-        // Parent process
-        pid_t pgid = pid;
-        add_job(pid, pgid, args[0], is_background ? BACKGROUND : FOREGROUND, is_background);
-
-        if (!is_background) {
-            Job* job = get_job_by_pid(pid);
-            if (job) {
-                put_job_in_foreground(job, 0);
+        status = handle_pipe(pipeline, is_background);
+    }
+    return pipeline->negated ? !status : status;
+}
+
+// Runs the pipelines of an and-or list, skipping those whose && or || condition fails
+static int execute_and_or(const AndOrList* list, int is_background) {
+    int status = 0;
+    const Pipeline* pipeline = list->pipelines;
+
+    while (pipeline != NULL) {
+        if (interrupted()) {
+            status = 128 + SIGINT;
+            break;
+        }
+        status = execute_pipeline(pipeline, is_background);
+
+        // Ctrl+C stops the rest of the command line, loops included, along with the job it killed
+        if (status == 128 + SIGINT && shell_is_interactive) {
+            pending_flow = FLOW_INTERRUPT;
+        } else if (pending_flow == FLOW_INTERRUPT) {
+            status = 128 + SIGINT; // It came while a loop or function inside ran
+        }
+        last_exit_status = status;
+        if (pending_flow != FLOW_NORMAL) {
+            break;
+        }
+
+        enum Connector connector = pipeline->connector;
+        pipeline = pipeline->next;
+        while (pipeline != NULL &&
+               ((connector == CONNECT_AND && status != 0) || (connector == CONNECT_OR && status == 0))) {
+            connector = pipeline->connector;
+            pipeline = pipeline->next;
+        }
+    }
+    return status;
+}
+
+// Body of a background subshell; its commands stay in its process group
+static int run_subshell(void* ctx) {
+    shell_is_interactive = 0;
+    inherited_pgid = getpgrp();
+    return execute_and_or(ctx, 0);
+}
+
+// `a && b &` runs the whole and-or list in a forked copy of the shell, as one job
+static int execute_in_background(const AndOrList* list) {
+    SpawnRequest req = {
+        .pgid = inherited_pgid,
+        .stdin_fd = -1,
+        .stdout_fd = -1,
+        .tty_fd = -1,
+    };
+    pid_t pid = spawn_subshell(&req, run_subshell, (void*)list);
+    if (pid < 0) {
+        return 1;
+    }
+
+    Job* job = add_job(inherited_pgid ? inherited_pgid : pid, list->text, BACKGROUND, 1);
+    if (job) {
+        add_job_process(job, pid);
+        announce_background_job(job, pid);
+    }
+    return 0;
+}
+
+// Whether a background list needs a copy of the shell of its own: anything
+// but a plain pipeline, or a subshell, which forks anyway
+static int needs_background_shell(const AndOrList* item) {
+    const Pipeline* pipeline = item->pipelines;
+    if (pipeline->next != NULL || pipeline->negated) {
+        return 1;
+    }
+    enum CommandType type = pipeline->commands->type;
+    return pipeline->command_count == 1 && type != COMMAND_SIMPLE && type != COMMAND_SUBSHELL;
+}
+
+// Whether an and-or list is one simple command, neither negated nor in the background
+static int is_lone_simple_command(const AndOrList* item) {
+    const Pipeline* pipeline = item->pipelines;
+    return !item->is_background && pipeline->next == NULL && !pipeline->negated &&
+           pipeline->command_count == 1 && pipeline->commands->type == COMMAND_SIMPLE;
+}
+
+int execute_list(const CommandList* list) {
+    int exec_last = exec_last_command;
+    exec_last_command = 0; // Lists inside compound commands always return
+    for (const AndOrList* item = list->first; item != NULL; item = item->next) {
+        if (pending_flow != FLOW_NORMAL) {
+            break;
+        }
+        // A script has no event loop and no line boundaries: finished background
+        // jobs are collected, and directory listings dropped, between commands
+        if (!shell_is_interactive) {
+            if (has_active_jobs()) {
+                reap_children();
+                dispatch_queued_jobs();
+                cleanup_jobs();
             }
+            path_glob_clear_cache();
+        }
+
+        exec_in_place = exec_last && item->next == NULL && is_lone_simple_command(item);
+        if (item->is_background && needs_background_shell(item)) {
+            last_exit_status = execute_in_background(item);
+        } else {
+            last_exit_status = execute_and_or(item, item->is_background);
         }
     }
+    return last_exit_status;
 }
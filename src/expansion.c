@@ -1,89 +1,654 @@
 #include "expansion.h"
+#include "executor.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <wordexp.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <pwd.h>
+#include "pathglob.h"
+#include "arith.h"
+#include "variables.h"
+#include "jobs.h"
+#include "text.h"
 
-// This function now returns a new, correctly allocated argument array.
-// The caller is responsible for freeing the returned array.
-char** expand_variables(char** args) {
-    if (args == NULL || args[0] == NULL) {
-        return args;
+#define IFS_WHITESPACE " \t\n" // Unquoted expansions are split on these
+
+/*
+ * Expansion state for one command. Finished fields are stored back to back in
+ * out, NUL-separated, so the final argv can be packed with a single allocation.
+ * The field being built is kept twice: as its literal text, and as a glob
+ * pattern in which quoted characters are escaped.
+ */
+typedef struct {
+    Buffer out;
+    size_t field_count;
+
+    Buffer text;     // Field in progress
+    Buffer pattern;  // The same field, as a pattern for path_glob()
+    int has_glob;    // An unquoted *, ? or [ was seen
+    int started;     // Something was added, even an empty quoted string
+    int failed;      // An error was reported
+    int assigning;   // Expanding an assignment value or a case word: no splitting or globbing
+} Expander;
+
+#define GLOB_SPECIAL "*?[]\\" // Escaped in the pattern when quoted
+
+// Adds text that came from quotes or an escape: never split or globbed
+static void add_quoted_run(Expander* e, const char* s, size_t len) {
+    buffer_append(&e->text, s, len);
+    const char* end = s + len;
+    while (s < end) {
+        const char* special = s;
+        while (special < end && !strchr(GLOB_SPECIAL, *special)) special++;
+        buffer_append(&e->pattern, s, special - s);
+        if (special < end) {
+            buffer_putc(&e->pattern, '\\');
+            buffer_putc(&e->pattern, *special++);
+        }
+        s = special;
     }
+    e->started = 1;
+}
+
+static void add_quoted(Expander* e, char c) {
+    add_quoted_run(e, &c, 1);
+}
 
-    // Reconstruct the full command line from the arguments.
-    // This is necessary because wordexp works on a single string.
-    size_t len = 0;
-    for (int i = 0; args[i] != NULL; i++) {
-        len += strlen(args[i]) + 1; // +1 for space or null terminator
+// Adds unquoted text, which may hold glob metacharacters
+static void add_unquoted_run(Expander* e, const char* s, size_t len) {
+    buffer_append(&e->text, s, len);
+    buffer_append(&e->pattern, s, len);
+    if (memchr(s, '*', len) || memchr(s, '?', len) || memchr(s, '[', len)) {
+        e->has_glob = 1;
     }
+    e->started = 1;
+}
 
-    char* cmd_line = malloc(len);
-    if (!cmd_line) {
-        perror("malloc");
-        return args;
+static void add_unquoted(Expander* e, char c) {
+    add_unquoted_run(e, &c, 1);
+}
+
+static void emit_field(Expander* e, const char* s, size_t len) {
+    buffer_append(&e->out, s, len);
+    buffer_putc(&e->out, '\0'); // Fields are kept NUL-separated
+    e->field_count++;
+}
+
+// Ends the field in progress, expanding it as a glob pattern if it has one
+static void finish_field(Expander* e) {
+    if (!e->started) {
+        return;
     }
-    cmd_line[0] = '\0';
 
-    for (int i = 0; args[i] != NULL; i++) {
-        strcat(cmd_line, args[i]);
-        if (args[i+1] != NULL) {
-            strcat(cmd_line, " ");
+    int matched = 0;
+    // A '[' with no ']' after it, as in the `[` command, is no pattern: skip the listing
+    if (e->has_glob && !e->assigning && pattern_has_meta(e->pattern.data)) {
+        PathList matches;
+        if (path_glob(e->pattern.data, &matches) > 0) {
+            for (size_t i = 0; i < matches.count; i++) {
+                emit_field(e, matches.paths[i], strlen(matches.paths[i]));
+            }
+            matched = 1;
         }
+        free_path_list(&matches);
     }
+    // A pattern that matches nothing is kept as written
+    if (!matched) {
+        emit_field(e, e->text.data ? e->text.data : "", e->text.len);
+    }
+
+    e->text.len = 0;
+    e->pattern.len = 0;
+    e->has_glob = 0;
+    e->started = 0;
+}
 
-    wordexp_t p;
-    // WRDE_NOCMD prevents command substitution for security.
-    // WRDE_REUSE can be used to reuse the wordexp_t struct.
-    if (wordexp(cmd_line, &p, 0) != 0) {
-        // Expansion failed, return original args
-        free(cmd_line);
-        return args;
+// Adds the value of an unquoted expansion, splitting it into fields on blanks
+static void add_split(Expander* e, const char* value) {
+    while (*value) {
+        size_t len = strcspn(value, IFS_WHITESPACE);
+        if (len > 0) {
+            add_unquoted_run(e, value, len);
+            value += len;
+        } else {
+            finish_field(e);
+            value++;
+        }
     }
-    
-    // wordexp was successful. We need to create a new args array
-    // that the rest of our shell can use and free normally.
+}
 
-    // Free the original, unexpanded args from parse_input
-    free(args[0]); // The data block
-    free(args);    // The pointer array
+static void add_value(Expander* e, const char* value, int quoted) {
+    if (value == NULL) {
+        return;
+    }
+    if (quoted || e->assigning) {
+        add_quoted_run(e, value, strlen(value));
+    } else {
+        add_split(e, value);
+    }
+}
 
-    // Allocate a new array of pointers
-    char** new_args = malloc((p.we_wordc + 1) * sizeof(char*));
-    if (!new_args) {
-        perror("malloc");
-        wordfree(&p);
-        free(cmd_line);
+static int is_name_start(char c) {
+    return isalpha((unsigned char)c) || c == '_';
+}
+
+static int is_name_char(char c) {
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+// The positional parameters joined with spaces, as $* gives them; NULL if there are none
+static const char* join_positional() {
+    static Buffer joined;
+    if (positional_count == 0) {
         return NULL;
     }
-    
-    // Calculate total size for the new argument strings
-    size_t total_arg_len = 0;
-    for (size_t i = 0; i < p.we_wordc; i++) {
-        total_arg_len += strlen(p.we_wordv[i]) + 1;
+    joined.len = 0;
+    for (int i = 0; i < positional_count; i++) {
+        if (i > 0) buffer_putc(&joined, ' ');
+        buffer_append(&joined, positional_params[i], strlen(positional_params[i]));
+    }
+    return joined.data;
+}
+
+// Looks up a variable or special parameter; returns NULL if it is unset.
+// Special parameters are formatted into scratch.
+static const char* lookup(const char* name, size_t len, char* scratch, size_t scratch_size) {
+    if (isdigit((unsigned char)name[0])) {
+        // $0, $1 ... ${10}
+        long index = strtol(name, NULL, 10);
+        if (index == 0) {
+            return shell_name;
+        }
+        return index <= positional_count ? positional_params[index - 1] : NULL;
+    }
+    if (len == 1) {
+        switch (name[0]) {
+            case '?':
+                snprintf(scratch, scratch_size, "%d", last_exit_status);
+                return scratch;
+            case '$':
+                snprintf(scratch, scratch_size, "%d", (int)getpid());
+                return scratch;
+            case '#':
+                snprintf(scratch, scratch_size, "%d", positional_count);
+                return scratch;
+            case '!':
+                if (last_background_pid == 0) {
+                    return NULL;
+                }
+                snprintf(scratch, scratch_size, "%d", (int)last_background_pid);
+                return scratch;
+            case '@':
+            case '*':
+                return join_positional();
+        }
+    }
+    if (len >= scratch_size) {
+        return NULL;
+    }
+    memcpy(scratch, name, len);
+    scratch[len] = '\0';
+    return getenv(scratch);
+}
+
+static void expand_range(Expander* e, const char* s, const char* end, int in_dquote);
+
+// Expands $@ and $*: one field per parameter, except that "$*" joins them with spaces
+static void add_positional(Expander* e, char c, int in_dquote) {
+    if ((c == '*' && in_dquote) || e->assigning) {
+        add_value(e, join_positional(), 1);
+        return;
+    }
+    for (int i = 0; i < positional_count; i++) {
+        if (i > 0) {
+            finish_field(e);
+        }
+        add_value(e, positional_params[i], in_dquote);
+    }
+}
+
+// Finds the '}' closing a ${...} that starts at s, skipping quotes and nested braces
+static const char* find_closing_brace(const char* s, const char* end) {
+    int depth = 0;
+    for (; s < end; s++) {
+        if (*s == '\\' && s + 1 < end) {
+            s++;
+        } else if (*s == '\'' || *s == '"') {
+            const char* close = memchr(s + 1, *s, end - s - 1);
+            if (!close) return NULL;
+            s = close;
+        } else if (*s == '{') {
+            depth++;
+        } else if (*s == '}') {
+            if (--depth == 0) return s;
+        }
+    }
+    return NULL;
+}
+
+// Expands ${...}; s points at the '$'. Returns the position after the '}'.
+static const char* expand_braced(Expander* e, const char* s, const char* end, int in_dquote) {
+    const char* close = find_closing_brace(s + 1, end);
+    if (close == NULL) {
+        fprintf(stderr, "%.*s: bad substitution\n", (int)(end - s), s);
+        e->failed = 1;
+        return end;
+    }
+
+    const char* p = s + 2;
+    int want_length = 0;
+    if (*p == '#' && p + 1 < close) {
+        want_length = 1; // ${#name}
+        p++;
+    }
+
+    const char* name = p;
+    if (p < close && strchr("?$#!@*", *p)) {
+        p++;
+    } else if (p < close && isdigit((unsigned char)*p)) {
+        while (p < close && isdigit((unsigned char)*p)) p++;
+    } else if (p < close && is_name_start(*p)) {
+        while (p < close && is_name_char(*p)) p++;
     }
+    size_t name_len = p - name;
 
-    // Allocate a single block for all argument strings
-    char* new_args_data = malloc(total_arg_len);
-     if (!new_args_data) {
+    // What follows the name: nothing, or an operator and a word
+    int colon = 0;
+    char op = '\0';
+    if (p < close && *p == ':') {
+        colon = 1;
+        p++;
+    }
+    if (p < close && strchr("-+=?", *p)) {
+        op = *p++;
+    }
+    if (name_len == 0 || (p < close && op == '\0') || (colon && op == '\0') || (want_length && op != '\0')) {
+        fprintf(stderr, "%.*s: bad substitution\n", (int)(close - s + 1), s);
+        e->failed = 1;
+        return close + 1;
+    }
+
+    if (name_len == 1 && (*name == '@' || *name == '*') && op == '\0' && !want_length) {
+        add_positional(e, *name, in_dquote);
+        return close + 1;
+    }
+
+    char scratch[256];
+    const char* value = lookup(name, name_len, scratch, sizeof(scratch));
+    int is_set = value != NULL && (!colon || value[0] != '\0');
+
+    if (want_length) {
+        char len_text[32];
+        snprintf(len_text, sizeof(len_text), "%zu", value ? strlen(value) : 0);
+        add_value(e, len_text, in_dquote);
+    } else if (op == '\0' || (op == '+' ? !is_set : is_set)) {
+        if (op != '+') {
+            add_value(e, value, in_dquote);
+        }
+    } else if (op == '-' || op == '+') {
+        expand_range(e, p, close, in_dquote);
+    } else {
+        // ${name=word} assigns the expanded word; ${name?word} reports it
+        Expander word = { 0 };
+        expand_range(&word, p, close, 1);
+        finish_field(&word);
+        const char* text = word.field_count > 0 ? word.out.data : "";
+        if (op == '=') {
+            char* var = strndup(name, name_len);
+            set_variable(var, text);
+            free(var);
+            add_value(e, text, in_dquote);
+        } else {
+            fprintf(stderr, "%.*s: %s\n", (int)name_len, name, text[0] ? text : "parameter null or not set");
+            e->failed = 1;
+        }
+        free(word.out.data);
+        free(word.text.data);
+        free(word.pattern.data);
+    }
+    return close + 1;
+}
+
+// Expands $((expr)); s points at the '$'. Returns the position after the "))".
+static const char* expand_arithmetic(Expander* e, const char* s, const char* end, int in_dquote) {
+    const char* close = NULL;
+    int depth = 0;
+    for (const char* p = s + 1; p < end && close == NULL; p++) {
+        if (*p == '(') {
+            depth++;
+        } else if (*p == ')' && --depth == 0) {
+            close = p;
+        }
+    }
+    if (close == NULL || close[-1] != ')' || close - 1 < s + 3) {
+        fprintf(stderr, "%.*s: bad substitution\n", (int)(end - s), s);
+        e->failed = 1;
+        return end;
+    }
+
+    // The expression is expanded first, as if quoted: $x and ${x} are allowed inside
+    Expander expr = { .assigning = 1 };
+    expand_range(&expr, s + 3, close - 1, 0);
+    long value = 0;
+    if (expr.failed || arith_evaluate(expr.text.data ? expr.text.data : "", &value) < 0) {
+        e->failed = 1;
+    } else {
+        char text[32];
+        snprintf(text, sizeof(text), "%ld", value);
+        add_value(e, text, in_dquote);
+    }
+    free(expr.out.data);
+    free(expr.text.data);
+    free(expr.pattern.data);
+    return close + 1;
+}
+
+// Expands a '$' expansion at s. Returns the position after it.
+static const char* expand_dollar(Expander* e, const char* s, const char* end, int in_dquote) {
+    const char* p = s + 1;
+    char scratch[256];
+
+    if (p < end && *p == '{') {
+        return expand_braced(e, s, end, in_dquote);
+    }
+    if (p + 1 < end && p[0] == '(' && p[1] == '(') {
+        return expand_arithmetic(e, s, end, in_dquote);
+    }
+    if (p < end && *p == '(') {
+        // Command substitution would need a subshell; it is not supported
+        fprintf(stderr, "%.*s: command substitution is not supported\n", (int)(end - s), s);
+        e->failed = 1;
+        return end;
+    }
+    if (p < end && (*p == '@' || *p == '*')) {
+        add_positional(e, *p, in_dquote);
+        return p + 1;
+    }
+    if (p < end && (*p == '?' || *p == '$' || *p == '#' || *p == '!' || isdigit((unsigned char)*p))) {
+        add_value(e, lookup(p, 1, scratch, sizeof(scratch)), in_dquote);
+        return p + 1;
+    }
+    if (p < end && is_name_start(*p)) {
+        const char* name = p;
+        while (p < end && is_name_char(*p)) p++;
+        add_value(e, lookup(name, p - name, scratch, sizeof(scratch)), in_dquote);
+        return p;
+    }
+
+    // A lone '$' is literal
+    if (in_dquote) {
+        add_quoted(e, '$');
+    } else {
+        add_unquoted(e, '$');
+    }
+    return p;
+}
+
+// Expands a leading ~ or ~user at s. Returns the position after it, or s if it is not one.
+static const char* expand_tilde(Expander* e, const char* s, const char* end) {
+    const char* p = s + 1;
+    while (p < end && *p != '/' && (is_name_char(*p) || *p == '.' || *p == '-')) p++;
+    if (p < end && *p != '/') {
+        return s; // Something like ~'x' is not a tilde prefix
+    }
+
+    const char* home = NULL;
+    if (p == s + 1) {
+        home = getenv("HOME");
+        if (home == NULL) {
+            struct passwd* pw = getpwuid(getuid());
+            home = pw ? pw->pw_dir : NULL;
+        }
+    } else {
+        char* user = strndup(s + 1, p - s - 1);
+        struct passwd* pw = getpwnam(user);
+        free(user);
+        home = pw ? pw->pw_dir : NULL;
+    }
+    if (home == NULL) {
+        return s; // Unknown user: left as written
+    }
+    add_quoted_run(e, home, strlen(home));
+    return p;
+}
+
+// Expands the characters in [s, end) into the field in progress
+static void expand_range(Expander* e, const char* s, const char* end, int in_dquote) {
+    while (s < end && !e->failed) {
+        char c = *s;
+
+        if (c == '\\') {
+            if (s + 1 >= end) {
+                add_quoted(e, c);
+                s++;
+            } else if (s[1] == '\n') {
+                s += 2; // Line continuation
+            } else if (!in_dquote || strchr("$`\"\\", s[1])) {
+                add_quoted(e, s[1]);
+                s += 2;
+            } else {
+                add_quoted(e, c); // Inside double quotes, other backslashes are literal
+                s++;
+            }
+        } else if (c == '\'' && !in_dquote) {
+            const char* close = memchr(s + 1, '\'', end - s - 1);
+            if (close == NULL) close = end;
+            add_quoted_run(e, s + 1, close - s - 1); // '' is an empty argument, not nothing
+            s = close < end ? close + 1 : end;
+        } else if (c == '"' && !in_dquote) {
+            // Find the closing quote, skipping escaped characters
+            const char* close = s + 1;
+            while (close < end && *close != '"') {
+                if (*close == '\\' && close + 1 < end) close++;
+                close++;
+            }
+            int was_started = e->started;
+            e->started = 1;
+            expand_range(e, s + 1, close, 1);
+            // "$@" without parameters is no field at all, not an empty one
+            size_t len = close - s - 1;
+            if (!was_started && positional_count == 0 &&
+                ((len == 2 && memcmp(s + 1, "$@", 2) == 0) || (len == 4 && memcmp(s + 1, "${@}", 4) == 0))) {
+                e->started = 0;
+            }
+            s = close < end ? close + 1 : end;
+        } else if (c == '$') {
+            s = expand_dollar(e, s, end, in_dquote);
+        } else if (!in_dquote && !e->assigning && strchr(IFS_WHITESPACE, c)) {
+            finish_field(e); // Only possible inside ${name:-word}
+            s++;
+        } else if (c == '`') {
+            fprintf(stderr, "%.*s: command substitution is not supported\n", (int)(end - s), s);
+            e->failed = 1;
+        } else {
+            // Plain text up to the next character that needs attention
+            const char* run = s + 1;
+            while (run < end && !strchr("\\'\"$` \t\n", *run)) run++;
+            if (in_dquote) {
+                add_quoted_run(e, s, run - s);
+            } else {
+                add_unquoted_run(e, s, run - s);
+            }
+            s = run;
+        }
+    }
+}
+
+static void expand_word(Expander* e, const char* word) {
+    const char* s = word;
+    const char* end = word + strlen(word);
+
+    if (*s == '~') {
+        s = expand_tilde(e, s, end);
+    }
+    expand_range(e, s, end, 0);
+    finish_field(e);
+}
+
+// Steps over one unit of a raw word: a character, an escape, a quoted string or a ${...}
+static const char* next_unit(const char* s, const char* end) {
+    if (*s == '\\' && s + 1 < end) {
+        return s + 2;
+    }
+    if (*s == '\'' || *s == '"') {
+        const char* p = s + 1;
+        while (p < end && *p != *s) {
+            if (*s == '"' && *p == '\\' && p + 1 < end) p++;
+            p++;
+        }
+        return p < end ? p + 1 : end;
+    }
+    if (s[0] == '$' && s + 1 < end && s[1] == '{') {
+        const char* close = find_closing_brace(s + 1, end);
+        return close ? close + 1 : end;
+    }
+    return s + 1;
+}
+
+// Finds the first brace expression in [s, end): an unquoted '{' whose matching '}'
+// has a comma at its own level. Returns the '{', or NULL if there is none.
+static const char* find_brace_expression(const char* s, const char* end, const char** close) {
+    for (; s < end; s = next_unit(s, end)) {
+        if (*s != '{') {
+            continue;
+        }
+        int depth = 0, has_comma = 0;
+        for (const char* p = s; p < end; p = next_unit(p, end)) {
+            if (next_unit(p, end) != p + 1) {
+                continue; // Quoted or escaped
+            }
+            if (*p == '{') {
+                depth++;
+            } else if (*p == ',' && depth == 1) {
+                has_comma = 1;
+            } else if (*p == '}' && --depth == 0) {
+                if (has_comma) {
+                    *close = p;
+                    return s;
+                }
+                break;
+            }
+        }
+    }
+    return NULL;
+}
+
+// Brace expansion: a{b,c}d becomes abd and acd, each then expanded on its own
+static void expand_braces(Expander* e, const char* word) {
+    const char* end = word + strlen(word);
+    const char* close;
+    const char* open = find_brace_expression(word, end, &close);
+    if (open == NULL) {
+        expand_word(e, word);
+        return;
+    }
+
+    size_t prefix_len = open - word;
+    size_t suffix_len = end - close - 1;
+    char* alternative = malloc(end - word + 1);
+    if (!alternative) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    int depth = 0;
+    const char* start = open + 1;
+    for (const char* p = open + 1; p <= close && !e->failed; p = next_unit(p, end)) {
+        int plain = next_unit(p, end) == p + 1;
+        if (plain && *p == '{') {
+            depth++;
+        } else if (plain && *p == '}' && depth > 0) {
+            depth--;
+        } else if (plain && (*p == ',' || p == close) && depth == 0) {
+            // prefix + this alternative + suffix; the suffix may hold more braces
+            size_t len = p - start;
+            memcpy(alternative, word, prefix_len);
+            memcpy(alternative + prefix_len, start, len);
+            memcpy(alternative + prefix_len + len, close + 1, suffix_len);
+            alternative[prefix_len + len + suffix_len] = '\0';
+            expand_braces(e, alternative);
+            start = p + 1;
+        }
+    }
+    free(alternative);
+}
+
+// Packs the finished fields into one allocation: the pointer array, then the strings
+static char** pack_fields(Expander* e) {
+    size_t pointers = (e->field_count + 1) * sizeof(char*);
+    char** argv = malloc(pointers + e->out.len);
+    if (!argv) {
         perror("malloc");
-        free(new_args);
-        wordfree(&p);
-        free(cmd_line);
         return NULL;
     }
 
-    // Copy the strings from wordexp results into our new block
-    char* current_pos = new_args_data;
-    for (size_t i = 0; i < p.we_wordc; i++) {
-        strcpy(current_pos, p.we_wordv[i]);
-        new_args[i] = current_pos;
-        current_pos += strlen(p.we_wordv[i]) + 1;
+    char* data = (char*)argv + pointers;
+    if (e->out.len > 0) {
+        memcpy(data, e->out.data, e->out.len);
+    }
+    for (size_t i = 0; i < e->field_count; i++) {
+        argv[i] = data;
+        data += strlen(data) + 1;
     }
-    new_args[p.we_wordc] = NULL;
+    argv[e->field_count] = NULL;
+    return argv;
+}
 
-    wordfree(&p);
-    free(cmd_line);
+static void free_expander(Expander* e) {
+    free(e->out.data);
+    free(e->text.data);
+    free(e->pattern.data);
+}
+
+char** expand_variables(char** words) {
+    Expander e = { 0 };
+    for (int i = 0; words[i] != NULL && !e.failed; i++) {
+        expand_braces(&e, words[i]);
+    }
 
-    return new_args;
-}
\ No newline at end of file
+    char** argv = e.failed ? NULL : pack_fields(&e);
+    free_expander(&e);
+    return argv;
+}
+
+// Expands a word into one string, without splitting or globbing.
+// With as_pattern, quoted glob characters come back escaped.
+static char* expand_unsplit(const char* word, int as_pattern) {
+    Expander e = { .assigning = 1 };
+    const char* end = word + strlen(word);
+    const char* s = *word == '~' ? expand_tilde(&e, word, end) : word;
+    expand_range(&e, s, end, 0);
+
+    char* result = NULL;
+    if (!e.failed) {
+        Buffer* b = as_pattern ? &e.pattern : &e.text;
+        result = strdup(b->data ? b->data : "");
+    }
+    free_expander(&e);
+    return result;
+}
+
+char* expand_assignment(const char* value) {
+    return expand_unsplit(value, 0);
+}
+
+char* expand_pattern(const char* word) {
+    return expand_unsplit(word, 1);
+}
+
+char* expand_redirection_target(const char* word) {
+    Expander e = { 0 };
+    expand_braces(&e, word);
+
+    char* path = NULL;
+    if (!e.failed) {
+        if (e.field_count != 1) {
+            fprintf(stderr, "%s: ambiguous redirect\n", word);
+        } else {
+            path = strdup(e.out.data);
+        }
+    }
+    free_expander(&e);
+    return path;
+}
@@ -0,0 +1,133 @@
+#define _GNU_SOURCE
+#include "fastcopy.h"
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+
+#define KERNEL_CHUNK (1 << 30)  // Bytes per copy_file_range/sendfile/splice call
+#define BUFFER_SIZE (128 * 1024) // Bytes per read() in the userspace fallback
+
+// Returned by a strategy that cannot handle this pair of descriptors at all
+#define COPY_UNSUPPORTED ((off_t)-2)
+
+// Errors meaning "not for these descriptors"; the next strategy is tried instead
+static int is_unsupported(int err) {
+    return err == EINVAL || err == ENOSYS || err == EXDEV || err == EOPNOTSUPP || err == EBADF;
+}
+
+static off_t copy_with_copy_file_range(int in_fd, int out_fd) {
+    off_t total = 0;
+    for (;;) {
+        ssize_t n = copy_file_range(in_fd, NULL, out_fd, NULL, KERNEL_CHUNK, 0);
+        if (n > 0) {
+            total += n;
+        } else if (n == 0) {
+            // Some pseudo filesystems report EOF straight away; let a later strategy read them
+            return total > 0 ? total : COPY_UNSUPPORTED;
+        } else if (errno != EINTR) {
+            return (total == 0 && is_unsupported(errno)) ? COPY_UNSUPPORTED : -1;
+        }
+    }
+}
+
+static off_t copy_with_sendfile(int in_fd, int out_fd) {
+    off_t total = 0;
+    for (;;) {
+        ssize_t n = sendfile(out_fd, in_fd, NULL, KERNEL_CHUNK);
+        if (n > 0) {
+            total += n;
+        } else if (n == 0) {
+            return total > 0 ? total : COPY_UNSUPPORTED;
+        } else if (errno != EINTR) {
+            return (total == 0 && is_unsupported(errno)) ? COPY_UNSUPPORTED : -1;
+        }
+    }
+}
+
+static off_t copy_with_splice(int in_fd, int out_fd) {
+    off_t total = 0;
+    for (;;) {
+        ssize_t n = splice(in_fd, NULL, out_fd, NULL, KERNEL_CHUNK, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (n > 0) {
+            total += n;
+        } else if (n == 0) {
+            return total; // The writer closed the pipe
+        } else if (errno != EINTR) {
+            return (total == 0 && is_unsupported(errno)) ? COPY_UNSUPPORTED : -1;
+        }
+    }
+}
+
+static off_t copy_with_read_write(int in_fd, int out_fd) {
+    static char buffer[BUFFER_SIZE];
+    off_t total = 0;
+    for (;;) {
+        ssize_t n = read(in_fd, buffer, sizeof(buffer));
+        if (n == 0) {
+            return total;
+        }
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        for (ssize_t done = 0; done < n; ) {
+            ssize_t written = write(out_fd, buffer + done, n - done);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                return -1;
+            }
+            done += written;
+        }
+        total += n;
+    }
+}
+
+// copy_file_range refuses O_APPEND descriptors, so an append is done by seeking
+// to the end with O_APPEND cleared, which is where appended writes would land.
+static off_t copy_file_to_file(int in_fd, int out_fd) {
+    int flags = fcntl(out_fd, F_GETFL);
+    if (flags < 0) {
+        return COPY_UNSUPPORTED;
+    }
+    if (flags & O_APPEND) {
+        if (lseek(out_fd, 0, SEEK_END) < 0 || fcntl(out_fd, F_SETFL, flags & ~O_APPEND) < 0) {
+            return COPY_UNSUPPORTED;
+        }
+    }
+
+    off_t copied = copy_with_copy_file_range(in_fd, out_fd);
+
+    if (flags & O_APPEND) {
+        fcntl(out_fd, F_SETFL, flags);
+    }
+    return copied;
+}
+
+off_t copy_fd_data(int in_fd, int out_fd) {
+    struct stat in_st, out_st;
+    if (fstat(in_fd, &in_st) < 0 || fstat(out_fd, &out_st) < 0) {
+        return -1;
+    }
+
+    off_t copied = COPY_UNSUPPORTED;
+
+    // Files in /proc and similar report a size of 0; only read() sees their contents
+    if (S_ISREG(in_st.st_mode) && in_st.st_size > 0) {
+        if (S_ISREG(out_st.st_mode)) {
+            copied = copy_file_to_file(in_fd, out_fd);
+        }
+        if (copied == COPY_UNSUPPORTED) {
+            copied = copy_with_sendfile(in_fd, out_fd);
+        }
+    } else if (S_ISFIFO(in_st.st_mode) || S_ISFIFO(out_st.st_mode)) {
+        copied = copy_with_splice(in_fd, out_fd);
+    }
+
+    if (copied == COPY_UNSUPPORTED) {
+        copied = copy_with_read_write(in_fd, out_fd);
+    }
+    return copied;
+}
@@ -0,0 +1,96 @@
+#include "functions.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "astimage.h"
+#include "text.h"
+
+#define FUNCTION_BUCKETS 64
+
+static Function* function_table[FUNCTION_BUCKETS];
+
+static unsigned int hash_name(const char* name) {
+    return hash_string(name) % FUNCTION_BUCKETS;
+}
+
+static void free_function(Function* fn) {
+    free(fn->image);
+    free(fn->name);
+    free(fn);
+}
+
+// Unlinks the function called name from the table, returning it
+static Function* take_function(const char* name) {
+    Function** link = &function_table[hash_name(name)];
+    for (; *link != NULL; link = &(*link)->next) {
+        if (strcmp((*link)->name, name) == 0) {
+            Function* fn = *link;
+            *link = fn->next;
+            fn->next = NULL;
+            return fn;
+        }
+    }
+    return NULL;
+}
+
+// Frees a function that left the table, unless a call to it is still running
+static void retire_function(Function* fn) {
+    if (fn->running > 0) {
+        fn->retired = 1;
+    } else {
+        free_function(fn);
+    }
+}
+
+void define_function(const FunctionDef* def) {
+    Function* fn = calloc(1, sizeof(Function));
+    if (!fn) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    // A flattened copy of the body, relocated to where it now lives
+    AstImage image;
+    flatten_command(def->body, &image);
+    relocate_ast_image(image.data, image.size, image.relocs, image.reloc_count);
+    fn->image = image.data;
+    fn->body = (const Command*)image.data;
+    fn->name = strdup(def->name);
+    free(image.relocs);
+
+    Function* old = take_function(def->name);
+    if (old != NULL) {
+        retire_function(old);
+    }
+    unsigned int bucket = hash_name(fn->name);
+    fn->next = function_table[bucket];
+    function_table[bucket] = fn;
+}
+
+Function* find_function(const char* name) {
+    for (Function* fn = function_table[hash_name(name)]; fn != NULL; fn = fn->next) {
+        if (strcmp(fn->name, name) == 0) {
+            return fn;
+        }
+    }
+    return NULL;
+}
+
+int unset_function(const char* name) {
+    Function* fn = take_function(name);
+    if (fn == NULL) {
+        return -1;
+    }
+    retire_function(fn);
+    return 0;
+}
+
+void function_enter(Function* fn) {
+    fn->running++;
+}
+
+void function_leave(Function* fn) {
+    if (--fn->running == 0 && fn->retired) {
+        free_function(fn);
+    }
+}
@@ -0,0 +1,312 @@
+#define _GNU_SOURCE
+#include "histindex.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "text.h"
+
+#define INITIAL_TABLE_SIZE 1024 // Slots in each hash table (always a power of two)
+#define MAX_QUERY_WORDS 16
+#define PREFIX_BONUS 4.0        // A word that starts the command
+#define WORD_START_BONUS 2.0    // A word that starts one of the command's words
+#define RECENCY_WEIGHT 8.0      // The most recent command gets all of it, the oldest none
+
+static void* grow_array(void* array, size_t count, size_t size) {
+    void* grown = realloc(array, count * size);
+    if (!grown) {
+        perror("realloc");
+        exit(EXIT_FAILURE);
+    }
+    return grown;
+}
+
+// Three bytes of text, lowercased; never 0, since text holds no NUL
+static uint32_t trigram_at(const char* s) {
+    return (uint32_t)tolower((unsigned char)s[0]) << 16 | (uint32_t)tolower((unsigned char)s[1]) << 8 |
+           (uint32_t)tolower((unsigned char)s[2]);
+}
+
+static size_t trigram_slot(uint32_t key, size_t size) {
+    return (key * 2654435761u) & (size - 1);
+}
+
+// --- Building ---
+
+static void grow_text_table(HistIndex* index) {
+    size_t size = index->by_text_size ? index->by_text_size * 2 : INITIAL_TABLE_SIZE;
+    uint32_t* table = calloc(size, sizeof(uint32_t));
+    if (!table) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    for (uint32_t id = 0; id < index->command_count; id++) {
+        const IndexedCommand* c = &index->commands[id];
+        size_t slot = hash_bytes(index->texts + c->text, c->len) & (size - 1);
+        while (table[slot] != 0) slot = (slot + 1) & (size - 1);
+        table[slot] = id + 1;
+    }
+    free(index->by_text);
+    index->by_text = table;
+    index->by_text_size = size;
+}
+
+static void grow_trigram_table(HistIndex* index) {
+    size_t size = index->trigram_size ? index->trigram_size * 2 : INITIAL_TABLE_SIZE;
+    uint32_t* keys = calloc(size, sizeof(uint32_t));
+    PostingList* postings = calloc(size, sizeof(PostingList));
+    if (!keys || !postings) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < index->trigram_size; i++) {
+        if (index->trigram_keys[i] != 0) {
+            size_t slot = trigram_slot(index->trigram_keys[i], size);
+            while (keys[slot] != 0) slot = (slot + 1) & (size - 1);
+            keys[slot] = index->trigram_keys[i];
+            postings[slot] = index->postings[i];
+        }
+    }
+    free(index->trigram_keys);
+    free(index->postings);
+    index->trigram_keys = keys;
+    index->postings = postings;
+    index->trigram_size = size;
+}
+
+// The posting list of a trigram, or NULL if it occurs nowhere (and create is 0)
+static PostingList* find_postings(HistIndex* index, uint32_t key, int create) {
+    if (create && (index->trigram_count + 1) * 2 > index->trigram_size) {
+        grow_trigram_table(index);
+    }
+    if (index->trigram_size == 0) {
+        return NULL;
+    }
+    size_t slot = trigram_slot(key, index->trigram_size);
+    for (; index->trigram_keys[slot] != 0; slot = (slot + 1) & (index->trigram_size - 1)) {
+        if (index->trigram_keys[slot] == key) {
+            return &index->postings[slot];
+        }
+    }
+    if (!create) {
+        return NULL;
+    }
+    index->trigram_keys[slot] = key;
+    index->trigram_count++;
+    return &index->postings[slot];
+}
+
+void hist_index_add(HistIndex* index, const char* text, size_t len) {
+    index->seq++;
+    if ((index->command_count + 1) * 2 > index->by_text_size) {
+        grow_text_table(index);
+    }
+    size_t mask = index->by_text_size - 1;
+    size_t slot = hash_bytes(text, len) & mask;
+    for (; index->by_text[slot] != 0; slot = (slot + 1) & mask) {
+        IndexedCommand* c = &index->commands[index->by_text[slot] - 1];
+        if (c->len == len && memcmp(index->texts + c->text, text, len) == 0) {
+            // Seen before: its postings are already there
+            c->count++;
+            c->last_seq = index->seq;
+            return;
+        }
+    }
+
+    if (index->texts_len + len + 1 > index->texts_cap) {
+        index->texts_cap = index->texts_cap ? index->texts_cap * 2 : 64 * 1024;
+        while (index->texts_len + len + 1 > index->texts_cap) index->texts_cap *= 2;
+        index->texts = grow_array(index->texts, index->texts_cap, 1);
+    }
+    if (index->command_count == index->command_cap) {
+        index->command_cap = index->command_cap ? index->command_cap * 2 : 1024;
+        index->commands = grow_array(index->commands, index->command_cap, sizeof(IndexedCommand));
+    }
+    uint32_t id = index->command_count++;
+    index->commands[id] = (IndexedCommand){ index->texts_len, len, 1, index->seq };
+    memcpy(index->texts + index->texts_len, text, len);
+    index->texts[index->texts_len + len] = '\0';
+    index->texts_len += len + 1;
+    index->by_text[slot] = id + 1;
+
+    for (size_t i = 0; i + 3 <= len; i++) {
+        PostingList* list = find_postings(index, trigram_at(text + i), 1);
+        // Ids only grow, so a trigram repeated within this command is caught here
+        if (list->len > 0 && list->ids[list->len - 1] == id) {
+            continue;
+        }
+        if (list->len == list->cap) {
+            list->cap = list->cap ? list->cap * 2 : 4;
+            list->ids = grow_array(list->ids, list->cap, sizeof(uint32_t));
+        }
+        list->ids[list->len++] = id;
+    }
+}
+
+// --- Searching ---
+
+// Keeps out sorted best first, holding at most max matches
+static void offer_match(HistMatch* out, int* found, int max, HistMatch match) {
+    int i = *found < max ? (*found)++ : max;
+    while (i > 0 && out[i - 1].score < match.score) {
+        if (i < max) {
+            out[i] = out[i - 1];
+        }
+        i--;
+    }
+    if (i < max) {
+        out[i] = match;
+    }
+}
+
+// What every match earns: more for a command entered often, and recently
+static double usage_score(const HistIndex* index, const IndexedCommand* c) {
+    int frequency = 32 - __builtin_clz(c->count); // Doubling the count adds one
+    return frequency + RECENCY_WEIGHT * c->last_seq / index->seq;
+}
+
+static int has_id(const PostingList* list, uint32_t id) {
+    uint32_t lo = 0, hi = list->len;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (list->ids[mid] < id) lo = mid + 1; else hi = mid;
+    }
+    return lo < list->len && list->ids[lo] == id;
+}
+
+static int compare_lengths(const void* a, const void* b) {
+    const PostingList* x = *(PostingList* const*)a;
+    const PostingList* y = *(PostingList* const*)b;
+    return (x->len > y->len) - (x->len < y->len);
+}
+
+// Scores a command holding every word, or returns -1 if one is missing
+static double score_words(const HistIndex* index, const IndexedCommand* c, char** words, int word_count) {
+    const char* text = index->texts + c->text;
+    double score = usage_score(index, c);
+    for (int w = 0; w < word_count; w++) {
+        const char* at = strcasestr(text, words[w]);
+        if (at == NULL) {
+            return -1;
+        }
+        if (at == text) {
+            score += PREFIX_BONUS;
+        } else if (!isalnum((unsigned char)at[-1])) {
+            score += WORD_START_BONUS;
+        }
+    }
+    return score;
+}
+
+static int search_words(HistIndex* index, char** words, int word_count, HistMatch* out, int max) {
+    // Every trigram of every word must occur in a match; start from the rarest
+    size_t list_count = 0, list_cap = 0;
+    PostingList** lists = NULL;
+    for (int w = 0; w < word_count; w++) {
+        for (size_t i = 0; i + 3 <= strlen(words[w]); i++) {
+            PostingList* list = find_postings(index, trigram_at(words[w] + i), 0);
+            if (list == NULL) {
+                free(lists);
+                return 0;
+            }
+            if (list_count == list_cap) {
+                list_cap = list_cap ? list_cap * 2 : 16;
+                lists = grow_array(lists, list_cap, sizeof(PostingList*));
+            }
+            lists[list_count++] = list;
+        }
+    }
+    qsort(lists, list_count, sizeof(PostingList*), compare_lengths);
+
+    int found = 0;
+    uint32_t candidates = list_count ? lists[0]->len : index->command_count;
+    for (uint32_t i = 0; i < candidates; i++) {
+        uint32_t id = list_count ? lists[0]->ids[i] : i;
+        size_t l = 1;
+        while (l < list_count && has_id(lists[l], id)) l++;
+        if (l < list_count) {
+            continue;
+        }
+        // Trigrams can all be there without the words being: check the text itself
+        const IndexedCommand* c = &index->commands[id];
+        double score = score_words(index, c, words, word_count);
+        if (score >= 0) {
+            offer_match(out, &found, max, (HistMatch){ index->texts + c->text, c->count, score });
+        }
+    }
+    free(lists);
+    return found;
+}
+
+// The fallback: the query's characters in order anywhere in the command, scored by how close together
+static int search_subsequence(HistIndex* index, const char* query, HistMatch* out, int max) {
+    int found = 0;
+    size_t query_len = strlen(query);
+    for (uint32_t id = 0; id < index->command_count; id++) {
+        const IndexedCommand* c = &index->commands[id];
+        const char* text = index->texts + c->text;
+        const char* first = NULL;
+        const char* p = text;
+        size_t q = 0;
+        for (; *p && q < query_len; p++) {
+            if (tolower((unsigned char)*p) == query[q]) {
+                if (q++ == 0) first = p;
+            }
+        }
+        if (q < query_len) {
+            continue;
+        }
+        double score = usage_score(index, c) + 10.0 * query_len / (p - first);
+        if (first == text) {
+            score += PREFIX_BONUS;
+        }
+        offer_match(out, &found, max, (HistMatch){ text, c->count, score });
+    }
+    return found;
+}
+
+int hist_index_search(HistIndex* index, const char* query, HistMatch* out, int max) {
+    if (index->command_count == 0 || max <= 0) {
+        return 0;
+    }
+    char* lowered = strdup(query);
+    char* squeezed = malloc(strlen(query) + 1);
+    if (!lowered || !squeezed) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    char* words[MAX_QUERY_WORDS];
+    int word_count = 0;
+    size_t squeezed_len = 0;
+    for (char* p = lowered; *p; p++) {
+        *p = tolower((unsigned char)*p);
+        if (!isspace((unsigned char)*p)) squeezed[squeezed_len++] = *p;
+    }
+    squeezed[squeezed_len] = '\0';
+    for (char* word = strtok(lowered, " \t\n"); word && word_count < MAX_QUERY_WORDS; word = strtok(NULL, " \t\n")) {
+        words[word_count++] = word;
+    }
+
+    int found = 0;
+    if (word_count > 0) {
+        found = search_words(index, words, word_count, out, max);
+        if (found == 0) {
+            found = search_subsequence(index, squeezed, out, max);
+        }
+    }
+    free(lowered);
+    free(squeezed);
+    return found;
+}
+
+void hist_index_free(HistIndex* index) {
+    for (size_t i = 0; i < index->trigram_size; i++) {
+        free(index->postings[i].ids);
+    }
+    free(index->trigram_keys);
+    free(index->postings);
+    free(index->by_text);
+    free(index->commands);
+    free(index->texts);
+    memset(index, 0, sizeof(HistIndex));
+}
@@ -1,19 +1,512 @@
+#define _GNU_SOURCE
 #include "history.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <readline/readline.h>
 #include <readline/history.h>
+#include "redirect.h" // For move_shell_fd
+#include "text.h"
 
-// Built-in history command
-void builtin_history(char** args) {
-    HIST_ENTRY** hist_list = history_list();
-    if (hist_list) {
-        for (int i = 0; hist_list[i]; i++) {
-            printf("%d  %s\n", i+history_base, hist_list[i]->line);
+#define DEFAULT_HISTSIZE 10000          // Entries loaded at startup and kept in memory
+#define DEFAULT_HISTFILESIZE 100000     // Entries a compacted file keeps
+#define COMPACT_CHECK_INTERVAL 1000     // Entries appended between looks at the file's length
+#define RECORD_START '\x1e'             // ASCII record separator; see the file format in history.h
+#define MAX_LENGTH_DIGITS 10
+#define DEFAULT_SEARCH_RESULTS 20       // Matches `history -s` prints without -n
+
+// One entry of the file: where its text is and how long it is
+typedef struct {
+    size_t text;
+    size_t len;
+} FileEntry;
+
+// What a compaction works with, copied so the thread never reads settings that change
+typedef struct {
+    long limit;
+    int erase_dups;
+} CompactSettings;
+
+static char history_path[1024];
+static int history_fd = -1;         // Every accepted line is appended through it
+static pid_t history_owner = 0;     // Forked copies of the shell neither append nor compact
+static long memory_limit = DEFAULT_HISTSIZE;
+static long file_limit = DEFAULT_HISTFILESIZE;
+static int appended_since_check = 0;
+static pthread_t compact_thread;
+static int compact_started = 0;
+
+static int share_history = -1;      // -1 until read from $HISTSHARE
+static int erase_dups = -1;         // -1 until read from $HISTCONTROL
+static ino_t read_ino;              // The file read_offset belongs to
+static off_t read_offset;           // Everything before it is in readline's history
+
+static HistIndex search_index;      // The whole file, not just the entries in memory
+static pthread_t index_thread;
+static int index_started = 0;
+static int index_fd = -1;           // The file the index is built from, up to index_end
+static off_t index_end;
+static char** unindexed = NULL;     // Entries that came after index_end, oldest first
+static size_t unindexed_count = 0;
+static size_t unindexed_capacity = 0;
+
+// A positive number from the environment, as HISTSIZE and HISTFILESIZE are in bash
+static long env_limit(const char* name, long fallback) {
+    const char* value = getenv(name);
+    long n = value ? atol(value) : 0;
+    return n > 0 ? n : fallback;
+}
+
+// 1 for "on", 0 for "off", -1 for anything else
+static int parse_switch(const char* value) {
+    if (strcmp(value, "on") == 0) return 1;
+    if (strcmp(value, "off") == 0) return 0;
+    return -1;
+}
+
+// --- The file format ---
+
+// Reads the record at pos: 1 with its text if it is whole, -1 if it is cut
+// short by the end of data (still being written), 0 if pos holds no record
+static int parse_record(const char* data, size_t size, size_t pos, FileEntry* entry) {
+    if (pos >= size || data[pos] != RECORD_START) {
+        return 0;
+    }
+    size_t len = 0, p = pos + 1;
+    for (; p < size && p - pos <= MAX_LENGTH_DIGITS && data[p] >= '0' && data[p] <= '9'; p++) {
+        len = len * 10 + (data[p] - '0');
+    }
+    if (p == size) {
+        return -1;
+    }
+    if (p == pos + 1 || data[p] != ':') {
+        return 0;
+    }
+    if (p + 1 + len + 1 > size) {
+        return -1;
+    }
+    if (data[p + 1 + len] != '\n') {
+        return 0;
+    }
+    entry->text = p + 1;
+    entry->len = len;
+    return 1;
+}
+
+// Reads the entry at pos and returns where the next one starts. Anything but
+// a record is a plain line, as older versions of the shell wrote them.
+static size_t next_entry(const char* data, size_t size, size_t pos, FileEntry* entry) {
+    if (parse_record(data, size, pos, entry) == 1) {
+        return entry->text + entry->len + 1;
+    }
+    const char* nl = memchr(data + pos, '\n', size - pos);
+    entry->text = pos;
+    entry->len = (nl ? (size_t)(nl - data) : size) - pos;
+    return pos + entry->len + 1;
+}
+
+// Offset of the first of the last count entries of data, or 0 if it has no
+// more entries than that. Only the tail is read, however long the file.
+static size_t tail_offset(const char* data, size_t size, long count) {
+    size_t start = size;
+    size_t no_separator_below = 0; // memrchr() is known to find none before this
+    while (count-- > 0) {
+        if (start == 0) {
+            return 0;
+        }
+        // The entry ending at start is a record if a separator's length reaches exactly
+        // there; a separator inside an entry's text never parses as one that does
+        size_t search = start, floor = 0;
+        int is_record = 0;
+        for (;;) {
+            const char* rs = search > no_separator_below ? memrchr(data, RECORD_START, search) : NULL;
+            if (rs == NULL) {
+                no_separator_below = search;
+                break;
+            }
+            FileEntry entry;
+            search = rs - data;
+            if (parse_record(data, size, search, &entry) == 1 && entry.text + entry.len + 1 <= start) {
+                floor = entry.text + entry.len + 1;
+                is_record = floor == start;
+                break;
+            }
+        }
+        if (is_record) {
+            start = search;
+            continue;
+        }
+        // Otherwise a plain line, from before the file used records
+        const char* nl = start - 1 > floor ? memrchr(data + floor, '\n', start - 1 - floor) : NULL;
+        start = nl ? (size_t)(nl - data) + 1 : floor;
+    }
+    return start;
+}
+
+static void note_for_search(const char* line);
+
+// Adds the entries of data between from and to to readline's history, and with
+// new_entries to the search index too; returns where it stopped, before a
+// record that is not yet complete
+static size_t add_entries(const char* data, size_t from, size_t to, int new_entries) {
+    char* line = NULL;
+    size_t capacity = 0;
+    size_t pos = from;
+    while (pos < to) {
+        FileEntry entry;
+        if (parse_record(data, to, pos, &entry) < 0) {
+            break;
+        }
+        size_t next = next_entry(data, to, pos, &entry);
+        if (entry.len + 1 > capacity) {
+            capacity = entry.len + 1;
+            line = realloc(line, capacity);
+            if (!line) {
+                perror("realloc");
+                exit(EXIT_FAILURE);
+            }
+        }
+        memcpy(line, data + entry.text, entry.len);
+        line[entry.len] = '\0';
+        if (entry.len > 0) {
+            add_history(line);
+            if (new_entries) {
+                note_for_search(line);
+            }
+        }
+        pos = next;
+    }
+    free(line);
+    return pos < to ? pos : to;
+}
+
+// Replaces readline's history with the last memory_limit entries of the file
+static void load_tail() {
+    clear_history();
+    struct stat st;
+    if (fstat(history_fd, &st) < 0) {
+        return;
+    }
+    read_ino = st.st_ino;
+    read_offset = st.st_size;
+    if (st.st_size == 0) {
+        return;
+    }
+    char* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, history_fd, 0);
+    if (data == MAP_FAILED) {
+        perror("history: mmap");
+        return;
+    }
+    read_offset = add_entries(data, tail_offset(data, st.st_size, memory_limit), st.st_size, 0);
+    munmap(data, st.st_size);
+}
+
+// --- Compaction ---
+
+// Picks the entries a compacted file keeps, the newest limit of them, and with
+// erase_dups only the newest copy of each. Returns how many, at the end of entries.
+static size_t select_entries(const char* data, FileEntry* entries, size_t count, const CompactSettings* settings) {
+    size_t keep = 0;
+    if (!settings->erase_dups) {
+        keep = count < (size_t)settings->limit ? count : (size_t)settings->limit;
+        return keep;
+    }
+
+    size_t slots = 16;
+    while (slots < 2 * (size_t)settings->limit) slots *= 2;
+    FileEntry** seen = calloc(slots, sizeof(FileEntry*));
+    if (!seen) {
+        return 0;
+    }
+    // Newest first; kept entries are gathered at the end of the array, in order
+    for (size_t i = count; i-- > 0 && keep < (size_t)settings->limit;) {
+        FileEntry e = entries[i];
+        size_t slot = hash_bytes(data + e.text, e.len) & (slots - 1);
+        int duplicate = 0;
+        for (; seen[slot] != NULL; slot = (slot + 1) & (slots - 1)) {
+            if (seen[slot]->len == e.len && memcmp(data + seen[slot]->text, data + e.text, e.len) == 0) {
+                duplicate = 1;
+                break;
+            }
+        }
+        if (!duplicate) {
+            keep++;
+            entries[count - keep] = e;
+            seen[slot] = &entries[count - keep];
+        }
+    }
+    free(seen);
+    return keep;
+}
+
+// Body of the compaction thread. The file is rewritten when it has outgrown
+// its limit by a quarter, or still holds plain lines: its newest entries go
+// to a new file as records, which then replaces it through rename().
+static void* compact_history_file(void* arg) {
+    CompactSettings* settings = arg;
+    int fd = open(history_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        free(settings);
+        return NULL;
+    }
+    // Appends wait on the lock, then find the new file in place
+    flock(fd, LOCK_EX);
+    struct stat st, path_st;
+    char* data = MAP_FAILED;
+    // Another session may have compacted the file while we waited
+    if (fstat(fd, &st) == 0 && stat(history_path, &path_st) == 0 && st.st_ino == path_st.st_ino &&
+        st.st_size > 0) {
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    long slack = settings->limit + settings->limit / 4;
+    if (data != MAP_FAILED && (data[0] != RECORD_START || tail_offset(data, st.st_size, slack) > 0)) {
+        // Without erase_dups only the newest entries are read
+        size_t pos = settings->erase_dups ? 0 : tail_offset(data, st.st_size, settings->limit);
+        size_t count = 0, capacity = 1024;
+        FileEntry* entries = malloc(capacity * sizeof(FileEntry));
+        while (entries && pos < (size_t)st.st_size) {
+            if (count == capacity) {
+                capacity *= 2;
+                FileEntry* grown = realloc(entries, capacity * sizeof(FileEntry));
+                if (!grown) {
+                    free(entries);
+                    entries = NULL;
+                    break;
+                }
+                entries = grown;
+            }
+            pos = next_entry(data, st.st_size, pos, &entries[count]);
+            count += entries[count].len > 0;
+        }
+
+        char temp_path[sizeof(history_path) + 16];
+        snprintf(temp_path, sizeof(temp_path), "%s.compact", history_path);
+        int out = entries ? open(temp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600) : -1;
+        FILE* f = out >= 0 ? fdopen(out, "w") : NULL;
+        int ok = f != NULL;
+        size_t keep = ok ? select_entries(data, entries, count, settings) : 0;
+        for (size_t i = count - keep; ok && i < count; i++) {
+            ok = fprintf(f, "%c%zu:", RECORD_START, entries[i].len) > 0 &&
+                 fwrite(data + entries[i].text, 1, entries[i].len, f) == entries[i].len && fputc('\n', f) != EOF;
+        }
+        // The new file must be on disk before it replaces the old one
+        ok = ok && fflush(f) == 0 && fsync(out) == 0;
+        if (f != NULL) {
+            fclose(f);
+        } else if (out >= 0) {
+            close(out);
+        }
+        if (!ok || rename(temp_path, history_path) < 0) {
+            unlink(temp_path);
+        }
+        free(entries);
+    }
+    if (data != MAP_FAILED) {
+        munmap(data, st.st_size);
+    }
+    close(fd);
+    free(settings);
+    return NULL;
+}
+
+static void start_compaction() {
+    if (compact_started) {
+        pthread_join(compact_thread, NULL); // The last one finished long ago
+        compact_started = 0;
+    }
+    CompactSettings* settings = malloc(sizeof(CompactSettings));
+    if (!settings) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    settings->limit = file_limit;
+    settings->erase_dups = get_history_erase_dups();
+    compact_started = pthread_create(&compact_thread, NULL, compact_history_file, settings) == 0;
+    if (!compact_started) {
+        free(settings);
+    }
+}
+
+// --- Search ---
+
+// Body of the index thread: reads every entry the file held at startup
+static void* build_search_index(void* arg) {
+    (void)arg;
+    char* data = mmap(NULL, index_end, PROT_READ, MAP_PRIVATE, index_fd, 0);
+    if (data != MAP_FAILED) {
+        size_t pos = 0;
+        while (pos < (size_t)index_end) {
+            FileEntry entry;
+            if (parse_record(data, index_end, pos, &entry) < 0) {
+                break;
+            }
+            pos = next_entry(data, index_end, pos, &entry);
+            if (entry.len > 0) {
+                hist_index_add(&search_index, data + entry.text, entry.len);
+            }
+        }
+        munmap(data, index_end);
+    }
+    close(index_fd);
+    index_fd = -1;
+    return NULL;
+}
+
+// Indexes the file as it is now, up to read_offset, while the prompt is up.
+// A duplicate of the descriptor keeps it readable after a compaction replaces it.
+static void start_indexing() {
+    index_end = read_offset;
+    index_fd = index_end > 0 ? dup(history_fd) : -1;
+    if (index_fd < 0) {
+        return;
+    }
+    index_started = pthread_create(&index_thread, NULL, build_search_index, NULL) == 0;
+    if (!index_started) {
+        close(index_fd);
+        index_fd = -1;
+    }
+}
+
+// Keeps an entry for the index; the thread owns it until it is joined
+static void note_for_search(const char* line) {
+    if (unindexed_count == unindexed_capacity) {
+        unindexed_capacity = unindexed_capacity ? unindexed_capacity * 2 : 64;
+        unindexed = realloc(unindexed, unindexed_capacity * sizeof(char*));
+        if (!unindexed) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    unindexed[unindexed_count] = strdup(line);
+    if (!unindexed[unindexed_count]) {
+        perror("strdup");
+        exit(EXIT_FAILURE);
+    }
+    unindexed_count++;
+}
+
+int search_history(const char* query, HistMatch* out, int max) {
+    sync_history();
+    if (index_started) {
+        pthread_join(index_thread, NULL); // Only the first search can wait for it
+        index_started = 0;
+    }
+    for (size_t i = 0; i < unindexed_count; i++) {
+        hist_index_add(&search_index, unindexed[i], strlen(unindexed[i]));
+        free(unindexed[i]);
+    }
+    unindexed_count = 0;
+    return hist_index_search(&search_index, query, out, max);
+}
+
+// `history -s [-n N] words...`
+static int print_search(char** args) {
+    int max = DEFAULT_SEARCH_RESULTS;
+    if (args[0] != NULL && strcmp(args[0], "-n") == 0) {
+        max = args[1] ? atoi(args[1]) : 0;
+        if (max <= 0) {
+            fprintf(stderr, "history: -n: expected a positive number\n");
+            return 1;
         }
+        args += 2;
+    }
+    if (args[0] == NULL) {
+        fprintf(stderr, "history: -s: expected a pattern\n");
+        return 1;
+    }
+    char* query = join_args(args);
+    HistMatch* matches = malloc(max * sizeof(HistMatch));
+    if (!matches) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    int found = search_history(query, matches, max);
+    for (int i = 0; i < found; i++) {
+        printf("%6u  %s\n", matches[i].count, matches[i].text);
+    }
+    free(query);
+    free(matches);
+    return found > 0 ? 0 : 1;
+}
+
+// --- Appending and sharing ---
+
+static void open_history_file() {
+    history_fd = move_shell_fd(open(history_path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600));
+    if (history_fd < 0) {
+        perror(history_path);
+    }
+}
+
+// Whether history_fd is still the file at history_path, and not one compaction replaced
+static int is_current_file() {
+    struct stat fd_st, path_st;
+    return fstat(history_fd, &fd_st) == 0 && stat(history_path, &path_st) == 0 &&
+           fd_st.st_ino == path_st.st_ino && fd_st.st_dev == path_st.st_dev;
+}
+
+// Writes one record with a single O_APPEND write, so a crash never leaves
+// half of it and concurrent sessions never interleave. Returns 0 on success.
+// O_APPEND alone would be enough between sessions; the shared lock is only
+// there against compaction, which reads the file and then renames a new one
+// over it. A record written between those two steps would land in the old
+// file after it was read and be lost. Appends share the lock, so it costs an
+// uncontended flock() each, and only wait while a compaction runs.
+static int append_record(const char* record, size_t len) {
+    for (int attempt = 0; attempt < 3 && history_fd >= 0; attempt++) {
+        flock(history_fd, LOCK_SH);
+        if (is_current_file()) {
+            int ok = write(history_fd, record, len) == (ssize_t)len;
+            if (!ok) {
+                perror("history: write");
+            }
+            flock(history_fd, LOCK_UN);
+            return ok ? 0 : -1;
+        }
+        // The file was compacted (or removed) since we opened it: follow the path
+        flock(history_fd, LOCK_UN);
+        close(history_fd);
+        open_history_file();
+    }
+    return -1;
+}
+
+void sync_history() {
+    if (!get_history_sharing() || history_fd < 0 || getpid() != history_owner) {
+        return;
+    }
+    struct stat st;
+    if (!is_current_file()) {
+        // Compacted: what we hold may have been trimmed or deduplicated, so start over
+        close(history_fd);
+        open_history_file();
+        if (history_fd >= 0) {
+            load_tail();
+        }
+        return;
+    }
+    if (fstat(history_fd, &st) < 0 || st.st_ino != read_ino || st.st_size <= read_offset) {
+        return;
+    }
+
+    // Only what other sessions appended since the last look is read
+    size_t len = st.st_size - read_offset;
+    char* data = malloc(len);
+    if (!data) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    ssize_t n = pread(history_fd, data, len, read_offset);
+    if (n > 0) {
+        read_offset += add_entries(data, 0, n, 1);
     }
+    free(data);
 }
 
 // Load history from file
@@ -24,22 +517,121 @@ void load_history() {
         return;
     }
 
-    char history_path[1024];
     snprintf(history_path, sizeof(history_path), "%s/%s", home_dir, HISTORY_FILE);
+    history_owner = getpid();
+    memory_limit = env_limit("HISTSIZE", DEFAULT_HISTSIZE);
+    file_limit = env_limit("HISTFILESIZE", DEFAULT_HISTFILESIZE);
+    stifle_history(memory_limit);
 
-    read_history(history_path);
+    open_history_file();
+    if (history_fd < 0) {
+        return;
+    }
+    load_tail();
+    start_indexing();
+    start_compaction();
+    // `exit` leaves through exit(), so the thread is joined from there too
+    atexit(close_history);
 }
 
-// Save history to file
-void save_history() {
-    char* home_dir = getenv("HOME");
-    if (home_dir == NULL) {
-        fprintf(stderr, "HOME environment variable not set, cannot save history.\n");
+void record_history(const char* line) {
+    if (history_fd < 0 || getpid() != history_owner) {
+        add_history(line);
+        note_for_search(line);
         return;
     }
 
-    char history_path[1024];
-    snprintf(history_path, sizeof(history_path), "%s/%s", home_dir, HISTORY_FILE);
-    
-    write_history(history_path);
+    size_t len = strlen(line);
+    char* record = malloc(len + MAX_LENGTH_DIGITS + 3);
+    if (!record) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    int header = sprintf(record, "%c%zu:", RECORD_START, len);
+    memcpy(record + header, line, len);
+    record[header + len] = '\n';
+    int written = append_record(record, header + len + 1) == 0;
+    free(record);
+
+    if (written && get_history_sharing()) {
+        // The line comes back from the file with everything other sessions added before it
+        sync_history();
+    } else {
+        add_history(line);
+        note_for_search(line);
+    }
+
+    if (++appended_since_check >= COMPACT_CHECK_INTERVAL) {
+        appended_since_check = 0;
+        start_compaction();
+    }
+}
+
+void close_history() {
+    if (getpid() != history_owner) {
+        return;
+    }
+    if (compact_started) {
+        // Let a rewrite in progress finish, so no temporary file is left behind
+        pthread_join(compact_thread, NULL);
+        compact_started = 0;
+    }
+    if (history_fd >= 0) {
+        close(history_fd);
+        history_fd = -1;
+    }
+}
+
+int set_history_sharing(const char* value) {
+    int on = parse_switch(value);
+    if (on < 0) {
+        return -1;
+    }
+    int was_on = get_history_sharing();
+    share_history = on;
+    if (on && !was_on && history_fd >= 0 && getpid() == history_owner) {
+        // Lines this session kept to itself would otherwise appear twice
+        load_tail();
+    }
+    return 0;
+}
+
+int get_history_sharing() {
+    if (share_history < 0) {
+        const char* env = getenv("HISTSHARE");
+        share_history = env != NULL && parse_switch(env) == 1;
+    }
+    return share_history;
+}
+
+int set_history_erase_dups(const char* value) {
+    int on = parse_switch(value);
+    if (on < 0) {
+        return -1;
+    }
+    erase_dups = on;
+    return 0;
+}
+
+int get_history_erase_dups() {
+    if (erase_dups < 0) {
+        const char* env = getenv("HISTCONTROL");
+        erase_dups = env != NULL && strstr(env, "erasedups") != NULL;
+    }
+    return erase_dups;
+}
+
+// Built-in history command
+int builtin_history(char** args) {
+    if (args[1] != NULL && strcmp(args[1], "-s") == 0) {
+        return print_search(args + 2);
+    }
+    sync_history();
+    HIST_ENTRY** hist_list = history_list();
+    if (hist_list) {
+        for (int i = 0; hist_list[i]; i++) {
+            printf("%d  %s\n", i+history_base, hist_list[i]->line);
+        }
+    }
+    return 0;
 }
@@ -0,0 +1,165 @@
+#include "histsearch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <readline/readline.h>
+#include "history.h"
+
+#define MAX_MATCHES 64
+#define MAX_QUERY 256
+#define KEY_CTRL_G 7
+#define KEY_BACKSPACE 8
+#define KEY_CTRL_R 18
+#define KEY_DELETE 127
+
+// Keys are bound to the handlers below while a search is on, so the event
+// loop keeps feeding readline one character at a time, as it does at the prompt
+static Keymap search_keymap;
+static Keymap saved_keymap;
+static int searching = 0;
+
+static char query[MAX_QUERY];
+static size_t query_len = 0;
+static char last_query[MAX_QUERY];  // What Ctrl-R searches for again on an empty query
+static HistMatch matches[MAX_MATCHES];
+static int match_count = 0;
+static int match_index = 0;
+static char* saved_line = NULL;     // The line before the search, for Ctrl-G
+static int saved_point = 0;
+
+static void show_search() {
+    if (match_count > 0) {
+        rl_replace_line(matches[match_index].text, 0);
+        rl_point = rl_end;
+    }
+    rl_message("(%sfuzzy search)`%s': ", query_len > 0 && match_count == 0 ? "failed " : "", query);
+}
+
+static void run_search() {
+    match_index = 0;
+    match_count = query_len > 0 ? search_history(query, matches, MAX_MATCHES) : 0;
+    if (query_len == 0) {
+        rl_replace_line(saved_line, 0);
+        rl_point = saved_point;
+    }
+    show_search();
+}
+
+static void end_search() {
+    if (query_len > 0) {
+        memcpy(last_query, query, query_len + 1);
+    }
+    rl_set_keymap(saved_keymap);
+    rl_restore_prompt();
+    rl_clear_message();
+    free(saved_line);
+    saved_line = NULL;
+    searching = 0;
+}
+
+static int search_insert(int count, int key) {
+    (void)count;
+    if (query_len + 1 < MAX_QUERY) {
+        query[query_len++] = key;
+        query[query_len] = '\0';
+    }
+    run_search();
+    return 0;
+}
+
+static int search_backspace(int count, int key) {
+    (void)count; (void)key;
+    if (query_len > 0) {
+        query[--query_len] = '\0';
+    }
+    run_search();
+    return 0;
+}
+
+static int search_next(int count, int key) {
+    (void)count; (void)key;
+    if (query_len == 0 && last_query[0] != '\0') {
+        query_len = strlen(last_query);
+        memcpy(query, last_query, query_len + 1);
+        run_search();
+    } else if (match_index + 1 < match_count) {
+        match_index++;
+        show_search();
+    } else {
+        rl_ding();
+    }
+    return 0;
+}
+
+static int search_accept(int count, int key) {
+    end_search();
+    return rl_newline(count, key);
+}
+
+static int search_abort(int count, int key) {
+    (void)count; (void)key;
+    rl_replace_line(saved_line, 0);
+    rl_point = saved_point;
+    end_search();
+    return 0;
+}
+
+// Any other key ends the search with the match on the line, then does what it always does
+static int search_exit(int count, int key) {
+    (void)count;
+    end_search();
+    rl_execute_next(key);
+    return 0;
+}
+
+static int start_search(int count, int key) {
+    (void)count; (void)key;
+    saved_line = strdup(rl_line_buffer);
+    if (!saved_line) {
+        perror("strdup");
+        exit(EXIT_FAILURE);
+    }
+    saved_point = rl_point;
+    query_len = 0;
+    query[0] = '\0';
+    match_count = 0;
+    match_index = 0;
+    saved_keymap = rl_get_keymap();
+    rl_set_keymap(search_keymap);
+    rl_save_prompt();
+    searching = 1;
+    show_search();
+    return 0;
+}
+
+void init_history_search() {
+    search_keymap = rl_make_bare_keymap();
+    for (int key = 0; key < 256; key++) {
+        rl_command_func_t* handler = search_exit;
+        if ((key >= ' ' && key < KEY_DELETE) || key >= 128) {
+            handler = search_insert;
+        } else if (key == KEY_DELETE || key == KEY_BACKSPACE) {
+            handler = search_backspace;
+        } else if (key == KEY_CTRL_R) {
+            handler = search_next;
+        } else if (key == '\n' || key == '\r') {
+            handler = search_accept;
+        } else if (key == KEY_CTRL_G) {
+            handler = search_abort;
+        }
+        rl_bind_key_in_map(key, handler, search_keymap);
+    }
+    rl_add_defun("fuzzy-history-search", start_search, -1);
+    rl_bind_keyseq("\\C-r", start_search);
+}
+
+void cancel_history_search() {
+    if (!searching) {
+        return;
+    }
+    rl_set_keymap(saved_keymap);
+    rl_restore_prompt();
+    free(saved_line);
+    saved_line = NULL;
+    searching = 0;
+}
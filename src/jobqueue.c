@@ -0,0 +1,301 @@
+#include "jobqueue.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "arena.h"
+#include "executor.h"
+#include "parser.h"
+#include "spawner.h"
+#include "text.h"
+
+#define LOAD_POLL_MS 1000           // How often a load-limited queue looks again
+#define LOAD_START_INTERVAL_MS 1000 // With a load limit, starts are spaced so each one can show in the average
+#define STATUS_INTERRUPTED 130
+
+static int max_running = 0;     // Running background jobs allowed; 0 means the number of CPUs
+static double max_load = 0;     // 1-minute load average allowed; 0 means it is not checked
+static double last_start_ms = -LOAD_START_INTERVAL_MS;
+static pid_t queue_owner = 0;   // Only the shell that queued the jobs starts them, never a forked copy of it
+
+static int running_limit() {
+    if (max_running > 0) {
+        return max_running;
+    }
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? cpus : 1;
+}
+
+// The 1-minute load average, or -1 if it cannot be read
+static double current_load() {
+    FILE* f = fopen("/proc/loadavg", "r");
+    double load = -1;
+    if (f != NULL) {
+        if (fscanf(f, "%lf", &load) != 1) {
+            load = -1;
+        }
+        fclose(f);
+    }
+    return load;
+}
+
+typedef struct {
+    int running;        // Background jobs with a process still running
+    int queued;
+    int started;        // Jobs from the queue that have not finished
+    Job* next;          // The queued job to start first
+} QueueScan;
+
+static void scan_job(Job* job, void* ctx) {
+    QueueScan* scan = ctx;
+    if (job->status == QUEUED) {
+        scan->queued++;
+        // Job ids grow, so the lowest id among equal priorities is the oldest
+        if (scan->next == NULL || job->priority > scan->next->priority) {
+            scan->next = job;
+        }
+        return;
+    }
+    if (job->from_queue && job->live_count > 0) {
+        scan->started++;
+    }
+    if (job->is_background && job_is_running(job)) {
+        scan->running++;
+    }
+}
+
+static QueueScan scan_jobs() {
+    QueueScan scan = { 0 };
+    for_each_job(scan_job, &scan);
+    return scan;
+}
+
+// Body of the forked shell running a queued command line
+static int run_queued_command(void* ctx) {
+    shell_is_interactive = 0;
+    inherited_pgid = getpgrp();
+    Arena arena = { 0 };
+    CommandList* list = parse_line(ctx, &arena, NULL);
+    return list != NULL ? execute_list(list) : 2;
+}
+
+int start_queued_job(Job* job, int foreground) {
+    SpawnRequest req = {
+        .pgid = inherited_pgid,
+        .stdin_fd = -1,
+        .stdout_fd = -1,
+        .tty_fd = -1,
+    };
+    pid_t pid = spawn_subshell(&req, run_queued_command, (void*)job->command);
+    if (pid < 0) {
+        remove_job(job->job_id);
+        return -1;
+    }
+    job->pgid = inherited_pgid ? inherited_pgid : pid;
+    job->status = foreground ? FOREGROUND : BACKGROUND;
+    job->is_background = !foreground;
+    job->from_queue = 1;
+    add_job_process(job, pid);
+    last_start_ms = now_ms();
+    return 0;
+}
+
+void dispatch_queued_jobs() {
+    if (queue_owner != getpid()) {
+        return;
+    }
+    for (;;) {
+        QueueScan scan = scan_jobs();
+        if (scan.next == NULL || scan.running >= running_limit()) {
+            return;
+        }
+        if (max_load > 0) {
+            if (now_ms() - last_start_ms < LOAD_START_INTERVAL_MS || current_load() >= max_load) {
+                return;
+            }
+        }
+        if (start_queued_job(scan.next, 0) < 0) {
+            return;
+        }
+    }
+}
+
+int queue_poll_timeout() {
+    if (max_load <= 0 || queue_owner != getpid()) {
+        return -1;
+    }
+    QueueScan scan = scan_jobs();
+    if (scan.next == NULL || scan.running >= running_limit()) {
+        return -1;
+    }
+    // Until the spacing between starts has passed, or the next reading of the load
+    int spacing = LOAD_START_INTERVAL_MS - (int)(now_ms() - last_start_ms);
+    return spacing > 0 && spacing < LOAD_POLL_MS ? spacing : LOAD_POLL_MS;
+}
+
+static int compare_start_order(const void* a, const void* b) {
+    const Job* x = *(Job* const*)a;
+    const Job* y = *(Job* const*)b;
+    if (x->priority != y->priority) {
+        return y->priority - x->priority;
+    }
+    return x->job_id - y->job_id;
+}
+
+typedef struct {
+    Job** jobs;
+    int count;
+} QueuedList;
+
+static void collect_queued(Job* job, void* ctx) {
+    QueuedList* list = ctx;
+    if (job->status == QUEUED) {
+        list->jobs[list->count++] = job;
+    }
+}
+
+static int queue_ls() {
+    QueueScan scan = scan_jobs();
+    double load = current_load();
+    printf("max=%d load=", running_limit());
+    if (max_load > 0) {
+        printf("%.2f", max_load);
+    } else {
+        printf("off");
+    }
+    printf(" (now %.2f), %d running, %d queued\n", load, scan.running, scan.queued);
+
+    QueuedList list = { malloc((scan.queued + 1) * sizeof(Job*)), 0 };
+    if (!list.jobs) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    for_each_job(collect_queued, &list);
+    qsort(list.jobs, list.count, sizeof(Job*), compare_start_order);
+    for (int i = 0; i < list.count; i++) {
+        printf("[%d] Queued prio=%d %s\n", list.jobs[i]->job_id, list.jobs[i]->priority, list.jobs[i]->command);
+    }
+    free(list.jobs);
+    return 0;
+}
+
+static int queue_add(char** args) {
+    int priority = 0;
+    if (args[0] != NULL && strcmp(args[0], "-p") == 0) {
+        char* end;
+        priority = args[1] ? (int)strtol(args[1], &end, 10) : 0;
+        if (args[1] == NULL || *end != '\0') {
+            fprintf(stderr, "queue: -p: expected a number\n");
+            return 1;
+        }
+        args += 2;
+    }
+    if (args[0] == NULL) {
+        fprintf(stderr, "queue: add: expected a command\n");
+        return 1;
+    }
+
+    // The words make up one command line, parsed again when the job starts, as eval would
+    char* text = join_args(args);
+
+    Arena arena = { 0 };
+    int valid = parse_line(text, &arena, NULL) != NULL;
+    arena_free(&arena);
+    if (!valid) {
+        free(text);
+        return 2;
+    }
+
+    Job* job = add_job(0, text, QUEUED, 1);
+    free(text);
+    if (job == NULL) {
+        return 1;
+    }
+    job->priority = priority;
+    queue_owner = getpid();
+    if (shell_is_interactive) {
+        printf("[%d] Queued\n", job->job_id);
+    }
+    dispatch_queued_jobs();
+    return 0;
+}
+
+static int queue_set(char** args) {
+    for (int i = 0; args[i]; i++) {
+        char* end;
+        if (strncmp(args[i], "max=", 4) == 0) {
+            long n = strtol(args[i] + 4, &end, 10);
+            if (*end != '\0' || n < 0) {
+                fprintf(stderr, "queue: %s: expected max=N\n", args[i]);
+                return 1;
+            }
+            max_running = n;
+        } else if (strncmp(args[i], "load=", 5) == 0) {
+            double load = strtod(args[i] + 5, &end);
+            if (*end != '\0' || load < 0) {
+                fprintf(stderr, "queue: %s: expected load=L\n", args[i]);
+                return 1;
+            }
+            max_load = load;
+        } else {
+            fprintf(stderr, "queue: set: %s: expected max=N or load=L\n", args[i]);
+            return 1;
+        }
+    }
+    dispatch_queued_jobs();
+    return 0;
+}
+
+static int queue_rm(char** args) {
+    if (args[0] == NULL) {
+        fprintf(stderr, "queue: rm: expected a job id\n");
+        return 1;
+    }
+    int status = 0;
+    for (int i = 0; args[i]; i++) {
+        Job* job = get_job_by_job_id(atoi(args[i] + (args[i][0] == '%')));
+        if (job == NULL || job->status != QUEUED) {
+            fprintf(stderr, "queue: rm: %s: no such queued job\n", args[i]);
+            status = 1;
+            continue;
+        }
+        remove_job(job->job_id);
+    }
+    return status;
+}
+
+static int queue_drain() {
+    for (;;) {
+        dispatch_queued_jobs();
+        QueueScan scan = scan_jobs();
+        if (scan.queued == 0 && scan.started == 0) {
+            return 0;
+        }
+        // A queue that cannot start anything and has nothing running would never move on
+        if (scan.running == 0 && queue_poll_timeout() < 0 && scan.started == 0) {
+            fprintf(stderr, "queue: drain: %d jobs cannot start\n", scan.queued);
+            return 1;
+        }
+        if (wait_for_child_event(queue_poll_timeout())) {
+            return STATUS_INTERRUPTED;
+        }
+        cleanup_jobs();
+    }
+}
+
+int builtin_queue(char** args) {
+    const char* cmd = args[1] ? args[1] : "ls";
+    if (strcmp(cmd, "add") == 0) {
+        return queue_add(args + 2);
+    } else if (strcmp(cmd, "ls") == 0) {
+        return queue_ls();
+    } else if (strcmp(cmd, "set") == 0) {
+        return queue_set(args + 2);
+    } else if (strcmp(cmd, "rm") == 0) {
+        return queue_rm(args + 2);
+    } else if (strcmp(cmd, "drain") == 0) {
+        return queue_drain();
+    }
+    fprintf(stderr, "queue: %s: expected add, ls, set, rm or drain\n", cmd);
+    return 1;
+}
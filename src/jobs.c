@@ -1,21 +1,69 @@
 #include "jobs.h"
-#include "parser.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>  // For strcasecmp
+#include <ctype.h>
 #include <signal.h>
 #include <unistd.h>
 #include <termios.h>
-#include <sys/wait.h> // For waitpid, WUNTRACED, WCONTINUED
+#include <time.h>
+#include <sys/wait.h> // For wait4, WUNTRACED, WCONTINUED
 #include <errno.h>    // For errno, ECHILD
+#include <stdint.h>
+#include <poll.h>
+#include "signals.h"
+#include "jobqueue.h"
+#include "text.h"
+
+#define JOB_SLAB_CHUNK 64   // Jobs allocated together; their addresses never move
+#define INITIAL_MAP_SIZE 64 // Slots in each lookup map (always a power of two)
+#define SAVED_STATUS_LIMIT 1024 // Processes of finished background jobs whose status `wait` can still collect
+#define STATUS_NOT_FOUND 127
+#define STATUS_INTERRUPTED (128 + SIGINT)
+
+// Open-addressing map from a pid or job id to its job
+typedef struct {
+    int* keys;          // 0 marks an empty slot
+    Job** values;
+    size_t size;
+    size_t count;
+} JobMap;
+
+// A command string shared by every job that runs it
+typedef struct InternedCommand {
+    char* text;
+    int refs;
+    struct InternedCommand* next;
+} InternedCommand;
+
+// The status of one process of a background job that finished and left the table
+typedef struct {
+    int job_id;         // 0 once collected by `wait`
+    pid_t pid;
+    int status;         // As $? would show it
+    int is_last;        // The job's last process, whose status is the job's
+} SavedStatus;
+
+static Job* free_jobs = NULL;       // Unused slab slots, linked through next
+static Job* first_job = NULL;       // Active jobs in job-id order
+static Job* last_job = NULL;
+static Job* finished_jobs = NULL;   // Jobs that completed since the last cleanup
+static JobMap jobs_by_pid;
+static JobMap jobs_by_id;
+static InternedCommand** command_buckets = NULL;
+static size_t command_bucket_count = 0;
+static SavedStatus saved_statuses[SAVED_STATUS_LIMIT];
+static int saved_next = 0;          // Slot written next; it holds the oldest status
 
-Job jobs[MAX_JOBS];
 int next_job_id = 1;
 pid_t shell_pgid;
 int shell_is_interactive;
 struct termios shell_tmodes;
 int shell_terminal;
 int current_foreground_job = -1; // job_id of the current foreground job
+pid_t inherited_pgid = 0;        // Set in subshells, whose commands stay in the subshell's group
+pid_t last_background_pid = 0;
 
 void init_job_control() {
     shell_terminal = STDIN_FILENO;
@@ -33,7 +81,8 @@ void init_job_control() {
         signal(SIGTSTP, SIG_IGN);
         signal(SIGTTIN, SIG_IGN);
         signal(SIGTTOU, SIG_IGN);
-        signal(SIGCHLD, SIG_IGN); // We'll handle SIGCHLD explicitly in main loop or separate function
+        // SIGCHLD keeps its default disposition: children are reaped synchronously
+        // by reap_children() and put_job_in_foreground(), never by a handler
 
         // Put ourselves in our own process group
         shell_pgid = getpid();
@@ -50,170 +99,666 @@ void init_job_control() {
     }
 }
 
-void cleanup_jobs() {
-    for (int i = 0; i < MAX_JOBS; i++) {
-        if (jobs[i].pid != 0 && (jobs[i].status == COMPLETED || jobs[i].status == TERMINATED)) {
-            // Optionally print a message about the job finishing
-            // printf("[%d] %s %s\n", jobs[i].job_id, jobs[i].status == COMPLETED ? "Done" : "Terminated", jobs[i].command);
-            jobs[i].pid = 0;
-            jobs[i].job_id = 0;
+// --- Lookup maps ---
+
+static size_t map_slot(const JobMap* map, int key) {
+    // Fibonacci hashing spreads sequential pids and ids across the table
+    return ((uint32_t)key * 2654435769u) & (map->size - 1);
+}
+
+static Job* map_get(const JobMap* map, int key) {
+    if (map->size == 0) return NULL;
+    for (size_t i = map_slot(map, key); map->keys[i] != 0; i = (i + 1) & (map->size - 1)) {
+        if (map->keys[i] == key) {
+            return map->values[i];
+        }
+    }
+    return NULL;
+}
+
+static void map_put(JobMap* map, int key, Job* value);
+
+static void map_grow(JobMap* map) {
+    JobMap old = *map;
+    map->size = old.size ? old.size * 2 : INITIAL_MAP_SIZE;
+    map->count = 0;
+    map->keys = calloc(map->size, sizeof(int));
+    map->values = calloc(map->size, sizeof(Job*));
+    if (!map->keys || !map->values) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < old.size; i++) {
+        if (old.keys[i] != 0) {
+            map_put(map, old.keys[i], old.values[i]);
         }
     }
+    free(old.keys);
+    free(old.values);
 }
 
-void add_job(pid_t pid, pid_t pgid, const char* command, enum JobStatus status, int is_background) {
-    for (int i = 0; i < MAX_JOBS; i++) {
-        if (jobs[i].pid == 0) {
-            jobs[i].pid = pid;
-            jobs[i].pgid = pgid;
-            strncpy(jobs[i].command, command, sizeof(jobs[i].command) - 1);
-            jobs[i].command[sizeof(jobs[i].command) - 1] = '\0';
-            jobs[i].status = status;
-            jobs[i].job_id = next_job_id++;
-            jobs[i].is_background = is_background;
+static void map_put(JobMap* map, int key, Job* value) {
+    if ((map->count + 1) * 2 > map->size) {
+        map_grow(map);
+    }
+    size_t i = map_slot(map, key);
+    while (map->keys[i] != 0 && map->keys[i] != key) {
+        i = (i + 1) & (map->size - 1);
+    }
+    if (map->keys[i] == 0) {
+        map->count++;
+    }
+    map->keys[i] = key;
+    map->values[i] = value;
+}
+
+static void map_remove(JobMap* map, int key) {
+    if (map->size == 0) return;
+    size_t mask = map->size - 1;
+    size_t i = map_slot(map, key);
+    while (map->keys[i] != key) {
+        if (map->keys[i] == 0) return;
+        i = (i + 1) & mask;
+    }
+
+    // Backward-shift deletion keeps every probe chain intact without tombstones
+    size_t j = i;
+    while (1) {
+        j = (j + 1) & mask;
+        if (map->keys[j] == 0) break;
+        size_t home = map_slot(map, map->keys[j]);
+        // Move j into the hole at i unless its home lies cyclically in (i, j]
+        if ((j > i && (home <= i || home > j)) || (j < i && (home <= i && home > j))) {
+            map->keys[i] = map->keys[j];
+            map->values[i] = map->values[j];
+            i = j;
+        }
+    }
+    map->keys[i] = 0;
+    map->values[i] = NULL;
+    map->count--;
+}
+
+// --- Interned command strings ---
+
+static const char* intern_command(const char* text) {
+    if (command_bucket_count == 0) {
+        command_bucket_count = 64;
+        command_buckets = calloc(command_bucket_count, sizeof(InternedCommand*));
+    }
+
+    size_t b = hash_string(text) & (command_bucket_count - 1);
+    for (InternedCommand* c = command_buckets[b]; c; c = c->next) {
+        if (strcmp(c->text, text) == 0) {
+            c->refs++;
+            return c->text;
+        }
+    }
+
+    InternedCommand* c = malloc(sizeof(InternedCommand));
+    c->text = strdup(text);
+    c->refs = 1;
+    c->next = command_buckets[b];
+    command_buckets[b] = c;
+    return c->text;
+}
 
-            if (is_background) {
-                printf("[%d] %d\n", jobs[i].job_id, jobs[i].pid);
+static void release_command(const char* text) {
+    size_t b = hash_string(text) & (command_bucket_count - 1);
+    for (InternedCommand** link = &command_buckets[b]; *link; link = &(*link)->next) {
+        InternedCommand* c = *link;
+        if (c->text == text) {
+            if (--c->refs == 0) {
+                *link = c->next;
+                free(c->text);
+                free(c);
             }
             return;
         }
     }
-    fprintf(stderr, "Too many jobs.\n");
 }
 
-void remove_job(int job_id) {
-    for (int i = 0; i < MAX_JOBS; i++) {
-        if (jobs[i].job_id == job_id) {
-            jobs[i].pid = 0;
-            jobs[i].job_id = 0;
-            // Potentially shift other jobs down or just leave gap
-            return;
+// --- Job table ---
+
+static Job* allocate_job() {
+    if (free_jobs == NULL) {
+        // Grow the slab by a whole chunk, so existing Job pointers stay valid
+        Job* chunk = calloc(JOB_SLAB_CHUNK, sizeof(Job));
+        if (!chunk) {
+            perror("calloc");
+            return NULL;
+        }
+        for (int i = JOB_SLAB_CHUNK - 1; i >= 0; i--) {
+            chunk[i].next = free_jobs;
+            free_jobs = &chunk[i];
         }
     }
+
+    Job* job = free_jobs;
+    free_jobs = job->next;
+    return job;
 }
 
-Job* get_job_by_pid(pid_t pid) {
-    for (int i = 0; i < MAX_JOBS; i++) {
-        if (jobs[i].pid == pid) {
-            return &jobs[i];
+double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// A waitpid status word as $? shows it
+static int exit_status_of(int status) {
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+    if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    }
+    if (WIFSTOPPED(status)) {
+        return 128 + WSTOPSIG(status);
+    }
+    return 0;
+}
+
+static void add_time(struct timeval* total, const struct timeval* t) {
+    total->tv_sec += t->tv_sec;
+    total->tv_usec += t->tv_usec;
+    if (total->tv_usec >= 1000000) {
+        total->tv_sec++;
+        total->tv_usec -= 1000000;
+    }
+}
+
+// Adds an exited process's usage to its job's; the largest resident set stands for the job's
+static void add_usage(struct rusage* total, const struct rusage* usage) {
+    add_time(&total->ru_utime, &usage->ru_utime);
+    add_time(&total->ru_stime, &usage->ru_stime);
+    if (usage->ru_maxrss > total->ru_maxrss) {
+        total->ru_maxrss = usage->ru_maxrss;
+    }
+    total->ru_minflt += usage->ru_minflt;
+    total->ru_majflt += usage->ru_majflt;
+}
+
+// Adds what the job's live processes have used so far, which wait4 only reports once they exit
+static void add_live_usage(const Job* job, struct rusage* total) {
+    long ticks = sysconf(_SC_CLK_TCK);
+    for (int i = 0; i < job->proc_count; i++) {
+        if (job->procs[i].exited) {
+            continue;
+        }
+        char path[64], buf[1024];
+        snprintf(path, sizeof(path), "/proc/%d/stat", (int)job->procs[i].pid);
+        FILE* f = fopen(path, "r");
+        if (f == NULL) {
+            continue;
+        }
+        // Fields 10 to 17 follow the command name, which may itself hold spaces
+        char* fields = fgets(buf, sizeof(buf), f) ? strrchr(buf, ')') : NULL;
+        unsigned long minflt, cminflt, majflt, cmajflt, utime, stime;
+        long cutime, cstime;
+        if (fields && sscanf(fields, ") %*c %*d %*d %*d %*d %*d %*u %lu %lu %lu %lu %lu %lu %ld %ld",
+                             &minflt, &cminflt, &majflt, &cmajflt, &utime, &stime, &cutime, &cstime) == 8) {
+            struct rusage live = { 0 };
+            live.ru_utime.tv_sec = (utime + cutime) / ticks;
+            live.ru_utime.tv_usec = (utime + cutime) % ticks * 1000000 / ticks;
+            live.ru_stime.tv_sec = (stime + cstime) / ticks;
+            live.ru_stime.tv_usec = (stime + cstime) % ticks * 1000000 / ticks;
+            live.ru_minflt = minflt + cminflt;
+            live.ru_majflt = majflt + cmajflt;
+            add_usage(total, &live);
+        }
+        fclose(f);
+
+        // The peak resident set, in kilobytes like ru_maxrss
+        snprintf(path, sizeof(path), "/proc/%d/status", (int)job->procs[i].pid);
+        f = fopen(path, "r");
+        if (f == NULL) {
+            continue;
+        }
+        long peak;
+        while (fgets(buf, sizeof(buf), f)) {
+            if (sscanf(buf, "VmHWM: %ld kB", &peak) == 1 && peak > total->ru_maxrss) {
+                total->ru_maxrss = peak;
+            }
         }
+        fclose(f);
     }
-    return NULL;
 }
 
-Job* get_job_by_job_id(int job_id) {
-    for (int i = 0; i < MAX_JOBS; i++) {
-        if (jobs[i].job_id == job_id) {
-            return &jobs[i];
+// Formats a job's run time and resource usage, e.g. "wall 1.20s user 0.80s sys 0.05s maxrss 12.4M minflt 3100 majflt 0"
+static void format_job_usage(const Job* job, char* buf, size_t size) {
+    struct rusage total = job->usage;
+    const struct rusage* ru = &total;
+    add_live_usage(job, &total);
+    double wall = ((job->end_ms > 0 ? job->end_ms : now_ms()) - job->start_ms) / 1e3;
+    double rss = ru->ru_maxrss; // In kilobytes
+    const char* unit = "K";
+    if (rss >= 1024 * 1024) {
+        rss /= 1024 * 1024;
+        unit = "G";
+    } else if (rss >= 1024) {
+        rss /= 1024;
+        unit = "M";
+    }
+    snprintf(buf, size, "wall %.2fs user %.2fs sys %.2fs maxrss %.1f%s minflt %ld majflt %ld",
+             job->proc_count > 0 ? wall : 0.0,
+             ru->ru_utime.tv_sec + ru->ru_utime.tv_usec / 1e6,
+             ru->ru_stime.tv_sec + ru->ru_stime.tv_usec / 1e6,
+             rss, unit, ru->ru_minflt, ru->ru_majflt);
+}
+
+// Keeps the statuses of a finished background job for `wait`, over the oldest ones
+static void save_job_statuses(const Job* job) {
+    for (int i = 0; i < job->proc_count; i++) {
+        saved_statuses[saved_next] = (SavedStatus){
+            .job_id = job->job_id,
+            .pid = job->procs[i].pid,
+            .status = exit_status_of(job->procs[i].status),
+            .is_last = i == job->proc_count - 1,
+        };
+        saved_next = (saved_next + 1) % SAVED_STATUS_LIMIT;
+    }
+}
+
+// Takes the saved status of a job, by id or by the pid of one of its processes,
+// or with neither the oldest one; the job's other statuses are dropped with it
+static int take_saved_status(int job_id, pid_t pid, int* status) {
+    for (int i = 0; i < SAVED_STATUS_LIMIT; i++) {
+        SavedStatus* saved = &saved_statuses[(saved_next + i) % SAVED_STATUS_LIMIT];
+        if (saved->job_id == 0 || (pid ? saved->pid != pid : !saved->is_last || (job_id && saved->job_id != job_id))) {
+            continue;
+        }
+        *status = saved->status;
+        int taken = saved->job_id;
+        for (int j = 0; j < SAVED_STATUS_LIMIT; j++) {
+            if (saved_statuses[j].job_id == taken) {
+                saved_statuses[j].job_id = 0;
+            }
         }
+        return 1;
     }
-    return NULL;
+    return 0;
 }
 
-void update_job_status(pid_t pid, enum JobStatus status) {
-    Job* job = get_job_by_pid(pid);
+void cleanup_jobs() {
+    // Only jobs that finished since the last call are visited
+    while (finished_jobs != NULL) {
+        Job* job = finished_jobs;
+        // Foreground jobs were already reported when we stopped waiting for them
+        if (job->is_background) {
+            if (shell_is_interactive) {
+                char usage[160];
+                format_job_usage(job, usage, sizeof(usage));
+                printf("[%d] %s %s (%s)\n", job->job_id, job->status == COMPLETED ? "Done" : "Terminated",
+                       job->command, usage);
+            }
+            save_job_statuses(job);
+        }
+        remove_job(job->job_id);
+    }
+}
+
+Job* add_job(pid_t pgid, const char* command, enum JobStatus status, int is_background) {
+    Job* job = allocate_job();
     if (job) {
+        memset(job, 0, sizeof(Job));
+        job->pgid = pgid;
+        job->command = intern_command(command);
         job->status = status;
+        job->job_id = next_job_id++;
+        job->is_background = is_background;
+        job->in_use = 1;
+
+        // Job ids only grow, so appending keeps the list in job-id order
+        job->prev = last_job;
+        if (last_job) {
+            last_job->next = job;
+        } else {
+            first_job = job;
+        }
+        last_job = job;
+
+        map_put(&jobs_by_id, job->job_id, job);
     }
+
+    return job;
 }
 
-void print_jobs() {
-    for (int i = 0; i < MAX_JOBS; i++) {
-        if (jobs[i].pid != 0) {
-            char status_str[20];
-            switch (jobs[i].status) {
-                case RUNNING:
-                case FOREGROUND:
-                case BACKGROUND:
-                    strcpy(status_str, "Running");
-                    break;
-                case STOPPED:
-                    strcpy(status_str, "Stopped");
-                    break;
-                case COMPLETED:
-                    strcpy(status_str, "Done");
-                    break;
-                case TERMINATED:
-                    strcpy(status_str, "Terminated");
+void add_job_process(Job* job, pid_t pid) {
+    if (job->proc_count == job->proc_capacity) {
+        job->proc_capacity = job->proc_capacity ? job->proc_capacity * 2 : 4;
+        job->procs = realloc(job->procs, job->proc_capacity * sizeof(JobProcess));
+    }
+    JobProcess* proc = &job->procs[job->proc_count++];
+    memset(proc, 0, sizeof(JobProcess));
+    proc->pid = pid;
+    if (job->proc_count == 1) {
+        job->pid = pid;
+        job->start_ms = now_ms();
+    }
+    job->live_count++;
+    map_put(&jobs_by_pid, pid, job);
+}
+
+void remove_job(int job_id) {
+    Job* job = map_get(&jobs_by_id, job_id);
+    if (job) {
+        map_remove(&jobs_by_id, job_id);
+        for (int i = 0; i < job->proc_count; i++) {
+            map_remove(&jobs_by_pid, job->procs[i].pid);
+        }
+
+        if (job->finished_queued) {
+            for (Job** link = &finished_jobs; *link; link = &(*link)->next_finished) {
+                if (*link == job) {
+                    *link = job->next_finished;
                     break;
+                }
             }
-            printf("[%d] %s %s\n", jobs[i].job_id, status_str, jobs[i].command);
         }
+
+        if (job->prev) job->prev->next = job->next; else first_job = job->next;
+        if (job->next) job->next->prev = job->prev; else last_job = job->prev;
+
+        release_command(job->command);
+        free(job->procs);
+        job->in_use = 0;
+        job->next = free_jobs;
+        free_jobs = job;
     }
 }
 
-void put_job_in_foreground(Job* job, int cont) {
-    if (!shell_is_interactive || !job) return;
+void announce_background_job(const Job* job, pid_t pid) {
+    last_background_pid = pid;
+    if (shell_is_interactive) {
+        printf("[%d] %d\n", job->job_id, pid);
+    }
+}
+
+Job* get_job_by_pid(pid_t pid) {
+    return map_get(&jobs_by_pid, pid);
+}
+
+Job* get_job_by_job_id(int job_id) {
+    return map_get(&jobs_by_id, job_id);
+}
+
+int job_is_running(const Job* job) {
+    return job->live_count > 0 && job->stopped_count < job->live_count;
+}
+
+int has_active_jobs() {
+    return first_job != NULL;
+}
+
+int has_finished_jobs() {
+    return finished_jobs != NULL;
+}
+
+void reap_children() {
+    pid_t pid;
+    int status;
+    struct rusage usage;
+
+    // WNOHANG: only collect what has already happened
+    while ((pid = wait4(-1, &status, WNOHANG | WUNTRACED | WCONTINUED, &usage)) > 0) {
+        // Processes not managed by our job control are simply ignored
+        update_job_status(pid, status, &usage);
+    }
+}
+
+void update_job_status(pid_t pid, int status, const struct rusage* usage) {
+    Job* job = get_job_by_pid(pid);
+    if (!job) {
+        return;
+    }
+
+    JobProcess* proc = NULL;
+    for (int i = 0; i < job->proc_count; i++) {
+        if (job->procs[i].pid == pid) {
+            proc = &job->procs[i];
+            break;
+        }
+    }
+    if (!proc || proc->exited) {
+        return;
+    }
+
+    proc->status = status;
+    if (WIFEXITED(status) || WIFSIGNALED(status)) {
+        if (proc->stopped) {
+            proc->stopped = 0;
+            job->stopped_count--;
+        }
+        proc->exited = 1;
+        job->live_count--;
+        if (usage != NULL) {
+            add_usage(&job->usage, usage);
+        }
+    } else if (WIFSTOPPED(status) && !proc->stopped) {
+        proc->stopped = 1;
+        job->stopped_count++;
+    } else if (WIFCONTINUED(status) && proc->stopped) {
+        proc->stopped = 0;
+        job->stopped_count--;
+    }
+
+    if (job->live_count == 0) {
+        job->end_ms = now_ms();
+        // A pipeline's status is that of its last command
+        int last = job->procs[job->proc_count - 1].status;
+        job->status = WIFSIGNALED(last) ? TERMINATED : COMPLETED;
+        if (!job->finished_queued) {
+            job->finished_queued = 1;
+            job->next_finished = finished_jobs;
+            finished_jobs = job;
+        }
+    } else if (job->stopped_count == job->live_count) {
+        job->status = STOPPED;
+    } else if (job->status == STOPPED) {
+        job->status = job->is_background ? BACKGROUND : RUNNING;
+    }
+}
+
+void for_each_job(void (*fn)(Job* job, void* ctx), void* ctx) {
+    for (Job* job = first_job; job != NULL; job = job->next) {
+        fn(job, ctx);
+    }
+}
+
+static void print_job(Job* job, void* ctx) {
+    int long_format = *(int*)ctx;
+    // The foreground job is the pipeline `jobs` itself is running in
+    if (job->status == FOREGROUND) {
+        return;
+    }
+    const char* status_str = "Running";
+    switch (job->status) {
+        case RUNNING:
+        case FOREGROUND:
+        case BACKGROUND:
+            status_str = "Running";
+            break;
+        case STOPPED:
+            status_str = "Stopped";
+            break;
+        case COMPLETED:
+            status_str = "Done";
+            break;
+        case TERMINATED:
+            status_str = "Terminated";
+            break;
+        case QUEUED:
+            status_str = "Queued";
+            break;
+    }
+    if (!long_format) {
+        printf("[%d] %s %s\n", job->job_id, status_str, job->command);
+        return;
+    }
+    char usage[160];
+    format_job_usage(job, usage, sizeof(usage));
+    printf("[%d] %d %s %s (%s)\n", job->job_id, (int)job->pid, status_str, job->command, usage);
+}
+
+int wait_for_child_event(int timeout_ms) {
+    // Without a limit, a shell with no children would sleep forever; WNOWAIT leaves them unreaped
+    siginfo_t info;
+    if (timeout_ms < 0 && waitid(P_ALL, 0, &info, WEXITED | WSTOPPED | WCONTINUED | WNOHANG | WNOWAIT) < 0 &&
+        errno == ECHILD) {
+        return -1;
+    }
+
+    int signal_fd = get_signal_fd();
+    if (shell_is_interactive && signal_fd >= 0) {
+        // SIGCHLD and SIGINT are blocked and arrive on the signalfd, as in the event loop
+        struct pollfd pfd = { .fd = signal_fd, .events = POLLIN };
+        unsigned int pending = poll(&pfd, 1, timeout_ms) > 0 ? read_pending_signals() : 0;
+        reap_children();
+        return (pending & SIGNAL_BIT(SIGINT)) != 0;
+    }
+
+    // Block SIGCHLD before looking, so an exit between the check and the wait still wakes us
+    sigset_t set, old;
+    sigemptyset(&set);
+    sigaddset(&set, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &set, &old);
+    int changed = 0;
+    pid_t pid;
+    int status;
+    struct rusage usage;
+    while ((pid = wait4(-1, &status, WNOHANG | WUNTRACED | WCONTINUED, &usage)) > 0) {
+        update_job_status(pid, status, &usage);
+        changed = 1;
+    }
+    if (!changed && timeout_ms >= 0) {
+        // Without children, nothing but the timeout can end the wait
+        struct timespec timeout = { timeout_ms / 1000, (timeout_ms % 1000) * 1000000L };
+        if (pid == 0) {
+            sigtimedwait(&set, NULL, &timeout);
+        } else {
+            nanosleep(&timeout, NULL);
+        }
+        reap_children();
+    } else if (!changed && pid == 0) {
+        sigwaitinfo(&set, NULL);
+        reap_children();
+    }
+    sigprocmask(SIG_SETMASK, &old, NULL);
+    return 0;
+}
+
+void print_jobs(int long_format) {
+    for_each_job(print_job, &long_format);
+}
+
+// Sends SIGCONT to a stopped job and marks all of its processes as running again
+static void continue_job(Job* job) {
+    for (int i = 0; i < job->proc_count; i++) {
+        job->procs[i].stopped = 0;
+    }
+    job->stopped_count = 0;
+
+    if (kill(-job->pgid, SIGCONT) < 0) {
+        perror("kill (SIGCONT)");
+    }
+}
+
+int job_exit_status(const Job* job) {
+    if (job->proc_count == 0) {
+        return 0;
+    }
+    return exit_status_of(job->procs[job->proc_count - 1].status);
+}
+
+int put_job_in_foreground(Job* job, int cont) {
+    if (!job) return 0;
 
     current_foreground_job = job->job_id;
 
     // Send the job to the foreground
-    tcsetpgrp(shell_terminal, job->pgid);
+    if (shell_is_interactive) {
+        tcsetpgrp(shell_terminal, job->pgid);
+    }
 
     // Send SIGCONT to a stopped job
     if (cont && job->status == STOPPED) {
-        if (kill(-job->pgid, SIGCONT) < 0) {
-            perror("kill (SIGCONT)");
-        }
+        continue_job(job);
     }
 
     job->status = FOREGROUND;
+    job->is_background = 0;
 
-    // Wait for the job to complete or stop
-    int status;
-    pid_t wpid;
-    do {
-        wpid = waitpid(job->pid, &status, WUNTRACED | WCONTINUED);
-        if (wpid == -1 && errno != ECHILD) {
-            perror("waitpid");
+    // Wait for every process of the job to exit, or for the job to stop.
+    // Background children that exit meanwhile are collected too, so their run times end when they did.
+    while (job_is_running(job)) {
+        int status;
+        struct rusage usage;
+        pid_t wpid = wait4(-1, &status, WUNTRACED, &usage);
+        if (wpid > 0) {
+            update_job_status(wpid, status, &usage);
+        } else if (errno == ECHILD) {
+            break;
+        } else if (errno != EINTR) {
+            perror("wait4");
+            break;
         }
+    }
 
-        if (WIFEXITED(status)) {
-            update_job_status(job->pid, COMPLETED);
-            printf("[%d] Done %s\n", job->job_id, job->command);
-            remove_job(job->job_id);
-        } else if (WIFSIGNALED(status)) {
-            update_job_status(job->pid, TERMINATED);
-            printf("[%d] Terminated %s\n", job->job_id, job->command);
-            remove_job(job->job_id);
-        } else if (WIFSTOPPED(status)) {
-            update_job_status(job->pid, STOPPED);
-            printf("[%d] Stopped %s\n", job->job_id, job->command);
-        } else if (WIFCONTINUED(status)) {
-            update_job_status(job->pid, RUNNING); // Or BACKGROUND/FOREGROUND based on context
-        }
-    } while (!WIFEXITED(status) && !WIFSIGNALED(status) && !WIFSTOPPED(status));
+    int exit_status = job_exit_status(job);
+
+    // Only an interactive user wants to hear about every foreground job
+    if (job->status == COMPLETED) {
+        if (shell_is_interactive) printf("[%d] Done %s\n", job->job_id, job->command);
+        remove_job(job->job_id);
+    } else if (job->status == TERMINATED) {
+        if (shell_is_interactive) printf("[%d] Terminated %s\n", job->job_id, job->command);
+        remove_job(job->job_id);
+    } else if (job->status == STOPPED) {
+        printf("[%d] Stopped %s\n", job->job_id, job->command);
+    }
 
     // Give the terminal back to the shell
-    tcsetpgrp(shell_terminal, shell_pgid);
-    tcsetattr(shell_terminal, TCSADRAIN, &shell_tmodes);
+    if (shell_is_interactive) {
+        tcsetpgrp(shell_terminal, shell_pgid);
+        tcsetattr(shell_terminal, TCSADRAIN, &shell_tmodes);
+    }
 
     current_foreground_job = -1;
+    return exit_status;
 }
 
 void put_job_in_background(Job* job, int cont) {
-    if (!shell_is_interactive || !job) return;
+    if (!job) return;
 
     // If it was stopped, continue it in the background
-    if (cont && job->status == STOPPED) {
-        if (kill(-job->pgid, SIGCONT) < 0) {
-            perror("kill (SIGCONT)");
-        }
+    int was_stopped = job->status == STOPPED;
+    if (cont && was_stopped) {
+        continue_job(job);
     }
     job->status = BACKGROUND;
     job->is_background = 1;
-    printf("[%d] %s %s\n", job->job_id, (cont && job->status == STOPPED) ? "Continuing" : "Running", job->command);
+    printf("[%d] %s %s\n", job->job_id, (cont && was_stopped) ? "Continuing" : "Running", job->command);
 }
 
 // Built-in functions
-void builtin_jobs(char** args) {
-    print_jobs();
+int builtin_jobs(char** args) {
+    int long_format = 0;
+    for (int i = 1; args[i] != NULL; i++) {
+        if (strcmp(args[i], "-l") != 0) {
+            fprintf(stderr, "jobs: %s: invalid option\n", args[i]);
+            return 2;
+        }
+        long_format = 1;
+    }
+    print_jobs(long_format);
+    return 0;
 }
 
-void builtin_fg(char** args) {
+int builtin_fg(char** args) {
     if (args[1] == NULL) {
         fprintf(stderr, "fg: usage: fg <job_id>\n");
-        return;
+        return 1;
     }
 
     int job_id = atoi(args[1]);
@@ -221,15 +766,19 @@ void builtin_fg(char** args) {
 
     if (job == NULL) {
         fprintf(stderr, "fg: no such job: %d\n", job_id);
-        return;
+        return 1;
     }
-    put_job_in_foreground(job, 1);
+    // A queued job skips the rest of the queue
+    if (job->status == QUEUED && start_queued_job(job, 1) < 0) {
+        return 1;
+    }
+    return put_job_in_foreground(job, 1);
 }
 
-void builtin_bg(char** args) {
+int builtin_bg(char** args) {
     if (args[1] == NULL) {
         fprintf(stderr, "bg: usage: bg <job_id>\n");
-        return;
+        return 1;
     }
 
     int job_id = atoi(args[1]);
@@ -237,7 +786,277 @@ void builtin_bg(char** args) {
 
     if (job == NULL) {
         fprintf(stderr, "bg: no such job: %d\n", job_id);
-        return;
+        return 1;
+    }
+    if (job->status == QUEUED && start_queued_job(job, 0) < 0) {
+        return 1;
     }
     put_job_in_background(job, 1);
+    return 0;
+}
+
+// A job or process named on the `wait` command line
+typedef struct {
+    const char* text;
+    int job_id;         // %N, or 0
+    pid_t pid;          // Otherwise
+} WaitTarget;
+
+static int parse_wait_target(const char* text, WaitTarget* target) {
+    const char* digits = text + (text[0] == '%');
+    char* end;
+    long n = strtol(digits, &end, 10);
+    if (*digits == '\0' || *end != '\0' || n <= 0) {
+        fprintf(stderr, "wait: %s: not a pid or valid job spec\n", text);
+        return -1;
+    }
+    *target = (WaitTarget){ text, text[0] == '%' ? (int)n : 0, text[0] == '%' ? 0 : (pid_t)n };
+    return 0;
+}
+
+// 1 with its status once the target is over, 0 while it runs or waits in the
+// queue, -1 if the shell knows no such job. A finished job is collected, so it
+// is not reported again.
+static int check_wait_target(const WaitTarget* target, int* status) {
+    Job* job = target->pid ? get_job_by_pid(target->pid) : get_job_by_job_id(target->job_id);
+    if (job == NULL) {
+        return take_saved_status(target->job_id, target->pid, status) ? 1 : -1;
+    }
+    if (job->status == QUEUED || job_is_running(job)) {
+        return 0;
+    }
+    *status = job_exit_status(job);
+    for (int i = 0; i < job->proc_count; i++) {
+        if (job->procs[i].pid == target->pid) {
+            *status = exit_status_of(job->procs[i].status);
+        }
+    }
+    if (job->live_count == 0) {
+        remove_job(job->job_id);
+    }
+    return 1;
+}
+
+// wait -n without targets: the oldest finished background job, saved or still in the table
+static int take_any_finished_job(int* status) {
+    if (take_saved_status(0, 0, status)) {
+        return 1;
+    }
+    for (Job* job = first_job; job != NULL; job = job->next) {
+        if (job->is_background && job->status != QUEUED && job->live_count == 0) {
+            *status = job_exit_status(job);
+            remove_job(job->job_id);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int has_waitable_jobs() {
+    for (Job* job = first_job; job != NULL; job = job->next) {
+        if (job->is_background && (job->status == QUEUED || job_is_running(job))) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Sleeps until a child changes state, letting the queue start jobs meanwhile
+static int wait_for_next_event() {
+    int event = wait_for_child_event(queue_poll_timeout());
+    dispatch_queued_jobs();
+    return event;
+}
+
+int builtin_wait(char** args) {
+    int any = args[1] != NULL && strcmp(args[1], "-n") == 0;
+    char** words = args + 1 + any;
+    int count = 0;
+    while (words[count] != NULL) count++;
+    WaitTarget* targets = malloc((count + 1) * sizeof(WaitTarget));
+    if (!targets) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < count; i++) {
+        if (parse_wait_target(words[i], &targets[i]) < 0) {
+            free(targets);
+            return 2;
+        }
+    }
+
+    int status = 0;
+    int event = 0;
+    if (count == 0 && !any) {
+        while (has_waitable_jobs() && (event = wait_for_next_event()) == 0);
+    } else if (count == 0) {
+        while (!take_any_finished_job(&status)) {
+            if (!has_waitable_jobs() || (event = wait_for_next_event()) != 0) {
+                status = STATUS_NOT_FOUND;
+                break;
+            }
+        }
+    } else if (any) {
+        for (;;) {
+            int state = -1, known = 0;
+            for (int i = 0; i < count && state <= 0; i++) {
+                state = check_wait_target(&targets[i], &status);
+                known |= state == 0;
+            }
+            if (state > 0) {
+                break;
+            }
+            if (!known || (event = wait_for_next_event()) != 0) {
+                status = STATUS_NOT_FOUND;
+                break;
+            }
+        }
+    } else {
+        for (int i = 0; i < count && event <= 0; i++) {
+            int state;
+            while ((state = check_wait_target(&targets[i], &status)) == 0 &&
+                   (event = wait_for_next_event()) == 0);
+            // With event < 0 its processes are not this shell's children, as in a subshell
+            if (state < 0 || event < 0) {
+                fprintf(stderr, "wait: %s: no such job\n", targets[i].text);
+                status = STATUS_NOT_FOUND;
+            }
+        }
+    }
+    free(targets);
+    return event > 0 ? STATUS_INTERRUPTED : status;
+}
+
+static const struct {
+    const char* name;
+    int signo;
+} signal_names[] = {
+    { "HUP", SIGHUP }, { "INT", SIGINT }, { "QUIT", SIGQUIT }, { "ILL", SIGILL }, { "TRAP", SIGTRAP },
+    { "ABRT", SIGABRT }, { "BUS", SIGBUS }, { "FPE", SIGFPE }, { "KILL", SIGKILL }, { "USR1", SIGUSR1 },
+    { "SEGV", SIGSEGV }, { "USR2", SIGUSR2 }, { "PIPE", SIGPIPE }, { "ALRM", SIGALRM }, { "TERM", SIGTERM },
+#ifdef SIGSTKFLT
+    { "STKFLT", SIGSTKFLT },
+#endif
+    { "CHLD", SIGCHLD }, { "CONT", SIGCONT }, { "STOP", SIGSTOP }, { "TSTP", SIGTSTP }, { "TTIN", SIGTTIN },
+    { "TTOU", SIGTTOU }, { "URG", SIGURG }, { "XCPU", SIGXCPU }, { "XFSZ", SIGXFSZ }, { "VTALRM", SIGVTALRM },
+    { "PROF", SIGPROF }, { "WINCH", SIGWINCH }, { "IO", SIGIO },
+#ifdef SIGPWR
+    { "PWR", SIGPWR },
+#endif
+    { "SYS", SIGSYS },
+};
+#define SIGNALS_PER_ROW 5
+#define SIGNAL_NAME_COUNT (int)(sizeof(signal_names) / sizeof(signal_names[0]))
+
+// A signal by number or name, with or without SIG; -1 if there is none
+static int parse_signal(const char* text) {
+    char* end;
+    long n = strtol(text, &end, 10);
+    if (*text != '\0' && *end == '\0') {
+        return n >= 0 && n < NSIG ? (int)n : -1;
+    }
+    if (strncasecmp(text, "SIG", 3) == 0) {
+        text += 3;
+    }
+    for (int i = 0; i < SIGNAL_NAME_COUNT; i++) {
+        if (strcasecmp(text, signal_names[i].name) == 0) {
+            return signal_names[i].signo;
+        }
+    }
+    return -1;
+}
+
+// kill -l [n]: every signal in a table, as bash prints it, the name of one
+// (also of an exit status 128+n), or the number of a name
+static int list_signals(const char* number) {
+    if (number == NULL) {
+        for (int i = 0; i < SIGNAL_NAME_COUNT; i++) {
+            int row_end = (i + 1) % SIGNALS_PER_ROW == 0 || i + 1 == SIGNAL_NAME_COUNT;
+            printf("%2d) SIG%s%c", signal_names[i].signo, signal_names[i].name, row_end ? '\n' : '\t');
+        }
+        return 0;
+    }
+    if (!isdigit((unsigned char)number[0])) {
+        int signo = parse_signal(number);
+        if (signo > 0) {
+            printf("%d\n", signo);
+            return 0;
+        }
+        fprintf(stderr, "kill: %s: invalid signal specification\n", number);
+        return 1;
+    }
+    int signo = atoi(number);
+    signo = signo > 128 ? signo - 128 : signo;
+    for (int i = 0; i < SIGNAL_NAME_COUNT; i++) {
+        if (signal_names[i].signo == signo) {
+            printf("%s\n", signal_names[i].name);
+            return 0;
+        }
+    }
+    fprintf(stderr, "kill: %s: invalid signal specification\n", number);
+    return 1;
+}
+
+int builtin_kill(char** args) {
+    int signo = SIGTERM;
+    int i = 1;
+    if (args[1] != NULL && strcmp(args[1], "-l") == 0) {
+        return list_signals(args[2]);
+    }
+    if (args[1] != NULL && (strcmp(args[1], "-s") == 0 || strcmp(args[1], "-n") == 0)) {
+        signo = args[2] ? parse_signal(args[2]) : -1;
+        if (signo < 0) {
+            fprintf(stderr, "kill: %s: invalid signal specification\n", args[2] ? args[2] : "");
+            return 2;
+        }
+        i = 3;
+    } else if (args[1] != NULL && args[1][0] == '-' && strcmp(args[1], "--") != 0) {
+        signo = parse_signal(args[1] + 1);
+        if (signo < 0) {
+            fprintf(stderr, "kill: %s: invalid signal specification\n", args[1] + 1);
+            return 2;
+        }
+        i = 2;
+    }
+    i += args[i] != NULL && strcmp(args[i], "--") == 0;
+    if (args[i] == NULL) {
+        fprintf(stderr, "kill: usage: kill [-s sigspec | -n signum | -sigspec] pid | %%job ...\n");
+        return 2;
+    }
+
+    int status = 0;
+    for (; args[i] != NULL; i++) {
+        const char* digits = args[i] + (args[i][0] == '%');
+        char* end;
+        long n = strtol(digits, &end, 10);
+        if (*digits == '\0' || *end != '\0' || (args[i][0] == '%' && n <= 0)) {
+            fprintf(stderr, "kill: %s: arguments must be process or job IDs\n", args[i]);
+            status = 1;
+            continue;
+        }
+        if (args[i][0] != '%') {
+            if (kill((pid_t)n, signo) < 0) {
+                fprintf(stderr, "kill: (%ld) - %s\n", n, strerror(errno));
+                status = 1;
+            }
+            continue;
+        }
+        Job* job = get_job_by_job_id((int)n);
+        if (job == NULL) {
+            fprintf(stderr, "kill: %s: no such job\n", args[i]);
+            status = 1;
+        } else if (job->status == QUEUED) {
+            // Never started: it simply leaves the queue
+            if (signo != 0) {
+                remove_job(job->job_id);
+            }
+        } else if (kill(-job->pgid, signo) < 0) {
+            fprintf(stderr, "kill: %s: %s\n", args[i], strerror(errno));
+            status = 1;
+        } else if (job->status == STOPPED && (signo == SIGTERM || signo == SIGHUP)) {
+            // A stopped job would only see the signal once continued, as in bash
+            kill(-job->pgid, SIGCONT);
+        }
+    }
+    return status;
 }
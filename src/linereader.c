@@ -0,0 +1,143 @@
+#include "linereader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define CHUNK_SIZE (64 * 1024) // Bytes asked of each read()
+
+void line_reader_init(LineReader* reader, int fd) {
+    memset(reader, 0, sizeof(LineReader));
+    reader->fd = fd;
+
+    // A regular file is mapped from the current offset on; mmap() wants a page-aligned start
+    struct stat st;
+    off_t start = lseek(fd, 0, SEEK_CUR);
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || start < 0 || st.st_size <= start) {
+        return;
+    }
+    off_t base = start - start % sysconf(_SC_PAGESIZE);
+    char* map = mmap(NULL, st.st_size - base, PROT_READ, MAP_PRIVATE, fd, base);
+    if (map == MAP_FAILED) {
+        return;
+    }
+    madvise(map, st.st_size - base, MADV_SEQUENTIAL);
+    reader->data = map;
+    reader->len = st.st_size - base;
+    reader->pos = start - base;
+    reader->map_offset = base;
+    reader->mapped = 1;
+}
+
+// Leaves the mapping for the read buffer, keeping the unfinished line, since the file may have grown
+static void unmap(LineReader* reader) {
+    size_t rest = reader->len - reader->pos;
+    size_t cap = rest + CHUNK_SIZE;
+    char* buffer = malloc(cap);
+    if (!buffer) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(buffer, reader->data + reader->pos, rest);
+    lseek(reader->fd, reader->map_offset + reader->len, SEEK_SET);
+    munmap(reader->data, reader->len);
+    reader->data = buffer;
+    reader->len = rest;
+    reader->pos = 0;
+    reader->cap = cap;
+    reader->mapped = 0;
+}
+
+// Appends another chunk of input after the unconsumed bytes. Returns 0 at end of input.
+static int fill(LineReader* reader) {
+    if (reader->mapped) {
+        unmap(reader);
+    }
+    if (reader->eof) {
+        return 0;
+    }
+    if (reader->pos > 0) {
+        memmove(reader->data, reader->data + reader->pos, reader->len - reader->pos);
+        reader->len -= reader->pos;
+        reader->pos = 0;
+    }
+    if (reader->cap - reader->len < CHUNK_SIZE) {
+        // Grows with the longest line, so a generated command line of any length fits
+        reader->cap = reader->cap * 2 > reader->len + CHUNK_SIZE ? reader->cap * 2 : reader->len + CHUNK_SIZE;
+        reader->data = realloc(reader->data, reader->cap);
+        if (!reader->data) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    ssize_t n;
+    do {
+        n = read(reader->fd, reader->data + reader->len, reader->cap - reader->len);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        if (n < 0) {
+            perror("read");
+        }
+        reader->eof = 1;
+        return 0;
+    }
+    reader->len += n;
+    return 1;
+}
+
+// Copies out the len bytes at pos and consumes them, plus skip more
+static char* take(LineReader* reader, size_t len, size_t skip) {
+    char* line = malloc(len + 1);
+    if (!line) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(line, reader->data + reader->pos, len);
+    line[len] = '\0';
+    reader->pos += len + skip;
+    if (reader->mapped) {
+        // Commands started from the file read on from the next line
+        lseek(reader->fd, reader->map_offset + reader->pos, SEEK_SET);
+    }
+    return line;
+}
+
+char* line_reader_next(LineReader* reader) {
+    if (reader->mapped) {
+        // A command that read from the file, such as `head -n 1`, moved the offset past what it used
+        off_t at = lseek(reader->fd, 0, SEEK_CUR);
+        if (at >= reader->map_offset && (size_t)(at - reader->map_offset) <= reader->len) {
+            reader->pos = at - reader->map_offset;
+        }
+    }
+    size_t scanned = 0; // Bytes after pos already known to hold no newline
+    for (;;) {
+        if (reader->data != NULL) {
+            char* start = reader->data + reader->pos;
+            char* newline = memchr(start + scanned, '\n', reader->len - reader->pos - scanned);
+            if (newline != NULL) {
+                return take(reader, newline - start, 1);
+            }
+            scanned = reader->len - reader->pos;
+        }
+        if (!fill(reader)) {
+            break;
+        }
+    }
+    // The last line may lack its newline
+    return reader->len > reader->pos ? take(reader, reader->len - reader->pos, 0) : NULL;
+}
+
+void line_reader_close(LineReader* reader) {
+    if (reader->mapped) {
+        munmap(reader->data, reader->len);
+    } else {
+        free(reader->data);
+    }
+    memset(reader, 0, sizeof(LineReader));
+    reader->fd = -1;
+}
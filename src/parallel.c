@@ -0,0 +1,337 @@
+#define _GNU_SOURCE
+#include "parallel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "builtins.h"
+#include "fastcopy.h"
+#include "jobs.h"
+#include "linereader.h"
+#include "spawner.h"
+#include "text.h"
+
+#define MAX_REPORTED_FAILURES 101 // As in GNU parallel: higher counts would wrap around
+#define STATUS_NOT_FOUND 127
+#define STATUS_INTERRUPTED (128 + SIGINT)
+
+typedef struct ParallelItem {
+    int seq;                    // Position in the input, from 1
+    char* command;              // The command as run, for the report
+    int output_fd;              // Captured stdout and stderr
+    Job* job;                   // NULL if the command could not be started
+    double start_ms;
+    int status;
+    double elapsed_ms;
+    struct ParallelItem* next;  // In the queue of finished items waiting for their turn (-k)
+} ParallelItem;
+
+typedef struct {
+    char** template;            // Command words, with {} where the item goes
+    int template_len;
+    int has_placeholder;
+    char** items;               // After :::, or NULL to read stdin
+    LineReader reader;
+    int jobs;
+    int keep_order;
+    int quiet;
+
+    ParallelItem** running;
+    int running_count;
+    ParallelItem* waiting;      // Finished, sorted by seq, with -k
+    int next_seq;
+    int next_to_print;
+    int failures;
+    int interrupted;
+} Parallel;
+
+// The next item, or NULL once they run out
+static char* next_item(Parallel* p) {
+    if (p->items != NULL) {
+        return *p->items ? strdup(*p->items++) : NULL;
+    }
+    char* line;
+    while ((line = line_reader_next(&p->reader)) != NULL && line[0] == '\0') {
+        free(line);
+    }
+    return line;
+}
+
+// Replaces every {} in word with item
+static char* substitute(const char* word, const char* item) {
+    size_t item_len = strlen(item), len = 0;
+    for (const char* s = word; *s; s++) {
+        len += (s[0] == '{' && s[1] == '}') ? (s++, item_len) : 1;
+    }
+    char* out = malloc(len + 1);
+    if (!out) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    char* o = out;
+    for (const char* s = word; *s; s++) {
+        if (s[0] == '{' && s[1] == '}') {
+            memcpy(o, item, item_len);
+            o += item_len;
+            s++;
+        } else {
+            *o++ = *s;
+        }
+    }
+    *o = '\0';
+    return out;
+}
+
+static char** build_argv(const Parallel* p, const char* item) {
+    char** argv = malloc((p->template_len + 2) * sizeof(char*));
+    if (!argv) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    int argc = 0;
+    for (int i = 0; i < p->template_len; i++) {
+        argv[argc++] = substitute(p->template[i], item);
+    }
+    if (!p->has_placeholder) {
+        argv[argc++] = strdup(item);
+    }
+    argv[argc] = NULL;
+    return argv;
+}
+
+// An anonymous file for one child's output, on disk so a large output costs no memory
+static int open_output_file() {
+    int fd = open(P_tmpdir, O_TMPFILE | O_RDWR | O_APPEND | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        char path[] = P_tmpdir "/myshell-parallel-XXXXXX";
+        fd = mkostemp(path, O_APPEND | O_CLOEXEC);
+        if (fd >= 0) {
+            unlink(path);
+        }
+    }
+    if (fd < 0) {
+        perror("parallel: output file");
+    }
+    return fd;
+}
+
+static void start_item(Parallel* p, const char* arg) {
+    ParallelItem* item = calloc(1, sizeof(ParallelItem));
+    if (!item) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    char** argv = build_argv(p, arg);
+    item->seq = p->next_seq++;
+    item->command = join_args(argv);
+    item->output_fd = open_output_file();
+    item->start_ms = now_ms();
+
+    Redirection redirs[2];
+    int redir_count = 0;
+    if (p->items == NULL) {
+        // The items come from stdin, so it is not the children's to read
+        redirs[redir_count++] = (Redirection){ STDIN_FILENO, O_RDONLY, "/dev/null" };
+    }
+    if (item->output_fd >= 0) {
+        // Reopens the output file once it is stdout, so both streams append to it in the order written
+        redirs[redir_count++] = (Redirection){ STDERR_FILENO, O_WRONLY | O_APPEND, "/proc/self/fd/1" };
+    }
+    SpawnRequest req = {
+        .argv = argv,
+        .pgid = getpgrp(), // The shell's group, so Ctrl+C reaches every child
+        .stdin_fd = -1,
+        .stdout_fd = item->output_fd,
+        .redirs = redirs,
+        .redir_count = redir_count,
+        .tty_fd = -1,
+    };
+
+    BuiltinFunc builtin = find_builtin(argv, 0);
+    pid_t pid = builtin ? spawn_builtin(&req, builtin) : spawn_command(&req);
+    if (pid > 0) {
+        item->job = add_job(req.pgid, item->command, FOREGROUND, 0);
+        if (item->job) {
+            add_job_process(item->job, pid);
+        }
+    } else {
+        item->status = STATUS_NOT_FOUND;
+    }
+    for (int i = 0; argv[i]; i++) {
+        free(argv[i]);
+    }
+    free(argv);
+    p->running[p->running_count++] = item;
+}
+
+// Writes out a finished item's output and its report
+static void print_item(Parallel* p, ParallelItem* item) {
+    if (item->output_fd >= 0) {
+        lseek(item->output_fd, 0, SEEK_SET);
+        fflush(stdout);
+        copy_fd_data(item->output_fd, STDOUT_FILENO);
+        close(item->output_fd);
+    }
+    if (!p->quiet || item->status != 0) {
+        fprintf(stderr, "parallel: [%d] exit %d in %.3f s: %s\n", item->seq, item->status,
+                item->elapsed_ms / 1e3, item->command);
+    }
+    free(item->command);
+    free(item);
+}
+
+static void finish_item(Parallel* p, ParallelItem* item) {
+    item->elapsed_ms = now_ms() - item->start_ms;
+    if (item->job != NULL) {
+        item->status = job_exit_status(item->job);
+        remove_job(item->job->job_id);
+        item->job = NULL;
+    }
+    if (item->status != 0) {
+        p->failures++;
+    }
+    if (item->status == STATUS_INTERRUPTED) {
+        p->interrupted = 1;
+    }
+
+    if (!p->keep_order) {
+        print_item(p, item);
+        return;
+    }
+    ParallelItem** link = &p->waiting;
+    while (*link != NULL && (*link)->seq < item->seq) {
+        link = &(*link)->next;
+    }
+    item->next = *link;
+    *link = item;
+    while (p->waiting != NULL && p->waiting->seq == p->next_to_print) {
+        ParallelItem* ready = p->waiting;
+        p->waiting = ready->next;
+        p->next_to_print++;
+        print_item(p, ready);
+    }
+}
+
+// Finishes every running item whose process is gone
+static void collect_finished(Parallel* p) {
+    for (int i = 0; i < p->running_count;) {
+        ParallelItem* item = p->running[i];
+        if (item->job == NULL || item->job->live_count == 0) {
+            p->running[i] = p->running[--p->running_count];
+            finish_item(p, item);
+        } else {
+            i++;
+        }
+    }
+}
+
+// Blocks until some child changes state, recording it in the job table
+static void wait_for_child(Parallel* p) {
+    int status;
+    struct rusage usage;
+    pid_t pid = wait4(-1, &status, 0, &usage);
+    if (pid > 0) {
+        update_job_status(pid, status, &usage);
+    } else if (errno == ECHILD) {
+        // Someone else reaped them: nothing is left to wait for
+        for (int i = 0; i < p->running_count; i++) {
+            if (p->running[i]->job != NULL) {
+                p->running[i]->job->live_count = 0;
+            }
+        }
+    }
+}
+
+static int parse_options(Parallel* p, char** args) {
+    int i = 1;
+    for (; args[i] != NULL && args[i][0] == '-'; i++) {
+        if (strcmp(args[i], "--") == 0) {
+            i++;
+            break;
+        } else if (strcmp(args[i], "-k") == 0) {
+            p->keep_order = 1;
+        } else if (strcmp(args[i], "-q") == 0) {
+            p->quiet = 1;
+        } else if (strncmp(args[i], "-j", 2) == 0) {
+            const char* count = args[i][2] ? args[i] + 2 : args[++i];
+            char* end;
+            p->jobs = count ? (int)strtol(count, &end, 10) : 0;
+            if (count == NULL || *end != '\0' || p->jobs < 1) {
+                fprintf(stderr, "parallel: -j: expected a positive number\n");
+                return -1;
+            }
+        } else {
+            fprintf(stderr, "parallel: %s: invalid option\n", args[i]);
+            return -1;
+        }
+    }
+
+    p->template = args + i;
+    while (args[i] != NULL && strcmp(args[i], ":::") != 0) {
+        p->has_placeholder |= strstr(args[i], "{}") != NULL;
+        i++;
+    }
+    p->template_len = args + i - p->template;
+    if (args[i] != NULL) {
+        p->items = args + i + 1;
+    }
+    if (p->template_len == 0) {
+        fprintf(stderr, "parallel: usage: parallel [-j N] [-k] [-q] command [args...] [::: items...]\n");
+        return -1;
+    }
+    return 0;
+}
+
+int builtin_parallel(char** args) {
+    Parallel p = { .next_seq = 1, .next_to_print = 1 };
+    if (parse_options(&p, args) < 0) {
+        return 1;
+    }
+    if (p.jobs == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        p.jobs = cpus > 0 ? cpus : 1;
+    }
+    if (p.items == NULL) {
+        line_reader_init(&p.reader, STDIN_FILENO);
+    }
+    p.running = malloc(p.jobs * sizeof(ParallelItem*));
+    if (!p.running) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    int input_left = 1;
+    for (;;) {
+        // Top up to N children; items are read only as slots free up, so input may stream
+        while (input_left && !p.interrupted && p.running_count < p.jobs) {
+            char* arg = next_item(&p);
+            if (arg == NULL) {
+                input_left = 0;
+                break;
+            }
+            start_item(&p, arg);
+            free(arg);
+        }
+        collect_finished(&p);
+        if (p.running_count == 0 && (!input_left || p.interrupted)) {
+            break;
+        }
+        if (p.running_count == p.jobs || !input_left || p.interrupted) {
+            wait_for_child(&p);
+            collect_finished(&p);
+        }
+    }
+
+    free(p.running);
+    if (p.items == NULL) {
+        line_reader_close(&p.reader);
+    }
+    if (p.interrupted) {
+        return STATUS_INTERRUPTED;
+    }
+    return p.failures < MAX_REPORTED_FAILURES ? p.failures : MAX_REPORTED_FAILURES;
+}
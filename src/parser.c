@@ -2,56 +2,775 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
 
-char** parse_input(char* input) {
-    // Use a copy for counting tokens, as strtok is destructive.
-    char* temp_input = strdup(input);
-    if (!temp_input) {
-        perror("strdup");
-        exit(EXIT_FAILURE);
+enum TokenType {
+    TOKEN_WORD,
+    TOKEN_PIPE,    // |
+    TOKEN_OR,      // ||
+    TOKEN_AMP,     // &
+    TOKEN_AND,     // &&
+    TOKEN_SEMI,    // ;
+    TOKEN_DSEMI,   // ;;
+    TOKEN_LESS,    // <
+    TOKEN_GREAT,   // >
+    TOKEN_DGREAT,  // >>
+    TOKEN_IO_NUMBER, // The 2 of 2>file
+    TOKEN_LPAREN,  // (
+    TOKEN_RPAREN,  // )
+    TOKEN_NEWLINE,
+    TOKEN_EOF,
+    TOKEN_ERROR    // Unterminated quote; see Parser.error
+};
+
+typedef struct {
+    enum TokenType type;
+    const char* start; // Points into the line
+    size_t len;
+} Token;
+
+// The lexer runs one token ahead of the parser; nothing is scanned twice
+typedef struct {
+    const char* input;    // Start of the text, for line numbers
+    const char* pos;      // Where the next token starts
+    const char* prev_end; // End of the last token consumed, for source text slices
+    Token token;          // Current token
+    const char* error;    // Why the current token is TOKEN_ERROR
+    int* incomplete;      // Where to report running out of input, or NULL
+    Arena* arena;
+} Parser;
+
+// Words that end a list when they appear where a command could start
+static const char* list_terminators[] = { "then", "elif", "else", "fi", "do", "done", "esac", "}", NULL };
+
+// Characters that end an unquoted word
+static int is_meta(char c) {
+    return strchr(" \t\r\n|&;<>()", c) != NULL;
+}
+
+// Finds the bracket closing the one at s (a '{' or '('), skipping quoted text and nesting.
+// Returns NULL if the input ends first.
+static const char* scan_closing(const char* s) {
+    char open = *s, close = open == '{' ? '}' : ')';
+    int depth = 0;
+    for (; *s != '\0'; s++) {
+        if (*s == '\\' && s[1] != '\0') {
+            s++;
+        } else if (*s == '\'' || *s == '"') {
+            const char* end = strchr(s + 1, *s);
+            if (end == NULL) return NULL;
+            s = end;
+        } else if (*s == open) {
+            depth++;
+        } else if (*s == close && --depth == 0) {
+            return s;
+        }
+    }
+    return NULL;
+}
+
+// Scans a word starting at s, honouring quotes and backslashes.
+// Returns the end of the word, or NULL with *error set if something is never closed.
+static const char* scan_word(const char* s, const char** error) {
+    while (*s != '\0' && !is_meta(*s)) {
+        if (*s == '\\') {
+            s += s[1] ? 2 : 1;
+        } else if (s[0] == '$' && (s[1] == '{' || s[1] == '(')) {
+            // ${name:-word} and $((expr)) are one word even with blanks or operators inside
+            const char* close = scan_closing(s + 1);
+            if (close == NULL) {
+                *error = s[1] == '{' ? "unexpected EOF while looking for matching `}'"
+                                     : "unexpected EOF while looking for matching `)'";
+                return NULL;
+            }
+            s = close + 1;
+        } else if (*s == '\'') {
+            const char* close = strchr(s + 1, '\'');
+            if (close == NULL) {
+                *error = "unexpected EOF while looking for matching `''";
+                return NULL;
+            }
+            s = close + 1;
+        } else if (*s == '"') {
+            s++;
+            while (*s != '\0' && *s != '"') {
+                if (*s == '\\' && s[1] != '\0') {
+                    s++;
+                }
+                s++;
+            }
+            if (*s == '\0') {
+                *error = "unexpected EOF while looking for matching `\"'";
+                return NULL;
+            }
+            s++;
+        } else {
+            s++;
+        }
+    }
+    return s;
+}
+
+static void lex(Parser* p) {
+    const char* s = p->pos;
+
+    // Blanks and backslash-newline continuations separate tokens
+    for (;;) {
+        if (*s == ' ' || *s == '\t' || *s == '\r') {
+            s++;
+        } else if (s[0] == '\\' && s[1] == '\n') {
+            s += 2;
+        } else {
+            break;
+        }
+    }
+    // A comment runs to the end of the line
+    if (*s == '#') {
+        s += strcspn(s, "\n");
+    }
+
+    Token* t = &p->token;
+    t->start = s;
+    t->len = 1;
+    switch (*s) {
+        case '\0': t->type = TOKEN_EOF; t->len = 0; break;
+        case '\n': t->type = TOKEN_NEWLINE; break;
+        case '<':  t->type = TOKEN_LESS; break;
+        case '(':  t->type = TOKEN_LPAREN; break;
+        case ')':  t->type = TOKEN_RPAREN; break;
+        case ';':
+            if (s[1] == ';') { t->type = TOKEN_DSEMI; t->len = 2; } else { t->type = TOKEN_SEMI; }
+            break;
+        case '|':
+            if (s[1] == '|') { t->type = TOKEN_OR; t->len = 2; } else { t->type = TOKEN_PIPE; }
+            break;
+        case '&':
+            if (s[1] == '&') { t->type = TOKEN_AND; t->len = 2; } else { t->type = TOKEN_AMP; }
+            break;
+        case '>':
+            if (s[1] == '>') { t->type = TOKEN_DGREAT; t->len = 2; } else { t->type = TOKEN_GREAT; }
+            break;
+        default: {
+            // Digits right before a redirection operator name the descriptor
+            size_t digits = strspn(s, "0123456789");
+            if (digits > 0 && digits < 4 && (s[digits] == '<' || s[digits] == '>')) {
+                t->type = TOKEN_IO_NUMBER;
+                t->len = digits;
+                break;
+            }
+            const char* end = scan_word(s, &p->error);
+            if (end != NULL && *end == '\0' && p->incomplete != NULL) {
+                // A backslash ending the input continues the line, when more can be read
+                size_t backslashes = 0;
+                while (end - backslashes > s && end[-1 - (long)backslashes] == '\\') {
+                    backslashes++;
+                }
+                if (backslashes % 2 == 1) {
+                    p->error = "unexpected EOF after `\\'";
+                    end = NULL;
+                }
+            }
+            if (end == NULL) {
+                t->type = TOKEN_ERROR;
+                t->len = strlen(s);
+            } else {
+                t->type = TOKEN_WORD;
+                t->len = end - s;
+            }
+            break;
+        }
+    }
+    p->pos = s + t->len;
+}
+
+// Consumes the current token and reads the next one
+static void advance(Parser* p) {
+    p->prev_end = p->token.start + p->token.len;
+    lex(p);
+}
+
+static void skip_newlines(Parser* p) {
+    while (p->token.type == TOKEN_NEWLINE) {
+        advance(p);
+    }
+}
+
+// Whether the current token is the unquoted word w
+static int is_word(const Parser* p, const char* w) {
+    size_t len = strlen(w);
+    return p->token.type == TOKEN_WORD && p->token.len == len && memcmp(p->token.start, w, len) == 0;
+}
+
+static int at_list_end(const Parser* p) {
+    enum TokenType type = p->token.type;
+    if (type == TOKEN_EOF || type == TOKEN_RPAREN || type == TOKEN_DSEMI) {
+        return 1;
+    }
+    for (int i = 0; list_terminators[i] != NULL; i++) {
+        if (is_word(p, list_terminators[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void syntax_error(Parser* p) {
+    // Running out of input is not an error when the caller can supply more
+    if ((p->token.type == TOKEN_EOF || p->token.type == TOKEN_ERROR) && p->incomplete != NULL) {
+        *p->incomplete = 1;
+        return;
+    }
+
+    // Scripts get the line number, as in bash
+    if (strchr(p->input, '\n') != NULL) {
+        int line = 1;
+        for (const char* s = p->input; s < p->token.start; s++) {
+            if (*s == '\n') line++;
+        }
+        fprintf(stderr, "line %d: ", line);
+    }
+    if (p->token.type == TOKEN_ERROR) {
+        fprintf(stderr, "%s\n", p->error);
+    } else if (p->token.type == TOKEN_EOF) {
+        fprintf(stderr, "syntax error: unexpected end of file\n");
+    } else if (p->token.type == TOKEN_NEWLINE) {
+        fprintf(stderr, "syntax error near unexpected token `newline'\n");
+    } else {
+        fprintf(stderr, "syntax error near unexpected token `%.*s'\n", (int)p->token.len, p->token.start);
+    }
+}
+
+// Consumes the reserved word w, or reports a syntax error
+static int expect_word(Parser* p, const char* w) {
+    if (!is_word(p, w)) {
+        syntax_error(p);
+        return 0;
+    }
+    advance(p);
+    return 1;
+}
+
+// Makes room to append to an array that lives in the arena, doubling it when full.
+// One slot beyond the new element is always left, for a terminator.
+static void* arena_push(Arena* arena, void* array, int count, int* capacity, size_t elem_size) {
+    if (count + 1 < *capacity) {
+        return array;
+    }
+    int new_capacity = *capacity ? *capacity * 2 : 8;
+    void* grown = arena_alloc(arena, new_capacity * elem_size);
+    if (count > 0) {
+        memcpy(grown, array, count * elem_size);
+    }
+    *capacity = new_capacity;
+    return grown;
+}
+
+static void* arena_zalloc(Arena* arena, size_t size) {
+    void* ptr = arena_alloc(arena, size);
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+static char* token_text(Parser* p) {
+    return arena_strndup(p->arena, p->token.start, p->token.len);
+}
+
+static int is_name(const char* s, size_t len) {
+    if (len == 0 || !(isalpha((unsigned char)s[0]) || s[0] == '_')) {
+        return 0;
+    }
+    for (size_t i = 1; i < len; i++) {
+        if (!(isalnum((unsigned char)s[i]) || s[i] == '_')) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static CommandList* parse_list(Parser* p);
+static Command* parse_command(Parser* p);
+
+// A list that must hold at least one command, as the parts of compound commands do
+static CommandList* parse_body(Parser* p) {
+    CommandList* list = parse_list(p);
+    if (list != NULL && list->first == NULL) {
+        syntax_error(p);
+        return NULL;
+    }
+    return list;
+}
+
+// Parses one redirection into cmd.
+// Returns 1 if one was parsed, 0 if the current token does not start one, -1 on an error.
+static int parse_redirection(Parser* p, Command* cmd, int* capacity) {
+    int fd = -1, flags;
+    if (p->token.type == TOKEN_IO_NUMBER) {
+        fd = atoi(p->token.start);
+        advance(p); // An IO number is always followed by an operator
+    }
+    if (p->token.type == TOKEN_GREAT) {
+        fd = fd < 0 ? STDOUT_FILENO : fd;
+        flags = O_WRONLY | O_CREAT | O_TRUNC;
+    } else if (p->token.type == TOKEN_DGREAT) {
+        fd = fd < 0 ? STDOUT_FILENO : fd;
+        flags = O_WRONLY | O_CREAT | O_APPEND;
+    } else if (p->token.type == TOKEN_LESS) {
+        fd = fd < 0 ? STDIN_FILENO : fd;
+        flags = O_RDONLY;
+    } else {
+        return 0;
+    }
+
+    advance(p);
+    if (p->token.type != TOKEN_WORD) {
+        syntax_error(p);
+        return -1;
+    }
+    cmd->redirs = arena_push(p->arena, cmd->redirs, cmd->redir_count, capacity, sizeof(Redirection));
+    cmd->redirs[cmd->redir_count].fd = fd;
+    cmd->redirs[cmd->redir_count].flags = flags;
+    cmd->redirs[cmd->redir_count].path = token_text(p);
+    cmd->redir_count++;
+    advance(p);
+    return 1;
+}
+
+static Command* new_command(Parser* p, enum CommandType type) {
+    Command* cmd = arena_zalloc(p->arena, sizeof(Command));
+    cmd->type = type;
+    cmd->words = arena_zalloc(p->arena, sizeof(char*));
+    return cmd;
+}
+
+// The body of a function: a compound command, possibly with redirections
+static Command* parse_function_body(Parser* p, const char* name, const char* start) {
+    skip_newlines(p);
+    Command* body = parse_command(p);
+    if (body == NULL) {
+        return NULL;
+    }
+    if (body->type == COMMAND_SIMPLE || body->type == COMMAND_FUNCTION) {
+        fprintf(stderr, "%s: function body must be a compound command\n", name);
+        return NULL;
     }
 
-    int arg_count = 0;
-    char* token = strtok(temp_input, " \t\n\r");
-    while (token != NULL) {
-        arg_count++;
-        token = strtok(NULL, " \t\n\r");
+    Command* cmd = new_command(p, COMMAND_FUNCTION);
+    cmd->function = arena_alloc(p->arena, sizeof(FunctionDef));
+    cmd->function->name = name;
+    cmd->function->body = body;
+    cmd->function->text = arena_strndup(p->arena, start, p->prev_end - start);
+    return cmd;
+}
+
+static Command* parse_simple(Parser* p) {
+    Command* cmd = new_command(p, COMMAND_SIMPLE);
+    const char* start = p->token.start;
+    int word_capacity = 0, redir_capacity = 0;
+
+    for (;;) {
+        if (p->token.type == TOKEN_WORD) {
+            cmd->words = arena_push(p->arena, cmd->words, cmd->word_count, &word_capacity, sizeof(char*));
+            cmd->words[cmd->word_count++] = token_text(p);
+            advance(p);
+
+            // name() starts a function definition
+            if (cmd->word_count == 1 && cmd->redir_count == 0 && p->token.type == TOKEN_LPAREN) {
+                if (!is_name(cmd->words[0], strlen(cmd->words[0]))) {
+                    syntax_error(p);
+                    return NULL;
+                }
+                advance(p);
+                if (p->token.type != TOKEN_RPAREN) {
+                    syntax_error(p);
+                    return NULL;
+                }
+                advance(p);
+                return parse_function_body(p, cmd->words[0], start);
+            }
+            continue;
+        }
+
+        int r = parse_redirection(p, cmd, &redir_capacity);
+        if (r < 0) {
+            return NULL;
+        }
+        if (r == 0) {
+            break;
+        }
+    }
+
+    if (cmd->word_count == 0 && cmd->redir_count == 0) {
+        syntax_error(p);
+        return NULL;
+    }
+    cmd->words[cmd->word_count] = NULL;
+    return cmd;
+}
+
+// Parses what follows `if` or `elif`, up to and including the `fi`
+static IfClause* parse_if_clause(Parser* p) {
+    IfClause* clause = arena_zalloc(p->arena, sizeof(IfClause));
+    if ((clause->condition = parse_body(p)) == NULL || !expect_word(p, "then") ||
+        (clause->then_part = parse_body(p)) == NULL) {
+        return NULL;
+    }
+    if (is_word(p, "elif")) {
+        advance(p);
+        clause->elif = parse_if_clause(p); // Consumes the fi
+        return clause->elif ? clause : NULL;
+    }
+    if (is_word(p, "else")) {
+        advance(p);
+        if ((clause->else_part = parse_body(p)) == NULL) {
+            return NULL;
+        }
+    }
+    return expect_word(p, "fi") ? clause : NULL;
+}
+
+static LoopClause* parse_loop(Parser* p) {
+    LoopClause* loop = arena_zalloc(p->arena, sizeof(LoopClause));
+    if ((loop->condition = parse_body(p)) == NULL || !expect_word(p, "do") ||
+        (loop->body = parse_body(p)) == NULL || !expect_word(p, "done")) {
+        return NULL;
+    }
+    return loop;
+}
+
+static ForClause* parse_for(Parser* p) {
+    ForClause* clause = arena_zalloc(p->arena, sizeof(ForClause));
+    if (p->token.type != TOKEN_WORD || !is_name(p->token.start, p->token.len)) {
+        syntax_error(p);
+        return NULL;
+    }
+    clause->name = token_text(p);
+    advance(p);
+    skip_newlines(p);
+
+    if (is_word(p, "in")) {
+        advance(p);
+        int capacity = 0;
+        clause->words = arena_zalloc(p->arena, sizeof(char*));
+        while (p->token.type == TOKEN_WORD) {
+            clause->words = arena_push(p->arena, clause->words, clause->word_count, &capacity, sizeof(char*));
+            clause->words[clause->word_count++] = token_text(p);
+            advance(p);
+        }
+        clause->words[clause->word_count] = NULL;
+        if (p->token.type != TOKEN_SEMI && p->token.type != TOKEN_NEWLINE) {
+            syntax_error(p);
+            return NULL;
+        }
+        advance(p);
+    } else if (p->token.type == TOKEN_SEMI) {
+        advance(p);
+    }
+
+    skip_newlines(p);
+    if (!expect_word(p, "do") || (clause->body = parse_body(p)) == NULL || !expect_word(p, "done")) {
+        return NULL;
+    }
+    return clause;
+}
+
+static CaseClause* parse_case(Parser* p) {
+    CaseClause* clause = arena_zalloc(p->arena, sizeof(CaseClause));
+    if (p->token.type != TOKEN_WORD) {
+        syntax_error(p);
+        return NULL;
+    }
+    clause->subject = token_text(p);
+    advance(p);
+    skip_newlines(p);
+    if (!expect_word(p, "in")) {
+        return NULL;
+    }
+
+    CaseItem** tail = &clause->items;
+    for (;;) {
+        skip_newlines(p);
+        if (is_word(p, "esac")) {
+            advance(p);
+            return clause;
+        }
+
+        CaseItem* item = arena_zalloc(p->arena, sizeof(CaseItem));
+        int capacity = 0;
+        if (p->token.type == TOKEN_LPAREN) {
+            advance(p);
+        }
+        for (;;) {
+            if (p->token.type != TOKEN_WORD) {
+                syntax_error(p);
+                return NULL;
+            }
+            item->patterns = arena_push(p->arena, item->patterns, item->pattern_count, &capacity, sizeof(char*));
+            item->patterns[item->pattern_count++] = token_text(p);
+            advance(p);
+            if (p->token.type != TOKEN_PIPE) {
+                break;
+            }
+            advance(p);
+        }
+        item->patterns[item->pattern_count] = NULL;
+        if (p->token.type != TOKEN_RPAREN) {
+            syntax_error(p);
+            return NULL;
+        }
+        advance(p);
+
+        if ((item->body = parse_list(p)) == NULL) {
+            return NULL;
+        }
+        *tail = item;
+        tail = &item->next;
+
+        // The last item may leave out its ;;
+        if (p->token.type == TOKEN_DSEMI) {
+            advance(p);
+        } else if (!is_word(p, "esac")) {
+            syntax_error(p);
+            return NULL;
+        }
+    }
+}
+
+static Command* parse_compound(Parser* p) {
+    const char* start = p->token.start;
+    Command* cmd;
+    if (p->token.type == TOKEN_LPAREN) {
+        advance(p);
+        cmd = new_command(p, COMMAND_SUBSHELL);
+        if ((cmd->list = parse_body(p)) == NULL) {
+            return NULL;
+        }
+        if (p->token.type != TOKEN_RPAREN) {
+            syntax_error(p);
+            return NULL;
+        }
+        advance(p);
+    } else if (is_word(p, "{")) {
+        advance(p);
+        cmd = new_command(p, COMMAND_GROUP);
+        if ((cmd->list = parse_body(p)) == NULL || !expect_word(p, "}")) {
+            return NULL;
+        }
+    } else if (is_word(p, "if")) {
+        advance(p);
+        cmd = new_command(p, COMMAND_IF);
+        if ((cmd->if_clause = parse_if_clause(p)) == NULL) {
+            return NULL;
+        }
+    } else if (is_word(p, "while") || is_word(p, "until")) {
+        cmd = new_command(p, is_word(p, "while") ? COMMAND_WHILE : COMMAND_UNTIL);
+        advance(p);
+        if ((cmd->loop = parse_loop(p)) == NULL) {
+            return NULL;
+        }
+    } else if (is_word(p, "for")) {
+        advance(p);
+        cmd = new_command(p, COMMAND_FOR);
+        if ((cmd->for_clause = parse_for(p)) == NULL) {
+            return NULL;
+        }
+    } else {
+        advance(p); // case
+        cmd = new_command(p, COMMAND_CASE);
+        if ((cmd->case_clause = parse_case(p)) == NULL) {
+            return NULL;
+        }
+    }
+
+    // Redirections after a compound command apply to all of it
+    int capacity = 0;
+    int r;
+    while ((r = parse_redirection(p, cmd, &capacity)) > 0) {
+    }
+    if (r < 0) {
+        return NULL;
+    }
+    cmd->text = arena_strndup(p->arena, start, p->prev_end - start);
+    return cmd;
+}
+
+static Command* parse_command(Parser* p) {
+    if (p->token.type == TOKEN_LPAREN || is_word(p, "{") || is_word(p, "if") || is_word(p, "while") ||
+        is_word(p, "until") || is_word(p, "for") || is_word(p, "case")) {
+        return parse_compound(p);
+    }
+
+    if (is_word(p, "function")) {
+        const char* start = p->token.start;
+        advance(p);
+        if (p->token.type != TOKEN_WORD || !is_name(p->token.start, p->token.len)) {
+            syntax_error(p);
+            return NULL;
+        }
+        const char* name = token_text(p);
+        advance(p);
+        if (p->token.type == TOKEN_LPAREN) {
+            advance(p);
+            if (p->token.type != TOKEN_RPAREN) {
+                syntax_error(p);
+                return NULL;
+            }
+            advance(p);
+        }
+        return parse_function_body(p, name, start);
+    }
+
+    // then, fi and the like cannot start a command
+    if (at_list_end(p)) {
+        syntax_error(p);
+        return NULL;
+    }
+    return parse_simple(p);
+}
+
+static Pipeline* parse_pipeline(Parser* p) {
+    Pipeline* pipeline = arena_zalloc(p->arena, sizeof(Pipeline));
+    const char* start = p->token.start;
+
+    if (is_word(p, "!")) {
+        pipeline->negated = 1;
+        advance(p);
     }
-    free(temp_input);
 
-    // This is the single block of memory for all the argument strings.
-    char* data_block = strdup(input);
-    if (!data_block) {
-        perror("strdup");
-        exit(EXIT_FAILURE);
+    Command** tail = &pipeline->commands;
+    for (;;) {
+        Command* cmd = parse_command(p);
+        if (cmd == NULL) {
+            return NULL;
+        }
+        *tail = cmd;
+        tail = &cmd->next;
+        pipeline->command_count++;
+
+        if (p->token.type != TOKEN_PIPE) {
+            break;
+        }
+        advance(p);
+        skip_newlines(p);
+    }
+
+    pipeline->text = arena_strndup(p->arena, start, p->prev_end - start);
+    return pipeline;
+}
+
+static AndOrList* parse_and_or(Parser* p) {
+    AndOrList* list = arena_zalloc(p->arena, sizeof(AndOrList));
+    const char* start = p->token.start;
+
+    Pipeline** tail = &list->pipelines;
+    for (;;) {
+        Pipeline* pipeline = parse_pipeline(p);
+        if (pipeline == NULL) {
+            return NULL;
+        }
+        *tail = pipeline;
+        tail = &pipeline->next;
+
+        if (p->token.type == TOKEN_AND) {
+            pipeline->connector = CONNECT_AND;
+        } else if (p->token.type == TOKEN_OR) {
+            pipeline->connector = CONNECT_OR;
+        } else {
+            break;
+        }
+        advance(p);
+        skip_newlines(p);
     }
 
-    // This is the array of pointers that will point into the data_block.
-    char** args = malloc((arg_count + 1) * sizeof(char*));
-    if (!args) {
-        free(data_block);
-        perror("malloc");
-        exit(EXIT_FAILURE);
+    list->text = arena_strndup(p->arena, start, p->prev_end - start);
+    return list;
+}
+
+// Parses and-or lists until the input ends or a word such as `fi` ends the list.
+// The caller checks that what stopped the list belongs there.
+static CommandList* parse_list(Parser* p) {
+    CommandList* list = arena_zalloc(p->arena, sizeof(CommandList));
+    AndOrList** tail = &list->first;
+
+    for (;;) {
+        skip_newlines(p);
+        if (at_list_end(p)) {
+            break;
+        }
+
+        AndOrList* item = parse_and_or(p);
+        if (item == NULL) {
+            return NULL;
+        }
+        *tail = item;
+        tail = &item->next;
+
+        if (p->token.type == TOKEN_AMP) {
+            item->is_background = 1;
+            advance(p);
+        } else if (p->token.type == TOKEN_SEMI || p->token.type == TOKEN_NEWLINE) {
+            advance(p);
+        } else {
+            break;
+        }
     }
+    return list;
+}
 
-    // If there were no tokens, we still need a valid structure to free.
-    // The first pointer in args will point to the data block.
-    if (arg_count == 0) {
-        args[0] = NULL;
-        // To prevent a memory leak, we attach the data_block to the first pointer,
-        // even though it will be set to NULL for logic purposes. The shell.c free logic
-        // will now free the data_block via a temporary variable.
-        // Let's refactor shell.c to handle this more cleanly instead.
-        // For now, let's assume arg_count > 0 for non-empty lines.
+CommandList* parse_line(const char* line, Arena* arena, int* incomplete) {
+    Parser p = { .input = line, .pos = line, .prev_end = line, .incomplete = incomplete, .arena = arena };
+    if (incomplete != NULL) {
+        *incomplete = 0;
     }
+    lex(&p);
 
-    int i = 0;
-    token = strtok(data_block, " \t\n\r");
-    while (token != NULL) {
-        args[i++] = token;
-        token = strtok(NULL, " \t\n\r");
+    CommandList* list = parse_list(&p);
+    if (list != NULL && p.token.type != TOKEN_EOF) {
+        syntax_error(&p); // A stray fi, ), ;; or similar
+        return NULL;
     }
-    args[i] = NULL;
+    return list;
+}
 
-    return args;
+size_t unquote_word(const char* raw, char* out) {
+    char* o = out;
+    const char* s = raw;
+
+    while (*s != '\0') {
+        if (*s == '\\') {
+            if (s[1] == '\n') {
+                s += 2; // Line continuation
+            } else if (s[1] != '\0') {
+                *o++ = s[1];
+                s += 2;
+            } else {
+                *o++ = *s++;
+            }
+        } else if (*s == '\'') {
+            s++;
+            while (*s != '\0' && *s != '\'') {
+                *o++ = *s++;
+            }
+            if (*s == '\'') s++;
+        } else if (*s == '"') {
+            s++;
+            while (*s != '\0' && *s != '"') {
+                // Inside double quotes a backslash only escapes these
+                if (*s == '\\' && s[1] != '\0' && strchr("$`\"\\\n", s[1])) {
+                    if (s[1] != '\n') {
+                        *o++ = s[1];
+                    }
+                    s += 2;
+                } else {
+                    *o++ = *s++;
+                }
+            }
+            if (*s == '"') s++;
+        } else {
+            *o++ = *s++;
+        }
+    }
+    *o = '\0';
+    return o - out;
 }
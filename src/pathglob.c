@@ -0,0 +1,702 @@
+#define _GNU_SOURCE
+#include "pathglob.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "text.h"
+
+#define DENTS_BUFFER_SIZE (64 * 1024)
+#define CACHE_INITIAL_SLOTS 64
+#define RACY_WINDOW_NS 10000000L // A directory changed this close to being read is read again next time
+#define MAX_GLOB_THREADS 64
+
+// The record getdents64 returns
+typedef struct {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+} Dirent64;
+
+// The entries of one directory, read with getdents64
+typedef struct DirListing {
+    char* path;             // Cache key: "." or a prefix ending in '/'
+    char* names;            // Entry names, NUL-separated
+    size_t* offsets;        // Where each name starts in names
+    unsigned char* types;   // d_type of each entry
+    size_t count;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;  // The directory's mtime when it was read
+    int racy;               // Changed while being read; never reused
+    struct DirListing* retired_next;
+} DirListing;
+
+// Open-addressed hash table of listings, keyed by path
+static DirListing** cache_slots = NULL;
+static size_t cache_capacity = 0;
+static size_t cache_count = 0;
+// Replaced listings stay alive until the cache is cleared, as a walk may still use them
+static DirListing* retired = NULL;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int glob_threads = 0; // 0 until read from $GLOB_THREADS
+
+static void free_listing(DirListing* l) {
+    free(l->path);
+    free(l->names);
+    free(l->offsets);
+    free(l->types);
+    free(l);
+}
+
+// Returns the slot for path: the one holding it, or the empty one where it belongs
+static DirListing** cache_slot(const char* path) {
+    size_t i = hash_string(path) & (cache_capacity - 1);
+    while (cache_slots[i] != NULL && strcmp(cache_slots[i]->path, path) != 0) {
+        i = (i + 1) & (cache_capacity - 1);
+    }
+    return &cache_slots[i];
+}
+
+static void cache_grow() {
+    DirListing** old = cache_slots;
+    size_t old_capacity = cache_capacity;
+
+    cache_capacity = old_capacity ? old_capacity * 2 : CACHE_INITIAL_SLOTS;
+    cache_slots = calloc(cache_capacity, sizeof(DirListing*));
+    if (!cache_slots) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old[i] != NULL) {
+            *cache_slot(old[i]->path) = old[i];
+        }
+    }
+    free(old);
+}
+
+// Reads a directory with getdents64. st is the directory's stat, taken just before.
+static DirListing* read_listing(const char* path, const struct stat* st) {
+    struct timespec started;
+    clock_gettime(CLOCK_REALTIME, &started);
+
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+    DirListing* l = calloc(1, sizeof(DirListing));
+    char* buf = malloc(DENTS_BUFFER_SIZE);
+    if (!l || !buf) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t names_len = 0, names_cap = 0, entries_cap = 0;
+    long n;
+    while ((n = syscall(SYS_getdents64, fd, buf, DENTS_BUFFER_SIZE)) > 0) {
+        for (long pos = 0; pos < n;) {
+            Dirent64* d = (Dirent64*)(buf + pos);
+            pos += d->d_reclen;
+            if (strcmp(d->d_name, ".") == 0 || strcmp(d->d_name, "..") == 0) {
+                continue;
+            }
+
+            size_t len = strlen(d->d_name) + 1;
+            if (names_len + len > names_cap) {
+                names_cap = names_cap ? names_cap * 2 : 4096;
+                while (names_len + len > names_cap) names_cap *= 2;
+                l->names = realloc(l->names, names_cap);
+            }
+            if (l->count == entries_cap) {
+                entries_cap = entries_cap ? entries_cap * 2 : 64;
+                l->offsets = realloc(l->offsets, entries_cap * sizeof(size_t));
+                l->types = realloc(l->types, entries_cap);
+            }
+            if (!l->names || !l->offsets || !l->types) {
+                perror("realloc");
+                exit(EXIT_FAILURE);
+            }
+            memcpy(l->names + names_len, d->d_name, len);
+            l->offsets[l->count] = names_len;
+            l->types[l->count] = d->d_type;
+            l->count++;
+            names_len += len;
+        }
+    }
+    free(buf);
+    close(fd);
+
+    l->path = strdup(path);
+    l->dev = st->st_dev;
+    l->ino = st->st_ino;
+    l->mtime = st->st_mtim;
+    // mtime has coarse granularity: a change in the same tick would go unnoticed
+    long long age_ns = (started.tv_sec - st->st_mtim.tv_sec) * 1000000000LL + (started.tv_nsec - st->st_mtim.tv_nsec);
+    l->racy = age_ns < RACY_WINDOW_NS;
+    return l;
+}
+
+// Returns the listing of a directory, from the cache if it has not changed since
+static DirListing* get_listing(const char* path) {
+    struct stat st;
+    if (stat(path, &st) < 0 || !S_ISDIR(st.st_mode)) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&cache_lock);
+    if (cache_capacity > 0) {
+        DirListing* l = *cache_slot(path);
+        if (l != NULL && !l->racy && l->dev == st.st_dev && l->ino == st.st_ino &&
+            l->mtime.tv_sec == st.st_mtim.tv_sec && l->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+            pthread_mutex_unlock(&cache_lock);
+            return l;
+        }
+    }
+    pthread_mutex_unlock(&cache_lock);
+
+    DirListing* l = read_listing(path, &st);
+    if (l == NULL) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&cache_lock);
+    if ((cache_count + 1) * 2 > cache_capacity) {
+        cache_grow();
+    }
+    DirListing** slot = cache_slot(path);
+    if (*slot != NULL) {
+        (*slot)->retired_next = retired;
+        retired = *slot;
+    } else {
+        cache_count++;
+    }
+    *slot = l;
+    pthread_mutex_unlock(&cache_lock);
+    return l;
+}
+
+void path_glob_clear_cache() {
+    pthread_mutex_lock(&cache_lock);
+    for (size_t i = 0; i < cache_capacity; i++) {
+        if (cache_slots[i] != NULL) {
+            free_listing(cache_slots[i]);
+        }
+    }
+    free(cache_slots);
+    cache_slots = NULL;
+    cache_capacity = 0;
+    cache_count = 0;
+    while (retired != NULL) {
+        DirListing* next = retired->retired_next;
+        free_listing(retired);
+        retired = next;
+    }
+    pthread_mutex_unlock(&cache_lock);
+}
+
+int set_glob_threads(const char* value) {
+    char* end;
+    long n = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || n < 1 || n > MAX_GLOB_THREADS) {
+        return -1;
+    }
+    glob_threads = (int)n;
+    return 0;
+}
+
+int get_glob_threads() {
+    if (glob_threads == 0) {
+        const char* env = getenv("GLOB_THREADS");
+        if (env == NULL || set_glob_threads(env) < 0) {
+            glob_threads = 1;
+        }
+    }
+    return glob_threads;
+}
+
+// The ']' closing the bracket expression that starts at p, or NULL if there
+// is none, in which case the '[' is an ordinary character
+static const char* bracket_end(const char* p, const char* end) {
+    const char* q = p + 1;
+    if (q < end && (*q == '!' || *q == '^')) q++;
+    const char* first = q; // A ']' right after the '[' or '[!' is a member
+    while (q < end && (*q != ']' || q == first)) {
+        if (*q == '\\' && q + 1 < end) q++;
+        q++;
+    }
+    return q < end ? q : NULL;
+}
+
+// Whether [p, end) holds a metacharacter: *, ?, or a [ that a ] closes
+static int has_meta(const char* p, const char* end) {
+    for (; p < end; p++) {
+        if (*p == '\\' && p + 1 < end) {
+            p++;
+        } else if (*p == '*' || *p == '?' || (*p == '[' && bracket_end(p, end) != NULL)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int pattern_has_meta(const char* pattern) {
+    const char* start = pattern;
+    for (const char* s = pattern; ; s++) {
+        if (*s == '\\' && s[1] != '\0' && s[1] != '/') {
+            s++;
+        } else if (*s == '/' || *s == '\0') {
+            // A bracket expression never spans a '/'
+            if (has_meta(start, s)) {
+                return 1;
+            }
+            if (*s == '\0') {
+                return 0;
+            }
+            start = s + 1;
+        }
+    }
+}
+
+// Matches one character of a name against the pattern at p.
+// Returns how many pattern characters were used, or 0 if c does not match.
+static int match_char(const char* p, const char* end, char c) {
+    if (*p == '?') {
+        return 1;
+    }
+    if (*p == '\\' && p + 1 < end) {
+        return p[1] == c ? 2 : 0;
+    }
+    if (*p != '[') {
+        return *p == c ? 1 : 0;
+    }
+
+    // A bracket expression; without a closing ']' the '[' is literal
+    const char* close = bracket_end(p, end);
+    if (close == NULL) {
+        return c == '[' ? 1 : 0;
+    }
+    const char* q = p + 1;
+    int negate = *q == '!' || *q == '^';
+    if (negate) q++;
+    int matched = 0;
+    while (q < close) {
+        char lo = *q;
+        if (lo == '\\' && q + 1 < end) lo = *++q;
+        char hi = lo;
+        if (q + 2 < end && q[1] == '-' && q[2] != ']') {
+            q += 2;
+            hi = *q;
+            if (hi == '\\' && q + 1 < end) hi = *++q;
+        }
+        if ((unsigned char)c >= (unsigned char)lo && (unsigned char)c <= (unsigned char)hi) {
+            matched = 1;
+        }
+        q++;
+    }
+    return matched != negate ? (int)(close - p + 1) : 0;
+}
+
+// Matches a name against the pattern component [p, end)
+static int match_name(const char* p, const char* end, const char* name) {
+    const char* star_p = NULL; // Where to resume after the last '*'
+    const char* star_name = NULL;
+
+    while (*name != '\0') {
+        if (p < end && *p == '*') {
+            star_p = ++p;
+            star_name = name;
+            continue;
+        }
+        int used = p < end ? match_char(p, end, *name) : 0;
+        if (used > 0) {
+            p += used;
+            name++;
+        } else if (star_p != NULL) {
+            // Let the last '*' swallow one more character
+            p = star_p;
+            name = ++star_name;
+        } else {
+            return 0;
+        }
+    }
+    while (p < end && *p == '*') p++;
+    return p == end;
+}
+
+int pattern_match(const char* pattern, const char* string) {
+    return match_name(pattern, pattern + strlen(pattern), string);
+}
+
+// One '/'-separated part of a pattern
+typedef struct {
+    const char* start;
+    size_t len;
+    int has_meta;   // Contains an unescaped *, ? or [
+    int globstar;   // Is exactly **
+} Component;
+
+typedef struct {
+    Component* comps;
+    size_t count;
+    char* path;         // The path built so far
+    size_t path_cap;
+    int prefetched;     // The tree under the first ** has been read in parallel
+    PathList* out;
+} Walk;
+
+static void path_reserve(Walk* w, size_t len) {
+    if (len + 1 > w->path_cap) {
+        while (len + 1 > w->path_cap) w->path_cap *= 2;
+        w->path = realloc(w->path, w->path_cap);
+        if (!w->path) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+// Appends s at len; returns the new length
+static size_t path_append(Walk* w, size_t len, const char* s, size_t n) {
+    path_reserve(w, len + n);
+    memcpy(w->path + len, s, n);
+    w->path[len + n] = '\0';
+    return len + n;
+}
+
+static void add_match(PathList* out, const char* path) {
+    if (out->count == out->capacity) {
+        out->capacity = out->capacity ? out->capacity * 2 : 16;
+        out->paths = realloc(out->paths, out->capacity * sizeof(char*));
+        if (!out->paths) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    out->paths[out->count++] = strdup(path);
+}
+
+// Whether entry i is a directory. Symbolic links are followed unless no_follow is set.
+static int entry_is_dir(const DirListing* l, size_t i, const char* path, int no_follow) {
+    unsigned char type = l->types[i];
+    if (type == DT_DIR) {
+        return 1;
+    }
+    if (type == DT_UNKNOWN || (type == DT_LNK && !no_follow)) {
+        struct stat st;
+        int r = no_follow ? lstat(path, &st) : stat(path, &st);
+        return r == 0 && S_ISDIR(st.st_mode);
+    }
+    return 0;
+}
+
+// A directory waiting to be read by prefetch_tree()
+typedef struct {
+    char** stack;
+    size_t count;
+    size_t capacity;
+    int active; // Workers reading a directory, which may push more
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} TreeQueue;
+
+// The cache key of a subdirectory; parent is "." or ends in '/'
+static char* child_path(const char* parent, const char* name) {
+    char* path;
+    if (strcmp(parent, ".") == 0) {
+        if (asprintf(&path, "%s/", name) < 0) path = NULL;
+    } else {
+        if (asprintf(&path, "%s%s/", parent, name) < 0) path = NULL;
+    }
+    return path;
+}
+
+static void queue_push(TreeQueue* q, char* dir) {
+    if (q->count == q->capacity) {
+        q->capacity = q->capacity ? q->capacity * 2 : 64;
+        q->stack = realloc(q->stack, q->capacity * sizeof(char*));
+        if (!q->stack) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    q->stack[q->count++] = dir;
+}
+
+static void* prefetch_worker(void* arg) {
+    TreeQueue* q = arg;
+    pthread_mutex_lock(&q->lock);
+    for (;;) {
+        while (q->count == 0 && q->active > 0) {
+            pthread_cond_wait(&q->cond, &q->lock);
+        }
+        if (q->count == 0) {
+            break; // Nothing queued and nobody left to queue more
+        }
+        char* dir = q->stack[--q->count];
+        q->active++;
+        pthread_mutex_unlock(&q->lock);
+
+        // Read the directory into the cache and find its subdirectories
+        char** subdirs = NULL;
+        size_t subdir_count = 0;
+        DirListing* l = get_listing(dir);
+        if (l != NULL) {
+            subdirs = malloc(l->count * sizeof(char*));
+            for (size_t i = 0; subdirs && i < l->count; i++) {
+                const char* name = l->names + l->offsets[i];
+                if (name[0] == '.') continue;
+                char* sub = child_path(dir, name);
+                if (sub == NULL) continue;
+                // Checked without the trailing '/', which would follow a symbolic link
+                size_t sub_len = strlen(sub);
+                sub[sub_len - 1] = '\0';
+                int is_dir = entry_is_dir(l, i, sub, 1);
+                sub[sub_len - 1] = '/';
+                if (is_dir) {
+                    subdirs[subdir_count++] = sub;
+                } else {
+                    free(sub);
+                }
+            }
+        }
+        free(dir);
+
+        pthread_mutex_lock(&q->lock);
+        for (size_t i = 0; i < subdir_count; i++) {
+            queue_push(q, subdirs[i]);
+        }
+        free(subdirs);
+        q->active--;
+        pthread_cond_broadcast(&q->cond);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return NULL;
+}
+
+// Reads every directory under root into the cache with several threads, so
+// the walk that follows finds them all there
+static void prefetch_tree(const char* root, int threads) {
+    TreeQueue q = { 0 };
+    pthread_mutex_init(&q.lock, NULL);
+    pthread_cond_init(&q.cond, NULL);
+    queue_push(&q, strdup(root));
+
+    pthread_t workers[MAX_GLOB_THREADS];
+    int started = 0;
+    for (; started < threads; started++) {
+        if (pthread_create(&workers[started], NULL, prefetch_worker, &q) != 0) {
+            break;
+        }
+    }
+    if (started == 0) {
+        prefetch_worker(&q);
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    free(q.stack);
+    pthread_mutex_destroy(&q.lock);
+    pthread_cond_destroy(&q.cond);
+}
+
+static void walk(Walk* w, size_t len, size_t i);
+
+// Matches a ** component: the rest of the pattern at this level and under every subdirectory
+static void walk_globstar(Walk* w, size_t len, size_t i, int nested) {
+    int last = i + 1 == w->count;
+    // A trailing **/ lists directories, including links to them, as bash does
+    int dirs_only = i + 2 == w->count && w->comps[i + 1].len == 0;
+    if (!last) {
+        walk(w, len, i + 1); // ** may match no directories at all
+    } else if (len > 0 && !nested) {
+        add_match(w->out, w->path); // dir/** includes dir/ itself
+    }
+    w->path[len] = '\0'; // The walk above built on the same buffer
+    char* dir = strdup(len > 0 ? w->path : ".");
+
+    if (!w->prefetched) {
+        w->prefetched = 1;
+        int threads = get_glob_threads();
+        if (threads > 1) {
+            prefetch_tree(dir, threads);
+        }
+    }
+
+    DirListing* l = get_listing(dir);
+    free(dir);
+    if (l == NULL) {
+        return;
+    }
+    for (size_t e = 0; e < l->count; e++) {
+        const char* name = l->names + l->offsets[e];
+        if (name[0] == '.') {
+            continue;
+        }
+        size_t entry_len = path_append(w, len, name, strlen(name));
+        if (last) {
+            add_match(w->out, w->path);
+        }
+        // Symbolic links are not followed, so the walk cannot loop
+        if (entry_is_dir(l, e, w->path, 1)) {
+            walk_globstar(w, path_append(w, entry_len, "/", 1), i, 1);
+        } else if (dirs_only && entry_is_dir(l, e, w->path, 0)) {
+            path_append(w, entry_len, "/", 1);
+            add_match(w->out, w->path);
+        }
+    }
+}
+
+// Matches components i onwards below the directory in w->path[0, len)
+static void walk(Walk* w, size_t len, size_t i) {
+    w->path[len] = '\0';
+    if (i == w->count) {
+        if (len > 0) {
+            add_match(w->out, w->path);
+        }
+        return;
+    }
+
+    const Component* c = &w->comps[i];
+    int last = i + 1 == w->count;
+
+    if (c->len == 0) {
+        // From a doubled or trailing '/'
+        walk(w, len, i + 1);
+        return;
+    }
+
+    if (!c->has_meta) {
+        // A literal component needs no listing; remove its escapes and go on
+        size_t new_len = len;
+        path_reserve(w, len + c->len);
+        for (size_t k = 0; k < c->len; k++) {
+            if (c->start[k] == '\\' && k + 1 < c->len) k++;
+            w->path[new_len++] = c->start[k];
+        }
+        w->path[new_len] = '\0';
+        struct stat st;
+        if (last) {
+            if (lstat(w->path, &st) == 0) {
+                add_match(w->out, w->path);
+            }
+        } else {
+            walk(w, path_append(w, new_len, "/", 1), i + 1);
+        }
+        return;
+    }
+
+    if (c->globstar) {
+        walk_globstar(w, len, i, 0);
+        return;
+    }
+
+    DirListing* l = get_listing(len > 0 ? w->path : ".");
+    if (l == NULL) {
+        return;
+    }
+    int match_hidden = c->start[0] == '.';
+    for (size_t e = 0; e < l->count; e++) {
+        const char* name = l->names + l->offsets[e];
+        if ((name[0] == '.' && !match_hidden) || !match_name(c->start, c->start + c->len, name)) {
+            continue;
+        }
+        size_t entry_len = path_append(w, len, name, strlen(name));
+        if (last) {
+            add_match(w->out, w->path);
+        } else if (entry_is_dir(l, e, w->path, 0)) {
+            walk(w, path_append(w, entry_len, "/", 1), i + 1);
+        }
+    }
+}
+
+static int compare_paths(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+size_t path_glob(const char* pattern, PathList* out) {
+    out->paths = NULL;
+    out->count = 0;
+    out->capacity = 0;
+
+    // Split the pattern into components
+    size_t comp_cap = 1;
+    for (const char* s = pattern; *s; s++) {
+        if (*s == '/') comp_cap++;
+    }
+    Walk w = {
+        .comps = malloc(comp_cap * sizeof(Component)),
+        .path_cap = 256,
+        .path = malloc(256),
+        .out = out,
+    };
+    if (!w.comps || !w.path) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    const char* s = pattern;
+    size_t len = 0;
+    if (*s == '/') {
+        w.path[len++] = '/'; // Absolute pattern
+        while (*s == '/') s++;
+    }
+    for (;;) {
+        Component* c = &w.comps[w.count++];
+        c->start = s;
+        while (*s != '\0' && *s != '/') {
+            if (*s == '\\' && s[1] != '\0' && s[1] != '/') {
+                s++;
+            }
+            s++;
+        }
+        c->len = s - c->start;
+        // A '[' that nothing closes is literal, so `[` or `a[1` needs no listing
+        c->has_meta = has_meta(c->start, s);
+        c->globstar = c->len == 2 && c->start[0] == '*' && c->start[1] == '*';
+        if (*s == '\0') {
+            break;
+        }
+        s++;
+    }
+
+    walk(&w, len, 0);
+    free(w.comps);
+    free(w.path);
+
+    if (out->count > 1) {
+        qsort(out->paths, out->count, sizeof(char*), compare_paths);
+        // Overlapping ** components can find a path twice
+        size_t kept = 1;
+        for (size_t i = 1; i < out->count; i++) {
+            if (strcmp(out->paths[i], out->paths[kept - 1]) == 0) {
+                free(out->paths[i]);
+            } else {
+                out->paths[kept++] = out->paths[i];
+            }
+        }
+        out->count = kept;
+    }
+    return out->count;
+}
+
+void free_path_list(PathList* list) {
+    for (size_t i = 0; i < list->count; i++) {
+        free(list->paths[i]);
+    }
+    free(list->paths);
+    list->paths = NULL;
+    list->count = 0;
+    list->capacity = 0;
+}
@@ -1,97 +1,191 @@
+#define _GNU_SOURCE
 #include "pipe.h"
 #include "parser.h"
+#include "executor.h"
 #include "builtins.h"
 #include "redirect.h"
+#include "spawner.h"
+#include "jobs.h"
+#include "functions.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <sys/wait.h>
+#include <fcntl.h>
+#include <errno.h>
 
-#define MAX_COMMANDS 16 // Maximum number of piped commands
+#define STATUS_NOT_FOUND 127 // Exit status of a stage that could not be started
+#define MAX_PIPE_SIZE (1L << 30) // Largest pipebuf accepted
 
-void handle_pipe(char* input) {
-    char* commands[MAX_COMMANDS];
-    int num_commands = 0;
+static long pipe_buffer_size = -1; // -1 until $PIPE_BUFSIZE has been read
+static int pipe_size_warned = 0;   // F_SETPIPE_SZ failures are reported once per setting
 
-    // Split the input string into commands based on the pipe character
-    char* token = strtok(input, "|");
-    while (token != NULL && num_commands < MAX_COMMANDS) {
-        commands[num_commands++] = token;
-        token = strtok(NULL, "|");
+// Parses a size such as 65536, 256K or 1M
+static long parse_size(const char* value) {
+    if (strcmp(value, "default") == 0) {
+        return 0;
     }
-    
-    if (num_commands == 0) {
-        return;
+    char* end;
+    errno = 0;
+    long size = strtol(value, &end, 10);
+    if (errno != 0 || end == value || size < 0) {
+        return -1;
+    }
+    int shift = 0;
+    if (*end == 'K' || *end == 'k') {
+        shift = 10;
+        end++;
+    } else if (*end == 'M' || *end == 'm') {
+        shift = 20;
+        end++;
+    }
+    // Checked before shifting, which could overflow
+    if (*end != '\0' || size > (MAX_PIPE_SIZE >> shift)) {
+        return -1;
+    }
+    return size << shift;
+}
+
+int set_pipe_buffer_size(const char* value) {
+    long size = parse_size(value);
+    if (size < 0) {
+        return -1;
+    }
+    pipe_buffer_size = size;
+    pipe_size_warned = 0;
+    return 0;
+}
+
+long get_pipe_buffer_size() {
+    if (pipe_buffer_size < 0) {
+        const char* env = getenv("PIPE_BUFSIZE");
+        if (env == NULL || set_pipe_buffer_size(env) < 0) {
+            pipe_buffer_size = 0;
+        }
+    }
+    return pipe_buffer_size;
+}
+
+// Creates a pipe between two stages. Both ends are close-on-exec, so no
+// stage inherits the ends meant for the others; the spawner dup2s the ones it needs.
+static int create_stage_pipe(int pipefd[2]) {
+    if (pipe2(pipefd, O_CLOEXEC) < 0) {
+        perror("pipe");
+        return -1;
     }
 
+    long size = get_pipe_buffer_size();
+    if (size > 0 && fcntl(pipefd[1], F_SETPIPE_SZ, (int)size) < 0 && !pipe_size_warned) {
+        // Unprivileged users are capped by /proc/sys/fs/pipe-max-size
+        perror("pipebuf");
+        pipe_size_warned = 1;
+    }
+    return 0;
+}
+
+int handle_pipe(const Pipeline* pipeline, int is_background) {
     int prev_pipe_read_end = -1;
-    pid_t pids[MAX_COMMANDS];
+    pid_t pgid = inherited_pgid; // Every stage joins the process group of the first one
+    pid_t last_pid = -1;
+    Job* job = NULL;
+    int status = 0;        // Exit status of the last stage, unless it runs as part of the job
+    int last_in_job = 0;
 
-    for (int i = 0; i < num_commands; i++) {
-        int pipefd[2];
+    // Each process must be in the job table before reap_children() can see it exit
+    for (const Command* cmd = pipeline->commands; cmd != NULL; cmd = cmd->next) {
+        int is_last = cmd->next == NULL;
+        int pipefd[2] = { -1, -1 };
 
         // Create a pipe for all but the last command
-        if (i < num_commands - 1) {
-            if (pipe(pipefd) < 0) {
-                perror("pipe");
-                return;
+        if (!is_last) {
+            if (create_stage_pipe(pipefd) < 0) {
+                break;
             }
         }
 
-        pids[i] = fork();
-        if (pids[i] < 0) {
-            perror("fork");
-            return;
-        }
-
-        if (pids[i] == 0) {
-            // --- Child Process ---
-
-            // If not the first command, redirect stdin from the previous pipe
-            if (prev_pipe_read_end != -1) {
-                dup2(prev_pipe_read_end, STDIN_FILENO);
-                close(prev_pipe_read_end);
+        // Built-ins run without exec: the last stage of a foreground pipeline runs
+        // in the shell itself, any other stage in a forked copy of the shell.
+        // Compound commands and functions always get a copy of the shell.
+        pid_t pid = -1;
+        ExpandedCommand ec;
+        if (expand_command(cmd, &ec) == 0) {
+            if (cmd->type != COMMAND_SIMPLE || ec.argv[0] != NULL) {
+                SpawnRequest req = {
+                    .argv = ec.argv,
+                    .pgid = pgid,
+                    .stdin_fd = prev_pipe_read_end,
+                    .stdout_fd = pipefd[1],
+                    .close_fds = &pipefd[0], // The read end is for the next command
+                    .close_count = pipefd[0] >= 0 ? 1 : 0,
+                    .redirs = ec.redirs,
+                    .redir_count = ec.redir_count,
+                    .tty_fd = (job == NULL && !is_background && shell_is_interactive) ? shell_terminal : -1,
+                };
+                int stdin_is_tty = prev_pipe_read_end < 0 && !redirects_fd(ec.redirs, ec.redir_count, STDIN_FILENO)
+                                   && isatty(STDIN_FILENO);
+                char** saved_env = push_assignments(&ec);
+                int in_shell_copy = cmd->type != COMMAND_SIMPLE || find_function(ec.argv[0]) != NULL;
+                BuiltinFunc builtin = in_shell_copy ? NULL : find_builtin(ec.argv, stdin_is_tty);
+                if (in_shell_copy) {
+                    pid = spawn_shell_command(&req, cmd, ec.argv);
+                    status = 1;
+                } else if (builtin == NULL) {
+                    pid = spawn_command(&req);
+                    status = STATUS_NOT_FOUND;
+                } else if (is_last && !is_background && builtin_runs_in_shell(builtin)) {
+                    status = run_builtin_in_shell(builtin, ec.argv, prev_pipe_read_end, ec.redirs, ec.redir_count);
+                } else {
+                    pid = spawn_builtin(&req, builtin);
+                    status = 1;
+                }
+                pop_assignments(&ec, saved_env);
             }
+            free_expanded_command(&ec);
+        } else {
+            status = 1;
+        }
 
-            // If not the last command, redirect stdout to the new pipe
-            if (i < num_commands - 1) {
-                dup2(pipefd[1], STDOUT_FILENO);
-                close(pipefd[1]); // Close the write end in the child
-                close(pipefd[0]); // Close the read end in the child (it's for the next command)
-            }
-            
-            char** args = parse_input(commands[i]);
-            
-            handle_redirection(args); // Handle redirection for this part of the pipe
-
-            // Note: Built-ins in a pipe won't work with this structure
-            // because they don't use execvp. This is an advanced feature.
-            if (args[0] != NULL) {
-                 if (execvp(args[0], args) == -1) {
-                    perror(args[0]);
-                    exit(EXIT_FAILURE);
+        if (pid > 0) {
+            if (job == NULL) {
+                if (pgid == 0) {
+                    pgid = pid;
                 }
+                job = add_job(pgid, pipeline->text, is_background ? BACKGROUND : FOREGROUND, is_background);
+            }
+            if (job) {
+                add_job_process(job, pid);
             }
-            exit(EXIT_SUCCESS); // Exit if command was empty
+            last_pid = pid;
         }
+        last_in_job = pid > 0;
 
         // --- Parent Process ---
 
         // Close the previous pipe's read end, it's been passed on
         if (prev_pipe_read_end != -1) {
             close(prev_pipe_read_end);
+            prev_pipe_read_end = -1;
         }
 
         // If not the last command, save the read end for the next child
-        if (i < num_commands - 1) {
+        if (!is_last) {
             close(pipefd[1]); // Close the write end in the parent
             prev_pipe_read_end = pipefd[0];
         }
     }
+    if (prev_pipe_read_end != -1) {
+        close(prev_pipe_read_end);
+    }
 
-    // Wait for all child processes to complete
-    for (int i = 0; i < num_commands; i++) {
-        waitpid(pids[i], NULL, 0);
+    if (job == NULL) {
+        return status;
+    }
+    if (is_background) {
+        announce_background_job(job, last_pid);
+        return 0;
     }
-}
\ No newline at end of file
+
+    // Wait for all child processes to complete
+    int job_status = put_job_in_foreground(job, 0);
+    return last_in_job ? job_status : status;
+}
@@ -4,63 +4,104 @@
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
 
-void handle_redirection(char** args) {
-    // --- Pass 1: Apply all redirections ---
-    for (int i = 0; args[i] != NULL; i++) {
-        // Handle output redirection (truncate)
-        if (strcmp(args[i], ">") == 0) {
-            if (args[i+1] == NULL) {
-                fprintf(stderr, "syntax error near unexpected token `newline'\n");
-                exit(EXIT_FAILURE);
-            }
-            int fd_out = open(args[i+1], O_WRONLY | O_CREAT | O_TRUNC, 0644);
-            if (fd_out < 0) {
-                perror("open");
-                exit(EXIT_FAILURE);
-            }
-            dup2(fd_out, STDOUT_FILENO);
-            close(fd_out);
+int apply_redirections(const Redirection* redirs, int count) {
+    for (int i = 0; i < count; i++) {
+        int fd = open(redirs[i].path, redirs[i].flags, 0644);
+        if (fd < 0) {
+            perror("open");
+            return -1;
         }
-        // Handle output redirection (append)
-        else if (strcmp(args[i], ">>") == 0) {
-            if (args[i+1] == NULL) {
-                fprintf(stderr, "syntax error near unexpected token `newline'\n");
-                exit(EXIT_FAILURE);
-            }
-            int fd_out = open(args[i+1], O_WRONLY | O_CREAT | O_APPEND, 0644);
-            if (fd_out < 0) {
-                perror("open");
-                exit(EXIT_FAILURE);
-            }
-            dup2(fd_out, STDOUT_FILENO);
-            close(fd_out);
+        if (fd != redirs[i].fd) {
+            dup2(fd, redirs[i].fd);
+            close(fd);
         }
-        // Handle input redirection
-        else if (strcmp(args[i], "<") == 0) {
-             if (args[i+1] == NULL) {
-                fprintf(stderr, "syntax error near unexpected token `newline'\n");
-                exit(EXIT_FAILURE);
-            }
-            int fd_in = open(args[i+1], O_RDONLY);
-            if (fd_in < 0) {
-                perror("open");
-                exit(EXIT_FAILURE);
-            }
-            dup2(fd_in, STDIN_FILENO);
-            close(fd_in);
+    }
+    return 0;
+}
+
+int redirects_fd(const Redirection* redirs, int count, int fd) {
+    for (int i = 0; i < count; i++) {
+        if (redirs[i].fd == fd) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Moves a descriptor out of the way, unless that was already done
+static int save_shell_fd(int fd, SavedFds* saved) {
+    for (int i = 0; i < saved->count; i++) {
+        if (saved->fds[i] == fd) {
+            return 0;
+        }
+    }
+    if (saved->count == MAX_SAVED_FDS) {
+        fprintf(stderr, "myshell: too many redirections\n");
+        return -1;
+    }
+    int copy = fcntl(fd, F_DUPFD_CLOEXEC, SHELL_FD_BASE);
+    if (copy < 0 && errno != EBADF) {
+        perror("fcntl");
+        return -1;
+    }
+    saved->fds[saved->count] = fd;
+    saved->copies[saved->count] = copy;
+    saved->count++;
+    return 0;
+}
+
+int redirect_shell_fds(int stdin_fd, const Redirection* redirs, int count, SavedFds* saved) {
+    saved->count = 0;
+
+    // Output already buffered belongs to the old stdout
+    fflush(stdout);
+
+    if (stdin_fd >= 0) {
+        if (save_shell_fd(STDIN_FILENO, saved) < 0) {
+            return -1;
+        }
+        dup2(stdin_fd, STDIN_FILENO);
+    }
+    for (int i = 0; i < count; i++) {
+        if (save_shell_fd(redirs[i].fd, saved) < 0) {
+            restore_shell_fds(saved);
+            return -1;
         }
     }
+    if (apply_redirections(redirs, count) < 0) {
+        restore_shell_fds(saved);
+        return -1;
+    }
+    return 0;
+}
 
-    // --- Pass 2: Clean up args for execvp ---
-    int j = 0; // write index
-    for (int i = 0; args[i] != NULL; i++) {
-        if (strcmp(args[i], "<") == 0 || strcmp(args[i], ">") == 0 || strcmp(args[i], ">>") == 0) {
-            i++; // Skip the operator and the filename that follows
+void restore_shell_fds(SavedFds* saved) {
+    fflush(stdout);
+    // Backwards: a copy made early may sit on a descriptor that was redirected, and saved, later
+    while (saved->count > 0) {
+        saved->count--;
+        int fd = saved->fds[saved->count];
+        int copy = saved->copies[saved->count];
+        if (copy >= 0) {
+            dup2(copy, fd);
+            close(copy);
         } else {
-            args[j] = args[i];
-            j++;
+            close(fd);
         }
     }
-    args[j] = NULL; // Null-terminate the new, cleaned-up argument list
-}
\ No newline at end of file
+}
+
+int move_shell_fd(int fd) {
+    if (fd < 0 || fd >= SHELL_FD_BASE) {
+        return fd;
+    }
+    int moved = fcntl(fd, F_DUPFD_CLOEXEC, SHELL_FD_BASE);
+    if (moved < 0) {
+        perror("fcntl");
+        return fd;
+    }
+    close(fd);
+    return moved;
+}
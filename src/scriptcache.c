@@ -0,0 +1,259 @@
+#include "scriptcache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "astimage.h"
+#include "arena.h"
+#include "jobs.h" // For now_ms
+
+#define CACHE_MAGIC "MSHTREE"   // 8 bytes with the NUL
+#define CACHE_VERSION 1         // Bump whenever the tree's structs change
+#define RACY_SECONDS 2          // Scripts modified this recently are not stored
+
+/*
+ * A cache entry: this header, the flattened tree at image_offset(), then the
+ * offsets of its pointers, as size_t, at reloc_offset().
+ */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t layout;        // Struct sizes of the build that wrote it
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t image_size;
+    uint64_t reloc_count;
+} CacheHeader;
+
+static Arena script_arena; // Trees parsed from source; never reset
+
+// An entry written by a build with a different tree layout must not be used
+static uint32_t tree_layout() {
+    return (uint32_t)(sizeof(void*) | sizeof(Command) << 4 | sizeof(Pipeline) << 12 |
+                      sizeof(AndOrList) << 18 | sizeof(CaseItem) << 24 | sizeof(Redirection) << 28);
+}
+
+static size_t image_offset() {
+    return (sizeof(CacheHeader) + 15) & ~(size_t)15;
+}
+
+static size_t reloc_offset(size_t image_size) {
+    return (image_offset() + image_size + sizeof(size_t) - 1) & ~(sizeof(size_t) - 1);
+}
+
+// Builds the directory and file name of the entry for a script
+static int cache_path(const struct stat* st, char* dir, char* path) {
+    const char* base = getenv("XDG_CACHE_HOME");
+    int len;
+    if (base != NULL && base[0] == '/') {
+        len = snprintf(dir, PATH_MAX, "%s/myshell", base);
+    } else if ((base = getenv("HOME")) != NULL) {
+        len = snprintf(dir, PATH_MAX, "%s/.cache/myshell", base);
+    } else {
+        return -1;
+    }
+    if (len >= PATH_MAX) {
+        return -1;
+    }
+    len = snprintf(path, PATH_MAX, "%s/%llx-%llx.tree", dir,
+                   (unsigned long long)st->st_dev, (unsigned long long)st->st_ino);
+    return len < PATH_MAX ? 0 : -1;
+}
+
+static int header_matches(const CacheHeader* h, const struct stat* st) {
+    return memcmp(h->magic, CACHE_MAGIC, sizeof(h->magic)) == 0 && h->version == CACHE_VERSION &&
+           h->layout == tree_layout() && h->dev == (uint64_t)st->st_dev && h->ino == (uint64_t)st->st_ino &&
+           h->size == (uint64_t)st->st_size && h->mtime_sec == st->st_mtim.tv_sec &&
+           h->mtime_nsec == st->st_mtim.tv_nsec;
+}
+
+// Maps the entry for the script described by st and relocates it. Returns NULL on a miss.
+static CommandList* map_entry(const char* path, const struct stat* st, ScriptCacheStats* stats) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat entry_st;
+    if (fstat(fd, &entry_st) < 0 || (size_t)entry_st.st_size < image_offset()) {
+        close(fd);
+        return NULL;
+    }
+    size_t size = entry_st.st_size;
+
+    // Private and writable: relocation only copies the pages it touches
+    char* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+
+    const CacheHeader* h = (const CacheHeader*)map;
+    if (!header_matches(h, st) || h->image_size == 0 || h->image_size > size - image_offset() ||
+        reloc_offset(h->image_size) > size ||
+        h->reloc_count > (size - reloc_offset(h->image_size)) / sizeof(size_t)) {
+        munmap(map, size);
+        return NULL;
+    }
+    char* image = map + image_offset();
+    const size_t* relocs = (const size_t*)(map + reloc_offset(h->image_size));
+    if (relocate_ast_image(image, h->image_size, relocs, h->reloc_count) < 0) {
+        munmap(map, size);
+        unlink(path); // Damaged; the next run writes a fresh one
+        return NULL;
+    }
+
+    stats->image_size = h->image_size;
+    stats->pointer_count = h->reloc_count;
+    return (CommandList*)image;
+}
+
+static int write_all(int fd, const void* data, size_t len) {
+    const char* p = data;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Writes the entry for a script next to its final name, then renames it into place,
+// so a concurrent run sees either the old entry or the complete new one
+static int store_entry(const char* dir, const char* path, const struct stat* st, const CommandList* list,
+                       ScriptCacheStats* stats) {
+    char parent[PATH_MAX];
+    snprintf(parent, sizeof(parent), "%s", dir);
+    char* slash = strrchr(parent, '/');
+    if (slash != NULL && slash != parent) {
+        *slash = '\0';
+        mkdir(parent, 0700); // ~/.cache, if it is missing
+    }
+    mkdir(dir, 0700);
+
+    AstImage image;
+    flatten_list(list, &image);
+
+    CacheHeader h = { .version = CACHE_VERSION, .layout = tree_layout() };
+    memcpy(h.magic, CACHE_MAGIC, sizeof(h.magic));
+    h.dev = st->st_dev;
+    h.ino = st->st_ino;
+    h.size = st->st_size;
+    h.mtime_sec = st->st_mtim.tv_sec;
+    h.mtime_nsec = st->st_mtim.tv_nsec;
+    h.image_size = image.size;
+    h.reloc_count = image.reloc_count;
+
+    char tmp[PATH_MAX + 32];
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        free_ast_image(&image);
+        return -1;
+    }
+
+    static const char padding[16];
+    size_t image_pad = image_offset() - sizeof(h);
+    size_t reloc_pad = reloc_offset(image.size) - image_offset() - image.size;
+    int failed = write_all(fd, &h, sizeof(h)) < 0 || write_all(fd, padding, image_pad) < 0 ||
+                 write_all(fd, image.data, image.size) < 0 || write_all(fd, padding, reloc_pad) < 0 ||
+                 write_all(fd, image.relocs, image.reloc_count * sizeof(size_t)) < 0;
+    failed |= close(fd) < 0;
+    if (failed || rename(tmp, path) < 0) {
+        unlink(tmp);
+        free_ast_image(&image);
+        return -1;
+    }
+
+    stats->image_size = image.size;
+    stats->pointer_count = image.reloc_count;
+    free_ast_image(&image);
+    return 0;
+}
+
+// Reads the rest of fd into a null-terminated buffer, or returns NULL (already reported)
+static char* read_script(int fd, const char* path, size_t size_hint) {
+    size_t cap = size_hint + 1, len = 0;
+    char* text = malloc(cap);
+    if (!text) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    ssize_t n;
+    // The size is only a hint: the file may be a pipe, or still growing
+    while ((n = read(fd, text + len, cap - len - 1)) > 0) {
+        len += n;
+        if (len == cap - 1) {
+            cap *= 2;
+            text = realloc(text, cap);
+            if (!text) {
+                perror("realloc");
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+    if (n < 0) {
+        perror(path);
+        free(text);
+        return NULL;
+    }
+    text[len] = '\0';
+    return text;
+}
+
+int load_script(const char* path, int use_cache, CommandList** list, ScriptCacheStats* stats) {
+    ScriptCacheStats unused;
+    if (stats == NULL) {
+        stats = &unused;
+    }
+    memset(stats, 0, sizeof(ScriptCacheStats));
+    *list = NULL;
+    double start = now_ms();
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror(path);
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+
+    char dir[PATH_MAX], entry[PATH_MAX];
+    use_cache = use_cache && S_ISREG(st.st_mode) && cache_path(&st, dir, entry) == 0;
+    stats->result = use_cache ? SCRIPT_CACHE_MISS : SCRIPT_CACHE_OFF;
+    if (use_cache && (*list = map_entry(entry, &st, stats)) != NULL) {
+        close(fd);
+        stats->result = SCRIPT_CACHE_HIT;
+        stats->elapsed_ms = now_ms() - start;
+        return 0;
+    }
+
+    char* text = read_script(fd, path, S_ISREG(st.st_mode) ? st.st_size : 0);
+    struct stat after;
+    int changed = fstat(fd, &after) < 0 || after.st_size != st.st_size ||
+                  after.st_mtim.tv_sec != st.st_mtim.tv_sec || after.st_mtim.tv_nsec != st.st_mtim.tv_nsec;
+    close(fd);
+    if (text == NULL) {
+        return -1;
+    }
+    *list = parse_line(text, &script_arena, NULL);
+    free(text);
+
+    // Only a file that has settled is stored: its key must describe what was parsed
+    if (*list != NULL && use_cache && !changed && time(NULL) - st.st_mtim.tv_sec >= RACY_SECONDS) {
+        stats->stored = store_entry(dir, entry, &st, *list, stats) == 0;
+    }
+    stats->elapsed_ms = now_ms() - start;
+    return 0;
+}
@@ -6,16 +6,134 @@
 #include <readline/history.h>
 #include "parser.h"
 #include "executor.h"
-#include "builtins.h"
-#include "pipe.h"
 #include "jobs.h"
 #include "signals.h"
 #include "history.h"
-#include "expansion.h"
 #include "completion.h"
+#include "histsearch.h"
 #include "alias.h"    // New include
+#include "eventloop.h"
+#include "arena.h"
+#include "pathglob.h"
+#include "scriptcache.h"
+#include "linereader.h"
+#include "jobqueue.h"
 
-#define MAX_INPUT 1024
+#define STATUS_SYNTAX_ERROR 2
+
+// Holds the syntax tree of the line being run; emptied after every line
+static Arena line_arena;
+
+// Parses and runs one command line, then frees its syntax tree in one go
+static void run_line(const char* line) {
+    CommandList* list = parse_line(line, &line_arena, NULL);
+    if (list != NULL) {
+        execute_list(list);
+    } else {
+        last_exit_status = STATUS_SYNTAX_ERROR;
+    }
+    pending_flow = FLOW_NORMAL; // A Ctrl+C only stops the line it interrupted
+    arena_reset(&line_arena);
+    path_glob_clear_cache();
+}
+
+static int use_script_cache = 1;   // --no-script-cache clears it
+static int show_cache_stats = 0;   // --script-cache-stats
+
+static void print_cache_stats(const ScriptCacheStats* stats) {
+    switch (stats->result) {
+        case SCRIPT_CACHE_HIT:
+            fprintf(stderr, "script cache: hit, %zu bytes mapped, %zu pointers relocated in %.3f ms\n",
+                    stats->image_size, stats->pointer_count, stats->elapsed_ms);
+            break;
+        case SCRIPT_CACHE_MISS:
+            if (stats->stored) {
+                fprintf(stderr, "script cache: miss, parsed and stored %zu bytes in %.3f ms\n",
+                        stats->image_size, stats->elapsed_ms);
+            } else {
+                fprintf(stderr, "script cache: miss, parsed in %.3f ms, not stored\n", stats->elapsed_ms);
+            }
+            break;
+        case SCRIPT_CACHE_OFF:
+            fprintf(stderr, "script cache: off, parsed in %.3f ms\n", stats->elapsed_ms);
+            break;
+    }
+}
+
+// Runs a whole script, parsed once or mapped from the cache, with args as its positional parameters
+static int run_script(const char* path, char** args, int arg_count) {
+    CommandList* list;
+    ScriptCacheStats stats;
+    if (load_script(path, use_script_cache, &list, &stats) < 0) {
+        return EXIT_FAILURE;
+    }
+    if (show_cache_stats) {
+        print_cache_stats(&stats);
+    }
+    if (list == NULL) {
+        return STATUS_SYNTAX_ERROR;
+    }
+    shell_name = path;
+    positional_params = args;
+    positional_count = arg_count;
+    // The tree stays until exit: functions copy their bodies, but nothing else does
+    return execute_list(list);
+}
+
+// Runs `myshell -c text [name [args...]]`, whose last command may replace the shell
+static int run_command_string(const char* text, char** args, int arg_count) {
+    if (arg_count > 0) {
+        shell_name = args[0];
+        positional_params = args + 1;
+        positional_count = arg_count - 1;
+    }
+    CommandList* list = parse_line(text, &line_arena, NULL);
+    if (list == NULL) {
+        return STATUS_SYNTAX_ERROR;
+    }
+    exec_last_command = 1;
+    return execute_list(list);
+}
+
+// Commands piped or redirected into the shell, read without readline
+static LineReader stdin_reader;
+
+// Reads a line at the prompt, through the event loop when the shell owns a terminal.
+// Input that is not a terminal gets no prompt.
+static char* read_input(const char* prompt) {
+    return shell_is_interactive ? event_loop_readline(prompt) : line_reader_next(&stdin_reader);
+}
+
+// Reads more lines while line ends in the middle of a command, such as after
+// `for i in 1 2; do`, and returns the whole text. *failed is set if it has a
+// syntax error, already reported.
+static char* read_continuation(char* line, int* failed) {
+    for (;;) {
+        int incomplete = 0;
+        *failed = parse_line(line, &line_arena, &incomplete) == NULL && !incomplete;
+        arena_reset(&line_arena);
+        if (!incomplete) {
+            return line;
+        }
+
+        char* more = read_input("> ");
+        if (more == NULL) {
+            // Ctrl+D in the middle of a command
+            *failed = parse_line(line, &line_arena, NULL) == NULL;
+            arena_reset(&line_arena);
+            return line;
+        }
+        char* joined = malloc(strlen(line) + strlen(more) + 2);
+        if (!joined) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        sprintf(joined, "%s\n%s", line, more);
+        free(line);
+        free(more);
+        line = joined;
+    }
+}
 
 char* current_prompt_str() {
     static char prompt[1024];
@@ -30,55 +148,77 @@ char* current_prompt_str() {
 }
 
 int main(int argc, char** argv) {
-    // --- Script Execution Mode ---
-    if (argc > 1) {
-        FILE* script_file = fopen(argv[1], "r");
-        if (!script_file) {
-            perror(argv[1]);
-            exit(EXIT_FAILURE);
+    int command_mode = 0; // -c
+    int stdin_mode = 0;   // -s
+    int first = 1;
+    for (; first < argc && argv[first][0] == '-' && argv[first][1] != '\0'; first++) {
+        if (strcmp(argv[first], "-c") == 0) {
+            command_mode = 1;
+        } else if (strcmp(argv[first], "-s") == 0) {
+            stdin_mode = 1;
+        } else if (strcmp(argv[first], "--no-script-cache") == 0) {
+            use_script_cache = 0;
+        } else if (strcmp(argv[first], "--script-cache-stats") == 0) {
+            show_cache_stats = 1;
+        } else if (strcmp(argv[first], "--") == 0) {
+            first++;
+            break;
+        } else {
+            fprintf(stderr, "myshell: %s: invalid option\n", argv[first]);
+            exit(STATUS_SYNTAX_ERROR);
         }
+    }
 
-        char line[MAX_INPUT];
-        while (fgets(line, sizeof(line), script_file)) {
-            // Basic execution, doesn't handle complex multi-line scripts,
-            // backgrounding, or job control in a meaningful way.
-            line[strcspn(line, "\n")] = 0; // Remove newline
-
-            char** args = parse_input(line);
-            if (args != NULL && args[0] != NULL) {
-                args = expand_variables(args);
-                if (!handle_builtin_command(args)) {
-                    execute_command(args, 0); // Always foreground in scripts
-                }
-                free(args[0]);
-                free(args);
-            } else if (args != NULL) {
-                free(args);
-            }
+    // --- Command Mode: no job control, readline, history or completion ---
+    if (command_mode) {
+        if (first >= argc) {
+            fprintf(stderr, "myshell: -c: option requires an argument\n");
+            exit(STATUS_SYNTAX_ERROR);
         }
-        fclose(script_file);
-        exit(EXIT_SUCCESS);
+        exit(run_command_string(argv[first], argv + first + 1, argc - first - 1));
     }
 
-    // --- Interactive Mode ---
-    char* input_line;
-    char** args;
-    // ... (rest of the interactive main function)
+    // --- Script Execution Mode ---
+    if (first < argc && !stdin_mode) {
+        exit(run_script(argv[first], argv + first + 1, argc - first - 1));
+    }
 
-    int is_background = 0;
+    // --- Interactive Mode, or commands from stdin ---
+    char* input_line;
 
-    init_job_control();
-    setup_signal_handlers();
-    load_history(); // Load history at startup
-    initialize_completion(); // Initialize tab completion
+    if (stdin_mode) {
+        // -s: the arguments are the positional parameters, and stdin is read like a pipe even from a terminal
+        positional_params = argv + first;
+        positional_count = argc - first;
+    } else {
+        init_job_control();
+    }
+    if (shell_is_interactive) {
+        // Children are reaped from the event loop, never from a signal handler
+        setup_signal_handlers();
+        init_event_loop();
+        load_history(); // Load history at startup
+        load_aliases();
+        initialize_completion(); // Initialize tab completion
+        init_history_search(); // Ctrl-R searches the whole history file
+    } else {
+        line_reader_init(&stdin_reader, STDIN_FILENO);
+    }
 
     while (1) {
+        reap_children();
+        dispatch_queued_jobs();
         cleanup_jobs();
 
-        input_line = readline(current_prompt_str());
+        if (shell_is_interactive) {
+            sync_history(); // Up-arrow sees what other sessions entered meanwhile
+        }
+        input_line = read_input(shell_is_interactive ? current_prompt_str() : NULL);
 
-        if (input_line == NULL) { // Ctrl+D
-            printf("\n");
+        if (input_line == NULL) { // Ctrl+D, or the end of piped input
+            if (shell_is_interactive) {
+                printf("\n");
+            }
             break;
         }
 
@@ -87,10 +227,25 @@ int main(int argc, char** argv) {
             continue;
         }
 
+        int failed;
+        input_line = read_continuation(input_line, &failed);
+        if (failed) {
+            if (shell_is_interactive) {
+                record_history(input_line);
+            }
+            free(input_line);
+            last_exit_status = STATUS_SYNTAX_ERROR;
+            continue;
+        }
+
         char* line_to_process = input_line; // Start with the original line
 
         // --- History Expansion ---
-        if (line_to_process[0] == '!') {
+        // As in bash, a `!` before a blank, `=` or `(`, or alone, is not an event: `! false && echo x` negates
+        char designator = line_to_process[1];
+        if (line_to_process[0] == '!' && designator != '\0' && designator != ' ' && designator != '\t' &&
+                designator != '=' && designator != '(') {
+            sync_history();
             char* expanded_line = NULL;
             HIST_ENTRY* entry = NULL;
 
@@ -113,7 +268,7 @@ int main(int argc, char** argv) {
                 printf("%s\n", expanded_line);
                 free(line_to_process);
                 line_to_process = expanded_line;
-            } else if (line_to_process[1] != '\0') {
+            } else {
                 fprintf(stderr, "%s: event not found\n", line_to_process);
                 free(line_to_process);
                 continue;
@@ -121,65 +276,28 @@ int main(int argc, char** argv) {
         }
 
         // --- Alias Expansion ---
-        char* first_word = strndup(line_to_process, strcspn(line_to_process, " \t\n\r"));
-        char* expanded_alias = expand_alias(first_word);
-        free(first_word);
-
-        if (expanded_alias) {
-            char* rest_of_line = strchr(line_to_process, ' ');
-            if (rest_of_line == NULL) rest_of_line = "";
-            
-            char* new_line = malloc(strlen(expanded_alias) + strlen(rest_of_line) + 2);
-            sprintf(new_line, "%s %s", expanded_alias, rest_of_line);
-            
-            free(expanded_alias);
+        char* expanded_line = expand_aliases(line_to_process);
+        if (expanded_line) {
             free(line_to_process);
-            line_to_process = new_line;
+            line_to_process = expanded_line;
         }
 
-        // Add the final, expanded command to history
-        if (line_to_process && line_to_process[0] != '\0') {
-            add_history(line_to_process);
+        // Add the final, expanded command to history; piped commands are not recorded
+        if (shell_is_interactive && line_to_process && line_to_process[0] != '\0') {
+            record_history(line_to_process);
         }
 
 
-        char temp_input[MAX_INPUT];
-        strncpy(temp_input, line_to_process, sizeof(temp_input) - 1);
-        temp_input[sizeof(temp_input) - 1] = '\0';
-
-        if (strlen(temp_input) > 0 && temp_input[strlen(temp_input) - 1] == '&') {
-            is_background = 1;
-            temp_input[strlen(temp_input) - 1] = '\0';
-        } else {
-            is_background = 0;
-        }
-
-        if (strchr(temp_input, '|')) {
-            // NOTE: Expansion for pipes would require more complex logic.
-            // For now, we skip expansion for pipes.
-            handle_pipe(temp_input);
-        } else {
-            args = parse_input(temp_input);
-            if (args != NULL) {
-                char* data_block_ptr = (args[0] != NULL) ? args[0] : NULL; // For freeing later
-
-                if (args[0] != NULL) {
-                    args = expand_variables(args); // Re-assign args
-                    if (!handle_builtin_command(args)) {
-                        execute_command(args, is_background);
-                    }
-                }
-                
-                // Free the memory allocated by either parse_input or expand_variables
-                free(args[0]); // Free the data block
-                free(args);    // Free the pointer array
-            }
-        }
+        // The parser finds pipes, lists and '&' itself, quotes included
+        run_line(line_to_process);
 
         free(line_to_process);
     }
 
-    save_history();
-    printf("Exiting shell.\n");
-    return 0;
+    if (shell_is_interactive) {
+        printf("Exiting shell.\n");
+    } else {
+        line_reader_close(&stdin_reader);
+    }
+    return last_exit_status;
 }
@@ -1,103 +1,66 @@
 #include "signals.h"
-#include "jobs.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <signal.h>
 #include <unistd.h>
-#include <sys/wait.h>
 #include <string.h>
+#include <sys/signalfd.h>
+#include "redirect.h" // For move_shell_fd
 
-// Handler for SIGINT (Ctrl+C)
-void sigint_handler(int signo) {
-    if (current_foreground_job != -1) {
-        Job* job = get_job_by_job_id(current_foreground_job);
-        if (job) {
-            fprintf(stderr, "\nSending SIGINT to foreground job [%d] %s\n", job->job_id, job->command);
-            if (kill(-job->pgid, SIGINT) < 0) {
-                perror("kill (SIGINT)");
-            }
-        }
-    } else {
-        // If no foreground job, let the default behavior (terminate shell) happen
-        // or you can choose to ignore, but usually Ctrl+C should terminate shell if no foreground job.
-        // For now, let's re-raise it for the shell to handle.
-        // This part might need refinement based on desired shell behavior.
-        signal(SIGINT, SIG_DFL);
-        kill(getpid(), SIGINT);
+static int signal_fd = -1;
+
+void setup_signal_handlers() {
+    // Nothing is handled asynchronously: these signals stay blocked and are
+    // read from a signalfd by the event loop, so the job table is only ever
+    // touched from normal control flow. Children get an empty mask back.
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGCHLD);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGWINCH);
+    if (sigprocmask(SIG_BLOCK, &set, NULL) < 0) {
+        perror("sigprocmask");
     }
-}
 
-// Handler for SIGTSTP (Ctrl+Z)
-void sigtstp_handler(int signo) {
-    if (current_foreground_job != -1) {
-        Job* job = get_job_by_job_id(current_foreground_job);
-        if (job) {
-            fprintf(stderr, "\nSending SIGTSTP to foreground job [%d] %s\n", job->job_id, job->command);
-            if (kill(-job->pgid, SIGTSTP) < 0) {
-                perror("kill (SIGTSTP)");
-            }
-        }
-    } else {
-        // If no foreground job, ignore or re-raise for shell
-        // For now, let's just ignore it for the shell itself when no job is in foreground.
+    // Ignored signals are discarded instead of queued, so SIGINT needs its
+    // default disposition back (it is blocked, so it never takes effect)
+    signal(SIGINT, SIG_DFL);
+
+    signal_fd = move_shell_fd(signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC));
+    if (signal_fd < 0) {
+        perror("signalfd");
     }
 }
 
-// Handler for SIGCHLD (Child process status changed)
-void sigchld_handler(int signo) {
-    pid_t pid;
-    int status;
+int get_signal_fd() {
+    return signal_fd;
+}
 
-    // Use WNOHANG to prevent blocking, as this is a signal handler
-    while ((pid = waitpid(-1, &status, WNOHANG | WUNTRACED | WCONTINUED)) > 0) {
-        Job* job = get_job_by_pid(pid);
-        if (!job) {
-            // Might be a process not managed by our job control (e.g. from a script or another shell)
-            continue;
-        }
+unsigned int read_pending_signals() {
+    unsigned int pending = 0;
+    struct signalfd_siginfo info[8];
+    ssize_t len;
 
-        if (WIFEXITED(status)) {
-            update_job_status(pid, COMPLETED);
-            // printf("[%d] Done %s\n", job->job_id, job->command); // Output might interfere with current process
-        } else if (WIFSIGNALED(status)) {
-            update_job_status(pid, TERMINATED);
-            // printf("[%d] Terminated %s\n", job->job_id, job->command);
-        } else if (WIFSTOPPED(status)) {
-            update_job_status(pid, STOPPED);
-            // printf("[%d] Stopped %s\n", job->job_id, job->command);
-        } else if (WIFCONTINUED(status)) {
-            update_job_status(pid, RUNNING);
+    if (signal_fd < 0) {
+        return 0;
+    }
+    while ((len = read(signal_fd, info, sizeof(info))) > 0) {
+        for (size_t i = 0; i < (size_t)len / sizeof(info[0]); i++) {
+            pending |= SIGNAL_BIT(info[i].ssi_signo);
         }
     }
+    return pending;
 }
 
-void setup_signal_handlers() {
-    // Setup SIGCHLD handler for cleaning up background processes
-    struct sigaction sa_chld;
-    memset(&sa_chld, 0, sizeof(sa_chld));
-    sa_chld.sa_handler = sigchld_handler;
-    sa_chld.sa_flags = SA_RESTART | SA_NOCLDSTOP; // SA_NOCLDSTOP prevents SIGCHLD for stopped children, we need it
-    if (sigaction(SIGCHLD, &sa_chld, 0) == -1) {
-        perror("sigaction SIGCHLD");
-    }
-
-    // These are for the shell to pass to foreground jobs
-    // For the shell itself, they are ignored in init_job_control
-    struct sigaction sa_int;
-    memset(&sa_int, 0, sizeof(sa_int));
-    sa_int.sa_handler = sigint_handler;
-    sigemptyset(&sa_int.sa_mask);
-    sa_int.sa_flags = SA_RESTART;
-    if (sigaction(SIGINT, &sa_int, NULL) == -1) {
-        perror("sigaction SIGINT");
-    }
-
-    struct sigaction sa_tstp;
-    memset(&sa_tstp, 0, sizeof(sa_tstp));
-    sa_tstp.sa_handler = sigtstp_handler;
-    sigemptyset(&sa_tstp.sa_mask);
-    sa_tstp.sa_flags = SA_RESTART;
-    if (sigaction(SIGTSTP, &sa_tstp, NULL) == -1) {
-        perror("sigaction SIGTSTP");
+int take_pending_interrupt() {
+    // sigpending() looks without consuming; a signalfd read would take SIGCHLD and SIGWINCH too
+    sigset_t pending;
+    if (signal_fd < 0 || sigpending(&pending) < 0 || !sigismember(&pending, SIGINT)) {
+        return 0;
     }
+    sigset_t interrupt;
+    sigemptyset(&interrupt);
+    sigaddset(&interrupt, SIGINT);
+    struct timespec no_wait = { 0, 0 };
+    return sigtimedwait(&interrupt, NULL, &no_wait) == SIGINT;
 }
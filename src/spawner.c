@@ -0,0 +1,334 @@
+#define _GNU_SOURCE
+#include "spawner.h"
+#include "cmdhash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <spawn.h>
+#include <errno.h>
+
+extern char** environ;
+
+// Used to run executable scripts that lack a shebang
+#define SELF_EXE "/proc/self/exe"
+
+// glibc 2.35 can hand the terminal to the child between setpgid and exec
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 35)
+#define HAVE_SPAWN_TCSETPGRP 1
+#endif
+
+// Signals the shell ignores or handles itself; children get the defaults back
+static const int job_signals[] = { SIGINT, SIGQUIT, SIGTSTP, SIGTTIN, SIGTTOU, SIGCHLD };
+
+static int spawn_engine = -1;
+
+void set_spawn_engine(enum SpawnEngine engine) {
+    spawn_engine = engine;
+}
+
+static enum SpawnEngine current_engine() {
+    if (spawn_engine < 0) {
+        const char* env = getenv("MYSHELL_SPAWN");
+        spawn_engine = (env && strcmp(env, "fork") == 0) ? SPAWN_ENGINE_FORK : SPAWN_ENGINE_POSIX;
+    }
+    return spawn_engine;
+}
+
+// Builds a new argv with our shell prepended, so it can interpret the script at path.
+// Only the pointer array is allocated; the strings are shared with argv.
+static char** script_argv(const char* path, char** argv) {
+    int arg_count = 0;
+    while (argv[arg_count] != NULL) {
+        arg_count++;
+    }
+
+    char** new_args = malloc((arg_count + 2) * sizeof(char*));
+    if (!new_args) {
+        perror("malloc");
+        return NULL;
+    }
+    new_args[0] = SELF_EXE;
+    new_args[1] = (char*)path;
+    for (int i = 1; i < arg_count; i++) {
+        new_args[i+1] = argv[i];
+    }
+    new_args[arg_count + 1] = NULL;
+    return new_args;
+}
+
+// Errors that describe the command itself rather than the spawn machinery
+static int is_exec_error(int err) {
+    switch (err) {
+        case ENOENT:
+        case EACCES:
+        case EPERM:
+        case ENOTDIR:
+        case EISDIR:
+        case ELOOP:
+        case ENAMETOOLONG:
+        case E2BIG:
+        case ETXTBSY:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static int posix_spawn_command(const SpawnRequest* req, const char* path, char** argv, pid_t* pid) {
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_t actions;
+    sigset_t sigs;
+
+    posix_spawnattr_init(&attr);
+    posix_spawn_file_actions_init(&actions);
+
+    sigemptyset(&sigs);
+    for (size_t i = 0; i < sizeof(job_signals) / sizeof(job_signals[0]); i++) {
+        sigaddset(&sigs, job_signals[i]);
+    }
+    posix_spawnattr_setsigdefault(&attr, &sigs);
+    sigemptyset(&sigs);
+    posix_spawnattr_setsigmask(&attr, &sigs);
+    posix_spawnattr_setpgroup(&attr, req->pgid);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK);
+
+    // Pipe ends first, then the command's own redirections, as the fork path does
+    if (req->stdin_fd >= 0 && req->stdin_fd != STDIN_FILENO) {
+        posix_spawn_file_actions_adddup2(&actions, req->stdin_fd, STDIN_FILENO);
+        posix_spawn_file_actions_addclose(&actions, req->stdin_fd);
+    }
+    if (req->stdout_fd >= 0 && req->stdout_fd != STDOUT_FILENO) {
+        posix_spawn_file_actions_adddup2(&actions, req->stdout_fd, STDOUT_FILENO);
+        posix_spawn_file_actions_addclose(&actions, req->stdout_fd);
+    }
+    for (int i = 0; i < req->close_count; i++) {
+        posix_spawn_file_actions_addclose(&actions, req->close_fds[i]);
+    }
+    for (int i = 0; i < req->redir_count; i++) {
+        posix_spawn_file_actions_addopen(&actions, req->redirs[i].fd, req->redirs[i].path,
+                                         req->redirs[i].flags, 0644);
+    }
+#ifdef HAVE_SPAWN_TCSETPGRP
+    if (req->tty_fd >= 0) {
+        posix_spawn_file_actions_addtcsetpgrp_np(&actions, req->tty_fd);
+    }
+#endif
+
+    int err = posix_spawn(pid, path, &actions, &attr, argv, environ);
+
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    return err;
+}
+
+// Puts a freshly forked child in its process group and installs its descriptors.
+// Exits the child if a redirection fails.
+static void setup_child(const SpawnRequest* req) {
+    pid_t pgid = req->pgid ? req->pgid : getpid();
+    if (setpgid(0, pgid) < 0) {
+        perror("setpgid");
+        _exit(EXIT_FAILURE);
+    }
+
+    if (req->tty_fd >= 0) {
+        tcsetpgrp(req->tty_fd, pgid);
+    }
+
+    for (size_t i = 0; i < sizeof(job_signals) / sizeof(job_signals[0]); i++) {
+        signal(job_signals[i], SIG_DFL);
+    }
+    sigset_t empty;
+    sigemptyset(&empty);
+    sigprocmask(SIG_SETMASK, &empty, NULL);
+
+    if (req->stdin_fd >= 0 && req->stdin_fd != STDIN_FILENO) {
+        dup2(req->stdin_fd, STDIN_FILENO);
+        close(req->stdin_fd);
+    }
+    if (req->stdout_fd >= 0 && req->stdout_fd != STDOUT_FILENO) {
+        dup2(req->stdout_fd, STDOUT_FILENO);
+        close(req->stdout_fd);
+    }
+    for (int i = 0; i < req->close_count; i++) {
+        close(req->close_fds[i]);
+    }
+    if (apply_redirections(req->redirs, req->redir_count) < 0) {
+        _exit(EXIT_FAILURE);
+    }
+}
+
+static pid_t fork_command(const SpawnRequest* req, const char* path) {
+    pid_t pid = fork();
+
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+
+    if (pid == 0) {
+        // Child process
+        setup_child(req);
+
+        execv(path, req->argv);
+
+        // If execv fails, check if it's an executable script without a shebang
+        if (errno == ENOEXEC) {
+            char** new_args = script_argv(path, req->argv);
+            if (new_args) {
+                execv(new_args[0], new_args);
+            }
+            // If this also fails, print the error for the original command
+            errno = ENOEXEC;
+        }
+
+        perror(req->argv[0]);
+        _exit(EXIT_FAILURE);
+    }
+
+    // Parent process: set the group too, so we never race the child's setpgid
+    setpgid(pid, req->pgid ? req->pgid : pid);
+    return pid;
+}
+
+pid_t spawn_subshell(const SpawnRequest* req, int (*fn)(void* ctx), void* ctx) {
+    // Anything still buffered would otherwise be written by both processes
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t pid = fork();
+
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+
+    if (pid == 0) {
+        setup_child(req);
+        int status = fn(ctx);
+        fflush(stdout);
+        _exit(status);
+    }
+
+    setpgid(pid, req->pgid ? req->pgid : pid);
+    return pid;
+}
+
+// Resolves argv[0] through the command hash, so $PATH is only walked on a miss
+static const char* resolve_command(const char* name) {
+    if (strchr(name, '/')) {
+        return name;
+    }
+    const char* path = cmdhash_lookup(name);
+    if (!path) {
+        fprintf(stderr, "%s: command not found\n", name);
+    }
+    return path;
+}
+
+pid_t spawn_command(const SpawnRequest* req) {
+    if (req->argv == NULL || req->argv[0] == NULL) {
+        return -1;
+    }
+
+    // What the shell printed comes first, ahead of "command not found" too
+    fflush(stdout);
+    const char* path = resolve_command(req->argv[0]);
+    if (!path) {
+        return -1;
+    }
+
+    int use_posix = current_engine() == SPAWN_ENGINE_POSIX;
+#ifndef HAVE_SPAWN_TCSETPGRP
+    // Without the tcsetpgrp action the child could read the terminal before we hand it over
+    if (req->tty_fd >= 0) {
+        use_posix = 0;
+    }
+#endif
+
+    if (use_posix) {
+        pid_t pid;
+        int err = posix_spawn_command(req, path, req->argv, &pid);
+
+        // The hashed file may have been removed since we last checked its directory
+        if (err == ENOENT && path != req->argv[0] && access(path, X_OK) != 0) {
+            cmdhash_forget(req->argv[0]);
+            path = resolve_command(req->argv[0]);
+            if (!path) {
+                return -1;
+            }
+            err = posix_spawn_command(req, path, req->argv, &pid);
+        }
+
+        if (err == ENOEXEC) {
+            char** new_args = script_argv(path, req->argv);
+            if (new_args) {
+                err = posix_spawn_command(req, new_args[0], new_args, &pid);
+                free(new_args);
+            }
+        }
+        if (err == 0) {
+            return pid;
+        }
+
+        // A plain exec failure is reported right here. Anything else, including a
+        // failed redirection, goes through fork so the child reports the exact step.
+        if (is_exec_error(err) && req->redir_count == 0) {
+            fprintf(stderr, "%s: %s\n", req->argv[0], strerror(err));
+            return -1;
+        }
+    }
+
+    // The path is copied, since a table update could free it while the child still needs it
+    char* path_copy = strdup(path);
+    pid_t pid = fork_command(req, path_copy);
+    free(path_copy);
+    return pid;
+}
+
+int exec_command(const SpawnRequest* req) {
+    if (req->argv == NULL || req->argv[0] == NULL) {
+        return 0;
+    }
+    // Whatever the shell printed goes out before anything else: a "command not
+    // found" from the lookup, the command's own output, or nothing if the buffers vanish
+    fflush(stdout);
+    fflush(stderr);
+    const char* path = resolve_command(req->argv[0]);
+    if (!path) {
+        return 127;
+    }
+
+    for (size_t i = 0; i < sizeof(job_signals) / sizeof(job_signals[0]); i++) {
+        signal(job_signals[i], SIG_DFL);
+    }
+    sigset_t empty;
+    sigemptyset(&empty);
+    sigprocmask(SIG_SETMASK, &empty, NULL);
+
+    if (req->stdin_fd >= 0 && req->stdin_fd != STDIN_FILENO) {
+        dup2(req->stdin_fd, STDIN_FILENO);
+        close(req->stdin_fd);
+    }
+    if (req->stdout_fd >= 0 && req->stdout_fd != STDOUT_FILENO) {
+        dup2(req->stdout_fd, STDOUT_FILENO);
+        close(req->stdout_fd);
+    }
+    if (apply_redirections(req->redirs, req->redir_count) < 0) {
+        return 1;
+    }
+
+    execv(path, req->argv);
+    if (errno == ENOEXEC) {
+        char** new_args = script_argv(path, req->argv);
+        if (new_args) {
+            execv(new_args[0], new_args);
+            free(new_args);
+        }
+        errno = ENOEXEC;
+    }
+    int err = errno;
+    perror(req->argv[0]);
+    return err == ENOENT ? 127 : 126;
+}
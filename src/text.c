@@ -0,0 +1,83 @@
+#include "text.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+void buffer_reserve(Buffer* b, size_t extra) {
+    if (b->len + extra + 1 <= b->cap) {
+        return;
+    }
+    size_t cap = b->cap ? b->cap : 64;
+    while (cap < b->len + extra + 1) {
+        cap *= 2;
+    }
+    b->data = realloc(b->data, cap);
+    if (!b->data) {
+        perror("realloc");
+        exit(EXIT_FAILURE);
+    }
+    b->cap = cap;
+}
+
+void buffer_append(Buffer* b, const char* s, size_t len) {
+    buffer_reserve(b, len);
+    memcpy(b->data + b->len, s, len);
+    b->len += len;
+    b->data[b->len] = '\0';
+}
+
+void buffer_putc(Buffer* b, char c) {
+    if (b->len + 2 > b->cap) {
+        buffer_reserve(b, 1);
+    }
+    b->data[b->len++] = c;
+    b->data[b->len] = '\0';
+}
+
+void buffer_reset(Buffer* b) {
+    buffer_reserve(b, 0);
+    b->len = 0;
+    b->data[0] = '\0';
+}
+
+char* join_args(char** argv) {
+    size_t len = 1;
+    for (int i = 0; argv[i] != NULL; i++) {
+        len += strlen(argv[i]) + 1;
+    }
+
+    char* text = malloc(len);
+    if (!text) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    char* end = text;
+    for (int i = 0; argv[i] != NULL; i++) {
+        if (i > 0) *end++ = ' ';
+        size_t word_len = strlen(argv[i]);
+        memcpy(end, argv[i], word_len);
+        end += word_len;
+    }
+    *end = '\0';
+    return text;
+}
+
+size_t hash_bytes(const char* data, size_t len) {
+    uint64_t h = FNV_OFFSET_BASIS;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)data[i]) * FNV_PRIME;
+    }
+    return (size_t)h;
+}
+
+size_t hash_string(const char* s) {
+    uint64_t h = FNV_OFFSET_BASIS;
+    for (; *s; s++) {
+        h = (h ^ (unsigned char)*s) * FNV_PRIME;
+    }
+    return (size_t)h;
+}
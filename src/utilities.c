@@ -0,0 +1,693 @@
+#define _GNU_SOURCE
+#include "utilities.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "alias.h"
+#include "builtins.h"
+#include "cmdhash.h"
+#include "functions.h"
+#include "jobs.h"
+#include "signals.h"
+#include "text.h"
+#include "variables.h"
+
+#define STATUS_TEST_ERROR 2
+#define STATUS_INTERRUPTED 130
+#define READ_CHUNK 4096
+
+// --- echo and printf ---
+
+// How an octal escape is written: \0nnn in echo, \nnn in a printf format, either in %b
+enum OctalEscape { OCTAL_ZERO, OCTAL_PLAIN, OCTAL_EITHER };
+
+// Decodes the escape after a backslash at p into out. Returns the rest of the
+// string, or NULL for \c, after which nothing more is printed.
+static const char* decode_escape(const char* p, enum OctalEscape octal, Buffer* out) {
+    static const char plain[] = "a\ab\be\033f\fn\nr\rt\tv\v\\\\";
+    for (const char* e = plain; *e; e += 2) {
+        if (*p == e[0]) {
+            buffer_putc(out, e[1]);
+            return p + 1;
+        }
+    }
+    if (*p == 'c') {
+        return NULL;
+    }
+    if (*p == 'x' && isxdigit((unsigned char)p[1])) {
+        int value = 0;
+        p++;
+        for (int n = 0; n < 2 && isxdigit((unsigned char)*p); n++, p++) {
+            value = value * 16 + (isdigit((unsigned char)*p) ? *p - '0' : tolower((unsigned char)*p) - 'a' + 10);
+        }
+        buffer_putc(out, value);
+        return p;
+    }
+    if ((*p == '0' && octal != OCTAL_PLAIN) || (*p >= '0' && *p <= '7' && octal != OCTAL_ZERO)) {
+        if (*p == '0' && octal != OCTAL_PLAIN) p++;
+        int value = 0;
+        for (int n = 0; n < 3 && *p >= '0' && *p <= '7'; n++, p++) {
+            value = value * 8 + (*p - '0');
+        }
+        buffer_putc(out, value);
+        return p;
+    }
+    // Not an escape: the backslash stays
+    buffer_putc(out, '\\');
+    if (*p != '\0') {
+        buffer_putc(out, *p++);
+    }
+    return p;
+}
+
+// Appends s to out with its escapes decoded; returns 0 if \c ended it
+static int decode_escapes(const char* s, enum OctalEscape octal, Buffer* out) {
+    while (*s) {
+        if (*s != '\\') {
+            buffer_putc(out, *s++);
+        } else if ((s = decode_escape(s + 1, octal, out)) == NULL) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int builtin_echo(char** args) {
+    int newline = 1, escapes = 0;
+    int i = 1;
+    // Options only while every letter is one, as in bash: `echo -nx` prints "-nx"
+    for (; args[i] != NULL && args[i][0] == '-' && args[i][1] != '\0'; i++) {
+        if (strspn(args[i] + 1, "neE") != strlen(args[i] + 1)) {
+            break;
+        }
+        for (const char* o = args[i] + 1; *o; o++) {
+            if (*o == 'n') newline = 0;
+            else escapes = *o == 'e';
+        }
+    }
+
+    Buffer out = { 0 };
+    int more = 1;
+    for (int first = i; args[i] != NULL && more; i++) {
+        if (i > first) {
+            buffer_putc(&out, ' ');
+        }
+        if (escapes) {
+            more = decode_escapes(args[i], OCTAL_ZERO, &out);
+        } else {
+            for (const char* p = args[i]; *p; p++) buffer_putc(&out, *p);
+        }
+    }
+    if (newline && more) {
+        buffer_putc(&out, '\n');
+    }
+    // One fwrite for the whole line; the flush after the built-in returns makes it one write()
+    int status = out.len == 0 || fwrite(out.data, 1, out.len, stdout) == out.len ? 0 : 1;
+    free(out.data);
+    return status;
+}
+
+typedef struct {
+    char** args;        // Arguments not yet consumed by a conversion
+    int status;
+} PrintfState;
+
+static const char* next_argument(PrintfState* st) {
+    return *st->args ? *st->args++ : NULL;
+}
+
+// An integer argument; 'c or "c gives the character's code, as in POSIX printf
+static long long integer_argument(PrintfState* st) {
+    const char* arg = next_argument(st);
+    if (arg == NULL) {
+        return 0;
+    }
+    if (arg[0] == '\'' || arg[0] == '"') {
+        return (unsigned char)arg[1];
+    }
+    char* end;
+    errno = 0;
+    long long value = arg[0] == '-' ? strtoll(arg, &end, 0) : (long long)strtoull(arg, &end, 0);
+    if (end == arg || *end != '\0' || errno == ERANGE) {
+        fprintf(stderr, "printf: %s: invalid number\n", arg);
+        st->status = 1;
+    }
+    return value;
+}
+
+static double float_argument(PrintfState* st) {
+    const char* arg = next_argument(st);
+    if (arg == NULL) {
+        return 0;
+    }
+    if (arg[0] == '\'' || arg[0] == '"') {
+        return (unsigned char)arg[1];
+    }
+    char* end;
+    double value = strtod(arg, &end);
+    if (end == arg || *end != '\0') {
+        fprintf(stderr, "printf: %s: invalid number\n", arg);
+        st->status = 1;
+    }
+    return value;
+}
+
+// Prints the format once, taking arguments as conversions need them.
+// Returns 0 if \c (in the format or a %b argument) ended all output.
+static int print_format(const char* format, PrintfState* st) {
+    Buffer text = { 0 };
+    const char* p = format;
+    int more = 1;
+    while (*p && more) {
+        if (*p == '\\') {
+            more = (p = decode_escape(p + 1, OCTAL_PLAIN, &text)) != NULL;
+            continue;
+        }
+        if (*p != '%') {
+            buffer_putc(&text, *p++);
+            continue;
+        }
+        if (p[1] == '%') {
+            buffer_putc(&text, '%');
+            p += 2;
+            continue;
+        }
+
+        // A conversion: flags, width and precision are handed to printf(3) as they are
+        char spec[64];
+        size_t n = 0;
+        spec[n++] = *p++;
+        while (*p && strchr("-+ #0", *p) && n < 16) spec[n++] = *p++;
+        for (int part = 0; part < 2; part++) {
+            if (part == 1) {
+                if (*p != '.') break;
+                spec[n++] = *p++;
+            }
+            if (*p == '*') {
+                n += snprintf(spec + n, sizeof(spec) - n, "%d", (int)integer_argument(st));
+                p++;
+            } else {
+                while (isdigit((unsigned char)*p) && n < 40) spec[n++] = *p++;
+            }
+        }
+        char conversion = *p ? *p++ : '\0';
+        if (text.len > 0) {
+            fwrite(text.data, 1, text.len, stdout);
+            text.len = 0;
+        }
+
+        if (conversion != '\0' && strchr("diouxX", conversion)) {
+            spec[n++] = 'l';
+            spec[n++] = 'l';
+            spec[n++] = conversion;
+            spec[n] = '\0';
+            printf(spec, integer_argument(st));
+        } else if (conversion != '\0' && strchr("eEfFgGaA", conversion)) {
+            spec[n++] = conversion;
+            spec[n] = '\0';
+            printf(spec, float_argument(st));
+        } else if (conversion == 's' || conversion == 'b' || conversion == 'c') {
+            const char* arg = next_argument(st);
+            Buffer decoded = { 0 };
+            if (conversion == 'b' && arg != NULL) {
+                more = decode_escapes(arg, OCTAL_EITHER, &decoded);
+                arg = decoded.data;
+            }
+            char first[2] = { arg ? arg[0] : '\0', '\0' };
+            spec[n++] = 's';
+            spec[n] = '\0';
+            printf(spec, conversion == 'c' ? first : arg ? arg : "");
+            free(decoded.data);
+        } else {
+            fprintf(stderr, "printf: %%%c: invalid format character\n", conversion);
+            st->status = 1;
+            more = 0;
+        }
+    }
+    if (text.len > 0) {
+        fwrite(text.data, 1, text.len, stdout);
+    }
+    free(text.data);
+    return more;
+}
+
+int builtin_printf(char** args) {
+    int i = 1 + (args[1] != NULL && strcmp(args[1], "--") == 0);
+    if (args[i] == NULL) {
+        fprintf(stderr, "printf: usage: printf format [arguments]\n");
+        return 2;
+    }
+    PrintfState st = { args + i + 1, 0 };
+    // The format is reused until every argument has been consumed
+    for (;;) {
+        char** before = st.args;
+        if (!print_format(args[i], &st) || *st.args == NULL || st.args == before) {
+            break;
+        }
+    }
+    return st.status;
+}
+
+// --- test and [ ---
+
+typedef struct {
+    char** args;
+    int count;
+    int pos;
+    int error;          // A syntax error or bad integer, already reported
+    const char* name;   // "test" or "[", for messages
+} TestParser;
+
+// Reports a syntax error once, as "[: message" or "test: message"
+static void test_error(TestParser* t, const char* format, const char* arg) {
+    if (!t->error) {
+        fprintf(stderr, "%s: ", t->name);
+        fprintf(stderr, format, arg);
+        fputc('\n', stderr);
+    }
+    t->error = 1;
+}
+
+static int is_binary_operator(const char* op) {
+    static const char* ops[] = { "=", "==", "!=", "<", ">", "-eq", "-ne", "-lt", "-le", "-gt", "-ge",
+                                 "-nt", "-ot", "-ef", NULL };
+    for (int i = 0; ops[i]; i++) {
+        if (strcmp(op, ops[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+static int is_unary_operator(const char* op) {
+    return op[0] == '-' && op[1] != '\0' && op[2] == '\0' && strchr("bcdefghkLnprsStuwxzOG", op[1]) != NULL;
+}
+
+static long long test_integer(TestParser* t, const char* text) {
+    char* end;
+    long long value = strtoll(text, &end, 10);
+    while (isspace((unsigned char)*end)) end++;
+    if (end == text || *end != '\0') {
+        test_error(t, "%s: integer expression expected", text);
+    }
+    return value;
+}
+
+static int test_unary(const char* op, const char* arg) {
+    struct stat st;
+    switch (op[1]) {
+        case 'z': return arg[0] == '\0';
+        case 'n': return arg[0] != '\0';
+        case 't': return isatty(atoi(arg));
+        case 'h':
+        case 'L': return lstat(arg, &st) == 0 && S_ISLNK(st.st_mode);
+        case 'r': return access(arg, R_OK) == 0;
+        case 'w': return access(arg, W_OK) == 0;
+        case 'x': return access(arg, X_OK) == 0;
+    }
+    if (stat(arg, &st) < 0) {
+        return 0;
+    }
+    switch (op[1]) {
+        case 'e': return 1;
+        case 'f': return S_ISREG(st.st_mode);
+        case 'd': return S_ISDIR(st.st_mode);
+        case 'b': return S_ISBLK(st.st_mode);
+        case 'c': return S_ISCHR(st.st_mode);
+        case 'p': return S_ISFIFO(st.st_mode);
+        case 'S': return S_ISSOCK(st.st_mode);
+        case 's': return st.st_size > 0;
+        case 'u': return (st.st_mode & S_ISUID) != 0;
+        case 'g': return (st.st_mode & S_ISGID) != 0;
+        case 'k': return (st.st_mode & S_ISVTX) != 0;
+        case 'O': return st.st_uid == geteuid();
+        case 'G': return st.st_gid == getegid();
+    }
+    return 0;
+}
+
+// Whether a was modified after b; a file that does not exist is older than any that does
+static int newer_than(const char* a, const char* b) {
+    struct stat sa, sb;
+    if (stat(a, &sa) < 0) return 0;
+    if (stat(b, &sb) < 0) return 1;
+    return sa.st_mtim.tv_sec > sb.st_mtim.tv_sec ||
+           (sa.st_mtim.tv_sec == sb.st_mtim.tv_sec && sa.st_mtim.tv_nsec > sb.st_mtim.tv_nsec);
+}
+
+static int test_binary(TestParser* t, const char* a, const char* op, const char* b) {
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0) return strcmp(a, b) == 0;
+    if (strcmp(op, "!=") == 0) return strcmp(a, b) != 0;
+    if (strcmp(op, "<") == 0) return strcmp(a, b) < 0;
+    if (strcmp(op, ">") == 0) return strcmp(a, b) > 0;
+    if (strcmp(op, "-nt") == 0) return newer_than(a, b);
+    if (strcmp(op, "-ot") == 0) return newer_than(b, a);
+    if (strcmp(op, "-ef") == 0) {
+        struct stat sa, sb;
+        return stat(a, &sa) == 0 && stat(b, &sb) == 0 && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+    }
+    long long x = test_integer(t, a), y = test_integer(t, b);
+    if (strcmp(op, "-eq") == 0) return x == y;
+    if (strcmp(op, "-ne") == 0) return x != y;
+    if (strcmp(op, "-lt") == 0) return x < y;
+    if (strcmp(op, "-le") == 0) return x <= y;
+    if (strcmp(op, "-gt") == 0) return x > y;
+    return x >= y;
+}
+
+static int test_or(TestParser* t);
+
+static const char* test_next(TestParser* t) {
+    if (t->pos >= t->count) {
+        test_error(t, "argument expected", NULL);
+        return "";
+    }
+    return t->args[t->pos++];
+}
+
+static int test_primary(TestParser* t) {
+    const char* word = test_next(t);
+    if (strcmp(word, "(") == 0 && t->pos < t->count) {
+        int value = test_or(t);
+        if (t->pos >= t->count) {
+            test_error(t, "`)' expected", NULL);
+        } else if (strcmp(t->args[t->pos], ")") != 0) {
+            test_error(t, "`)' expected, found %s", t->args[t->pos]);
+        }
+        t->pos++;
+        return value;
+    }
+    // A binary operator comes first, so `test -f = -f` compares two strings
+    if (t->pos + 1 < t->count && is_binary_operator(t->args[t->pos])) {
+        const char* op = t->args[t->pos++];
+        return test_binary(t, word, op, t->args[t->pos++]);
+    }
+    if (is_unary_operator(word) && t->pos < t->count) {
+        return test_unary(word, t->args[t->pos++]);
+    }
+    return word[0] != '\0';
+}
+
+static int test_not(TestParser* t) {
+    if (t->pos < t->count && strcmp(t->args[t->pos], "!") == 0) {
+        t->pos++;
+        return !test_not(t);
+    }
+    return test_primary(t);
+}
+
+static int test_and(TestParser* t) {
+    int value = test_not(t);
+    while (t->pos < t->count && strcmp(t->args[t->pos], "-a") == 0) {
+        t->pos++;
+        value = test_not(t) && value;
+    }
+    return value;
+}
+
+static int test_or(TestParser* t) {
+    int value = test_and(t);
+    while (t->pos < t->count && strcmp(t->args[t->pos], "-o") == 0) {
+        t->pos++;
+        value = test_and(t) || value;
+    }
+    return value;
+}
+
+// POSIX decides up to four arguments by their number; beyond that, the grammar
+// with ! ( ) -a -o decides, as in bash
+static int evaluate_test(TestParser* t) {
+    char** a = t->args;
+    switch (t->count) {
+        case 0:
+            return 0;
+        case 1:
+            return a[0][0] != '\0';
+        case 2:
+            if (strcmp(a[0], "!") == 0) return a[1][0] == '\0';
+            if (is_unary_operator(a[0])) return test_unary(a[0], a[1]);
+            test_error(t, "%s: unary operator expected", a[0]);
+            return 0;
+        case 3:
+            if (is_binary_operator(a[1])) return test_binary(t, a[0], a[1], a[2]);
+            if (strcmp(a[1], "-a") == 0) return a[0][0] != '\0' && a[2][0] != '\0';
+            if (strcmp(a[1], "-o") == 0) return a[0][0] != '\0' || a[2][0] != '\0';
+            if (strcmp(a[0], "!") == 0) {
+                TestParser rest = { a + 1, 2, 0, 0, t->name };
+                int value = !evaluate_test(&rest);
+                t->error = rest.error;
+                return value;
+            }
+            if (strcmp(a[0], "(") == 0 && strcmp(a[2], ")") == 0) return a[1][0] != '\0';
+            test_error(t, "%s: binary operator expected", a[1]);
+            return 0;
+        case 4:
+            if (strcmp(a[0], "!") == 0 || (strcmp(a[0], "(") == 0 && strcmp(a[3], ")") == 0)) {
+                int negate = a[0][0] == '!';
+                TestParser rest = { a + 1, negate ? 3 : 2, 0, 0, t->name };
+                int value = evaluate_test(&rest);
+                t->error = rest.error;
+                return negate ? !value : value;
+            }
+            break;
+    }
+    int value = test_or(t);
+    if (t->pos < t->count) {
+        test_error(t, "too many arguments", NULL);
+    }
+    return value;
+}
+
+int builtin_test(char** args) {
+    int count = 0;
+    while (args[count + 1] != NULL) count++;
+    if (strcmp(args[0], "[") == 0) {
+        if (count == 0 || strcmp(args[count], "]") != 0) {
+            fprintf(stderr, "[: missing `]'\n");
+            return STATUS_TEST_ERROR;
+        }
+        count--;
+    }
+    TestParser t = { args + 1, count, 0, 0, args[0] };
+    int value = evaluate_test(&t);
+    return t.error ? STATUS_TEST_ERROR : !value;
+}
+
+int builtin_true(char** args) {
+    (void)args;
+    return 0;
+}
+
+int builtin_false(char** args) {
+    (void)args;
+    return 1;
+}
+
+// --- read ---
+
+// Waits for the terminal to have input, or for Ctrl+C: the shell takes its
+// signals from the signalfd, so a plain read() would never see it.
+// Returns 1 if Ctrl+C came first.
+static int wait_for_terminal() {
+    int signal_fd = get_signal_fd();
+    if (!shell_is_interactive || signal_fd < 0 || !isatty(STDIN_FILENO)) {
+        return 0;
+    }
+    for (;;) {
+        struct pollfd fds[2] = { { .fd = STDIN_FILENO, .events = POLLIN }, { .fd = signal_fd, .events = POLLIN } };
+        if (poll(fds, 2, -1) < 0 && errno != EINTR) {
+            return 0;
+        }
+        if (fds[1].revents & POLLIN) {
+            unsigned int pending = read_pending_signals();
+            reap_children();
+            if (pending & SIGNAL_BIT(SIGINT)) {
+                return 1;
+            }
+        }
+        if (fds[0].revents) {
+            return 0;
+        }
+    }
+}
+
+// Reads one line of stdin into line, without the newline, and never past it:
+// the rest belongs to whatever runs next. A regular file is read in chunks and
+// the offset moved back to just after the line; anything else a byte at a time.
+// Without raw, a backslash-newline continues the line and other escapes are
+// kept for split_fields(). Returns 0 at a newline, 1 at end of input, 130 on Ctrl+C.
+static int read_line(Buffer* line, int raw) {
+    struct stat st;
+    int seekable = fstat(STDIN_FILENO, &st) == 0 && S_ISREG(st.st_mode);
+    char chunk[READ_CHUNK];
+    int escaped = 0;
+    for (;;) {
+        if (wait_for_terminal()) {
+            return STATUS_INTERRUPTED;
+        }
+        ssize_t n = read(STDIN_FILENO, chunk, seekable ? sizeof(chunk) : 1);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return 1;
+        }
+        for (ssize_t i = 0; i < n; i++) {
+            char c = chunk[i];
+            if (escaped) {
+                escaped = 0;
+                if (c == '\n') {
+                    continue;
+                }
+                buffer_putc(line, '\\');
+                buffer_putc(line, c);
+            } else if (c == '\\' && !raw) {
+                escaped = 1;
+            } else if (c == '\n') {
+                if (seekable && i + 1 < n) {
+                    lseek(STDIN_FILENO, i + 1 - n, SEEK_CUR);
+                }
+                return 0;
+            } else {
+                buffer_putc(line, c);
+            }
+        }
+    }
+}
+
+// Splits line on $IFS into one field per name, the last taking the rest of
+// the line, and assigns them. Escaped characters never split and lose their backslash.
+static void split_fields(const char* line, char** names, int raw) {
+    const char* ifs = getenv("IFS");
+    if (ifs == NULL) {
+        ifs = " \t\n";
+    }
+    Buffer field = { 0 };
+    const char* p = line;
+    for (int i = 0; names[i] != NULL; i++) {
+        int last = names[i + 1] == NULL;
+        while (*p && strchr(ifs, *p) && isspace((unsigned char)*p)) p++;
+        buffer_reset(&field);
+        size_t keep = 0; // Length up to the last character that is not trailing IFS whitespace
+        while (*p) {
+            if (*p == '\\' && !raw && p[1] != '\0') {
+                buffer_putc(&field, p[1]);
+                p += 2;
+                keep = field.len;
+                continue;
+            }
+            if (strchr(ifs, *p)) {
+                if (!last) break;
+                buffer_putc(&field, *p++);
+                if (!isspace((unsigned char)field.data[field.len - 1])) keep = field.len;
+                continue;
+            }
+            buffer_putc(&field, *p++);
+            keep = field.len;
+        }
+        field.data[keep] = '\0';
+        set_variable(names[i], field.data);
+        // One delimiter ends a field: IFS whitespace around it, and at most one other IFS character
+        while (*p && strchr(ifs, *p) && isspace((unsigned char)*p)) p++;
+        if (*p && strchr(ifs, *p)) p++;
+    }
+    free(field.data);
+}
+
+int builtin_read(char** args) {
+    int raw = 0;
+    const char* prompt = NULL;
+    int i = 1;
+    for (; args[i] != NULL && args[i][0] == '-' && args[i][1] != '\0'; i++) {
+        if (strcmp(args[i], "--") == 0) {
+            i++;
+            break;
+        }
+        for (const char* o = args[i] + 1; *o; o++) {
+            if (*o == 'r') {
+                raw = 1;
+            } else if (*o == 'p' && args[i + 1] != NULL) {
+                prompt = args[++i];
+                break;
+            } else {
+                fprintf(stderr, "read: -%c: invalid option\n", *o);
+                return 2;
+            }
+        }
+    }
+
+    if (prompt != NULL && isatty(STDIN_FILENO)) {
+        fputs(prompt, stderr);
+    }
+    fflush(stdout);
+    Buffer line = { 0 };
+    buffer_reset(&line);
+    int status = read_line(&line, raw);
+    if (status == STATUS_INTERRUPTED) {
+        fputc('\n', stderr);
+    } else if (args[i] == NULL) {
+        // Without names the line goes to REPLY as it is, not split or trimmed
+        char* out = line.data;
+        for (const char* p = line.data; *p; p++) {
+            if (*p == '\\' && !raw && p[1] != '\0') p++;
+            *out++ = *p;
+        }
+        *out = '\0';
+        set_variable("REPLY", line.data);
+    } else {
+        split_fields(line.data, args + i, raw);
+    }
+    free(line.data);
+    return status;
+}
+
+// --- type ---
+
+static const char* shell_keywords[] = { "if", "then", "elif", "else", "fi", "case", "esac", "for", "while",
+                                        "until", "do", "done", "in", "{", "}", "!", NULL };
+
+int builtin_type(char** args) {
+    int i = 1;
+    int terse = args[1] != NULL && strcmp(args[1], "-t") == 0;
+    i += terse;
+    int status = 0;
+    for (; args[i] != NULL; i++) {
+        const char* name = args[i];
+        const char* value = lookup_alias(name);
+        char* argv[] = { args[i], NULL };
+        const char* path = NULL;
+        const char* kind = NULL;
+        for (int k = 0; shell_keywords[k] && value == NULL; k++) {
+            if (strcmp(shell_keywords[k], name) == 0) kind = "keyword";
+        }
+        if (value != NULL) {
+            kind = "alias";
+        } else if (kind != NULL) {
+            // A keyword
+        } else if (find_function(name) != NULL) {
+            kind = "function";
+        } else if (find_builtin(argv, 0) != NULL) {
+            kind = "builtin";
+        } else if ((path = strchr(name, '/') ? (access(name, X_OK) == 0 ? name : NULL) : cmdhash_lookup(name))) {
+            kind = "file";
+        }
+
+        if (kind == NULL) {
+            if (!terse) fprintf(stderr, "type: %s: not found\n", name);
+            status = 1;
+        } else if (terse) {
+            printf("%s\n", kind);
+        } else if (value != NULL) {
+            printf("%s is aliased to `%s'\n", name, value);
+        } else if (path != NULL) {
+            printf("%s is %s\n", name, path);
+        } else {
+            printf("%s is a %s%s\n", name, kind[0] == 'f' ? "" : "shell ", kind);
+        }
+    }
+    return status;
+}
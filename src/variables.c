@@ -0,0 +1,82 @@
+#include "variables.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "text.h"
+
+#define VARIABLE_BUCKETS 256
+
+// An environment string installed with putenv(), which the shell must free
+typedef struct Variable {
+    char* entry;            // "name=value"
+    size_t name_len;
+    struct Variable* next;  // Next in the same bucket
+} Variable;
+
+static Variable* variable_table[VARIABLE_BUCKETS];
+
+static unsigned int hash_name(const char* name, size_t len) {
+    return hash_bytes(name, len) % VARIABLE_BUCKETS;
+}
+
+static Variable** find_slot(const char* name, size_t len) {
+    Variable** link = &variable_table[hash_name(name, len)];
+    for (; *link != NULL; link = &(*link)->next) {
+        if ((*link)->name_len == len && memcmp((*link)->entry, name, len) == 0) {
+            break;
+        }
+    }
+    return link;
+}
+
+int set_variable(const char* name, const char* value) {
+    size_t name_len = strlen(name);
+    if (name_len == 0 || strchr(name, '=') != NULL) {
+        fprintf(stderr, "`%s': not a valid identifier\n", name);
+        return -1;
+    }
+
+    size_t value_len = strlen(value);
+    char* entry = malloc(name_len + value_len + 2);
+    if (!entry) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(entry, name, name_len);
+    entry[name_len] = '=';
+    memcpy(entry + name_len + 1, value, value_len + 1);
+    if (putenv(entry) != 0) {
+        perror("putenv");
+        free(entry);
+        return -1;
+    }
+
+    // The environment now points at the new string, so the old one can go
+    Variable** slot = find_slot(name, name_len);
+    if (*slot != NULL) {
+        free((*slot)->entry);
+        (*slot)->entry = entry;
+        return 0;
+    }
+    Variable* v = malloc(sizeof(Variable));
+    if (!v) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    v->entry = entry;
+    v->name_len = name_len;
+    v->next = NULL;
+    *slot = v;
+    return 0;
+}
+
+void unset_variable(const char* name) {
+    unsetenv(name);
+    Variable** slot = find_slot(name, strlen(name));
+    if (*slot != NULL) {
+        Variable* v = *slot;
+        *slot = v->next;
+        free(v->entry);
+        free(v);
+    }
+}